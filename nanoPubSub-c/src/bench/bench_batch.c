@@ -0,0 +1,232 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Benchmark of the batching publisher over loopback. Bursts of small
+ * messages are sent one per datagram and packed into batches of different
+ * sizes, and the receiver unpacks them again. Every message must arrive
+ * once and in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <message.h>
+#include <network.h>
+#include <batch.h>
+#include <util.h>
+
+
+#define NUM_MESSAGES 500000
+#define BURST_LENGTH 64
+#define RECV_BATCH   64
+#define LINGER_MS    5
+#define RECV_BUFFER  (4 * 1024 * 1024)
+
+
+/** The buffers the receiver receives into */
+static char recvBuffers[RECV_BATCH][NANOPUBSUB__MAX_MESSAGE_LENGTH];
+
+
+/**
+ * Returns the time of a monotonic clock in nanoseconds.
+ */
+static uint64_t now(void)
+{
+	return nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+}
+
+
+/**
+ * Creates a non-blocking socket bound to an ephemeral loopback port.
+ *
+ * @return The socket, or -1 on error
+ */
+static int openSocket(struct sockaddr_in *addr)
+{
+	socklen_t addrLength = sizeof(*addr);
+	int socketfd, size = RECV_BUFFER;
+
+	if ((socketfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1) {
+		return -1;
+	}
+
+	/* A burst must fit into the receive buffer even when it is sent one
+	   message per datagram */
+	setsockopt(socketfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family      = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(socketfd, (struct sockaddr*)addr, sizeof(*addr)) == -1
+			|| getsockname(socketfd, (struct sockaddr*)addr, &addrLength)
+				== -1) {
+		close(socketfd);
+		return -1;
+	}
+
+	return socketfd;
+}
+
+
+/**
+ * Receives everything that has arrived and checks the messages' order.
+ *
+ * @param next Pointer to the index of the next expected message
+ * @return The number of messages that arrived out of order
+ */
+static unsigned int drain(int socketfd, nanoPubSub__Network_recvRing *ring,
+		unsigned int *next)
+{
+	const nanoPubSub__Message_view *view;
+	unsigned int first, errors = 0;
+	int received, i;
+
+	while ((received = nanoPubSub__Network_recvBatch(socketfd, ring,
+			RECV_BATCH, 0, &first)) > 0) {
+		for (i = 0; i < received; i++) {
+			do {
+				view = &ring->views[first + i];
+
+				if (view->length == 0
+						|| strtoul(view->body.data, NULL, 10) != *next) {
+					errors++;
+				}
+
+				(*next)++;
+			} while (nanoPubSub__Network_unpackNext(ring, first + i));
+		}
+	}
+
+	return errors;
+}
+
+
+/**
+ * Sends NUM_MESSAGES messages in bursts and prints the results.
+ *
+ * @param maxBytes The byte threshold of the batches, or 0 to send every
+ *                 message in a datagram of its own
+ *
+ * @return 1 if every message arrived once and in order, 0 otherwise
+ */
+static int runBenchmark(size_t maxBytes)
+{
+	nanoPubSub__Batch_publisher pub;
+	nanoPubSub__Network_recvRing ring;
+	nanoPubSub__Message msg;
+	struct sockaddr_in senderAddr, receiverAddr;
+	char body[16], label[32];
+	unsigned int index, next = 0, errors = 0;
+	unsigned long datagrams = 0;
+	uint64_t start, elapsed;
+	int senderfd, receiverfd, ok;
+
+	senderfd   = openSocket(&senderAddr);
+	receiverfd = openSocket(&receiverAddr);
+
+	if (senderfd == -1 || receiverfd == -1
+			|| !nanoPubSub__Network_initRecvRing(&ring, (char*)recvBuffers,
+				NANOPUBSUB__MAX_MESSAGE_LENGTH, RECV_BATCH)) {
+		fprintf(stderr, "Could not set up the benchmark\n");
+		exit(1);
+	}
+
+	nanoPubSub__Batch_initPublisher(&pub, senderfd,
+		(const struct sockaddr*)&receiverAddr, LINGER_MS, maxBytes);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type     = NANOPUBSUB__STANDARD_MESSAGE;
+	msg.clientId = "bench";
+	msg.topic    = "site/7/temp";
+	msg.body     = body;
+
+	start = now();
+
+	for (index = 0; index < NUM_MESSAGES; index++) {
+		snprintf(body, sizeof(body), "%08u", index);
+
+		if (maxBytes == 0) {
+			nanoPubSub__Network_sendMessage(senderfd,
+				(const struct sockaddr*)&receiverAddr, &msg);
+			datagrams++;
+		} else {
+			nanoPubSub__Batch_addMessage(&pub, &msg, 0);
+		}
+
+		/* Batches that are not full yet wait for the next burst */
+		if ((index + 1) % BURST_LENGTH == 0) {
+			nanoPubSub__Batch_tick(&pub);
+			errors += drain(receiverfd, &ring, &next);
+		}
+	}
+
+	nanoPubSub__Batch_flush(&pub);
+	errors += drain(receiverfd, &ring, &next);
+
+	elapsed = now() - start;
+
+	if (maxBytes != 0) {
+		datagrams = pub.datagramsSent;
+	}
+
+	ok = next == NUM_MESSAGES && errors == 0;
+
+	if (maxBytes == 0) {
+		snprintf(label, sizeof(label), "unbatched");
+	} else {
+		snprintf(label, sizeof(label), "batch %u bytes",
+			(unsigned int)maxBytes);
+	}
+
+	printf("%-16s %9.0f msgs/s  %7lu datagrams  %5.1f msgs/datagram"
+	       "  received %u/%u%s\n",
+		label, NUM_MESSAGES / (elapsed / 1e9),
+		datagrams, (double)NUM_MESSAGES / datagrams, next, NUM_MESSAGES,
+		ok ? "" : "  FAILED");
+
+	nanoPubSub__Network_freeRecvRing(&ring);
+	close(senderfd);
+	close(receiverfd);
+
+	return ok;
+}
+
+
+int main(void)
+{
+	static const size_t thresholds[] = { 0, 256, 512, 1024 };
+	unsigned int i;
+	int ok = 1;
+
+	printf("batching publisher, %u messages in bursts of %u over loopback\n",
+		NUM_MESSAGES, BURST_LENGTH);
+
+	for (i = 0; i < sizeof(thresholds) / sizeof(thresholds[0]); i++) {
+		ok &= runBenchmark(thresholds[i]);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Microbenchmark of parsing and serializing messages of different body
+ * sizes, in the text and the binary format. If a file name is given, the
+ * results are appended to it as JSON lines, one object per measurement,
+ * so that runs can be compared with each other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <message.h>
+#include <arena.h>
+#include <util.h>
+
+
+#define NUM_ITERATIONS 1000000
+#define ARENA_SIZE     4096
+
+/** The body sizes measured, all of which fit into a single datagram */
+static const size_t bodySizes[] = { 16, 64, 256, 960 };
+
+#define NUM_BODY_SIZES (sizeof(bodySizes) / sizeof(bodySizes[0]))
+
+/** The file results are appended to, or NULL */
+static FILE *results;
+
+/** Keeps the compiler from optimizing the measured calls away */
+static volatile size_t sink;
+
+
+/**
+ * Returns the time of a monotonic clock in nanoseconds.
+ */
+static double now(void)
+{
+	return (double)nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+}
+
+
+/**
+ * Prints a measurement and appends it to the results file.
+ */
+static void report(const char *operation, const char *format,
+		size_t bodySize, size_t frameLength, double elapsed)
+{
+	double nsPerOp = elapsed / NUM_ITERATIONS;
+
+	printf("%-18s %-6s body %4u  %8.1f ns/op  %8.1f MB/s\n", operation,
+		format, (unsigned int)bodySize, nsPerOp,
+		frameLength / nsPerOp * 1e3);
+
+	if (results != NULL) {
+		fprintf(results, "{\"benchmark\":\"message\","
+			"\"operation\":\"%s\",\"format\":\"%s\",\"body\":%u,"
+			"\"ns_per_op\":%.2f,\"mb_per_s\":%.2f}\n", operation, format,
+			(unsigned int)bodySize, nsPerOp, frameLength / nsPerOp * 1e3);
+	}
+}
+
+
+/**
+ * Measures all operations for one body size.
+ *
+ * @return 1 if every operation succeeded, 0 otherwise
+ */
+static int runBenchmark(size_t bodySize)
+{
+	char text[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	char binary[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	char body[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	nanoPubSub__Message msg, sized, parsed;
+	nanoPubSub__Message_view view;
+	nanoPubSub__Arena arena;
+	size_t textLength, binaryLength;
+	double start;
+	unsigned int i;
+	int ok = 1;
+
+	memset(body, 'x', bodySize);
+	body[bodySize] = '\0';
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type     = NANOPUBSUB__STANDARD_MESSAGE;
+	msg.clientId = "bench";
+	msg.topic    = "site/7/dev/42/temp";
+	msg.body     = body;
+
+	textLength = nanoPubSub__Message_length(&msg);
+	nanoPubSub__Message_toView(&msg, &view);
+	binaryLength = nanoPubSub__Message_writeViewBinary(&view, binary,
+		sizeof(binary));
+
+	if (textLength == 0 || textLength >= sizeof(text) || binaryLength == 0
+			|| !nanoPubSub__Arena_init(&arena, ARENA_SIZE)) {
+		fprintf(stderr, "Could not set up the benchmark\n");
+		exit(1);
+	}
+
+	/* Serializing */
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		nanoPubSub__Message_writeString(&msg, text, sizeof(text));
+		sink += text[textLength - 1];
+	}
+	report("writeString", "text", bodySize, textLength, now() - start);
+
+	/* Messages whose body length is set only scan the client id and
+	   topic */
+	sized = msg;
+	sized.bodyLength = bodySize;
+
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		nanoPubSub__Message_writeString(&sized, text, sizeof(text));
+		sink += text[textLength - 1];
+	}
+	report("writeStringSized", "text", bodySize, textLength,
+		now() - start);
+
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		sink += nanoPubSub__Message_writeViewString(&view, buffer,
+			sizeof(buffer));
+	}
+	report("writeViewString", "text", bodySize, textLength, now() - start);
+
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		sink += nanoPubSub__Message_writeViewBinary(&view, buffer,
+			sizeof(buffer));
+	}
+	report("writeViewBinary", "binary", bodySize, binaryLength,
+		now() - start);
+
+	/* Parsing */
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		memset(&parsed, 0, sizeof(parsed));
+		ok &= nanoPubSub__Message_parseString(text, textLength, &parsed);
+		free(parsed.clientId);
+		free(parsed.topic);
+		free(parsed.body);
+	}
+	report("parseString", "text", bodySize, textLength, now() - start);
+
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		memset(&parsed, 0, sizeof(parsed));
+		ok &= nanoPubSub__Message_parseStringArena(text, textLength,
+			&parsed, &arena);
+		nanoPubSub__Arena_reset(&arena);
+	}
+	report("parseStringArena", "text", bodySize, textLength, now() - start);
+
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		ok &= nanoPubSub__Message_parseView(text, textLength, &view);
+	}
+	report("parseView", "text", bodySize, textLength, now() - start);
+
+	start = now();
+	for (i = 0; i < NUM_ITERATIONS; i++) {
+		ok &= nanoPubSub__Message_parseView(binary, binaryLength, &view);
+	}
+	report("parseView", "binary", bodySize, binaryLength, now() - start);
+
+	nanoPubSub__Arena_free(&arena);
+
+	return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int ok = 1;
+
+	if (argc > 1 && (results = fopen(argv[1], "a")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	printf("message parsing and serializing, %u iterations per operation\n",
+		NUM_ITERATIONS);
+
+	for (i = 0; i < NUM_BODY_SIZES; i++) {
+		ok &= runBenchmark(bodySizes[i]);
+	}
+
+	if (!ok) {
+		printf("FAILED\n");
+	}
+
+	if (results != NULL) {
+		fclose(results);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,530 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * End-to-end benchmark of the broker over loopback. A broker process is
+ * started for every number of subscribers, each of which listens on an
+ * address of its own (127.0.0.2, 127.0.0.3, ...) as the broker sends all
+ * subscribers published messages on the same port. The publisher measures
+ * the latency of single messages, from sending them to their arrival at
+ * every subscriber, and the throughput of bursts of messages. Every
+ * measurement is run with the broker's socket transport and with its
+ * io_uring transport.
+ *
+ * Usage: bench_pubsub <broker executable> [results file]
+ *
+ * If a results file is given, the results are appended to it as JSON
+ * lines, one object per transport and number of subscribers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <message.h>
+#include <network.h>
+#include <util.h>
+
+
+#define BROKER_PORT      21011
+#define CLIENT_PORT      21012
+#define MAX_SUBSCRIBERS  64
+#define BODY_SIZE        64
+#define NUM_LATENCY      5000
+#define NUM_DELIVERIES   1000000
+#define MIN_MESSAGES     10000
+#define BURST_LENGTH     32
+#define WAIT_MS          100
+#define STARTUP_MS       3000
+#define RECV_BUFFER      (4 * 1024 * 1024)
+#define TOPIC            "bench/fanout"
+
+/** The numbers of subscribers measured */
+static const unsigned int fanOuts[] = { 1, 4, 16, 64 };
+
+#define NUM_FAN_OUTS (sizeof(fanOuts) / sizeof(fanOuts[0]))
+
+/** The broker's transports, in the order of its --io-uring option */
+static const char *const transports[] = { "socket", "io_uring" };
+
+/** The file results are appended to, or NULL */
+static FILE *results;
+
+/** The sockets of the subscribers */
+static int subscribers[MAX_SUBSCRIBERS];
+
+/** The latencies of all deliveries of the latency run (in ns) */
+static uint64_t latencies[NUM_LATENCY * MAX_SUBSCRIBERS];
+
+
+/**
+ * Returns the time of a monotonic clock in nanoseconds.
+ */
+static uint64_t now(void)
+{
+	return nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+}
+
+
+/**
+ * Compares two latencies for qsort.
+ */
+static int compareLatencies(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Returns a percentile of sorted latencies in microseconds.
+ */
+static double percentile(const uint64_t *sorted, size_t count, double p)
+{
+	return count > 0 ? sorted[(size_t)(p * (count - 1))] / 1e3 : 0;
+}
+
+
+/**
+ * Creates a non-blocking socket bound to an address.
+ *
+ * @param ip The IPv4 address to bind to (host byte order)
+ * @param port The port to bind to, or 0 for an ephemeral port
+ *
+ * @return The socket, or -1 on error
+ */
+static int openSocket(uint32_t ip, unsigned short port)
+{
+	struct sockaddr_in addr;
+	int socketfd, size = RECV_BUFFER;
+
+	if ((socketfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1) {
+		return -1;
+	}
+
+	setsockopt(socketfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(ip);
+	addr.sin_port        = htons(port);
+
+	if (bind(socketfd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		close(socketfd);
+		return -1;
+	}
+
+	return socketfd;
+}
+
+
+/**
+ * Starts a broker process whose output is discarded.
+ *
+ * @return The process id, or -1 on error
+ */
+static pid_t startBroker(const char *executable, int ioUring)
+{
+	char port[8], clientPort[8];
+	pid_t pid;
+	int devNull;
+
+	snprintf(port, sizeof(port), "%u", BROKER_PORT);
+	snprintf(clientPort, sizeof(clientPort), "%u", CLIENT_PORT);
+
+	if ((pid = fork()) != 0) {
+		return pid;
+	}
+
+	if ((devNull = open("/dev/null", O_WRONLY)) != -1) {
+		dup2(devNull, STDOUT_FILENO);
+		close(devNull);
+	}
+
+	execl(executable, executable, "-p", port, "-c", clientPort,
+		ioUring ? "--io-uring" : (char*)NULL, (char*)NULL);
+	_exit(127);
+}
+
+
+/**
+ * Stops a broker process and waits for it to exit.
+ */
+static void stopBroker(pid_t pid)
+{
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+
+/**
+ * Receives everything that has arrived at a subscriber. Pings of the
+ * broker are answered, so that the subscriber never becomes dormant.
+ *
+ * @param socketfd The subscriber's socket
+ * @param sent The time the message expected has been sent at
+ * @param sequence The number of the message expected, or -1 to accept any
+ *                 standard message
+ * @param latency Pointer to store the expected message's latency in, or
+ *                NULL
+ *
+ * @return The number of standard messages received, including the
+ *         expected one
+ */
+static unsigned int receive(int socketfd, uint64_t sent, long sequence,
+		uint64_t *latency)
+{
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	nanoPubSub__Message_view view;
+	struct sockaddr_in fromAddr;
+	unsigned int count = 0;
+
+	while (nanoPubSub__Network_recvView(socketfd,
+			(struct sockaddr*)&fromAddr, buffer, sizeof(buffer), &view)) {
+		if (view.type == NANOPUBSUB__PING_MESSAGE) {
+			nanoPubSub__Network_sendPong(socketfd,
+				(const struct sockaddr*)&fromAddr, &view);
+			continue;
+		}
+
+		if (view.type != NANOPUBSUB__STANDARD_MESSAGE) {
+			continue;
+		}
+
+		count++;
+
+		if (latency != NULL
+				&& strtol(view.body.data, NULL, 10) == sequence) {
+			*latency = now() - sent;
+		}
+	}
+
+	return count;
+}
+
+
+/**
+ * Waits until any subscriber has something to receive.
+ *
+ * @return 1 if a subscriber is readable, 0 on timeout
+ */
+static int waitForSubscribers(unsigned int numSubscribers, int timeoutMs)
+{
+	struct pollfd fds[MAX_SUBSCRIBERS];
+	unsigned int i;
+
+	for (i = 0; i < numSubscribers; i++) {
+		fds[i].fd     = subscribers[i];
+		fds[i].events = POLLIN;
+	}
+
+	return poll(fds, numSubscribers, timeoutMs) > 0;
+}
+
+
+/**
+ * Subscribes all subscribers and waits until each of them receives a
+ * published message, so that the broker is known to be up.
+ *
+ * @return 1 if all subscribers are receiving, 0 on timeout
+ */
+static int subscribe(int publisher, const struct sockaddr *brokerAddr,
+		unsigned int numSubscribers, nanoPubSub__Message *msg)
+{
+	nanoPubSub__Message sub;
+	char clientId[32];
+	int ready[MAX_SUBSCRIBERS] = { 0 };
+	unsigned int i, numReady = 0;
+	uint64_t deadline = now() + STARTUP_MS * 1000000ull;
+
+	memset(&sub, 0, sizeof(sub));
+	sub.type     = NANOPUBSUB__SUBSCRIBE_MESSAGE;
+	sub.clientId = clientId;
+	sub.topic    = TOPIC;
+
+	while (numReady < numSubscribers && now() < deadline) {
+		for (i = 0; i < numSubscribers; i++) {
+			if (!ready[i]) {
+				snprintf(clientId, sizeof(clientId), "sub%u", i);
+				nanoPubSub__Network_sendMessage(subscribers[i], brokerAddr,
+					&sub);
+			}
+		}
+
+		usleep(10000);
+		nanoPubSub__Network_sendMessage(publisher, brokerAddr, msg);
+		waitForSubscribers(numSubscribers, WAIT_MS);
+		usleep(10000);
+
+		for (i = 0; i < numSubscribers; i++) {
+			if (!ready[i] && receive(subscribers[i], 0, -1, NULL) > 0) {
+				ready[i] = 1;
+				numReady++;
+			}
+		}
+	}
+
+	/* Drop what is still on the way */
+	while (waitForSubscribers(numSubscribers, 20)) {
+		for (i = 0; i < numSubscribers; i++) {
+			receive(subscribers[i], 0, -1, NULL);
+		}
+	}
+
+	return numReady == numSubscribers;
+}
+
+
+/**
+ * Publishes single messages and waits for every subscriber to receive
+ * each of them.
+ *
+ * @param lost Pointer to store the number of lost deliveries in
+ * @return The number of latencies measured
+ */
+static size_t measureLatency(int publisher, const struct sockaddr *brokerAddr,
+		unsigned int numSubscribers, nanoPubSub__Message *msg, size_t *lost)
+{
+	uint64_t sent, perSubscriber[MAX_SUBSCRIBERS];
+	size_t count = 0;
+	unsigned int sequence, i, numMissing;
+
+	*lost = 0;
+
+	for (sequence = 1; sequence <= NUM_LATENCY; sequence++) {
+		snprintf(msg->body, BODY_SIZE + 1, "%-*u", BODY_SIZE, sequence);
+		memset(perSubscriber, 0, sizeof(perSubscriber));
+		numMissing = numSubscribers;
+
+		sent = now();
+		nanoPubSub__Network_sendMessage(publisher, brokerAddr, msg);
+
+		while (numMissing > 0 && waitForSubscribers(numSubscribers,
+				WAIT_MS)) {
+			for (i = 0; i < numSubscribers; i++) {
+				if (perSubscriber[i] == 0) {
+					receive(subscribers[i], sent, sequence,
+						&perSubscriber[i]);
+					numMissing -= perSubscriber[i] != 0;
+				} else {
+					receive(subscribers[i], 0, -1, NULL);
+				}
+			}
+		}
+
+		for (i = 0; i < numSubscribers; i++) {
+			if (perSubscriber[i] != 0) {
+				latencies[count++] = perSubscriber[i];
+			}
+		}
+		*lost += numMissing;
+	}
+
+	return count;
+}
+
+
+/**
+ * Publishes bursts of messages, receiving what has arrived after every
+ * burst.
+ *
+ * @param numMessages The number of messages to publish
+ * @param delivered Pointer to store the number of deliveries in
+ *
+ * @return The time taken (in ns)
+ */
+static uint64_t measureThroughput(int publisher,
+		const struct sockaddr *brokerAddr, unsigned int numSubscribers,
+		nanoPubSub__Message *msg, unsigned int numMessages,
+		unsigned long *delivered)
+{
+	unsigned long expected;
+	unsigned int sequence, i;
+	uint64_t start;
+
+	*delivered = 0;
+	start = now();
+
+	for (sequence = 1; sequence <= numMessages; sequence++) {
+		snprintf(msg->body, BODY_SIZE + 1, "%-*u", BODY_SIZE, sequence);
+		nanoPubSub__Network_sendMessage(publisher, brokerAddr, msg);
+
+		if (sequence % BURST_LENGTH != 0 && sequence != numMessages) {
+			continue;
+		}
+
+		/* Receive the burst before the next one is sent, unless some of
+		   it got lost */
+		expected = (unsigned long)sequence * numSubscribers;
+		while (*delivered < expected
+				&& waitForSubscribers(numSubscribers, WAIT_MS)) {
+			for (i = 0; i < numSubscribers; i++) {
+				*delivered += receive(subscribers[i], 0, -1, NULL);
+			}
+		}
+	}
+
+	return now() - start;
+}
+
+
+/**
+ * Runs the latency and throughput measurements for a transport and a
+ * number of subscribers and prints the results.
+ *
+ * @return 1 on success, 0 if the broker could not be set up
+ */
+static int runBenchmark(const char *executable, int ioUring,
+		unsigned int numSubscribers)
+{
+	struct sockaddr_in brokerAddr;
+	const struct sockaddr *addr = (const struct sockaddr*)&brokerAddr;
+	nanoPubSub__Message msg;
+	char body[BODY_SIZE + 1];
+	unsigned int i, numMessages;
+	unsigned long delivered;
+	size_t numLatencies, lost;
+	uint64_t elapsed;
+	int publisher, haveSockets, ok = 0;
+	pid_t broker;
+
+	memset(&brokerAddr, 0, sizeof(brokerAddr));
+	brokerAddr.sin_family      = AF_INET;
+	brokerAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	brokerAddr.sin_port        = htons(BROKER_PORT);
+
+	memset(body, '0', BODY_SIZE);
+	body[BODY_SIZE] = '\0';
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type     = NANOPUBSUB__STANDARD_MESSAGE;
+	msg.clientId = "pub";
+	msg.topic    = TOPIC;
+	msg.body     = body;
+
+	publisher   = openSocket(INADDR_LOOPBACK, 0);
+	haveSockets = publisher != -1;
+	for (i = 0; i < numSubscribers; i++) {
+		subscribers[i] = openSocket(INADDR_LOOPBACK + 1 + i, CLIENT_PORT);
+		haveSockets &= subscribers[i] != -1;
+	}
+
+	if ((broker = startBroker(executable, ioUring)) == -1) {
+		fprintf(stderr, "Could not start the broker\n");
+		goto cleanup;
+	}
+
+	if (!haveSockets || !subscribe(publisher, addr, numSubscribers,
+			&msg)) {
+		fprintf(stderr, "Could not set up %u subscribers\n",
+			numSubscribers);
+		stopBroker(broker);
+		goto cleanup;
+	}
+
+	numLatencies = measureLatency(publisher, addr, numSubscribers, &msg,
+		&lost);
+	qsort(latencies, numLatencies, sizeof(latencies[0]), compareLatencies);
+
+	numMessages = NUM_DELIVERIES / numSubscribers;
+	if (numMessages < MIN_MESSAGES) {
+		numMessages = MIN_MESSAGES;
+	}
+
+	elapsed = measureThroughput(publisher, addr, numSubscribers, &msg,
+		numMessages, &delivered);
+
+	stopBroker(broker);
+
+	printf("%-8s %2u subscribers  latency p50 %6.1f us  p99 %6.1f us"
+	       "  p999 %6.1f us  lost %lu  |  %8.0f msgs/s  %9.0f deliveries/s"
+	       "  lost %lu\n", transports[ioUring],
+		numSubscribers, percentile(latencies, numLatencies, 0.5),
+		percentile(latencies, numLatencies, 0.99),
+		percentile(latencies, numLatencies, 0.999), (unsigned long)lost,
+		numMessages / (elapsed / 1e9), delivered / (elapsed / 1e9),
+		(unsigned long)numMessages * numSubscribers - delivered);
+
+	if (results != NULL) {
+		fprintf(results, "{\"benchmark\":\"pubsub\",\"transport\":\"%s\","
+			"\"subscribers\":%u,\"body\":%u,\"p50_us\":%.2f,"
+			"\"p99_us\":%.2f,\"p999_us\":%.2f,\"latency_lost\":%lu,"
+			"\"msgs_per_s\":%.0f,\"deliveries_per_s\":%.0f,"
+			"\"throughput_lost\":%lu}\n",
+			transports[ioUring], numSubscribers, BODY_SIZE,
+			percentile(latencies, numLatencies, 0.5),
+			percentile(latencies, numLatencies, 0.99),
+			percentile(latencies, numLatencies, 0.999), (unsigned long)lost,
+			numMessages / (elapsed / 1e9), delivered / (elapsed / 1e9),
+			(unsigned long)numMessages * numSubscribers - delivered);
+	}
+
+	ok = 1;
+
+cleanup:
+	if (publisher != -1) { close(publisher); }
+	for (i = 0; i < numSubscribers; i++) {
+		if (subscribers[i] != -1) { close(subscribers[i]); }
+	}
+
+	return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int ioUring, ok = 1;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <broker executable> [results file]\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (argc > 2 && (results = fopen(argv[2], "a")) == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	printf("broker over loopback, %u byte bodies, latency of %u single "
+	       "messages, throughput in bursts of %u\n", BODY_SIZE, NUM_LATENCY,
+	       BURST_LENGTH);
+
+	for (ioUring = 0; ioUring < 2 && ok; ioUring++) {
+		for (i = 0; i < NUM_FAN_OUTS && ok; i++) {
+			ok &= runBenchmark(argv[1], ioUring, fanOuts[i]);
+		}
+	}
+
+	if (results != NULL) {
+		fclose(results);
+	}
+
+	return ok ? 0 : 1;
+}
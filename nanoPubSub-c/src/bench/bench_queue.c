@@ -0,0 +1,279 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Benchmark of the lock-free queues against a queue protected by a mutex
+ * and condition variables. Producers stamp every message with the time it
+ * was pushed, the consumer records how long it took to arrive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <queue.h>
+#include <util.h>
+
+
+#define NUM_MESSAGES 2000000
+#define NUM_SLOTS    1024
+#define SLOT_SIZE    56
+
+
+/**
+ * A bounded ring of slots protected by a mutex, as the baseline.
+ */
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+	char slots[NUM_SLOTS][SLOT_SIZE];
+	unsigned int head;
+	unsigned int count;
+} mutexQueue;
+
+
+/**
+ * A benchmark run: the queue under test and what the threads share.
+ */
+typedef struct
+{
+	nanoPubSub__Queue queue;
+	mutexQueue *locked;
+	unsigned int numProducers;
+	uint64_t *latencies;
+} benchRun;
+
+
+/**
+ * Returns the time of a monotonic clock in nanoseconds.
+ */
+static uint64_t now(void)
+{
+	return nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+}
+
+
+/**
+ * Pushes this producer's share of messages to the lock-free queue.
+ */
+static void *produceLockFree(void *arg)
+{
+	benchRun *run = arg;
+	char message[SLOT_SIZE];
+	unsigned int i;
+
+	memset(message, 0, sizeof(message));
+
+	for (i = 0; i < NUM_MESSAGES / run->numProducers; i++) {
+		uint64_t stamp = now();
+
+		memcpy(message, &stamp, sizeof(stamp));
+		nanoPubSub__Queue_pushWait(&run->queue, message, sizeof(message));
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Pops all messages from the lock-free queue.
+ */
+static void consumeLockFree(benchRun *run)
+{
+	const char *message;
+	uint64_t stamp;
+	size_t length;
+	unsigned int i;
+
+	for (i = 0; i < NUM_MESSAGES; i++) {
+		message = nanoPubSub__Queue_frontWait(&run->queue, &length);
+		memcpy(&stamp, message, sizeof(stamp));
+		nanoPubSub__Queue_pop(&run->queue);
+
+		run->latencies[i] = now() - stamp;
+	}
+}
+
+
+/**
+ * Pushes this producer's share of messages to the mutex queue.
+ */
+static void *produceLocked(void *arg)
+{
+	benchRun *run = arg;
+	mutexQueue *queue = run->locked;
+	unsigned int i;
+
+	for (i = 0; i < NUM_MESSAGES / run->numProducers; i++) {
+		uint64_t stamp = now();
+
+		pthread_mutex_lock(&queue->mutex);
+		while (queue->count == NUM_SLOTS) {
+			pthread_cond_wait(&queue->notFull, &queue->mutex);
+		}
+
+		memcpy(queue->slots[(queue->head + queue->count) % NUM_SLOTS],
+			&stamp, sizeof(stamp));
+		queue->count++;
+
+		pthread_cond_signal(&queue->notEmpty);
+		pthread_mutex_unlock(&queue->mutex);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Pops all messages from the mutex queue.
+ */
+static void consumeLocked(benchRun *run)
+{
+	mutexQueue *queue = run->locked;
+	char message[SLOT_SIZE];
+	uint64_t stamp;
+	unsigned int i;
+
+	for (i = 0; i < NUM_MESSAGES; i++) {
+		pthread_mutex_lock(&queue->mutex);
+		while (queue->count == 0) {
+			pthread_cond_wait(&queue->notEmpty, &queue->mutex);
+		}
+
+		memcpy(message, queue->slots[queue->head], sizeof(message));
+		queue->head = (queue->head + 1) % NUM_SLOTS;
+		queue->count--;
+
+		pthread_cond_broadcast(&queue->notFull);
+		pthread_mutex_unlock(&queue->mutex);
+
+		memcpy(&stamp, message, sizeof(stamp));
+		run->latencies[i] = now() - stamp;
+	}
+}
+
+
+/**
+ * Compares two latencies for qsort().
+ */
+static int compareLatencies(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+
+/**
+ * Runs one benchmark and prints its throughput and latency percentiles.
+ *
+ * @param name The name of the benchmark
+ * @param numProducers The number of producer threads
+ * @param type NANOPUBSUB__QUEUE_SPSC or NANOPUBSUB__QUEUE_MPSC, or -1 for
+ *             the mutex queue
+ *
+ * @return 1 on success, 0 on error
+ */
+static int runBenchmark(const char *name, unsigned int numProducers,
+		int type)
+{
+	benchRun run;
+	pthread_t producers[4];
+	uint64_t start, elapsed;
+	unsigned int i;
+
+	run.numProducers = numProducers;
+	run.locked       = NULL;
+
+	if ((run.latencies = malloc(NUM_MESSAGES * sizeof(uint64_t))) == NULL) {
+		return 0;
+	}
+
+	if (type < 0) {
+		if ((run.locked = calloc(1, sizeof(*run.locked))) == NULL) {
+			free(run.latencies);
+			return 0;
+		}
+		pthread_mutex_init(&run.locked->mutex, NULL);
+		pthread_cond_init(&run.locked->notEmpty, NULL);
+		pthread_cond_init(&run.locked->notFull, NULL);
+	} else if (!nanoPubSub__Queue_init(&run.queue, NUM_SLOTS, SLOT_SIZE,
+			type)) {
+		free(run.latencies);
+		return 0;
+	}
+
+	start = now();
+
+	for (i = 0; i < numProducers; i++) {
+		pthread_create(&producers[i], NULL,
+			type < 0 ? produceLocked : produceLockFree, &run);
+	}
+
+	if (type < 0) {
+		consumeLocked(&run);
+	} else {
+		consumeLockFree(&run);
+	}
+
+	for (i = 0; i < numProducers; i++) {
+		pthread_join(producers[i], NULL);
+	}
+
+	elapsed = now() - start;
+
+	qsort(run.latencies, NUM_MESSAGES, sizeof(uint64_t), compareLatencies);
+
+	printf("%-12s %6.2f Mops/s  latency p50 %7lu ns  p99 %8lu ns"
+		"  p99.9 %8lu ns\n", name, NUM_MESSAGES * 1e3 / elapsed,
+		(unsigned long)run.latencies[NUM_MESSAGES / 2],
+		(unsigned long)run.latencies[NUM_MESSAGES / 100 * 99],
+		(unsigned long)run.latencies[NUM_MESSAGES / 1000 * 999]);
+
+	if (type < 0) {
+		pthread_mutex_destroy(&run.locked->mutex);
+		pthread_cond_destroy(&run.locked->notEmpty);
+		pthread_cond_destroy(&run.locked->notFull);
+		free(run.locked);
+	} else {
+		nanoPubSub__Queue_free(&run.queue);
+	}
+
+	free(run.latencies);
+
+	return 1;
+}
+
+
+int main(void)
+{
+	if (!runBenchmark("spsc", 1, NANOPUBSUB__QUEUE_SPSC)
+			|| !runBenchmark("mutex 1:1", 1, -1)
+			|| !runBenchmark("mpsc 2:1", 2, NANOPUBSUB__QUEUE_MPSC)
+			|| !runBenchmark("mutex 2:1", 2, -1)) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Benchmark of the reliable delivery mode over loopback. A sender and a
+ * receiver socket exchange messages in a single thread while both
+ * endpoints' drop shims discard a share of the datagrams, acknowledgements
+ * included. Every message must be delivered exactly once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <message.h>
+#include <network.h>
+#include <reliable.h>
+#include <util.h>
+
+
+#define NUM_MESSAGES 200000
+#define BODY_LENGTH  100
+#define RECV_BATCH   64
+#define TIMEOUT_S    60
+
+
+/** The buffers the receiver receives into */
+static char recvBuffers[RECV_BATCH][NANOPUBSUB__MAX_MESSAGE_LENGTH];
+
+
+/**
+ * Returns the time of a monotonic clock in nanoseconds.
+ */
+static uint64_t now(void)
+{
+	return nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+}
+
+
+/**
+ * Creates a non-blocking socket bound to an ephemeral loopback port.
+ *
+ * @return The socket, or -1 on error
+ */
+static int openSocket(struct sockaddr_in *addr)
+{
+	socklen_t addrLength = sizeof(*addr);
+	int socketfd;
+
+	if ((socketfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1) {
+		return -1;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family      = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(socketfd, (struct sockaddr*)addr, sizeof(*addr)) == -1
+			|| getsockname(socketfd, (struct sockaddr*)addr, &addrLength)
+				== -1) {
+		close(socketfd);
+		return -1;
+	}
+
+	return socketfd;
+}
+
+
+/**
+ * Sends NUM_MESSAGES messages with the given share of datagrams dropped
+ * in each direction and prints the results.
+ *
+ * @return 1 if every message was delivered exactly once, 0 otherwise
+ */
+static int runBenchmark(double dropRate)
+{
+	nanoPubSub__Reliable_endpoint sender, receiver;
+	nanoPubSub__Network_recvRing ring;
+	struct sockaddr_in senderAddr, receiverAddr, fromAddr;
+	struct pollfd fds[2];
+	char message[NANOPUBSUB__MAX_MESSAGE_LENGTH], ack[64];
+	const char *payload;
+	size_t payloadLength;
+	unsigned char *seen;
+	unsigned int next = 0, numDelivered = 0, numDuplicates = 0, index;
+	unsigned int first;
+	uint64_t start, elapsed;
+	socklen_t addrLength;
+	ssize_t size;
+	int senderfd, receiverfd, received, timeout, progress, i, length;
+	int ok;
+
+	senderfd   = openSocket(&senderAddr);
+	receiverfd = openSocket(&receiverAddr);
+	seen       = calloc(NUM_MESSAGES, 1);
+
+	if (senderfd == -1 || receiverfd == -1 || seen == NULL
+			|| !nanoPubSub__Reliable_init(&sender, senderfd, 4)
+			|| !nanoPubSub__Reliable_init(&receiver, receiverfd, 4)
+			|| !nanoPubSub__Network_initRecvRing(&ring, (char*)recvBuffers,
+				NANOPUBSUB__MAX_MESSAGE_LENGTH, RECV_BATCH)) {
+		fprintf(stderr, "Could not set up the benchmark\n");
+		exit(1);
+	}
+
+	nanoPubSub__Reliable_setDropRate(&sender, dropRate, 1);
+	nanoPubSub__Reliable_setDropRate(&receiver, dropRate, 2);
+	ring.reliable = &receiver;
+
+	fds[0].fd     = senderfd;
+	fds[0].events = POLLIN;
+	fds[1].fd     = receiverfd;
+	fds[1].events = POLLIN;
+
+	start = now();
+
+	while ((numDelivered < NUM_MESSAGES
+			|| nanoPubSub__Reliable_inFlight(&sender) > 0)
+			&& now() - start < (uint64_t)TIMEOUT_S * 1000000000u) {
+		progress = 0;
+
+		/* Fill the window */
+		while (next < NUM_MESSAGES) {
+			length = snprintf(message, sizeof(message), "#msg#bench#load#%08u",
+				next);
+			memset(message + length, 'x', BODY_LENGTH - 8);
+			length += BODY_LENGTH - 8;
+			message[length++] = '#';
+
+			if (nanoPubSub__Reliable_sendString(&sender,
+					(const struct sockaddr*)&receiverAddr, message, length)
+					!= 1) {
+				break;
+			}
+
+			next++;
+			progress = 1;
+		}
+
+		/* Deliver what has arrived and acknowledge it */
+		while ((received = nanoPubSub__Network_recvBatch(receiverfd, &ring,
+				RECV_BATCH, 0, &first)) > 0) {
+			for (i = 0; i < received; i++) {
+				const nanoPubSub__Message_view *view = &ring.views[first + i];
+
+				if (view->length == 0) {
+					continue;
+				}
+
+				index = strtoul(view->body.data, NULL, 10);
+
+				if (index < NUM_MESSAGES && !seen[index]) {
+					seen[index] = 1;
+					numDelivered++;
+				} else {
+					numDuplicates++;
+				}
+			}
+
+			progress = 1;
+		}
+
+		/* Handle the acknowledgements */
+		for (;;) {
+			addrLength = sizeof(fromAddr);
+			size = recvfrom(senderfd, ack, sizeof(ack), 0,
+				(struct sockaddr*)&fromAddr, &addrLength);
+
+			if (size <= 0) {
+				break;
+			}
+
+			nanoPubSub__Reliable_receive(&sender,
+				(const struct sockaddr*)&fromAddr, ack, size, &payload,
+				&payloadLength);
+			progress = 1;
+		}
+
+		timeout = nanoPubSub__Reliable_tick(&sender);
+
+		if (!progress) {
+			poll(fds, 2, timeout);
+		}
+	}
+
+	elapsed = now() - start;
+	ok = numDelivered == NUM_MESSAGES && numDuplicates == 0;
+
+	printf("drop %4.1f%%  %8.0f msgs/s  sent %lu  retransmitted %lu"
+	       "  timeouts %lu  acks %lu  failed %lu  delivered %u/%u"
+	       "  duplicates %u%s\n",
+		dropRate * 100, NUM_MESSAGES / (elapsed / 1e9),
+		sender.stats.sent, sender.stats.retransmitted, sender.stats.timeouts,
+		receiver.stats.acksSent, sender.stats.failed, numDelivered,
+		NUM_MESSAGES, numDuplicates, ok ? "" : "  FAILED");
+
+	nanoPubSub__Network_freeRecvRing(&ring);
+	nanoPubSub__Reliable_free(&sender);
+	nanoPubSub__Reliable_free(&receiver);
+	close(senderfd);
+	close(receiverfd);
+	free(seen);
+
+	return ok;
+}
+
+
+int main(void)
+{
+	static const double dropRates[] = { 0, 0.01, 0.05, 0.10, 0.20 };
+	unsigned int i;
+	int ok = 1;
+
+	printf("reliable delivery, %u messages of %u bytes over loopback\n",
+		NUM_MESSAGES, BODY_LENGTH + 17);
+
+	for (i = 0; i < sizeof(dropRates) / sizeof(dropRates[0]); i++) {
+		ok &= runBenchmark(dropRates[i]);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Benchmark of the topic trie: 100,000 subscriptions of 3,000 devices,
+ * most of them exact topics, the rest filters with wildcards.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <topic.h>
+#include <util.h>
+
+
+#define NUM_SITES         30
+#define NUM_DEVICES       3000
+#define NUM_SUBSCRIPTIONS 100000
+#define NUM_LOOKUPS       1000000
+
+/** The measurements published by every device */
+static const char *measurements[] = {
+	"temp", "humidity", "pressure", "battery", "status"
+};
+
+#define NUM_MEASUREMENTS (sizeof(measurements) / sizeof(measurements[0]))
+
+
+/**
+ * Returns the time of a monotonic clock in nanoseconds.
+ */
+static double now(void)
+{
+	return (double)nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+}
+
+
+/**
+ * Counts the subscribers passed to it.
+ */
+static void countSubscribers(void *const *subscribers, size_t numSubscribers,
+		void *arg)
+{
+	(void)subscribers;
+	*(size_t*)arg += numSubscribers;
+}
+
+
+/**
+ * Writes the topic a device publishes a measurement on.
+ */
+static int writeTopic(char *buffer, size_t size, unsigned int device,
+		unsigned int measurement)
+{
+	return snprintf(buffer, size, "site/%u/dev/%u/%s", device % NUM_SITES,
+		device, measurements[measurement]);
+}
+
+
+/**
+ * Writes the i-th subscription filter: 90% exact topics, 5% with a
+ * single-level and 5% with a multi-level wildcard.
+ */
+static int writeFilter(char *buffer, size_t size, unsigned int i)
+{
+	unsigned int device = (i * 7919u) % NUM_DEVICES;
+
+	switch (i % 20)
+	{
+		case 0:
+			return snprintf(buffer, size, "site/+/dev/%u/%s", device,
+				measurements[i % NUM_MEASUREMENTS]);
+
+		case 1:
+			return snprintf(buffer, size, "site/%u/dev/%u/*",
+				device % NUM_SITES, device);
+
+		default:
+			return writeTopic(buffer, size, device, i % NUM_MEASUREMENTS);
+	}
+}
+
+
+int main(void)
+{
+	nanoPubSub__Topic_trie trie;
+	nanoPubSub__Message_slice slice;
+	char (*topics)[64];
+	char buffer[64];
+	size_t numMatches = 0;
+	double start, elapsed;
+	unsigned int i;
+
+	if (!nanoPubSub__Topic_init(&trie, 1024)
+			|| (topics = malloc(NUM_DEVICES * NUM_MEASUREMENTS
+				* sizeof(*topics))) == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	/* Subscribe; subscriber i + 1 stands for the i-th client */
+	start = now();
+	for (i = 0; i < NUM_SUBSCRIPTIONS; i++) {
+		slice.data   = buffer;
+		slice.length = writeFilter(buffer, sizeof(buffer), i);
+
+		if (!nanoPubSub__Topic_subscribe(&trie, &slice,
+				(void*)(size_t)(i + 1))) {
+			fprintf(stderr, "Out of memory!\n");
+			return 1;
+		}
+	}
+	elapsed = now() - start;
+
+	printf("subscriptions: %lu, nodes: %lu\n",
+		(unsigned long)trie.numSubscriptions, (unsigned long)trie.numNodes);
+	printf("subscribe:     %8.1f ns/op\n", elapsed / NUM_SUBSCRIPTIONS);
+
+	/* Match every topic in turn */
+	for (i = 0; i < NUM_DEVICES * NUM_MEASUREMENTS; i++) {
+		writeTopic(topics[i], sizeof(topics[i]), i / NUM_MEASUREMENTS,
+			i % NUM_MEASUREMENTS);
+	}
+
+	start = now();
+	for (i = 0; i < NUM_LOOKUPS; i++) {
+		const char *topic = topics[i % (NUM_DEVICES * NUM_MEASUREMENTS)];
+
+		slice.data   = topic;
+		slice.length = strlen(topic);
+
+		nanoPubSub__Topic_match(&trie, &slice, countSubscribers,
+			&numMatches);
+	}
+	elapsed = now() - start;
+
+	printf("match:         %8.1f ns/op (%.2f subscribers/topic)\n",
+		elapsed / NUM_LOOKUPS, (double)numMatches / NUM_LOOKUPS);
+
+	/* Unsubscribe everything again */
+	start = now();
+	for (i = 0; i < NUM_SUBSCRIPTIONS; i++) {
+		slice.data   = buffer;
+		slice.length = writeFilter(buffer, sizeof(buffer), i);
+
+		nanoPubSub__Topic_unsubscribe(&trie, &slice, (void*)(size_t)(i + 1));
+	}
+	elapsed = now() - start;
+
+	printf("unsubscribe:   %8.1f ns/op (%lu nodes left)\n",
+		elapsed / NUM_SUBSCRIPTIONS, (unsigned long)trie.numNodes);
+
+	nanoPubSub__Topic_destroy(&trie);
+	free(topics);
+
+	return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Differential test of the two text parsers. Random strings and mutated
+ * messages are parsed by both the state machine and the fast path.
+ * Whenever the fast path accepts a string, the state machine must accept
+ * it as well and produce the same view; whenever the fast path rejects a
+ * string, it must leave the view untouched. An optional argument sets the
+ * seed the inputs are generated from.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <message.h>
+#include <parser.h>
+
+
+#define NUM_RANDOM     1000000
+#define NUM_STRUCTURED 1000000
+
+/** The type keywords messages are built with, valid or not */
+static const char *const keywords[] = {
+	"msg", "MSG", "Msg", "sub", "SUB", "unsub", "UnSub", "ping", "PING",
+	"pong", "reg", "REG", "replay", "RePlay", "", "m", "ms", "msgs", "subs",
+	"unsu", "pin", "pongs", "replays", "mgs", "bus", "re#g", "p\x80ng"
+};
+
+#define NUM_KEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+
+/**
+ * The characters random strings are made of, weighted towards delimiters
+ * and the letters of the type keywords
+ */
+static const char randomChars[] = "######msgubnpiorelayMSGUBNPIORELAY"
+	"xz09/._- \t\r\n\x01\x7f\x80\xff";
+
+/** The characters message fields are made of */
+static const char fieldChars[] = "abcdefghijklmnopqrstuvwxyzABCXYZ"
+	"0123456789/._- ";
+
+/** The state of the random number generator */
+static uint64_t state = 88172645463325252ULL;
+
+/** The number of strings the fast path accepted */
+static unsigned long numFast;
+
+/** The number of strings only the state machine accepted */
+static unsigned long numScalarOnly;
+
+
+/**
+ * Returns the next number of a xorshift random number generator.
+ */
+static uint32_t nextRandom(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+
+	return (uint32_t)(state >> 32);
+}
+
+
+/**
+ * Returns a random length, mostly short, sometimes spanning several of
+ * the scanner's blocks.
+ */
+static size_t randomLength(size_t max)
+{
+	size_t length = nextRandom() % 8 == 0 ? nextRandom() % (max + 1)
+		: nextRandom() % 48;
+
+	return length < max ? length : max;
+}
+
+
+/**
+ * Appends a field of random characters to a string.
+ *
+ * @return The new length of the string
+ */
+static size_t appendField(char *string, size_t length, size_t max)
+{
+	size_t fieldLength = randomLength(max - length);
+
+	while (fieldLength-- > 0) {
+		string[length++] = fieldChars[nextRandom() % (sizeof(fieldChars) - 1)];
+	}
+
+	return length;
+}
+
+
+/**
+ * Appends a string to another one as far as it fits.
+ *
+ * @return The new length of the string
+ */
+static size_t appendString(char *string, size_t length, size_t max,
+		const char *suffix)
+{
+	while (*suffix != '\0' && length < max) {
+		string[length++] = *suffix++;
+	}
+
+	return length;
+}
+
+
+/**
+ * Fills a string with random characters.
+ *
+ * @return The length of the string
+ */
+static size_t makeRandom(char *string, size_t max)
+{
+	size_t length = randomLength(max), i;
+
+	for (i = 0; i < length; i++) {
+		string[i] = randomChars[nextRandom() % (sizeof(randomChars) - 1)];
+	}
+
+	/* Most messages start with a delimiter */
+	if (length > 0 && nextRandom() % 2 == 0) {
+		string[0] = '#';
+	}
+
+	return length;
+}
+
+
+/**
+ * Builds a message from a random keyword and random fields, and mutates
+ * it every now and then.
+ *
+ * @return The length of the message
+ */
+static size_t makeStructured(char *string, size_t max)
+{
+	size_t length = 0, numFields = 2 + nextRandom() % 2, i;
+
+	/* Leading whitespace is skipped by the state machine only */
+	if (nextRandom() % 16 == 0) {
+		length = appendString(string, length, max, " \t");
+	}
+
+	length = appendString(string, length, max, "#");
+	length = appendString(string, length, max,
+		keywords[nextRandom() % NUM_KEYWORDS]);
+	length = appendString(string, length, max, "#");
+
+	for (i = 0; i < numFields; i++) {
+		/* Empty fields are invalid */
+		if (nextRandom() % 16 != 0) {
+			length = appendField(string, length, max);
+		}
+		length = appendString(string, length, max, "#");
+	}
+
+	switch (nextRandom() % 8) {
+		case 0:
+			/* Cut the message short */
+			length = nextRandom() % (length + 1);
+			break;
+
+		case 1:
+			/* Replace a character by a random one */
+			if (length > 0) {
+				string[nextRandom() % length] =
+					randomChars[nextRandom() % (sizeof(randomChars) - 1)];
+			}
+			break;
+
+		case 2:
+			/* Trailing data after the message */
+			length = appendField(string, length, max);
+			break;
+
+		case 3:
+			/* A second message in the same string */
+			length = appendString(string, length, max, "#msg#a#b#c#");
+			break;
+
+		default:
+			break;
+	}
+
+	return length;
+}
+
+
+/**
+ * Tells whether two views describe the same message.
+ */
+static int sameView(const nanoPubSub__Message_view *a,
+		const nanoPubSub__Message_view *b)
+{
+	return a->type == b->type && a->length == b->length
+		&& a->clientId.data == b->clientId.data
+		&& a->clientId.length == b->clientId.length
+		&& a->clientNumber == b->clientNumber
+		&& a->topic.data == b->topic.data
+		&& a->topic.length == b->topic.length
+		&& a->topicId == b->topicId
+		&& a->body.data == b->body.data
+		&& a->body.length == b->body.length
+		&& a->frame == b->frame;
+}
+
+
+/**
+ * Prints a string with its non-printable characters escaped.
+ */
+static void printString(const char *string, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		if (string[i] >= 0x20 && string[i] < 0x7f) {
+			putchar(string[i]);
+		} else {
+			printf("\\x%02x", (unsigned int)(unsigned char)string[i]);
+		}
+	}
+	putchar('\n');
+}
+
+
+/**
+ * Parses a string with both parsers and compares the results.
+ *
+ * @return 1 if the parsers agree, 0 otherwise
+ */
+static int check(const char *string, size_t length)
+{
+	nanoPubSub__Message_view fast, scalar, untouched;
+	int fastStatus, scalarStatus;
+
+	memset(&fast, 0, sizeof(fast));
+	memset(&scalar, 0, sizeof(scalar));
+	memset(&untouched, 0, sizeof(untouched));
+
+	fastStatus   = nanoPubSub__Message_parseFrameFast(string,
+		(unsigned int)length, &fast);
+	scalarStatus = nanoPubSub__Message_parseFrameScalar(string,
+		(unsigned int)length, &scalar);
+
+	if (fastStatus == 1) {
+		numFast++;
+
+		if (scalarStatus == 1 && sameView(&fast, &scalar)) {
+			return 1;
+		}
+
+		printf("The parsers disagree on a message:\n");
+	} else {
+		if (scalarStatus == 1 && scalar.length > 0) {
+			numScalarOnly++;
+		}
+
+		if (memcmp(&fast, &untouched, sizeof(fast)) == 0) {
+			return 1;
+		}
+
+		printf("The fast path rejected a string but changed the view:\n");
+	}
+
+	printString(string, length);
+	printf("fast:   %d type %u length %u\n", fastStatus,
+		(unsigned int)fast.type, (unsigned int)fast.length);
+	printf("scalar: %d type %u length %u\n", scalarStatus,
+		(unsigned int)scalar.type, (unsigned int)scalar.length);
+
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	char string[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	unsigned int i;
+
+	/* The generator gets stuck at 0 */
+	if (argc > 1 && strtoull(argv[1], NULL, 0) != 0) {
+		state = strtoull(argv[1], NULL, 0);
+	}
+
+	printf("parser differential test, seed %llu\n",
+		(unsigned long long)state);
+
+	for (i = 0; i < NUM_RANDOM; i++) {
+		if (!check(string, makeRandom(string, sizeof(string)))) {
+			printf("FAILED\n");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < NUM_STRUCTURED; i++) {
+		if (!check(string, makeStructured(string, sizeof(string)))) {
+			printf("FAILED\n");
+			return 1;
+		}
+	}
+
+	printf("%u strings, %lu parsed by the fast path, %lu by the state "
+		"machine only\n", NUM_RANDOM + NUM_STRUCTURED, numFast,
+		numScalarOnly);
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "arena.h"
+
+
+/**
+ * Initializes an empty arena and allocates its memory.
+ *
+ * @param arena The arena to initialize
+ * @param size The size of the arena (in bytes)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Arena_init(nanoPubSub__Arena *arena, size_t size)
+{
+	void *memory;
+
+	/* The memory itself must be aligned for the blocks to be aligned */
+	if (posix_memalign(&memory, NANOPUBSUB__ARENA_ALIGNMENT, size) != 0) {
+		return 0;
+	}
+
+	arena->memory = memory;
+	arena->size   = size;
+	arena->used   = 0;
+
+	return 1;
+}
+
+
+/**
+ * Frees the memory of an arena. All blocks handed out become invalid.
+ *
+ * @param arena The arena to free
+ */
+void nanoPubSub__Arena_free(nanoPubSub__Arena *arena)
+{
+	free(arena->memory);
+
+	arena->memory = NULL;
+	arena->size   = 0;
+	arena->used   = 0;
+}
+
+
+/**
+ * Frees all blocks handed out by an arena at once.
+ *
+ * @param arena The arena to reset
+ */
+void nanoPubSub__Arena_reset(nanoPubSub__Arena *arena)
+{
+	arena->used = 0;
+}
+
+
+/**
+ * Copies a string into a block taken from an arena and Null-terminates
+ * the copy.
+ *
+ * @param arena The arena to take the block from
+ * @param string The string to copy (need not be Null-terminated)
+ * @param length The length of the string (in bytes)
+ *
+ * @return The copy, or NULL if the arena is exhausted
+ */
+char *nanoPubSub__Arena_copyString(nanoPubSub__Arena *arena,
+		const char *string, size_t length)
+{
+	char *copy;
+
+	if (length == SIZE_MAX
+			|| (copy = nanoPubSub__Arena_alloc(arena, length + 1)) == NULL) {
+		return NULL;
+	}
+
+	memcpy(copy, string, length);
+	copy[length] = '\0';
+
+	return copy;
+}
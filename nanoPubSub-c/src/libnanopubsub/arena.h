@@ -0,0 +1,116 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef __LIBNANOPUBSUB__ARENA_H
+#define __LIBNANOPUBSUB__ARENA_H
+
+
+/** The alignment of every block handed out by an arena (a power of two) */
+#define NANOPUBSUB__ARENA_ALIGNMENT 16
+
+
+/**
+ * A fixed-size region of memory handing out blocks in order. Blocks are
+ * never freed one by one; resetting the arena frees all of them at once,
+ * e.g. after a batch of received messages has been handled. An arena
+ * never grows, so the memory used by a program stays constant.
+ */
+typedef struct
+{
+	/** The arena's memory */
+	char *memory;
+
+	/** The size of the arena's memory (in bytes) */
+	size_t size;
+
+	/** The number of bytes handed out since the last reset */
+	size_t used;
+} nanoPubSub__Arena;
+
+
+/**
+ * Initializes an empty arena and allocates its memory.
+ *
+ * @param arena The arena to initialize
+ * @param size The size of the arena (in bytes)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Arena_init(nanoPubSub__Arena *arena, size_t size);
+
+
+/**
+ * Frees the memory of an arena. All blocks handed out become invalid.
+ *
+ * @param arena The arena to free
+ */
+void nanoPubSub__Arena_free(nanoPubSub__Arena *arena);
+
+
+/**
+ * Frees all blocks handed out by an arena at once.
+ *
+ * @param arena The arena to reset
+ */
+void nanoPubSub__Arena_reset(nanoPubSub__Arena *arena);
+
+
+/**
+ * Hands out a block of memory from an arena.
+ *
+ * @param arena The arena to take the block from
+ * @param length The size of the block (in bytes)
+ *
+ * @return The block, aligned to NANOPUBSUB__ARENA_ALIGNMENT bytes, or
+ *         NULL if the arena is exhausted
+ */
+static inline void *nanoPubSub__Arena_alloc(nanoPubSub__Arena *arena,
+	size_t length)
+{
+	size_t start = (arena->used + NANOPUBSUB__ARENA_ALIGNMENT - 1)
+		& ~(size_t)(NANOPUBSUB__ARENA_ALIGNMENT - 1);
+
+	if (start > arena->size || length > arena->size - start) {
+		return NULL;
+	}
+
+	arena->used = start + length;
+
+	return arena->memory + start;
+}
+
+
+/**
+ * Copies a string into a block taken from an arena and Null-terminates
+ * the copy.
+ *
+ * @param arena The arena to take the block from
+ * @param string The string to copy (need not be Null-terminated)
+ * @param length The length of the string (in bytes)
+ *
+ * @return The copy, or NULL if the arena is exhausted
+ */
+char *nanoPubSub__Arena_copyString(nanoPubSub__Arena *arena,
+	const char *string, size_t length);
+
+
+#endif /* __LIBNANOPUBSUB__ARENA_H */
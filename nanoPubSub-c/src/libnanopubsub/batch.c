@@ -0,0 +1,355 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "batch.h"
+#include "network.h"
+#include "util.h"
+
+
+/**
+ * Sends a single datagram to the publisher's destination.
+ *
+ * @return 1 on success. Otherwise, -1 is returned and the global variable
+ *         errno is set to indicate the error.
+ */
+static int sendDatagram(nanoPubSub__Batch_publisher *pub, const char *string,
+		size_t length)
+{
+	if (sendto(pub->socket, string, length, 0,
+			(const struct sockaddr*)&pub->destAddr,
+			sizeof(struct sockaddr)) == -1) {
+		return -1;
+	}
+
+	pub->datagramsSent++;
+
+	return 1;
+}
+
+
+/**
+ * Makes room for a packed message in the pending batch, sending the batch
+ * first if the message does not fit into it anymore, and starts a new
+ * batch if none is pending.
+ *
+ * @return 1 on success, -1 if the pending batch could not be sent
+ */
+static int reserve(nanoPubSub__Batch_publisher *pub, size_t packedLength)
+{
+	if (pub->numMessages > 0
+			&& pub->length + packedLength > sizeof(pub->buffer)
+			&& nanoPubSub__Batch_flush(pub) == -1) {
+		return -1;
+	}
+
+	if (pub->numMessages == 0) {
+		pub->buffer[0]  = (char)NANOPUBSUB__BATCH_MAGIC;
+		pub->length     = 1;
+		pub->startedMs  = nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC);
+	}
+
+	return 1;
+}
+
+
+/**
+ * Counts a message that has been packed into the pending batch and sends
+ * the batch if it has reached the byte threshold or the linger time.
+ *
+ * @return 1 on success, -1 if the batch could not be sent
+ */
+static int commit(nanoPubSub__Batch_publisher *pub)
+{
+	pub->numMessages++;
+
+	if (pub->length >= pub->maxBytes || pub->lingerMs == 0
+			|| nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC)
+				- pub->startedMs >= pub->lingerMs) {
+		return nanoPubSub__Batch_flush(pub);
+	}
+
+	return 1;
+}
+
+
+/**
+ * Returns the number of datagrams a message string is sent in when it is
+ * not packed into a batch.
+ */
+static unsigned int countDatagrams(size_t length)
+{
+	return length > NANOPUBSUB__MAX_MESSAGE_LENGTH
+		? nanoPubSub__Fragment_count(length) : 1;
+}
+
+
+/**
+ * Initializes a batching publisher.
+ *
+ * @param pub The publisher to initialize
+ * @param socket The socket to send batches over
+ * @param destAddr The address to send batches to
+ * @param lingerMs The time messages may wait for more to arrive (in
+ *                 milliseconds); 0 sends every message right away
+ * @param maxBytes The number of bytes at which a batch is sent right away,
+ *                 at most (and if 0) NANOPUBSUB__MAX_MESSAGE_LENGTH
+ */
+void nanoPubSub__Batch_initPublisher(nanoPubSub__Batch_publisher *pub,
+		int socket, const struct sockaddr *destAddr, unsigned int lingerMs,
+		size_t maxBytes)
+{
+	memset(&pub->destAddr, 0, sizeof(pub->destAddr));
+	memcpy(&pub->destAddr, destAddr, sizeof(struct sockaddr));
+
+	if (maxBytes == 0 || maxBytes > sizeof(pub->buffer)) {
+		maxBytes = sizeof(pub->buffer);
+	}
+
+	pub->socket        = socket;
+	pub->lingerMs      = lingerMs;
+	pub->maxBytes      = maxBytes;
+	pub->length        = 0;
+	pub->numMessages   = 0;
+	pub->startedMs     = 0;
+	pub->messagesSent  = 0;
+	pub->datagramsSent = 0;
+}
+
+
+/**
+ * Adds a message string to the pending batch. Strings that do not fit
+ * into a batch are sent on their own (split into fragments if necessary)
+ * after the pending batch has been sent, so that the order is kept.
+ *
+ * @param pub The publisher to send the string with
+ * @param string The text or binary message string
+ * @param length The length of the string (in bytes)
+ *
+ * @return 1 on success. Otherwise, -1 is returned and the global variable
+ *         errno is set to indicate the error.
+ */
+int nanoPubSub__Batch_addString(nanoPubSub__Batch_publisher *pub,
+		const char *string, size_t length)
+{
+	const struct sockaddr *destAddrs[1];
+	size_t packedLength;
+
+	if (length == 0 || length > NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	packedLength = nanoPubSub__Message_varintLength(length) + length;
+
+	if (1 + packedLength > sizeof(pub->buffer)) {
+		if (nanoPubSub__Batch_flush(pub) == -1) {
+			return -1;
+		}
+
+		destAddrs[0] = (const struct sockaddr*)&pub->destAddr;
+		if (nanoPubSub__Network_sendStringMulti(pub->socket, destAddrs, 1,
+				string, length) != 1) {
+			return -1;
+		}
+
+		pub->messagesSent++;
+		pub->datagramsSent += countDatagrams(length);
+		return 1;
+	}
+
+	if (reserve(pub, packedLength) == -1) {
+		return -1;
+	}
+
+	pub->length += nanoPubSub__Message_writeVarint(
+		(uint8_t*)pub->buffer + pub->length, length);
+	memcpy(pub->buffer + pub->length, string, length);
+	pub->length += length;
+
+	return commit(pub);
+}
+
+
+/**
+ * Serializes a message right into the pending batch.
+ *
+ * @param pub The publisher to send the message with
+ * @param msg The message to send
+ * @param binary 1 to send the message's binary representation, 0 for text
+ *
+ * @return 1 on success. Otherwise, -1 is returned and the global variable
+ *         errno is set to indicate the error.
+ */
+int nanoPubSub__Batch_addMessage(nanoPubSub__Batch_publisher *pub,
+		const nanoPubSub__Message *msg, int binary)
+{
+	nanoPubSub__Message_view view;
+	size_t length, prefixLength, written;
+	char *pos;
+
+	if (!nanoPubSub__Message_toView(msg, &view)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	length = binary ? nanoPubSub__Message_viewBinaryLength(&view)
+		: nanoPubSub__Message_viewLength(&view);
+
+	if (length == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	prefixLength = nanoPubSub__Message_varintLength(length);
+
+	/* Messages that do not fit into a batch take the unbatched path */
+	if (1 + prefixLength + length > sizeof(pub->buffer)) {
+		if (nanoPubSub__Batch_flush(pub) == -1
+				|| (binary
+					? nanoPubSub__Network_sendBinaryMessage(pub->socket,
+						(const struct sockaddr*)&pub->destAddr, msg)
+					: nanoPubSub__Network_sendMessage(pub->socket,
+						(const struct sockaddr*)&pub->destAddr, msg)) < 0) {
+			return -1;
+		}
+
+		pub->messagesSent++;
+		pub->datagramsSent += countDatagrams(length);
+		return 1;
+	}
+
+	if (reserve(pub, prefixLength + length) == -1) {
+		return -1;
+	}
+
+	/* Write the message before its length, so that a message that cannot
+	   be written leaves the batch untouched */
+	pos = pub->buffer + pub->length;
+	written = binary
+		? nanoPubSub__Message_writeViewBinary(&view, pos + prefixLength,
+			sizeof(pub->buffer) - pub->length - prefixLength)
+		: nanoPubSub__Message_writeViewString(&view, pos + prefixLength,
+			sizeof(pub->buffer) - pub->length - prefixLength);
+
+	if (written == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	nanoPubSub__Message_writeVarint((uint8_t*)pos, length);
+	pub->length += prefixLength + length;
+
+	return commit(pub);
+}
+
+
+/**
+ * Sends the pending batch, if any. A batch holding a single message is
+ * sent as that message, without the batch framing.
+ *
+ * @param pub The publisher to flush
+ *
+ * @return 1 on success. Otherwise, -1 is returned and the global variable
+ *         errno is set to indicate the error; the batch is dropped.
+ */
+int nanoPubSub__Batch_flush(nanoPubSub__Batch_publisher *pub)
+{
+	size_t pos = 1;
+	uint32_t length;
+	int retval;
+
+	if (pub->numMessages == 0) {
+		return 1;
+	}
+
+	/* A single message is all that follows its length */
+	if (pub->numMessages == 1) {
+		nanoPubSub__Message_readVarint((const uint8_t*)pub->buffer,
+			pub->length, &pos, &length);
+		retval = sendDatagram(pub, pub->buffer + pos, pub->length - pos);
+	} else {
+		retval = sendDatagram(pub, pub->buffer, pub->length);
+	}
+
+	if (retval == 1) {
+		pub->messagesSent += pub->numMessages;
+	}
+
+	pub->numMessages = 0;
+	pub->length      = 0;
+
+	return retval;
+}
+
+
+/**
+ * Sends the pending batch if its linger time has expired.
+ *
+ * @param pub The publisher to check
+ * @return The time until the pending batch's linger time expires (in
+ *         milliseconds), or -1 if no batch is pending
+ */
+int nanoPubSub__Batch_tick(nanoPubSub__Batch_publisher *pub)
+{
+	uint64_t elapsed;
+
+	if (pub->numMessages == 0) {
+		return -1;
+	}
+
+	elapsed = nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC)
+		- pub->startedMs;
+
+	if (elapsed >= pub->lingerMs) {
+		nanoPubSub__Batch_flush(pub);
+		return -1;
+	}
+
+	return pub->lingerMs - elapsed;
+}
+
+
+/**
+ * Reads the next message packed into a batch datagram.
+ *
+ * @param batch The messages of the batch, without the magic byte
+ * @param size The length of the messages (in bytes)
+ * @param pos Pointer to the position to read at, advanced past the message
+ * @param view Pointer to the view to write the message into; its length is
+ *             0 if the message is invalid
+ *
+ * @return 1 if a message was read, 0 at the end of the batch or if the
+ *         batch is truncated
+ */
+int nanoPubSub__Batch_next(const char *batch, size_t size, size_t *pos,
+		nanoPubSub__Message_view *view)
+{
+	uint32_t length;
+
+	if (*pos >= size
+			|| !nanoPubSub__Message_readVarint((const uint8_t*)batch, size,
+				pos, &length)
+			|| length == 0 || length > size - *pos) {
+		return 0;
+	}
+
+	nanoPubSub__Message_parseView(batch + *pos, length, view);
+	*pos += length;
+
+	return 1;
+}
@@ -0,0 +1,167 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "message.h"
+
+#ifndef __LIBNANOPUBSUB__BATCH_H
+#define __LIBNANOPUBSUB__BATCH_H
+
+
+/**
+ * The first byte of every datagram holding several packed messages. Like
+ * NANOPUBSUB__BINARY_MAGIC, it is rejected by text parsers.
+ */
+#define NANOPUBSUB__BATCH_MAGIC 0xA9
+
+
+/**
+ * A publisher that packs the messages sent to a single destination into as
+ * few datagrams as possible. A batch is sent once it holds at least the
+ * byte threshold, when the next message does not fit into it anymore, or
+ * when its first message has waited for the linger time.
+ *
+ * The publisher has no thread or timer of its own: the linger time is
+ * checked whenever a message is added and by nanoPubSub__Batch_tick,
+ * which should be called whenever the caller's event loop wakes up.
+ */
+typedef struct
+{
+	/** The socket batches are sent over */
+	int socket;
+
+	/** The address batches are sent to */
+	struct sockaddr_storage destAddr;
+
+	/** The time messages may wait for more to arrive (in milliseconds) */
+	unsigned int lingerMs;
+
+	/** The number of bytes at which a batch is sent right away */
+	size_t maxBytes;
+
+	/** The pending batch, starting with NANOPUBSUB__BATCH_MAGIC */
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+
+	/** The length of the pending batch (in bytes) */
+	size_t length;
+
+	/** The number of messages in the pending batch */
+	unsigned int numMessages;
+
+	/** The time the first message of the pending batch was added at */
+	uint64_t startedMs;
+
+	/** The number of messages sent so far */
+	unsigned long messagesSent;
+
+	/** The number of datagrams sent so far */
+	unsigned long datagramsSent;
+} nanoPubSub__Batch_publisher;
+
+
+/**
+ * Initializes a batching publisher.
+ *
+ * @param pub The publisher to initialize
+ * @param socket The socket to send batches over
+ * @param destAddr The address to send batches to
+ * @param lingerMs The time messages may wait for more to arrive (in
+ *                 milliseconds); 0 sends every message right away
+ * @param maxBytes The number of bytes at which a batch is sent right away,
+ *                 at most (and if 0) NANOPUBSUB__MAX_MESSAGE_LENGTH
+ */
+void nanoPubSub__Batch_initPublisher(nanoPubSub__Batch_publisher *pub,
+	int socket, const struct sockaddr *destAddr, unsigned int lingerMs,
+	size_t maxBytes);
+
+
+/**
+ * Adds a message string to the pending batch. Strings that do not fit
+ * into a batch are sent on their own (split into fragments if necessary)
+ * after the pending batch has been sent, so that the order is kept.
+ *
+ * @param pub The publisher to send the string with
+ * @param string The text or binary message string
+ * @param length The length of the string (in bytes)
+ *
+ * @return 1 on success. Otherwise, -1 is returned and the global variable
+ *         errno is set to indicate the error.
+ */
+int nanoPubSub__Batch_addString(nanoPubSub__Batch_publisher *pub,
+	const char *string, size_t length);
+
+
+/**
+ * Serializes a message right into the pending batch.
+ *
+ * @param pub The publisher to send the message with
+ * @param msg The message to send
+ * @param binary 1 to send the message's binary representation, 0 for text
+ *
+ * @return 1 on success. Otherwise, -1 is returned and the global variable
+ *         errno is set to indicate the error.
+ */
+int nanoPubSub__Batch_addMessage(nanoPubSub__Batch_publisher *pub,
+	const nanoPubSub__Message *msg, int binary);
+
+
+/**
+ * Sends the pending batch, if any. A batch holding a single message is
+ * sent as that message, without the batch framing.
+ *
+ * @param pub The publisher to flush
+ *
+ * @return 1 on success. Otherwise, -1 is returned and the global variable
+ *         errno is set to indicate the error; the batch is dropped.
+ */
+int nanoPubSub__Batch_flush(nanoPubSub__Batch_publisher *pub);
+
+
+/**
+ * Sends the pending batch if its linger time has expired.
+ *
+ * @param pub The publisher to check
+ * @return The time until the pending batch's linger time expires (in
+ *         milliseconds), or -1 if no batch is pending
+ */
+int nanoPubSub__Batch_tick(nanoPubSub__Batch_publisher *pub);
+
+
+/**
+ * Reads the next message packed into a batch datagram.
+ *
+ * @param batch The messages of the batch, without the magic byte
+ * @param size The length of the messages (in bytes)
+ * @param pos Pointer to the position to read at, advanced past the message
+ * @param view Pointer to the view to write the message into; its length is
+ *             0 if the message is invalid
+ *
+ * @return 1 if a message was read, 0 at the end of the batch or if the
+ *         batch is truncated
+ */
+int nanoPubSub__Batch_next(const char *batch, size_t size, size_t *pos,
+	nanoPubSub__Message_view *view);
+
+
+#endif /* __LIBNANOPUBSUB__BATCH_H */
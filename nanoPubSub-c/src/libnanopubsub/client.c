@@ -0,0 +1,609 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "client.h"
+
+
+/**
+ * Wakes up the event loop if it is waiting. The fence pairs with the one
+ * in runClient: either the event loop sees the queued request, or this
+ * thread sees the event loop waiting.
+ */
+static void wakeUp(nanoPubSub__Client *client)
+{
+	uint64_t one = 1;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&client->sleeping, __ATOMIC_RELAXED)
+			&& __atomic_exchange_n(&client->sleeping, 0, __ATOMIC_RELAXED)) {
+		if (write(client->wakefd, &one, sizeof(one)) == -1) {
+			/* The counter is already set, so the event loop wakes up */
+		}
+	}
+}
+
+
+/**
+ * Checks that a string can be sent in a text message field.
+ *
+ * @return 1 if the string does not contain '#', 0 otherwise
+ */
+static int isValidField(const char *string, size_t length)
+{
+	return memchr(string, '#', length) == NULL;
+}
+
+
+/**
+ * Writes a message into a request and queues the request for the event
+ * loop. The message string follows the fixed part right away, as its
+ * alignment is 1. The message is described by a view, as the lengths of
+ * all of its fields are known.
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the message
+ *         cannot be sent as text or is longer than
+ *         NANOPUBSUB__MAX_MESSAGE_LENGTH
+ */
+static int enqueue(nanoPubSub__Client *client,
+		const nanoPubSub__Message_view *view,
+		nanoPubSub__Client_callback callback, void *arg)
+{
+	struct
+	{
+		nanoPubSub__Client_request request;
+		char frame[NANOPUBSUB__MAX_MESSAGE_LENGTH + 1];
+	} entry;
+	size_t length;
+	int result;
+
+	length = nanoPubSub__Message_writeViewString(view, entry.frame,
+		NANOPUBSUB__MAX_MESSAGE_LENGTH);
+	if (length == 0) {
+		return -1;
+	}
+
+	entry.request.type     = view->type;
+	entry.request.callback = callback;
+	entry.request.arg      = arg;
+
+	result = nanoPubSub__Queue_push(&client->sendQueue, &entry,
+		sizeof(entry.request) + length);
+
+	if (result == 1) {
+		wakeUp(client);
+	}
+
+	return result;
+}
+
+
+/**
+ * Adds a subscription, or replaces the callback of an existing one.
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+static int addSubscription(nanoPubSub__Client *client,
+		const nanoPubSub__Message_slice *filter,
+		const nanoPubSub__Client_request *request)
+{
+	nanoPubSub__Client_subscription *subscription;
+	void *replaced;
+
+	if ((subscription = malloc(sizeof(*subscription))) == NULL) {
+		return 0;
+	}
+
+	subscription->callback = request->callback;
+	subscription->arg      = request->arg;
+
+	if (!nanoPubSub__Filter_add(&client->subscriptions, filter,
+			subscription, &replaced)) {
+		free(subscription);
+		return 0;
+	}
+
+	free(replaced);
+
+	return 1;
+}
+
+
+/**
+ * Removes the subscription to a filter, if there is one.
+ */
+static void removeSubscription(nanoPubSub__Client *client,
+		const nanoPubSub__Message_slice *filter)
+{
+	void *subscription;
+
+	if (nanoPubSub__Filter_remove(&client->subscriptions, filter,
+			&subscription)) {
+		free(subscription);
+	}
+}
+
+
+/**
+ * Sends the requests in the send queue. Subscriptions are added before
+ * their subscribe message is sent, so that no matching message is missed,
+ * and removed before their unsubscribe message is.
+ */
+static void sendRequests(nanoPubSub__Client *client)
+{
+	nanoPubSub__Client_request request;
+	nanoPubSub__Message_view view;
+	const char *entry, *frame;
+	size_t length;
+	int sent;
+
+	while ((entry = nanoPubSub__Queue_front(&client->sendQueue, &length))
+			!= NULL) {
+		memcpy(&request, entry, sizeof(request));
+		frame   = entry + sizeof(request);
+		length -= sizeof(request);
+		sent    = 1;
+
+		if (request.type == NANOPUBSUB__SUBSCRIBE_MESSAGE
+				|| request.type == NANOPUBSUB__UNSUBSCRIBE_MESSAGE) {
+			nanoPubSub__Message_parseView(frame, length, &view);
+
+			if (request.type == NANOPUBSUB__UNSUBSCRIBE_MESSAGE) {
+				removeSubscription(client, &view.topic);
+			} else if (!addSubscription(client, &view.topic, &request)) {
+				sent = 0;
+			}
+		}
+
+		if (sent && send(client->socket, frame, length, 0) != -1) {
+			nanoPubSub__Metrics_count(&client->metrics,
+				NANOPUBSUB__METRIC_SENT, 1);
+			nanoPubSub__Metrics_count(&client->metrics,
+				NANOPUBSUB__METRIC_BYTES_SENT, length);
+		} else {
+			nanoPubSub__Metrics_count(&client->metrics,
+				NANOPUBSUB__METRIC_DROPPED, 1);
+		}
+
+		nanoPubSub__Queue_pop(&client->sendQueue);
+	}
+}
+
+
+/**
+ * Calls the callback of a subscription matching a received message.
+ * Called by nanoPubSub__Filter_match.
+ */
+static void callSubscription(void *value, void *arg)
+{
+	const nanoPubSub__Client_subscription *subscription = value;
+
+	subscription->callback((const nanoPubSub__Message_view*)arg,
+		subscription->arg);
+}
+
+
+/**
+ * Passes a received message to the callbacks of all subscriptions it
+ * matches. Pings are answered, so the broker knows the client is still
+ * alive.
+ */
+static void dispatch(nanoPubSub__Client *client, unsigned int slot)
+{
+	const nanoPubSub__Message_view *view = &client->ring.views[slot];
+
+	if (view->length == 0) {
+		return;
+	}
+
+	if (view->type == NANOPUBSUB__PING_MESSAGE) {
+		nanoPubSub__Network_sendPong(client->socket,
+			(const struct sockaddr*)&client->ring.addrs[slot], view);
+		return;
+	}
+
+	if (view->type != NANOPUBSUB__STANDARD_MESSAGE
+			|| view->topic.data == NULL) {
+		return;
+	}
+
+	/* A callback may subscribe or unsubscribe, which only takes effect
+	   once the event loop sends the request */
+	nanoPubSub__Filter_match(&client->subscriptions, &view->topic,
+		callSubscription, (void*)view);
+}
+
+
+/**
+ * Receives messages in batches and dispatches them until the socket has
+ * no more datagrams.
+ */
+static void receiveMessages(nanoPubSub__Client *client)
+{
+	unsigned int first;
+	int i, received;
+
+	for (;;) {
+		received = nanoPubSub__Network_recvBatch(client->socket,
+			&client->ring, NANOPUBSUB__CLIENT_RECV_BATCH, MSG_DONTWAIT,
+			&first);
+
+		if (received == -1 && errno == EINTR) {
+			continue;
+		}
+
+		if (received <= 0) {
+			break;
+		}
+
+		for (i = 0; i < received; i++) {
+			do {
+				dispatch(client, first + i);
+			} while (nanoPubSub__Network_unpackNext(&client->ring,
+				first + i));
+		}
+	}
+}
+
+
+/**
+ * Runs the event loop of a client: sends queued requests and dispatches
+ * received messages until the client is stopped, then sends the requests
+ * still queued.
+ */
+static void *runClient(void *arg)
+{
+	nanoPubSub__Client *client = arg;
+	struct pollfd fds[2];
+	uint64_t count;
+	size_t length;
+
+	fds[0].fd     = client->socket;
+	fds[0].events = POLLIN;
+	fds[1].fd     = client->wakefd;
+	fds[1].events = POLLIN;
+
+	while (!__atomic_load_n(&client->stopping, __ATOMIC_ACQUIRE)) {
+		sendRequests(client);
+		receiveMessages(client);
+
+		/* Announce the wait before checking the queue a last time, so that
+		   producers either see the announcement or their request is seen
+		   here */
+		__atomic_store_n(&client->sleeping, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		fds[1].revents = 0;
+		if (nanoPubSub__Queue_front(&client->sendQueue, &length) == NULL
+				&& !__atomic_load_n(&client->stopping, __ATOMIC_ACQUIRE)) {
+			poll(fds, 2, -1);
+		}
+
+		__atomic_store_n(&client->sleeping, 0, __ATOMIC_RELAXED);
+
+		if (fds[1].revents & POLLIN) {
+			if (read(client->wakefd, &count, sizeof(count)) == -1) {
+				/* The counter has already been reset */
+			}
+		}
+	}
+
+	sendRequests(client);
+
+	return NULL;
+}
+
+
+/**
+ * Resolves a host name and opens a socket connected to the host, bound
+ * to the port the broker sends published messages to.
+ *
+ * @return The socket, or -1 on error
+ */
+static int openSocket(nanoPubSub__Client *client, const char *host,
+		unsigned short port, unsigned short clientPort)
+{
+	struct addrinfo hints, *result;
+	struct sockaddr_in addr;
+	int socketfd, error;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(&client->brokerAddr, result->ai_addr, sizeof(client->brokerAddr));
+	client->brokerAddr.sin_port = htons(port);
+	freeaddrinfo(result);
+
+	if ((socketfd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+		return -1;
+	}
+
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(clientPort);
+	addr.sin_addr.s_addr = INADDR_ANY;
+	memset(addr.sin_zero, '\0', sizeof(addr.sin_zero));
+
+	if (bind(socketfd, (struct sockaddr*)&addr, sizeof(addr)) == -1
+			|| connect(socketfd, (struct sockaddr*)&client->brokerAddr,
+				sizeof(client->brokerAddr)) == -1) {
+		error = errno;
+		close(socketfd);
+		errno = error;
+		return -1;
+	}
+
+	return socketfd;
+}
+
+
+/**
+ * Resolves the broker's host name, opens the client's socket and starts
+ * the event loop.
+ *
+ * @param client The client to start
+ * @param clientId The id to send messages with (must not contain '#')
+ * @param host The broker's host name or address
+ * @param port The broker's UDP port
+ * @param clientPort The UDP port the broker sends published messages to
+ *
+ * @return 1 on success. Otherwise, 0 is returned and the global variable
+ *         errno is set to indicate the error (EINVAL if the client id is
+ *         invalid or the host name cannot be resolved).
+ */
+int nanoPubSub__Client_start(nanoPubSub__Client *client,
+		const char *clientId, const char *host, unsigned short port,
+		unsigned short clientPort)
+{
+	size_t length = strlen(clientId);
+	int error;
+
+	memset(client, 0, sizeof(*client));
+	client->socket = -1;
+	client->wakefd = -1;
+	nanoPubSub__Metrics_init(&client->metrics);
+
+	if (length == 0 || !isValidField(clientId, length)) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	if ((client->clientId = malloc(length + 1)) == NULL) {
+		errno = ENOMEM;
+		goto error;
+	}
+	memcpy(client->clientId, clientId, length + 1);
+	client->clientIdLength = length;
+
+	if ((client->socket = openSocket(client, host, port, clientPort)) == -1
+			|| (client->wakefd = eventfd(0, EFD_NONBLOCK)) == -1) {
+		goto error;
+	}
+
+	if (!nanoPubSub__Queue_init(&client->sendQueue,
+				NANOPUBSUB__CLIENT_QUEUE_SLOTS,
+				sizeof(nanoPubSub__Client_request)
+					+ NANOPUBSUB__MAX_MESSAGE_LENGTH,
+				NANOPUBSUB__QUEUE_MPSC)
+			|| (client->buffers = malloc(NANOPUBSUB__CLIENT_RECV_BATCH
+				* NANOPUBSUB__MAX_MESSAGE_LENGTH)) == NULL
+			|| !nanoPubSub__Network_initRecvRing(&client->ring,
+				client->buffers, NANOPUBSUB__MAX_MESSAGE_LENGTH,
+				NANOPUBSUB__CLIENT_RECV_BATCH)
+			|| !nanoPubSub__Fragment_initPool(&client->fragments,
+				NANOPUBSUB__CLIENT_FRAGMENT_SLOTS,
+				NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH,
+				NANOPUBSUB__CLIENT_FRAGMENT_TIMEOUT)
+			|| !nanoPubSub__Filter_init(&client->subscriptions,
+				NANOPUBSUB__CLIENT_FILTER_BUCKETS)) {
+		errno = ENOMEM;
+		goto error;
+	}
+
+	client->ring.fragments = &client->fragments;
+	client->ring.metrics   = &client->metrics;
+
+	if ((error = pthread_create(&client->thread, NULL, runClient, client))
+			!= 0) {
+		errno = error;
+		goto error;
+	}
+
+	client->started = 1;
+
+	return 1;
+
+error:
+	error = errno;
+	nanoPubSub__Client_wait(client);
+	errno = error;
+
+	return 0;
+}
+
+
+/**
+ * Queues a message to be published without blocking.
+ *
+ * @param client The client
+ * @param topic The message's topic (must not contain '#')
+ * @param body The message's body (must not contain '#')
+ * @param length The length of the body (in bytes), or 0 if the body is a
+ *               Null-terminated string
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the message is
+ *         invalid or longer than NANOPUBSUB__MAX_MESSAGE_LENGTH
+ */
+int nanoPubSub__Client_publish(nanoPubSub__Client *client,
+		const char *topic, const char *body, size_t length)
+{
+	nanoPubSub__Message_view view;
+
+	if (length == 0) {
+		length = strlen(body);
+	}
+
+	memset(&view, 0, sizeof(view));
+	view.type            = NANOPUBSUB__STANDARD_MESSAGE;
+	view.clientId.data   = client->clientId;
+	view.clientId.length = client->clientIdLength;
+	view.topic.data      = topic;
+	view.topic.length    = strlen(topic);
+	view.body.data       = body;
+	view.body.length     = length;
+
+	if (!isValidField(topic, view.topic.length)
+			|| !isValidField(body, length)) {
+		return -1;
+	}
+
+	return enqueue(client, &view, NULL, NULL);
+}
+
+
+/**
+ * Queues a subscription without blocking. Once the event loop has sent
+ * it, the callback is called for every published message matching the
+ * filter. Subscribing to the same filter again replaces its callback.
+ *
+ * @param client The client
+ * @param filter The filter (see nanoPubSub__Topic_isValidFilter)
+ * @param callback The function handling matching messages
+ * @param arg An argument passed to the callback
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the filter is
+ *         invalid
+ */
+int nanoPubSub__Client_subscribe(nanoPubSub__Client *client,
+		const char *filter, nanoPubSub__Client_callback callback, void *arg)
+{
+	nanoPubSub__Message_view view;
+
+	memset(&view, 0, sizeof(view));
+	view.type            = NANOPUBSUB__SUBSCRIBE_MESSAGE;
+	view.clientId.data   = client->clientId;
+	view.clientId.length = client->clientIdLength;
+	view.topic.data      = filter;
+	view.topic.length    = strlen(filter);
+
+	if (!isValidField(filter, view.topic.length)
+			|| !nanoPubSub__Topic_isValidFilter(&view.topic)) {
+		return -1;
+	}
+
+	return enqueue(client, &view, callback, arg);
+}
+
+
+/**
+ * Queues the removal of a subscription without blocking.
+ *
+ * @param client The client
+ * @param filter The filter that has been subscribed to
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the filter is
+ *         invalid
+ */
+int nanoPubSub__Client_unsubscribe(nanoPubSub__Client *client,
+		const char *filter)
+{
+	nanoPubSub__Message_view view;
+
+	memset(&view, 0, sizeof(view));
+	view.type            = NANOPUBSUB__UNSUBSCRIBE_MESSAGE;
+	view.clientId.data   = client->clientId;
+	view.clientId.length = client->clientIdLength;
+	view.topic.data      = filter;
+	view.topic.length    = strlen(filter);
+
+	if (!isValidField(filter, view.topic.length)) {
+		return -1;
+	}
+
+	return enqueue(client, &view, NULL, NULL);
+}
+
+
+/**
+ * Makes the event loop of a client stop. Messages still queued are sent
+ * first. This function is async-signal-safe.
+ *
+ * @param client The client to stop
+ */
+void nanoPubSub__Client_stop(nanoPubSub__Client *client)
+{
+	uint64_t one = 1;
+
+	__atomic_store_n(&client->stopping, 1, __ATOMIC_RELEASE);
+
+	if (client->wakefd != -1
+			&& write(client->wakefd, &one, sizeof(one)) == -1) {
+		/* The counter is already set, so the event loop wakes up */
+	}
+}
+
+
+/**
+ * Waits for the event loop of a client to stop and frees the client's
+ * resources.
+ *
+ * @param client The client to wait for
+ */
+void nanoPubSub__Client_wait(nanoPubSub__Client *client)
+{
+	nanoPubSub__Filter_entry *entry;
+	size_t i;
+
+	if (client->started) {
+		pthread_join(client->thread, NULL);
+		client->started = 0;
+	}
+
+	if (client->socket != -1) {
+		close(client->socket);
+		client->socket = -1;
+	}
+
+	if (client->wakefd != -1) {
+		close(client->wakefd);
+		client->wakefd = -1;
+	}
+
+	/* The filter set leaves the subscriptions to their owner */
+	for (i = 0; i < client->subscriptions.numBuckets; i++) {
+		for (entry = client->subscriptions.buckets[i]; entry != NULL;
+				entry = entry->next) {
+			free(entry->value);
+		}
+	}
+
+	nanoPubSub__Filter_destroy(&client->subscriptions);
+	nanoPubSub__Queue_free(&client->sendQueue);
+	nanoPubSub__Network_freeRecvRing(&client->ring);
+	nanoPubSub__Fragment_freePool(&client->fragments);
+	free(client->buffers);
+	free(client->clientId);
+
+	client->buffers          = NULL;
+	client->clientId         = NULL;
+	client->clientIdLength   = 0;
+}
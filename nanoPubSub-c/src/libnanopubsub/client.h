@@ -0,0 +1,249 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "message.h"
+#include "network.h"
+#include "fragment.h"
+#include "topic.h"
+#include "filter.h"
+#include "queue.h"
+#include "metrics.h"
+
+#ifndef __LIBNANOPUBSUB__CLIENT_H
+#define __LIBNANOPUBSUB__CLIENT_H
+
+
+/** The number of requests that can be queued for the event loop */
+#define NANOPUBSUB__CLIENT_QUEUE_SLOTS 1024
+
+/** The max. number of messages the event loop receives with one call */
+#define NANOPUBSUB__CLIENT_RECV_BATCH 32
+
+/** The max. number of messages the event loop reassembles at a time */
+#define NANOPUBSUB__CLIENT_FRAGMENT_SLOTS 4
+
+/** The time after which incomplete messages are dropped (in milliseconds) */
+#define NANOPUBSUB__CLIENT_FRAGMENT_TIMEOUT 2000
+
+/** The number of hash buckets the subscriptions start with */
+#define NANOPUBSUB__CLIENT_FILTER_BUCKETS 16
+
+
+/**
+ * Called by the event loop for every published message whose topic
+ * matches a filter the callback has been subscribed with.
+ *
+ * @param view The received message, valid until the callback returns
+ * @param arg The argument passed to nanoPubSub__Client_subscribe
+ */
+typedef void (*nanoPubSub__Client_callback)(
+	const nanoPubSub__Message_view *view, void *arg);
+
+
+/**
+ * The callback handling the messages matching a filter a client has
+ * subscribed to.
+ */
+typedef struct
+{
+	/** The function handling matching messages */
+	nanoPubSub__Client_callback callback;
+
+	/** The argument passed to the callback */
+	void *arg;
+} nanoPubSub__Client_subscription;
+
+
+/**
+ * The fixed part of a request in the send queue. The message string to
+ * send follows right after it.
+ */
+typedef struct
+{
+	/** The type of the message following the request */
+	uint8_t type;
+
+	/** The callback of a subscribe message */
+	nanoPubSub__Client_callback callback;
+
+	/** The argument passed to the callback */
+	void *arg;
+} nanoPubSub__Client_request;
+
+
+/**
+ * A client connected to a broker, like the Java NanoPubSubClient. The
+ * client keeps one socket, which is connected to the broker's address
+ * resolved once at the start, for everything it sends and receives.
+ *
+ * A thread of its own runs the client's event loop. Publishing,
+ * subscribing and unsubscribing only copy the message into a lock-free
+ * queue and never block; the event loop sends the queued messages,
+ * answers the broker's pings and passes published messages to the
+ * callbacks of the matching subscriptions. The subscriptions are owned by
+ * the event loop, so callbacks run without any locks held and may publish
+ * or subscribe themselves.
+ */
+typedef struct
+{
+	/** The id the client's messages are sent with */
+	char *clientId;
+
+	/** The length of the client id (in bytes) */
+	size_t clientIdLength;
+
+	/** The socket connected to the broker */
+	int socket;
+
+	/** The broker's address */
+	struct sockaddr_in brokerAddr;
+
+	/** The eventfd waking up the event loop */
+	int wakefd;
+
+	/** The messages waiting to be sent by the event loop */
+	nanoPubSub__Queue sendQueue;
+
+	/** Set while the event loop is waiting, cleared by the first wake-up */
+	int sleeping;
+
+	/** The event loop's thread */
+	pthread_t thread;
+
+	/** 1 once the thread has been started */
+	int started;
+
+	/** Set to make the event loop stop */
+	int stopping;
+
+	/** The buffers messages are received into */
+	char *buffers;
+
+	/** The receive ring set up over the buffers */
+	nanoPubSub__Network_recvRing ring;
+
+	/** The pool fragmented messages are reassembled in */
+	nanoPubSub__Fragment_pool fragments;
+
+	/**
+	 * The filters subscribed to, with a nanoPubSub__Client_subscription
+	 * allocated on the heap as their value. Only used by the event loop.
+	 */
+	nanoPubSub__Filter subscriptions;
+
+	/** The messages and bytes the client sent and received */
+	nanoPubSub__Metrics metrics;
+} nanoPubSub__Client;
+
+
+/**
+ * Resolves the broker's host name, opens the client's socket and starts
+ * the event loop.
+ *
+ * @param client The client to start
+ * @param clientId The id to send messages with (must not contain '#')
+ * @param host The broker's host name or address
+ * @param port The broker's UDP port
+ * @param clientPort The UDP port the broker sends published messages to
+ *
+ * @return 1 on success. Otherwise, 0 is returned and the global variable
+ *         errno is set to indicate the error (EINVAL if the client id is
+ *         invalid or the host name cannot be resolved).
+ */
+int nanoPubSub__Client_start(nanoPubSub__Client *client,
+	const char *clientId, const char *host, unsigned short port,
+	unsigned short clientPort);
+
+
+/**
+ * Queues a message to be published without blocking.
+ *
+ * @param client The client
+ * @param topic The message's topic (must not contain '#')
+ * @param body The message's body (must not contain '#')
+ * @param length The length of the body (in bytes), or 0 if the body is a
+ *               Null-terminated string
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the message is
+ *         invalid or longer than NANOPUBSUB__MAX_MESSAGE_LENGTH
+ */
+int nanoPubSub__Client_publish(nanoPubSub__Client *client,
+	const char *topic, const char *body, size_t length);
+
+
+/**
+ * Queues a subscription without blocking. Once the event loop has sent
+ * it, the callback is called for every published message matching the
+ * filter. Subscribing to the same filter again replaces its callback.
+ *
+ * @param client The client
+ * @param filter The filter (see nanoPubSub__Topic_isValidFilter)
+ * @param callback The function handling matching messages
+ * @param arg An argument passed to the callback
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the filter is
+ *         invalid
+ */
+int nanoPubSub__Client_subscribe(nanoPubSub__Client *client,
+	const char *filter, nanoPubSub__Client_callback callback, void *arg);
+
+
+/**
+ * Queues the removal of a subscription without blocking.
+ *
+ * @param client The client
+ * @param filter The filter that has been subscribed to
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the filter is
+ *         invalid
+ */
+int nanoPubSub__Client_unsubscribe(nanoPubSub__Client *client,
+	const char *filter);
+
+
+/**
+ * Makes the event loop of a client stop. Messages still queued are sent
+ * first. This function is async-signal-safe.
+ *
+ * @param client The client to stop
+ */
+void nanoPubSub__Client_stop(nanoPubSub__Client *client);
+
+
+/**
+ * Waits for the event loop of a client to stop and frees the client's
+ * resources.
+ *
+ * @param client The client to wait for
+ */
+void nanoPubSub__Client_wait(nanoPubSub__Client *client);
+
+
+#endif /* __LIBNANOPUBSUB__CLIENT_H */
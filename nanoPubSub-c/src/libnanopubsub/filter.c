@@ -0,0 +1,393 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "filter.h"
+#include "util.h"
+
+
+/**
+ * The arguments of visitEntries: the visitor passed to
+ * nanoPubSub__Filter_match and its argument.
+ */
+typedef struct
+{
+	nanoPubSub__Filter_visitor visitor;
+	void *arg;
+} visitContext;
+
+
+/**
+ * Checks whether a valid filter contains wildcards. Wildcards always make
+ * up a whole level, so looking for the characters is enough.
+ */
+static inline int hasWildcard(const nanoPubSub__Message_slice *topicFilter)
+{
+	return memchr(topicFilter->data, NANOPUBSUB__TOPIC_SINGLE_LEVEL,
+			topicFilter->length) != NULL
+		|| memchr(topicFilter->data, NANOPUBSUB__TOPIC_MULTI_LEVEL,
+			topicFilter->length) != NULL;
+}
+
+
+/**
+ * Finds the link pointing to the entry of a filter. Strings are only
+ * compared if their hashes are equal.
+ *
+ * @return The link, pointing to NULL if the filter is not in the set
+ */
+static nanoPubSub__Filter_entry **findEntry(const nanoPubSub__Filter *filter,
+		const char *string, size_t length, uint32_t hash)
+{
+	nanoPubSub__Filter_entry **link =
+		&filter->buckets[hash & (filter->numBuckets - 1)];
+
+	while (*link != NULL && ((*link)->hash != hash
+			|| (*link)->filter.length != length
+			|| memcmp((*link)->filter.data, string, length) != 0)) {
+		link = &(*link)->next;
+	}
+
+	return link;
+}
+
+
+/**
+ * Doubles the number of hash buckets and rehashes all entries.
+ */
+static int growBuckets(nanoPubSub__Filter *filter)
+{
+	size_t numBuckets = filter->numBuckets * 2;
+	nanoPubSub__Filter_entry **buckets, *entry, *next;
+	size_t i;
+
+	if ((buckets = calloc(numBuckets, sizeof(*buckets))) == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < filter->numBuckets; i++) {
+		for (entry = filter->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			entry->next = buckets[entry->hash & (numBuckets - 1)];
+			buckets[entry->hash & (numBuckets - 1)] = entry;
+		}
+	}
+
+	free(filter->buckets);
+	filter->buckets    = buckets;
+	filter->numBuckets = numBuckets;
+
+	return 1;
+}
+
+
+/**
+ * Frees an entry and the copy of its filter.
+ */
+static void freeEntry(nanoPubSub__Filter_entry *entry)
+{
+	free((char*)entry->filter.data);
+	free(entry);
+}
+
+
+/**
+ * Passes the values of the entries of a matching wildcard filter to the
+ * visitor given to nanoPubSub__Filter_match. Called by
+ * nanoPubSub__Topic_match.
+ */
+static void visitEntries(void *const *subscribers, size_t numSubscribers,
+		void *arg)
+{
+	const visitContext *context = arg;
+	size_t i;
+
+	if (context->visitor == NULL) {
+		return;
+	}
+
+	for (i = 0; i < numSubscribers; i++) {
+		context->visitor(((nanoPubSub__Filter_entry*)subscribers[i])->value,
+			context->arg);
+	}
+}
+
+
+/**
+ * Finds the entry of a filter without wildcards that equals a topic.
+ *
+ * @return The entry, or NULL if there is none
+ */
+static const nanoPubSub__Filter_entry *findTopic(
+		const nanoPubSub__Filter *filter,
+		const nanoPubSub__Message_slice *topic)
+{
+	const nanoPubSub__Filter_entry *entry;
+
+	if (filter->numEntries == filter->numWildcards) {
+		return NULL;
+	}
+
+	entry = *findEntry(filter, topic->data, topic->length,
+		nanoPubSub__Util_hash(topic->data, topic->length));
+
+	/* A topic equal to a wildcard filter is matched by the trie */
+	return entry != NULL && !entry->wildcard ? entry : NULL;
+}
+
+
+/**
+ * Initializes an empty filter set.
+ *
+ * @param filter The filter set to initialize
+ * @param numBuckets The initial number of hash buckets (a power of two)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Filter_init(nanoPubSub__Filter *filter, size_t numBuckets)
+{
+	assert(numBuckets > 0 && (numBuckets & (numBuckets - 1)) == 0);
+
+	memset(filter, 0, sizeof(*filter));
+
+	if ((filter->buckets = calloc(numBuckets, sizeof(*filter->buckets)))
+			== NULL) {
+		return 0;
+	}
+
+	if (!nanoPubSub__Topic_init(&filter->wildcards, numBuckets)) {
+		free(filter->buckets);
+		filter->buckets = NULL;
+		return 0;
+	}
+
+	filter->numBuckets = numBuckets;
+
+	return 1;
+}
+
+
+/**
+ * Frees all memory owned by a filter set. The values are left untouched.
+ *
+ * @param filter The filter set to destroy
+ */
+void nanoPubSub__Filter_destroy(nanoPubSub__Filter *filter)
+{
+	nanoPubSub__Filter_entry *entry, *next;
+	size_t i;
+
+	for (i = 0; i < filter->numBuckets; i++) {
+		for (entry = filter->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			freeEntry(entry);
+		}
+	}
+
+	nanoPubSub__Topic_destroy(&filter->wildcards);
+	free(filter->buckets);
+	memset(filter, 0, sizeof(*filter));
+}
+
+
+/**
+ * Adds a subscription filter to a set. Adding a filter that is in the set
+ * already replaces its value.
+ *
+ * @param filter The filter set to modify
+ * @param topicFilter The filter (see nanoPubSub__Topic_isValidFilter),
+ *                    which is copied
+ * @param value The value passed to the visitor for matching topics
+ * @param oldValue Pointer to store the replaced value in (NULL if the
+ *                 filter is new), or NULL
+ *
+ * @return 1 on success, 0 if the filter is invalid or no memory could be
+ *         allocated
+ */
+int nanoPubSub__Filter_add(nanoPubSub__Filter *filter,
+		const nanoPubSub__Message_slice *topicFilter, void *value,
+		void **oldValue)
+{
+	uint32_t hash = nanoPubSub__Util_hash(topicFilter->data,
+		topicFilter->length);
+	nanoPubSub__Filter_entry **link, *entry;
+	char *copy;
+
+	if (oldValue != NULL) {
+		*oldValue = NULL;
+	}
+
+	if (!nanoPubSub__Topic_isValidFilter(topicFilter)) {
+		return 0;
+	}
+
+	link = findEntry(filter, topicFilter->data, topicFilter->length, hash);
+	if (*link != NULL) {
+		if (oldValue != NULL) {
+			*oldValue = (*link)->value;
+		}
+		(*link)->value = value;
+		return 1;
+	}
+
+	if (filter->numEntries >= filter->numBuckets) {
+		if (!growBuckets(filter)) {
+			return 0;
+		}
+		link = findEntry(filter, topicFilter->data, topicFilter->length,
+			hash);
+	}
+
+	if ((entry = calloc(1, sizeof(*entry))) == NULL) {
+		return 0;
+	}
+
+	if ((copy = malloc(topicFilter->length + 1)) == NULL) {
+		free(entry);
+		return 0;
+	}
+
+	memcpy(copy, topicFilter->data, topicFilter->length);
+	copy[topicFilter->length] = '\0';
+
+	entry->filter.data   = copy;
+	entry->filter.length = topicFilter->length;
+	entry->hash          = hash;
+	entry->wildcard      = hasWildcard(topicFilter);
+	entry->value         = value;
+
+	/* The trie's subscribers are the entries, so that replacing a value
+	   leaves the trie untouched */
+	if (entry->wildcard && !nanoPubSub__Topic_subscribe(&filter->wildcards,
+			&entry->filter, entry)) {
+		freeEntry(entry);
+		return 0;
+	}
+
+	*link = entry;
+	filter->numEntries++;
+	filter->numWildcards += entry->wildcard;
+
+	return 1;
+}
+
+
+/**
+ * Removes a subscription filter from a set.
+ *
+ * @param filter The filter set to modify
+ * @param topicFilter The filter
+ * @param value Pointer to store the filter's value in, or NULL
+ *
+ * @return 1 if the filter was removed, 0 if it was not in the set
+ */
+int nanoPubSub__Filter_remove(nanoPubSub__Filter *filter,
+		const nanoPubSub__Message_slice *topicFilter, void **value)
+{
+	nanoPubSub__Filter_entry **link, *entry;
+
+	link = findEntry(filter, topicFilter->data, topicFilter->length,
+		nanoPubSub__Util_hash(topicFilter->data, topicFilter->length));
+
+	if ((entry = *link) == NULL) {
+		return 0;
+	}
+
+	if (entry->wildcard) {
+		nanoPubSub__Topic_unsubscribe(&filter->wildcards, &entry->filter,
+			entry);
+		filter->numWildcards--;
+	}
+
+	if (value != NULL) {
+		*value = entry->value;
+	}
+
+	*link = entry->next;
+	filter->numEntries--;
+	freeEntry(entry);
+
+	return 1;
+}
+
+
+/**
+ * Finds all filters of a set matching a topic, following the rules of
+ * nanoPubSub__Topic_match, and passes their values to a visitor.
+ *
+ * @param filter The filter set to search
+ * @param topic The topic of a received message
+ * @param visitor The function to call for every matching filter, or NULL
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching filters
+ */
+size_t nanoPubSub__Filter_match(const nanoPubSub__Filter *filter,
+		const nanoPubSub__Message_slice *topic,
+		nanoPubSub__Filter_visitor visitor, void *arg)
+{
+	const nanoPubSub__Filter_entry *entry = findTopic(filter, topic);
+	visitContext context;
+	size_t numMatches = 0;
+
+	if (entry != NULL) {
+		if (visitor != NULL) {
+			visitor(entry->value, arg);
+		}
+		numMatches++;
+	}
+
+	if (filter->numWildcards > 0) {
+		context.visitor = visitor;
+		context.arg     = arg;
+		numMatches += nanoPubSub__Topic_match(&filter->wildcards, topic,
+			visitEntries, &context);
+	}
+
+	return numMatches;
+}
+
+
+/**
+ * Checks whether a received message's topic matches any filter of a set.
+ * The trie of filters with wildcards is only searched if no filter
+ * without wildcards matches.
+ *
+ * @param filter The filter set to search
+ * @param topic The topic of a received message
+ *
+ * @return 1 if the topic matches a filter, 0 otherwise
+ */
+int nanoPubSub__Filter_matches(const nanoPubSub__Filter *filter,
+		const nanoPubSub__Message_slice *topic)
+{
+	visitContext context;
+
+	if (findTopic(filter, topic) != NULL) {
+		return 1;
+	}
+
+	if (filter->numWildcards == 0) {
+		return 0;
+	}
+
+	context.visitor = NULL;
+	context.arg     = NULL;
+
+	return nanoPubSub__Topic_match(&filter->wildcards, topic, visitEntries,
+		&context) > 0;
+}
@@ -0,0 +1,171 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "message.h"
+#include "topic.h"
+
+#ifndef __LIBNANOPUBSUB__FILTER_H
+#define __LIBNANOPUBSUB__FILTER_H
+
+
+/**
+ * A subscription filter kept in a local filter set, together with the
+ * value it was added with.
+ */
+typedef struct nanoPubSub__Filter_entry
+{
+	/** The filter (a Null-terminated copy owned by the entry) */
+	nanoPubSub__Message_slice filter;
+
+	/** The FNV-1a hash of the filter */
+	uint32_t hash;
+
+	/** 1 if the filter contains wildcards and is kept in the trie */
+	int wildcard;
+
+	/** The value passed to the visitor for matching topics */
+	void *value;
+
+	/** The next entry in the same hash bucket */
+	struct nanoPubSub__Filter_entry *next;
+} nanoPubSub__Filter_entry;
+
+
+/**
+ * A set of subscription filters that received messages are matched
+ * against on the subscriber's side, right after parsing. All filters are
+ * kept in a chained hash table keyed by the whole filter, so a topic
+ * subscribed to without wildcards is found by hashing the topic once.
+ * Filters with wildcards are indexed by their levels in a topic trie in
+ * addition, which is only searched if there are any.
+ */
+typedef struct
+{
+	/** The hash table of all entries */
+	nanoPubSub__Filter_entry **buckets;
+
+	/** The number of hash buckets (a power of two) */
+	size_t numBuckets;
+
+	/** The number of entries */
+	size_t numEntries;
+
+	/** The trie holding the entries of filters with wildcards */
+	nanoPubSub__Topic_trie wildcards;
+
+	/** The number of filters with wildcards */
+	size_t numWildcards;
+} nanoPubSub__Filter;
+
+
+/**
+ * Called by nanoPubSub__Filter_match for every filter matching a topic.
+ *
+ * @param value The value the filter was added with
+ * @param arg The argument passed to nanoPubSub__Filter_match
+ */
+typedef void (*nanoPubSub__Filter_visitor)(void *value, void *arg);
+
+
+/**
+ * Initializes an empty filter set.
+ *
+ * @param filter The filter set to initialize
+ * @param numBuckets The initial number of hash buckets (a power of two)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Filter_init(nanoPubSub__Filter *filter, size_t numBuckets);
+
+
+/**
+ * Frees all memory owned by a filter set. The values are left untouched.
+ *
+ * @param filter The filter set to destroy
+ */
+void nanoPubSub__Filter_destroy(nanoPubSub__Filter *filter);
+
+
+/**
+ * Adds a subscription filter to a set. Adding a filter that is in the set
+ * already replaces its value.
+ *
+ * @param filter The filter set to modify
+ * @param topicFilter The filter (see nanoPubSub__Topic_isValidFilter),
+ *                    which is copied
+ * @param value The value passed to the visitor for matching topics
+ * @param oldValue Pointer to store the replaced value in (NULL if the
+ *                 filter is new), or NULL
+ *
+ * @return 1 on success, 0 if the filter is invalid or no memory could be
+ *         allocated
+ */
+int nanoPubSub__Filter_add(nanoPubSub__Filter *filter,
+	const nanoPubSub__Message_slice *topicFilter, void *value,
+	void **oldValue);
+
+
+/**
+ * Removes a subscription filter from a set.
+ *
+ * @param filter The filter set to modify
+ * @param topicFilter The filter
+ * @param value Pointer to store the filter's value in, or NULL
+ *
+ * @return 1 if the filter was removed, 0 if it was not in the set
+ */
+int nanoPubSub__Filter_remove(nanoPubSub__Filter *filter,
+	const nanoPubSub__Message_slice *topicFilter, void **value);
+
+
+/**
+ * Finds all filters of a set matching a topic, following the rules of
+ * nanoPubSub__Topic_match, and passes their values to a visitor.
+ *
+ * @param filter The filter set to search
+ * @param topic The topic of a received message
+ * @param visitor The function to call for every matching filter, or NULL
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching filters
+ */
+size_t nanoPubSub__Filter_match(const nanoPubSub__Filter *filter,
+	const nanoPubSub__Message_slice *topic, nanoPubSub__Filter_visitor visitor,
+	void *arg);
+
+
+/**
+ * Checks whether a received message's topic matches any filter of a set.
+ * The trie of filters with wildcards is only searched if no filter
+ * without wildcards matches.
+ *
+ * @param filter The filter set to search
+ * @param topic The topic of a received message
+ *
+ * @return 1 if the topic matches a filter, 0 otherwise
+ */
+int nanoPubSub__Filter_matches(const nanoPubSub__Filter *filter,
+	const nanoPubSub__Message_slice *topic);
+
+
+#endif /* __LIBNANOPUBSUB__FILTER_H */
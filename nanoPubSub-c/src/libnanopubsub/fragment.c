@@ -0,0 +1,355 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "fragment.h"
+#include "network.h"
+#include "util.h"
+
+
+/** The id assigned to the next message that is split into fragments */
+static uint32_t nextMessageId = 1;
+
+
+/**
+ * Initializes a reassembly pool and allocates all of its memory.
+ *
+ * @param pool The pool to initialize
+ * @param numSlots The max. number of messages reassembled at the same time
+ * @param maxLength The max. length of a reassembled message (in bytes),
+ *                  at most NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ * @param timeoutMs The time after which incomplete messages are dropped
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Fragment_initPool(nanoPubSub__Fragment_pool *pool,
+		unsigned int numSlots, size_t maxLength, unsigned int timeoutMs)
+{
+	size_t numWords = (nanoPubSub__Fragment_count(maxLength) + 63) / 64;
+	unsigned int i;
+
+	assert(numSlots > 0);
+	assert(maxLength <= NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH);
+
+	pool->numSlots  = numSlots;
+	pool->maxLength = maxLength;
+	pool->timeoutMs = timeoutMs;
+
+	if ((pool->slots = calloc(numSlots, sizeof(*pool->slots))) == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < numSlots; i++) {
+		pool->slots[i].buffer   = malloc(maxLength);
+		pool->slots[i].received = calloc(numWords, sizeof(uint64_t));
+
+		if (pool->slots[i].buffer == NULL
+				|| pool->slots[i].received == NULL) {
+			pool->numSlots = i + 1;
+			nanoPubSub__Fragment_freePool(pool);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+/**
+ * Frees all memory owned by a reassembly pool.
+ *
+ * @param pool The pool to free
+ */
+void nanoPubSub__Fragment_freePool(nanoPubSub__Fragment_pool *pool)
+{
+	unsigned int i;
+
+	if (pool->slots == NULL) {
+		return;
+	}
+
+	for (i = 0; i < pool->numSlots; i++) {
+		free(pool->slots[i].buffer);
+		free(pool->slots[i].received);
+	}
+
+	free(pool->slots);
+	pool->slots = NULL;
+}
+
+
+/**
+ * Frees the slots of all messages returned by
+ * nanoPubSub__Fragment_reassemble since the last call of this function.
+ * Messages stay valid until then, so a whole batch of datagrams can be
+ * fed into the pool before its messages are handled.
+ *
+ * @param pool The pool to release the messages of
+ */
+void nanoPubSub__Fragment_release(nanoPubSub__Fragment_pool *pool)
+{
+	unsigned int i;
+
+	for (i = 0; i < pool->numSlots; i++) {
+		if (pool->slots[i].delivered) {
+			pool->slots[i].used      = 0;
+			pool->slots[i].delivered = 0;
+		}
+	}
+}
+
+
+/**
+ * Picks the slot for a message whose first fragment has just arrived: a
+ * free slot if there is one, otherwise the slot of the message that was
+ * started first. Slots holding delivered messages are never reused.
+ *
+ * @return The slot, or NULL if all slots hold delivered messages
+ */
+static nanoPubSub__Fragment_slot *allocateSlot(nanoPubSub__Fragment_pool *pool)
+{
+	nanoPubSub__Fragment_slot *oldest = NULL;
+	unsigned int i;
+
+	for (i = 0; i < pool->numSlots; i++) {
+		nanoPubSub__Fragment_slot *slot = &pool->slots[i];
+
+		if (!slot->used) {
+			return slot;
+		}
+
+		if (!slot->delivered
+				&& (oldest == NULL || slot->started < oldest->started)) {
+			oldest = slot;
+		}
+	}
+
+	return oldest;
+}
+
+
+/**
+ * Adds a received fragment to its message. Incomplete messages whose
+ * first fragment arrived at least the pool's timeout ago are dropped.
+ *
+ * @param pool The pool to reassemble the message in
+ * @param fromAddr The address the fragment was received from
+ * @param datagram The received fragment
+ * @param size The size of the fragment (in bytes)
+ * @param message Pointer to store the complete message's bytes in
+ * @param length Pointer to store the complete message's length in
+ *
+ * @return 1 if the message is complete, 0 if fragments are missing, or -1
+ *         if the fragment is invalid
+ */
+int nanoPubSub__Fragment_reassemble(nanoPubSub__Fragment_pool *pool,
+		const struct sockaddr *fromAddr, const char *datagram, size_t size,
+		const char **message, size_t *length)
+{
+	const uint8_t *bytes = (const uint8_t*)datagram;
+	nanoPubSub__Fragment_slot *slot = NULL;
+	uint32_t messageId, totalLength, index;
+	size_t pos = 1, payloadLength;
+	unsigned int count, i;
+	uint64_t now;
+
+	/* Read the fragment header */
+	if (size < 1 || bytes[0] != NANOPUBSUB__FRAGMENT_MAGIC
+			|| !nanoPubSub__Message_readVarint(bytes, size, &pos, &messageId)
+			|| !nanoPubSub__Message_readVarint(bytes, size, &pos, &totalLength)
+			|| !nanoPubSub__Message_readVarint(bytes, size, &pos, &index)) {
+		return -1;
+	}
+
+	if (totalLength == 0 || totalLength > pool->maxLength) {
+		return -1;
+	}
+
+	/* Every fragment but the last carries a full payload */
+	count = nanoPubSub__Fragment_count(totalLength);
+	payloadLength = index + 1 < count
+		? NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH
+		: totalLength - (size_t)index * NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH;
+
+	if (index >= count || size - pos != payloadLength) {
+		return -1;
+	}
+
+	now = nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC);
+
+	/* Look for the message the fragment belongs to. Every fragment
+	   sweeps the whole pool, so messages that took too long to arrive
+	   are dropped after the timeout, not only once the pool is full. */
+	for (i = 0; i < pool->numSlots; i++) {
+		nanoPubSub__Fragment_slot *candidate = &pool->slots[i];
+
+		if (!candidate->used || candidate->delivered) {
+			continue;
+		}
+
+		if (now - candidate->started >= pool->timeoutMs) {
+			candidate->used = 0;
+			continue;
+		}
+
+		if (slot == NULL && candidate->messageId == messageId
+				&& candidate->length == totalLength
+				&& memcmp(&candidate->fromAddr, fromAddr,
+					sizeof(struct sockaddr)) == 0) {
+			slot = candidate;
+		}
+	}
+
+	if (slot == NULL) {
+		if ((slot = allocateSlot(pool)) == NULL) {
+			return 0;
+		}
+
+		memcpy(&slot->fromAddr, fromAddr, sizeof(struct sockaddr));
+		slot->messageId  = messageId;
+		slot->length     = totalLength;
+		slot->numMissing = count;
+		slot->started    = now;
+		slot->used       = 1;
+		slot->delivered  = 0;
+		memset(slot->received, 0, ((count + 63) / 64) * sizeof(uint64_t));
+	}
+
+	/* Ignore duplicates */
+	if (slot->received[index / 64] & ((uint64_t)1 << (index % 64))) {
+		return 0;
+	}
+
+	slot->received[index / 64] |= (uint64_t)1 << (index % 64);
+	memcpy(slot->buffer + (size_t)index * NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH,
+		bytes + pos, payloadLength);
+
+	if (--slot->numMissing > 0) {
+		return 0;
+	}
+
+	slot->delivered = 1;
+	*message = slot->buffer;
+	*length  = slot->length;
+
+	return 1;
+}
+
+
+/**
+ * Assigns an id to a message that is about to be split into fragments.
+ * Ids are unique within the process, even if several threads send
+ * fragmented messages.
+ *
+ * @return The message id
+ */
+uint32_t nanoPubSub__Fragment_nextMessageId(void)
+{
+	return __atomic_fetch_add(&nextMessageId, 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Writes a single fragment of a message string into a buffer.
+ *
+ * @param messageId The id of the message, see
+ *                  nanoPubSub__Fragment_nextMessageId
+ * @param string The message string
+ * @param length The length of the message string (in bytes), at most
+ *               NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ * @param index The index of the fragment to write
+ * @param buffer The buffer to write the fragment into, it must hold at least
+ *               NANOPUBSUB__FRAGMENT_HEADER_LENGTH
+ *               + NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH bytes
+ *
+ * @return The length of the fragment (in bytes)
+ */
+size_t nanoPubSub__Fragment_write(uint32_t messageId, const char *string,
+		size_t length, unsigned int index, char *buffer)
+{
+	uint8_t *datagram = (uint8_t*)buffer;
+	unsigned int count = nanoPubSub__Fragment_count(length);
+	size_t headerLength = 0, payloadLength;
+
+	assert(index < count);
+
+	payloadLength = index + 1 < count
+		? NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH
+		: length - (size_t)index * NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH;
+
+	datagram[headerLength++] = NANOPUBSUB__FRAGMENT_MAGIC;
+	headerLength += nanoPubSub__Message_writeVarint(
+		datagram + headerLength, messageId);
+	headerLength += nanoPubSub__Message_writeVarint(
+		datagram + headerLength, length);
+	headerLength += nanoPubSub__Message_writeVarint(
+		datagram + headerLength, index);
+
+	assert(headerLength <= NANOPUBSUB__FRAGMENT_HEADER_LENGTH);
+
+	memcpy(datagram + headerLength,
+		string + (size_t)index * NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH,
+		payloadLength);
+
+	return headerLength + payloadLength;
+}
+
+
+/**
+ * Splits a message string into fragments and sends every fragment to a
+ * number of destinations.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes), at most
+ *               NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ *
+ * @return The number of destinations all fragments were sent to, or -1 if
+ *         the message is too long.
+ */
+int nanoPubSub__Fragment_sendStringMulti(int socket,
+		const struct sockaddr *const *destAddrs, unsigned int numDestAddrs,
+		const char *string, size_t length)
+{
+	char datagram[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	unsigned int count, index, sent, minSent = numDestAddrs;
+	size_t datagramLength;
+	uint32_t messageId;
+
+	if (length == 0 || length > NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH) {
+		return -1;
+	}
+
+	messageId = nanoPubSub__Fragment_nextMessageId();
+	count     = nanoPubSub__Fragment_count(length);
+
+	for (index = 0; index < count; index++) {
+		datagramLength = nanoPubSub__Fragment_write(messageId, string, length,
+			index, datagram);
+
+		sent = nanoPubSub__Network_sendStringMulti(socket, destAddrs,
+			numDestAddrs, datagram, datagramLength);
+
+		if (sent < minSent) {
+			minSent = sent;
+		}
+	}
+
+	return minSent;
+}
@@ -0,0 +1,226 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "message.h"
+
+#ifndef __LIBNANOPUBSUB__FRAGMENT_H
+#define __LIBNANOPUBSUB__FRAGMENT_H
+
+
+/**
+ * The first byte of every fragment. Like NANOPUBSUB__BINARY_MAGIC, it is
+ * rejected by text parsers.
+ */
+#define NANOPUBSUB__FRAGMENT_MAGIC 0xA6
+
+/**
+ * The number of message bytes carried by every fragment but the last. The
+ * rest of a datagram is left for the fragment header, so that fragments
+ * never exceed NANOPUBSUB__MAX_MESSAGE_LENGTH bytes.
+ */
+#define NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH 1000
+
+/**
+ * The max. length of a fragment header (in bytes): the magic byte, the
+ * message id, the message length and the fragment index, the latter three
+ * as varints.
+ */
+#define NANOPUBSUB__FRAGMENT_HEADER_LENGTH 11
+
+/** The max. number of fragments a message can be split into */
+#define NANOPUBSUB__FRAGMENT_MAX_COUNT \
+	((NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH \
+		+ NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH - 1) \
+	 / NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH)
+
+
+/**
+ * Calculates the number of fragments a message of the given length is
+ * split into.
+ */
+static inline unsigned int nanoPubSub__Fragment_count(size_t length)
+{
+	return (length + NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH - 1)
+		/ NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH;
+}
+
+
+/**
+ * A message being reassembled from its fragments.
+ */
+typedef struct
+{
+	/** The address the fragments are received from */
+	struct sockaddr_storage fromAddr;
+
+	/** The id the sender assigned to the message */
+	uint32_t messageId;
+
+	/** The length of the complete message (in bytes) */
+	size_t length;
+
+	/** The number of fragments still missing */
+	unsigned int numMissing;
+
+	/** The time the first fragment was received at (in milliseconds) */
+	uint64_t started;
+
+	/** 1 if the slot holds a message, 0 if it is free */
+	int used;
+
+	/** 1 if the message has been handed to the caller */
+	int delivered;
+
+	/** One bit per fragment, set once the fragment has been received */
+	uint64_t *received;
+
+	/** The message's bytes */
+	char *buffer;
+} nanoPubSub__Fragment_slot;
+
+
+/**
+ * A bounded pool of reassembly buffers. The pool never allocates memory
+ * after it has been initialized: if all slots are in use, the message
+ * that was started first is dropped, and messages that are not complete
+ * after the pool's timeout are dropped as well.
+ */
+typedef struct
+{
+	/** The pool's slots */
+	nanoPubSub__Fragment_slot *slots;
+
+	/** The number of slots */
+	unsigned int numSlots;
+
+	/** The max. length of a reassembled message (in bytes) */
+	size_t maxLength;
+
+	/** The time after which incomplete messages are dropped */
+	unsigned int timeoutMs;
+} nanoPubSub__Fragment_pool;
+
+
+/**
+ * Initializes a reassembly pool and allocates all of its memory.
+ *
+ * @param pool The pool to initialize
+ * @param numSlots The max. number of messages reassembled at the same time
+ * @param maxLength The max. length of a reassembled message (in bytes),
+ *                  at most NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ * @param timeoutMs The time after which incomplete messages are dropped
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Fragment_initPool(nanoPubSub__Fragment_pool *pool,
+	unsigned int numSlots, size_t maxLength, unsigned int timeoutMs);
+
+
+/**
+ * Frees all memory owned by a reassembly pool.
+ *
+ * @param pool The pool to free
+ */
+void nanoPubSub__Fragment_freePool(nanoPubSub__Fragment_pool *pool);
+
+
+/**
+ * Frees the slots of all messages returned by
+ * nanoPubSub__Fragment_reassemble since the last call of this function.
+ * Messages stay valid until then, so a whole batch of datagrams can be
+ * fed into the pool before its messages are handled.
+ *
+ * @param pool The pool to release the messages of
+ */
+void nanoPubSub__Fragment_release(nanoPubSub__Fragment_pool *pool);
+
+
+/**
+ * Adds a received fragment to its message. Incomplete messages whose
+ * first fragment arrived at least the pool's timeout ago are dropped.
+ *
+ * @param pool The pool to reassemble the message in
+ * @param fromAddr The address the fragment was received from
+ * @param datagram The received fragment
+ * @param size The size of the fragment (in bytes)
+ * @param message Pointer to store the complete message's bytes in
+ * @param length Pointer to store the complete message's length in
+ *
+ * @return 1 if the message is complete, 0 if fragments are missing, or -1
+ *         if the fragment is invalid
+ */
+int nanoPubSub__Fragment_reassemble(nanoPubSub__Fragment_pool *pool,
+	const struct sockaddr *fromAddr, const char *datagram, size_t size,
+	const char **message, size_t *length);
+
+
+/**
+ * Assigns an id to a message that is about to be split into fragments.
+ * Ids are unique within the process, even if several threads send
+ * fragmented messages.
+ *
+ * @return The message id
+ */
+uint32_t nanoPubSub__Fragment_nextMessageId(void);
+
+
+/**
+ * Writes a single fragment of a message string into a buffer.
+ *
+ * @param messageId The id of the message, see
+ *                  nanoPubSub__Fragment_nextMessageId
+ * @param string The message string
+ * @param length The length of the message string (in bytes), at most
+ *               NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ * @param index The index of the fragment to write
+ * @param buffer The buffer to write the fragment into, it must hold at least
+ *               NANOPUBSUB__FRAGMENT_HEADER_LENGTH
+ *               + NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH bytes
+ *
+ * @return The length of the fragment (in bytes)
+ */
+size_t nanoPubSub__Fragment_write(uint32_t messageId, const char *string,
+	size_t length, unsigned int index, char *buffer);
+
+
+/**
+ * Splits a message string into fragments and sends every fragment to a
+ * number of destinations.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes), at most
+ *               NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ *
+ * @return The number of destinations all fragments were sent to, or -1 if
+ *         the message is too long.
+ */
+int nanoPubSub__Fragment_sendStringMulti(int socket,
+	const struct sockaddr *const *destAddrs, unsigned int numDestAddrs,
+	const char *string, size_t length);
+
+
+#endif /* __LIBNANOPUBSUB__FRAGMENT_H */
@@ -0,0 +1,134 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "histogram.h"
+
+
+/**
+ * Initializes an empty histogram.
+ *
+ * @param histogram The histogram to initialize
+ */
+void nanoPubSub__Histogram_init(nanoPubSub__Histogram *histogram)
+{
+	memset(histogram, 0, sizeof(*histogram));
+	histogram->min = UINT64_MAX;
+}
+
+
+/**
+ * Adds all values recorded in a histogram to another one.
+ *
+ * @param histogram The histogram to add the values to
+ * @param other The histogram whose values are added
+ */
+void nanoPubSub__Histogram_merge(nanoPubSub__Histogram *histogram,
+		const nanoPubSub__Histogram *other)
+{
+	unsigned int i;
+
+	for (i = 0; i < NANOPUBSUB__HISTOGRAM_BUCKETS; i++) {
+		histogram->counts[i] += other->counts[i];
+	}
+
+	histogram->count += other->count;
+	histogram->sum   += other->sum;
+
+	if (other->min < histogram->min) {
+		histogram->min = other->min;
+	}
+	if (other->max > histogram->max) {
+		histogram->max = other->max;
+	}
+}
+
+
+/**
+ * Returns the highest value counted in a bucket.
+ */
+static uint64_t bucketHighest(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < 2 * NANOPUBSUB__HISTOGRAM_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	shift = bucket / NANOPUBSUB__HISTOGRAM_SUB_BUCKETS - 1;
+
+	return (((uint64_t)(bucket % NANOPUBSUB__HISTOGRAM_SUB_BUCKETS
+		+ NANOPUBSUB__HISTOGRAM_SUB_BUCKETS) + 1) << shift) - 1;
+}
+
+
+/**
+ * Returns the highest value counted in the same bucket as a value.
+ *
+ * @param value The value
+ * @return The highest value of the value's bucket
+ */
+uint64_t nanoPubSub__Histogram_highestEquivalent(uint64_t value)
+{
+	return bucketHighest(nanoPubSub__Histogram_bucket(value));
+}
+
+
+/**
+ * Returns the value at a percentile, i.e. the highest value of the bucket
+ * in which the given share of all recorded values is reached. The result
+ * is never larger than the largest value recorded.
+ *
+ * @param histogram The histogram
+ * @param percentile The percentile (0 to 100)
+ *
+ * @return The value, or 0 if no value has been recorded
+ */
+uint64_t nanoPubSub__Histogram_valueAt(const nanoPubSub__Histogram *histogram,
+		double percentile)
+{
+	uint64_t target, seen = 0, value;
+	double share;
+	unsigned int i;
+
+	if (histogram->count == 0) {
+		return 0;
+	}
+
+	if (percentile > 100) {
+		percentile = 100;
+	}
+
+	/* Round the number of values up, and count at least one */
+	share  = percentile / 100 * histogram->count;
+	target = (uint64_t)share;
+	if (target < share || target == 0) {
+		target++;
+	}
+
+	for (i = 0; i < NANOPUBSUB__HISTOGRAM_BUCKETS; i++) {
+		seen += histogram->counts[i];
+
+		if (seen >= target) {
+			break;
+		}
+	}
+
+	value = bucketHighest(i);
+
+	return value < histogram->max ? value : histogram->max;
+}
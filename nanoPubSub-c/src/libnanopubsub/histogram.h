@@ -0,0 +1,152 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef __LIBNANOPUBSUB__HISTOGRAM_H
+#define __LIBNANOPUBSUB__HISTOGRAM_H
+
+
+/**
+ * The number of bits of a value kept by its bucket. Values are recorded
+ * with a relative error of at most 1 / 2^NANOPUBSUB__HISTOGRAM_SUB_BITS.
+ */
+#define NANOPUBSUB__HISTOGRAM_SUB_BITS 7
+
+/** The number of buckets per power of two */
+#define NANOPUBSUB__HISTOGRAM_SUB_BUCKETS (1 << NANOPUBSUB__HISTOGRAM_SUB_BITS)
+
+/** The number of buckets needed to cover all 64 bit values */
+#define NANOPUBSUB__HISTOGRAM_BUCKETS \
+	((64 - NANOPUBSUB__HISTOGRAM_SUB_BITS + 1) \
+		* NANOPUBSUB__HISTOGRAM_SUB_BUCKETS)
+
+
+/**
+ * A histogram of values such as latencies with log-linear buckets, in the
+ * style of HdrHistogram: small values are counted exactly, larger ones in
+ * buckets whose width grows with the value, so that the relative error
+ * stays the same across the whole range. Recording a value takes a few
+ * instructions and never allocates memory.
+ */
+typedef struct
+{
+	/** The number of values recorded per bucket */
+	uint64_t counts[NANOPUBSUB__HISTOGRAM_BUCKETS];
+
+	/** The number of values recorded */
+	uint64_t count;
+
+	/** The smallest value recorded, UINT64_MAX if there is none */
+	uint64_t min;
+
+	/** The largest value recorded */
+	uint64_t max;
+
+	/** The sum of all values recorded */
+	uint64_t sum;
+} nanoPubSub__Histogram;
+
+
+/**
+ * Returns the index of the bucket a value is counted in.
+ *
+ * @param value The value
+ * @return The bucket's index
+ */
+static inline unsigned int nanoPubSub__Histogram_bucket(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < 2 * NANOPUBSUB__HISTOGRAM_SUB_BUCKETS) {
+		return value;
+	}
+
+	/* Keep the highest NANOPUBSUB__HISTOGRAM_SUB_BITS + 1 bits */
+	shift = 63 - __builtin_clzll(value) - NANOPUBSUB__HISTOGRAM_SUB_BITS;
+
+	return (shift + 1) * NANOPUBSUB__HISTOGRAM_SUB_BUCKETS
+		+ (value >> shift) - NANOPUBSUB__HISTOGRAM_SUB_BUCKETS;
+}
+
+
+/**
+ * Records a value.
+ *
+ * @param histogram The histogram to record the value in
+ * @param value The value
+ */
+static inline void nanoPubSub__Histogram_record(
+		nanoPubSub__Histogram *histogram, uint64_t value)
+{
+	histogram->counts[nanoPubSub__Histogram_bucket(value)]++;
+	histogram->count++;
+	histogram->sum += value;
+
+	if (value < histogram->min) {
+		histogram->min = value;
+	}
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+
+/**
+ * Initializes an empty histogram.
+ *
+ * @param histogram The histogram to initialize
+ */
+void nanoPubSub__Histogram_init(nanoPubSub__Histogram *histogram);
+
+
+/**
+ * Adds all values recorded in a histogram to another one.
+ *
+ * @param histogram The histogram to add the values to
+ * @param other The histogram whose values are added
+ */
+void nanoPubSub__Histogram_merge(nanoPubSub__Histogram *histogram,
+	const nanoPubSub__Histogram *other);
+
+
+/**
+ * Returns the highest value counted in the same bucket as a value.
+ *
+ * @param value The value
+ * @return The highest value of the value's bucket
+ */
+uint64_t nanoPubSub__Histogram_highestEquivalent(uint64_t value);
+
+
+/**
+ * Returns the value at a percentile, i.e. the highest value of the bucket
+ * in which the given share of all recorded values is reached. The result
+ * is never larger than the largest value recorded.
+ *
+ * @param histogram The histogram
+ * @param percentile The percentile (0 to 100)
+ *
+ * @return The value, or 0 if no value has been recorded
+ */
+uint64_t nanoPubSub__Histogram_valueAt(const nanoPubSub__Histogram *histogram,
+	double percentile);
+
+
+#endif /* __LIBNANOPUBSUB__HISTOGRAM_H */
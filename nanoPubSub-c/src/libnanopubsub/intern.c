@@ -0,0 +1,204 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "intern.h"
+#include "util.h"
+
+
+/** The number of buckets a table starts with */
+#define INITIAL_BUCKETS 64
+
+
+/**
+ * Finds the bucket holding a string's id, or the empty bucket the id
+ * belongs into.
+ */
+static uint32_t *findBucket(const nanoPubSub__Intern_table *table,
+		const char *string, size_t length)
+{
+	uint32_t bucket = nanoPubSub__Util_hash(string, length) & table->mask;
+	const nanoPubSub__Message_slice *candidate;
+
+	/* Linear probing; the table is never more than half full */
+	for (;;) {
+		if (table->buckets[bucket] == 0) {
+			return &table->buckets[bucket];
+		}
+
+		candidate = &table->strings[table->buckets[bucket] - 1];
+		if (candidate->length == length
+				&& memcmp(candidate->data, string, length) == 0) {
+			return &table->buckets[bucket];
+		}
+
+		bucket = (bucket + 1) & table->mask;
+	}
+}
+
+
+/**
+ * Doubles the number of buckets and rehashes all strings.
+ */
+static int growBuckets(nanoPubSub__Intern_table *table)
+{
+	uint32_t numBuckets = (table->mask + 1) * 2;
+	uint32_t *oldBuckets = table->buckets;
+	uint32_t id;
+
+	if ((table->buckets = calloc(numBuckets, sizeof(*table->buckets)))
+			== NULL) {
+		table->buckets = oldBuckets;
+		return 0;
+	}
+
+	table->mask = numBuckets - 1;
+
+	for (id = 1; id <= table->numStrings; id++) {
+		*findBucket(table, table->strings[id - 1].data,
+			table->strings[id - 1].length) = id;
+	}
+
+	free(oldBuckets);
+
+	return 1;
+}
+
+
+/**
+ * Initializes an empty table.
+ *
+ * @param table The table to initialize
+ * @param limit The max. number of strings that may be interned
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Intern_init(nanoPubSub__Intern_table *table, uint32_t limit)
+{
+	assert(limit > 0);
+
+	if ((table->buckets = calloc(INITIAL_BUCKETS, sizeof(*table->buckets)))
+			== NULL) {
+		return 0;
+	}
+
+	table->strings    = NULL;
+	table->numStrings = 0;
+	table->maxStrings = 0;
+	table->limit      = limit;
+	table->mask       = INITIAL_BUCKETS - 1;
+
+	return 1;
+}
+
+
+/**
+ * Frees all memory owned by a table, including the interned strings.
+ *
+ * @param table The table to destroy
+ */
+void nanoPubSub__Intern_destroy(nanoPubSub__Intern_table *table)
+{
+	uint32_t i;
+
+	for (i = 0; i < table->numStrings; i++) {
+		free((char*)table->strings[i].data);
+	}
+
+	free(table->strings);
+	free(table->buckets);
+
+	table->strings    = NULL;
+	table->buckets    = NULL;
+	table->numStrings = 0;
+}
+
+
+/**
+ * Looks up the id of a string.
+ *
+ * @param table The table to search
+ * @param string The string
+ *
+ * @return The string's id, or 0 if the string has not been interned
+ */
+uint32_t nanoPubSub__Intern_find(const nanoPubSub__Intern_table *table,
+		const nanoPubSub__Message_slice *string)
+{
+	return *findBucket(table, string->data, string->length);
+}
+
+
+/**
+ * Interns a string: returns the id of a known string, or assigns the next
+ * id to a new one.
+ *
+ * @param table The table to add the string to
+ * @param string The string, which is copied
+ *
+ * @return The string's id, or 0 if the table is full or no memory could
+ *         be allocated
+ */
+uint32_t nanoPubSub__Intern_add(nanoPubSub__Intern_table *table,
+		const nanoPubSub__Message_slice *string)
+{
+	nanoPubSub__Message_slice *strings;
+	uint32_t *bucket = findBucket(table, string->data, string->length);
+	uint32_t maxStrings;
+	char *copy;
+
+	if (*bucket != 0) {
+		return *bucket;
+	}
+
+	if (table->numStrings >= table->limit) {
+		return 0;
+	}
+
+	/* Keep the hash table at most half full */
+	if ((table->numStrings + 1) * 2 > table->mask + 1) {
+		if (!growBuckets(table)) {
+			return 0;
+		}
+		bucket = findBucket(table, string->data, string->length);
+	}
+
+	if (table->numStrings == table->maxStrings) {
+		maxStrings = table->maxStrings > 0 ? table->maxStrings * 2 : 16;
+
+		if ((strings = realloc(table->strings,
+				maxStrings * sizeof(*strings))) == NULL) {
+			return 0;
+		}
+
+		table->strings    = strings;
+		table->maxStrings = maxStrings;
+	}
+
+	if ((copy = malloc(string->length + 1)) == NULL) {
+		return 0;
+	}
+
+	memcpy(copy, string->data, string->length);
+	copy[string->length] = '\0';
+
+	table->strings[table->numStrings].data   = copy;
+	table->strings[table->numStrings].length = string->length;
+	*bucket = ++table->numStrings;
+
+	return *bucket;
+}
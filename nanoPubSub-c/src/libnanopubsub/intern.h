@@ -0,0 +1,118 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "message.h"
+
+#ifndef __LIBNANOPUBSUB__INTERN_H
+#define __LIBNANOPUBSUB__INTERN_H
+
+
+/**
+ * A table assigning compact numeric ids to strings such as topics and
+ * client ids. Ids are handed out in order starting at 1 and never change,
+ * so an id is turned back into its string with a single array index. The
+ * strings are found by their ids in an open addressing hash table.
+ */
+typedef struct
+{
+	/** The interned strings (Null-terminated copies), indexed by id - 1 */
+	nanoPubSub__Message_slice *strings;
+
+	/** The number of interned strings, which is also the highest id */
+	uint32_t numStrings;
+
+	/** The number of entries allocated for the strings */
+	uint32_t maxStrings;
+
+	/** The max. number of strings that may be interned */
+	uint32_t limit;
+
+	/** The hash table holding the strings' ids, 0 for empty buckets */
+	uint32_t *buckets;
+
+	/** The number of hash buckets minus one (a power of two) */
+	uint32_t mask;
+} nanoPubSub__Intern_table;
+
+
+/**
+ * Returns the string an id has been assigned to.
+ *
+ * @param table The table to look the id up in
+ * @param id The id
+ *
+ * @return The string, or NULL if the id has not been assigned
+ */
+static inline const nanoPubSub__Message_slice *nanoPubSub__Intern_get(
+		const nanoPubSub__Intern_table *table, uint32_t id)
+{
+	return id > 0 && id <= table->numStrings ? &table->strings[id - 1] : NULL;
+}
+
+
+/**
+ * Initializes an empty table.
+ *
+ * @param table The table to initialize
+ * @param limit The max. number of strings that may be interned
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Intern_init(nanoPubSub__Intern_table *table, uint32_t limit);
+
+
+/**
+ * Frees all memory owned by a table, including the interned strings.
+ *
+ * @param table The table to destroy
+ */
+void nanoPubSub__Intern_destroy(nanoPubSub__Intern_table *table);
+
+
+/**
+ * Looks up the id of a string.
+ *
+ * @param table The table to search
+ * @param string The string
+ *
+ * @return The string's id, or 0 if the string has not been interned
+ */
+uint32_t nanoPubSub__Intern_find(const nanoPubSub__Intern_table *table,
+	const nanoPubSub__Message_slice *string);
+
+
+/**
+ * Interns a string: returns the id of a known string, or assigns the next
+ * id to a new one.
+ *
+ * @param table The table to add the string to
+ * @param string The string, which is copied
+ *
+ * @return The string's id, or 0 if the table is full or no memory could
+ *         be allocated
+ */
+uint32_t nanoPubSub__Intern_add(nanoPubSub__Intern_table *table,
+	const nanoPubSub__Message_slice *string);
+
+
+#endif /* __LIBNANOPUBSUB__INTERN_H */
@@ -0,0 +1,674 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "log.h"
+#include "util.h"
+
+
+/** The length of a segment's file name: a 20 digit offset and ".log" */
+#define SEGMENT_NAME_LENGTH 24
+
+
+/**
+ * Reads the header of the record at a position of a segment.
+ *
+ * @return 1 if a complete record starts at the position, 0 at the end of
+ *         the segment
+ */
+static int readHeader(const nanoPubSub__Log_segment *segment,
+		size_t position, uint32_t *length, uint64_t *timestampMs)
+{
+	if (segment->used - position < NANOPUBSUB__LOG_HEADER_LENGTH) {
+		return 0;
+	}
+
+	memcpy(length, segment->data + position, sizeof(*length));
+	memcpy(timestampMs, segment->data + position + sizeof(*length),
+		sizeof(*timestampMs));
+
+	return *length > 0 && *length <= segment->used - position
+		- NANOPUBSUB__LOG_HEADER_LENGTH;
+}
+
+
+/**
+ * Adds an entry to an index if the record it points to is the index's
+ * first one or the NANOPUBSUB__LOG_INDEX_INTERVAL-th since the last entry.
+ */
+static int indexRecord(nanoPubSub__Log_index *index,
+		const nanoPubSub__Log_entry *entry)
+{
+	nanoPubSub__Log_entry *entries;
+	size_t maxEntries;
+
+	if (index->numRecords++ % NANOPUBSUB__LOG_INDEX_INTERVAL == 0) {
+		if (index->numEntries == index->maxEntries) {
+			maxEntries = index->maxEntries > 0 ? index->maxEntries * 2 : 16;
+
+			if ((entries = realloc(index->entries,
+					maxEntries * sizeof(*entries))) == NULL) {
+				index->numRecords--;
+				return 0;
+			}
+
+			index->entries    = entries;
+			index->maxEntries = maxEntries;
+		}
+
+		index->entries[index->numEntries++] = *entry;
+	}
+
+	index->lastOffset = entry->offset;
+
+	return 1;
+}
+
+
+/**
+ * Adds a record to the index of all records and to the index of its topic.
+ * Topics beyond NANOPUBSUB__LOG_MAX_TOPICS only go into the former.
+ */
+static int indexMessage(nanoPubSub__Log *log,
+		const nanoPubSub__Message_slice *topic,
+		const nanoPubSub__Log_entry *entry)
+{
+	nanoPubSub__Log_index *indexes;
+	size_t maxIndexes;
+	uint32_t id;
+
+	if (!indexRecord(&log->index, entry)) {
+		return 0;
+	}
+
+	if (topic->length == 0
+			|| (id = nanoPubSub__Intern_add(&log->topics, topic)) == 0) {
+		return 1;
+	}
+
+	if (id > log->maxTopicIndexes) {
+		maxIndexes = log->maxTopicIndexes > 0 ? log->maxTopicIndexes * 2 : 16;
+
+		if ((indexes = realloc(log->topicIndexes,
+				maxIndexes * sizeof(*indexes))) == NULL) {
+			return 0;
+		}
+
+		memset(indexes + log->maxTopicIndexes, 0,
+			(maxIndexes - log->maxTopicIndexes) * sizeof(*indexes));
+		log->topicIndexes    = indexes;
+		log->maxTopicIndexes = maxIndexes;
+	}
+
+	return indexRecord(&log->topicIndexes[id - 1], entry);
+}
+
+
+/**
+ * Opens the file of a segment and maps it into memory. New files are
+ * created with the log's segment size.
+ */
+static int mapSegment(nanoPubSub__Log *log, uint64_t baseOffset,
+		int create, nanoPubSub__Log_segment *segment)
+{
+	char path[PATH_MAX];
+	struct stat info;
+	int fd, savedErrno;
+
+	if (snprintf(path, sizeof(path), "%s/%020" PRIu64 ".log",
+			log->directory, baseOffset) >= (int)sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+
+	if ((fd = open(path, create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR,
+			0644)) == -1) {
+		return 0;
+	}
+
+	if ((create && ftruncate(fd, log->segmentSize) == -1)
+			|| fstat(fd, &info) == -1) {
+		savedErrno = errno;
+		close(fd);
+		errno = savedErrno;
+		return 0;
+	}
+
+	segment->baseOffset = baseOffset;
+	segment->size       = info.st_size;
+	segment->used       = 0;
+	segment->data       = segment->size > 0
+		? mmap(NULL, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+		: NULL;
+
+	/* The mapping keeps the file open */
+	savedErrno = errno;
+	close(fd);
+	errno = savedErrno;
+
+	return segment->size > 0 && segment->data != MAP_FAILED;
+}
+
+
+/**
+ * Maps a segment and appends it to the log's segments.
+ *
+ * @param create 1 to create a new, empty segment, 0 to map an existing one
+ */
+static int addSegment(nanoPubSub__Log *log, uint64_t baseOffset, int create)
+{
+	nanoPubSub__Log_segment *segments;
+	unsigned int maxSegments;
+
+	if (log->numSegments == log->maxSegments) {
+		maxSegments = log->maxSegments > 0 ? log->maxSegments * 2 : 8;
+
+		if ((segments = realloc(log->segments,
+				maxSegments * sizeof(*segments))) == NULL) {
+			return 0;
+		}
+
+		log->segments    = segments;
+		log->maxSegments = maxSegments;
+	}
+
+	if (!mapSegment(log, baseOffset, create,
+			&log->segments[log->numSegments])) {
+		return 0;
+	}
+
+	log->numSegments++;
+
+	return 1;
+}
+
+
+/**
+ * Selects the directory entries that are segments.
+ */
+static int isSegmentName(const struct dirent *entry)
+{
+	return strlen(entry->d_name) == SEGMENT_NAME_LENGTH
+		&& strspn(entry->d_name, "0123456789") == SEGMENT_NAME_LENGTH - 4
+		&& strcmp(entry->d_name + SEGMENT_NAME_LENGTH - 4, ".log") == 0;
+}
+
+
+/**
+ * Finds the end of the last segment's records and indexes them.
+ */
+static int scanSegment(nanoPubSub__Log *log)
+{
+	nanoPubSub__Log_segment *segment = &log->segments[log->numSegments - 1];
+	nanoPubSub__Log_entry entry;
+	nanoPubSub__Message_view view;
+	uint32_t length;
+
+	entry.segment  = log->numSegments - 1;
+	entry.position = 0;
+	entry.offset   = segment->baseOffset;
+	segment->used  = segment->size;
+
+	while (readHeader(segment, entry.position, &length, &entry.timestampMs)) {
+		/* Records that are no messages are kept, but not indexed by
+		   topic */
+		if (!nanoPubSub__Message_parseLargeView(segment->data
+				+ entry.position + NANOPUBSUB__LOG_HEADER_LENGTH, length,
+				&view)) {
+			view.topic.length = 0;
+		}
+
+		if (!indexMessage(log, &view.topic, &entry)) {
+			return 0;
+		}
+
+		entry.position += NANOPUBSUB__LOG_HEADER_LENGTH + length;
+		entry.offset++;
+
+		if (entry.timestampMs > log->lastTimestampMs) {
+			log->lastTimestampMs = entry.timestampMs;
+		}
+	}
+
+	segment->used   = entry.position;
+	log->nextOffset = entry.offset;
+
+	return 1;
+}
+
+
+/**
+ * Maps the existing segments of a log in the order of their offsets and
+ * indexes their records.
+ */
+static int loadSegments(nanoPubSub__Log *log)
+{
+	struct dirent **names;
+	int numNames, i, retval = 1;
+
+	/* Zero-padded names sort like the offsets they hold */
+	if ((numNames = scandir(log->directory, &names, isSegmentName,
+			alphasort)) == -1) {
+		return 0;
+	}
+
+	for (i = 0; i < numNames; i++) {
+		if (retval == 1) {
+			retval = addSegment(log, strtoull(names[i]->d_name, NULL, 10), 0)
+				&& scanSegment(log);
+		}
+		free(names[i]);
+	}
+	free(names);
+
+	return retval;
+}
+
+
+/**
+ * Opens a log, creating its directory if it does not exist. Existing
+ * segments are mapped and indexed.
+ *
+ * @param log The log to open
+ * @param directory The directory holding the segments
+ * @param segmentSize The size of new segments (in bytes), large enough
+ *                    for a message of NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ *                    bytes
+ *
+ * @return 1 on success. Otherwise, 0 is returned and errno is set to
+ *         indicate the error.
+ */
+int nanoPubSub__Log_open(nanoPubSub__Log *log, const char *directory,
+		size_t segmentSize)
+{
+	int savedErrno;
+
+	assert(segmentSize >= NANOPUBSUB__LOG_HEADER_LENGTH
+		+ NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH);
+
+	memset(log, 0, sizeof(*log));
+	log->segmentSize = segmentSize;
+
+	if ((log->directory = strdup(directory)) == NULL
+			|| !nanoPubSub__Intern_init(&log->topics,
+				NANOPUBSUB__LOG_MAX_TOPICS)) {
+		free(log->directory);
+		errno = ENOMEM;
+		return 0;
+	}
+
+	if ((mkdir(directory, 0755) == -1 && errno != EEXIST)
+			|| !loadSegments(log)) {
+		savedErrno = errno;
+		nanoPubSub__Log_close(log);
+		errno = savedErrno;
+		return 0;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Unmaps all segments of a log and frees the memory it owns. Records that
+ * have been appended are written to the files by the kernel.
+ *
+ * @param log The log to close
+ */
+void nanoPubSub__Log_close(nanoPubSub__Log *log)
+{
+	unsigned int i;
+	size_t id;
+
+	for (i = 0; i < log->numSegments; i++) {
+		munmap(log->segments[i].data, log->segments[i].size);
+	}
+
+	for (id = 0; id < log->maxTopicIndexes; id++) {
+		free(log->topicIndexes[id].entries);
+	}
+
+	free(log->segments);
+	free(log->topicIndexes);
+	free(log->index.entries);
+	free(log->directory);
+	nanoPubSub__Intern_destroy(&log->topics);
+
+	memset(log, 0, sizeof(*log));
+}
+
+
+/**
+ * Appends a message to a log. The message is stored as it was received,
+ * i.e. the bytes from its view's frame up to its length.
+ *
+ * @param log The log to append to
+ * @param view The message, which must have a frame and a topic string
+ * @param offset Pointer to store the record's offset in, or NULL
+ *
+ * @return 1 on success. Otherwise, 0 is returned and errno is set to
+ *         indicate the error.
+ */
+int nanoPubSub__Log_append(nanoPubSub__Log *log,
+		const nanoPubSub__Message_view *view, uint64_t *offset)
+{
+	nanoPubSub__Log_segment *segment = NULL;
+	nanoPubSub__Log_entry entry;
+	uint32_t length = view->length;
+
+	if (view->frame == NULL || view->length == 0
+			|| view->length > NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+			|| view->topic.length == 0) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	if (log->numSegments > 0) {
+		segment = &log->segments[log->numSegments - 1];
+	}
+
+	/* Start a new segment when the current one is full */
+	if (segment == NULL || segment->size - segment->used
+			< NANOPUBSUB__LOG_HEADER_LENGTH + length) {
+		if (!addSegment(log, log->nextOffset, 1)) {
+			return 0;
+		}
+		segment = &log->segments[log->numSegments - 1];
+	}
+
+	/* Timestamps never go backwards, so the index stays sorted by time */
+	entry.timestampMs = nanoPubSub__Util_currentTimeMs(CLOCK_REALTIME);
+	if (entry.timestampMs < log->lastTimestampMs) {
+		entry.timestampMs = log->lastTimestampMs;
+	}
+
+	entry.offset   = log->nextOffset;
+	entry.segment  = log->numSegments - 1;
+	entry.position = segment->used;
+
+	if (!indexMessage(log, &view->topic, &entry)) {
+		errno = ENOMEM;
+		return 0;
+	}
+
+	/* The length goes in last, so that a reader of the file never sees an
+	   incomplete record */
+	memcpy(segment->data + segment->used + NANOPUBSUB__LOG_HEADER_LENGTH,
+		view->frame, length);
+	memcpy(segment->data + segment->used + sizeof(length),
+		&entry.timestampMs, sizeof(entry.timestampMs));
+	memcpy(segment->data + segment->used, &length, sizeof(length));
+
+	segment->used       += NANOPUBSUB__LOG_HEADER_LENGTH + length;
+	log->lastTimestampMs = entry.timestampMs;
+
+	if (offset != NULL) {
+		*offset = log->nextOffset;
+	}
+	log->nextOffset++;
+
+	return 1;
+}
+
+
+/**
+ * Asks the kernel to write the records appended to a log to its files,
+ * without waiting for it.
+ *
+ * @param log The log to flush
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Log_sync(nanoPubSub__Log *log)
+{
+	nanoPubSub__Log_segment *segment;
+
+	if (log->numSegments == 0) {
+		return 1;
+	}
+
+	segment = &log->segments[log->numSegments - 1];
+
+	return msync(segment->data, segment->size, MS_ASYNC) == 0;
+}
+
+
+/**
+ * Finds the last entry of an index at or before an offset.
+ *
+ * @return The entry, or NULL if the index's first record comes later
+ */
+static const nanoPubSub__Log_entry *findEntry(
+		const nanoPubSub__Log_index *index, uint64_t offset)
+{
+	size_t low = 0, high = index->numEntries, middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+
+		if (index->entries[middle].offset <= offset) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return low > 0 ? &index->entries[low - 1] : NULL;
+}
+
+
+/**
+ * Positions a cursor at the end of a log.
+ */
+static void seekEnd(const nanoPubSub__Log *log,
+		nanoPubSub__Log_cursor *cursor)
+{
+	cursor->segment  = log->numSegments > 0 ? log->numSegments - 1 : 0;
+	cursor->position = log->numSegments > 0
+		? log->segments[log->numSegments - 1].used : 0;
+	cursor->offset   = log->nextOffset;
+}
+
+
+/**
+ * Moves a cursor to the next record without reading it.
+ *
+ * @return 1 if the cursor was moved, 0 at the end of the log
+ */
+static int skipRecord(const nanoPubSub__Log *log,
+		nanoPubSub__Log_cursor *cursor, uint32_t *length,
+		uint64_t *timestampMs)
+{
+	while (cursor->segment < log->numSegments) {
+		if (readHeader(&log->segments[cursor->segment], cursor->position,
+				length, timestampMs)) {
+			cursor->position += NANOPUBSUB__LOG_HEADER_LENGTH + *length;
+			cursor->offset++;
+			return 1;
+		}
+
+		if (cursor->segment + 1 == log->numSegments) {
+			break;
+		}
+
+		cursor->segment++;
+		cursor->position = 0;
+		cursor->offset   = log->segments[cursor->segment].baseOffset;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Positions a cursor at the first record with at least the given offset.
+ * If a topic is given, the cursor may be moved further ahead, to the
+ * first record of the topic that could follow the offset.
+ *
+ * @param log The log to read
+ * @param cursor The cursor to position
+ * @param topic The topic records are going to be read of, or NULL
+ * @param offset The offset to start reading at
+ */
+void nanoPubSub__Log_seek(const nanoPubSub__Log *log,
+		nanoPubSub__Log_cursor *cursor, const nanoPubSub__Message_slice *topic,
+		uint64_t offset)
+{
+	const nanoPubSub__Log_entry *entry, *topicEntry;
+	const nanoPubSub__Log_index *topicIndex = NULL;
+	nanoPubSub__Log_cursor next;
+	uint64_t timestampMs;
+	uint32_t length, id;
+
+	if (topic != NULL && (id = nanoPubSub__Intern_find(&log->topics, topic))
+			!= 0) {
+		topicIndex = &log->topicIndexes[id - 1];
+	}
+
+	/* Nothing follows the topic's last record */
+	if (topicIndex != NULL && offset > topicIndex->lastOffset) {
+		seekEnd(log, cursor);
+		return;
+	}
+
+	/* Start at the closest entry of either index, or at the topic's first
+	   record if it comes after the offset */
+	entry = findEntry(&log->index, offset);
+
+	if (topicIndex != NULL) {
+		topicEntry = findEntry(topicIndex, offset);
+
+		if (topicEntry == NULL) {
+			entry = &topicIndex->entries[0];
+		} else if (entry == NULL || topicEntry->offset > entry->offset) {
+			entry = topicEntry;
+		}
+	}
+
+	if (entry != NULL) {
+		cursor->segment  = entry->segment;
+		cursor->position = entry->position;
+		cursor->offset   = entry->offset;
+	} else {
+		cursor->segment  = 0;
+		cursor->position = 0;
+		cursor->offset   = log->numSegments > 0
+			? log->segments[0].baseOffset : 0;
+	}
+
+	next = *cursor;
+	while (cursor->offset < offset
+			&& skipRecord(log, &next, &length, &timestampMs)) {
+		*cursor = next;
+	}
+}
+
+
+/**
+ * Positions a cursor at the first record appended at or after the given
+ * time.
+ *
+ * @param log The log to read
+ * @param cursor The cursor to position
+ * @param timestampMs The time to start reading at (in ms since the epoch)
+ */
+void nanoPubSub__Log_seekTime(const nanoPubSub__Log *log,
+		nanoPubSub__Log_cursor *cursor, uint64_t timestampMs)
+{
+	const nanoPubSub__Log_index *index = &log->index;
+	size_t low = 0, high = index->numEntries, middle;
+	nanoPubSub__Log_cursor next;
+	uint64_t recordTimestampMs;
+	uint32_t length;
+
+	/* Start at the last entry older than the time */
+	while (low < high) {
+		middle = low + (high - low) / 2;
+
+		if (index->entries[middle].timestampMs < timestampMs) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	if (low > 0) {
+		cursor->segment  = index->entries[low - 1].segment;
+		cursor->position = index->entries[low - 1].position;
+		cursor->offset   = index->entries[low - 1].offset;
+	} else {
+		nanoPubSub__Log_seek(log, cursor, NULL, 0);
+		return;
+	}
+
+	next = *cursor;
+	while (skipRecord(log, &next, &length, &recordTimestampMs)
+			&& recordTimestampMs < timestampMs) {
+		*cursor = next;
+	}
+}
+
+
+/**
+ * Reads the next record at a cursor and advances the cursor past it.
+ *
+ * @param log The log to read
+ * @param cursor The cursor to read at
+ * @param topic The topic to read records of, or NULL to read all records
+ * @param record Pointer to store the record in. Its view stays valid until
+ *               the log is closed.
+ *
+ * @return 1 if a record was read, 0 at the end of the log
+ */
+int nanoPubSub__Log_next(const nanoPubSub__Log *log,
+		nanoPubSub__Log_cursor *cursor, const nanoPubSub__Message_slice *topic,
+		nanoPubSub__Log_record *record)
+{
+	const char *data;
+	uint32_t length;
+
+	for (;;) {
+		if (!skipRecord(log, cursor, &length, &record->timestampMs)) {
+			return 0;
+		}
+
+		/* The cursor has been moved past the record */
+		data = log->segments[cursor->segment].data + cursor->position
+			- length;
+		record->offset = cursor->offset - 1;
+
+		if (!nanoPubSub__Message_parseLargeView(data, length,
+				&record->view)) {
+			continue;
+		}
+
+		if (topic == NULL || (record->view.topic.length == topic->length
+				&& memcmp(record->view.topic.data, topic->data,
+					topic->length) == 0)) {
+			return 1;
+		}
+	}
+}
@@ -0,0 +1,273 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "message.h"
+#include "intern.h"
+
+#ifndef __LIBNANOPUBSUB__LOG_H
+#define __LIBNANOPUBSUB__LOG_H
+
+
+/** The length of a record's header: its length and its timestamp */
+#define NANOPUBSUB__LOG_HEADER_LENGTH 12
+
+/**
+ * An index entry is added for the first record of the log and of every
+ * topic, and for every NANOPUBSUB__LOG_INDEX_INTERVAL-th record after it
+ */
+#define NANOPUBSUB__LOG_INDEX_INTERVAL 64
+
+/**
+ * The max. number of topics with an index of their own. Records of other
+ * topics are only found through the index of all records.
+ */
+#define NANOPUBSUB__LOG_MAX_TOPICS 65536
+
+
+/**
+ * The position of a record in the log.
+ */
+typedef struct
+{
+	/** The record's offset, i.e. the number of records before it */
+	uint64_t offset;
+
+	/** The time the record was appended at (in ms since the epoch) */
+	uint64_t timestampMs;
+
+	/** The segment holding the record */
+	unsigned int segment;
+
+	/** The position of the record's header within its segment */
+	size_t position;
+} nanoPubSub__Log_entry;
+
+
+/**
+ * A sparse index, holding an entry for every
+ * NANOPUBSUB__LOG_INDEX_INTERVAL-th of the records it covers. The entries
+ * are sorted by offset and by timestamp.
+ */
+typedef struct
+{
+	nanoPubSub__Log_entry *entries;
+	size_t numEntries;
+	size_t maxEntries;
+
+	/** The number of records the index covers */
+	uint64_t numRecords;
+
+	/** The offset of the last record the index covers */
+	uint64_t lastOffset;
+} nanoPubSub__Log_index;
+
+
+/**
+ * A file of the log, mapped into memory. Records are stored back to back,
+ * each consisting of its length (4 bytes), its timestamp (8 bytes, both in
+ * host byte order) and the message as it was received. The unused rest of
+ * the file is zero-filled, so a length of 0 marks its end.
+ */
+typedef struct
+{
+	/** The offset of the segment's first record */
+	uint64_t baseOffset;
+
+	/** The mapped file */
+	char *data;
+
+	/** The size of the file (in bytes) */
+	size_t size;
+
+	/** The number of bytes used by records */
+	size_t used;
+} nanoPubSub__Log_segment;
+
+
+/**
+ * An append-only message log, split into segments of a fixed size that
+ * are named after their first record's offset. The log is written and
+ * read through memory mappings, so reading a record never copies it.
+ * The indexes are kept in memory only and rebuilt when the log is opened.
+ */
+typedef struct
+{
+	/** The directory holding the segments */
+	char *directory;
+
+	/** The size of new segments (in bytes) */
+	size_t segmentSize;
+
+	/** The segments, ordered by offset; the last one is appended to */
+	nanoPubSub__Log_segment *segments;
+	unsigned int numSegments;
+	unsigned int maxSegments;
+
+	/** The offset the next record is appended at */
+	uint64_t nextOffset;
+
+	/** The timestamp of the last record */
+	uint64_t lastTimestampMs;
+
+	/** The index of all records */
+	nanoPubSub__Log_index index;
+
+	/** The topics that have an index of their own */
+	nanoPubSub__Intern_table topics;
+
+	/** The topics' indexes, by topic id - 1 */
+	nanoPubSub__Log_index *topicIndexes;
+	size_t maxTopicIndexes;
+} nanoPubSub__Log;
+
+
+/**
+ * The position of a reader in the log.
+ */
+typedef struct
+{
+	/** The segment the next record is read from */
+	unsigned int segment;
+
+	/** The position of the next record within the segment */
+	size_t position;
+
+	/** The offset of the next record */
+	uint64_t offset;
+} nanoPubSub__Log_cursor;
+
+
+/**
+ * A record read from the log.
+ */
+typedef struct
+{
+	/** The record's offset */
+	uint64_t offset;
+
+	/** The time the record was appended at (in ms since the epoch) */
+	uint64_t timestampMs;
+
+	/** The message, pointing into the mapped segment */
+	nanoPubSub__Message_view view;
+} nanoPubSub__Log_record;
+
+
+/**
+ * Opens a log, creating its directory if it does not exist. Existing
+ * segments are mapped and indexed.
+ *
+ * @param log The log to open
+ * @param directory The directory holding the segments
+ * @param segmentSize The size of new segments (in bytes), large enough
+ *                    for a message of NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH
+ *                    bytes
+ *
+ * @return 1 on success. Otherwise, 0 is returned and errno is set to
+ *         indicate the error.
+ */
+int nanoPubSub__Log_open(nanoPubSub__Log *log, const char *directory,
+	size_t segmentSize);
+
+
+/**
+ * Unmaps all segments of a log and frees the memory it owns. Records that
+ * have been appended are written to the files by the kernel.
+ *
+ * @param log The log to close
+ */
+void nanoPubSub__Log_close(nanoPubSub__Log *log);
+
+
+/**
+ * Appends a message to a log. The message is stored as it was received,
+ * i.e. the bytes from its view's frame up to its length.
+ *
+ * @param log The log to append to
+ * @param view The message, which must have a frame and a topic string
+ * @param offset Pointer to store the record's offset in, or NULL
+ *
+ * @return 1 on success. Otherwise, 0 is returned and errno is set to
+ *         indicate the error.
+ */
+int nanoPubSub__Log_append(nanoPubSub__Log *log,
+	const nanoPubSub__Message_view *view, uint64_t *offset);
+
+
+/**
+ * Asks the kernel to write the records appended to a log to its files,
+ * without waiting for it.
+ *
+ * @param log The log to flush
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Log_sync(nanoPubSub__Log *log);
+
+
+/**
+ * Positions a cursor at the first record with at least the given offset.
+ * If a topic is given, the cursor may be moved further ahead, to the
+ * first record of the topic that could follow the offset.
+ *
+ * @param log The log to read
+ * @param cursor The cursor to position
+ * @param topic The topic records are going to be read of, or NULL
+ * @param offset The offset to start reading at
+ */
+void nanoPubSub__Log_seek(const nanoPubSub__Log *log,
+	nanoPubSub__Log_cursor *cursor, const nanoPubSub__Message_slice *topic,
+	uint64_t offset);
+
+
+/**
+ * Positions a cursor at the first record appended at or after the given
+ * time.
+ *
+ * @param log The log to read
+ * @param cursor The cursor to position
+ * @param timestampMs The time to start reading at (in ms since the epoch)
+ */
+void nanoPubSub__Log_seekTime(const nanoPubSub__Log *log,
+	nanoPubSub__Log_cursor *cursor, uint64_t timestampMs);
+
+
+/**
+ * Reads the next record at a cursor and advances the cursor past it.
+ *
+ * @param log The log to read
+ * @param cursor The cursor to read at
+ * @param topic The topic to read records of, or NULL to read all records
+ * @param record Pointer to store the record in. Its view stays valid until
+ *               the log is closed.
+ *
+ * @return 1 if a record was read, 0 at the end of the log
+ */
+int nanoPubSub__Log_next(const nanoPubSub__Log *log,
+	nanoPubSub__Log_cursor *cursor, const nanoPubSub__Message_slice *topic,
+	nanoPubSub__Log_record *record);
+
+
+#endif /* __LIBNANOPUBSUB__LOG_H */
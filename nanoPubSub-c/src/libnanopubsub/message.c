@@ -17,80 +17,41 @@
  */
 
 #include "message.h"
+#include "parser.h"
+#include "scan.h"
 
-/*
- * A simple preprocessor macro shortcut to make the code within the
- * second switch statement in the function nanoPubSub__Message_length
- * look cleaner.
+
+/**
+ * Returns the length of a message's body, which is scanned for its
+ * terminating Null character unless the message sets the length.
  */
-#define __SAFEADD(a,b) nanoPubSub__Message_safeAdd(a, b)
+static inline size_t bodyLength(const nanoPubSub__Message *msg)
+{
+	return msg->bodyLength > 0 ? msg->bodyLength : strlen(msg->body);
+}
 
 
 /**
  * Calculates the length of a given nanoPubSub message (in bytes)
- * and returns it.
+ * and returns it. Callers that know the lengths of all fields should
+ * describe the message with a nanoPubSub__Message_view instead, whose
+ * functions never scan any strings.
  *
  * @param msg The message to calculate the length for
  * @return The length of the given message, or 0 if an error occurred
  */
 size_t nanoPubSub__Message_length(const nanoPubSub__Message *msg)
 {
-	size_t length = 0;
+	struct iovec iovecs[NANOPUBSUB__MESSAGE_IOVECS];
+	size_t length;
 
 	/* Make sure the message is not a Null pointer */
 	if (msg == NULL) {
 		return 0;
 	}
 
-	/* Add number of "special" characters to the length */
-	switch (msg->type)
-	{
-		case NANOPUBSUB__SUBSCRIBE_MESSAGE:
-			length += 7; /* 4x '#' + "sub" */
-			break;
-		
-		case  NANOPUBSUB__UNSUBSCRIBE_MESSAGE:
-			length += 9; /* 4x '#' + "unsub" */
-			break;
-		
-		case NANOPUBSUB__STANDARD_MESSAGE:
-			length += 8; /* 5x '#' + "msg" */
-			break;
-			
-		default:
-			/* The message obviously has an invalid format */
-			return 0;
-			break;
-	}
-
-	/* Add number of characters used for the message content to the length */
-	switch (msg->type)
-	{
-		case NANOPUBSUB__STANDARD_MESSAGE:
-			if (msg->body != NULL) {
-				if ( !__SAFEADD(&length, strlen(msg->body)) ) {
-					return 0;
-				}
-			} else {
-				/* The body is a Null string. This is an error. */
-				return 0;
-			}
-		
-		case NANOPUBSUB__SUBSCRIBE_MESSAGE:
-		case NANOPUBSUB__UNSUBSCRIBE_MESSAGE:
-			if (msg->clientId != NULL && msg->topic != NULL) {
-				if (!__SAFEADD(&length, strlen(msg->clientId))
-					|| !__SAFEADD(&length, strlen(msg->topic))) {
-						return 0;
-				}
-			} else {
-				/* Either the client id or the topic are Null strings.
-				   This is an error. */
-				return 0;
-			}
-			
-		default:
-			break;
+	if (nanoPubSub__Message_writeIovecs(msg, iovecs, &length) == 0) {
+		return 0;
 	}
 
 	return length;
@@ -110,49 +71,158 @@ size_t nanoPubSub__Message_length(const nanoPubSub__Message *msg)
 void nanoPubSub__Message_writeString(const nanoPubSub__Message *msg,
 	char *buffer, const size_t maxLength)
 {
+	struct iovec iovecs[NANOPUBSUB__MESSAGE_IOVECS];
+	size_t length, pos = 0, part;
+	int count, i;
+
+	if (maxLength == 0) {
+		return;
+	}
+
 	/* If the message is a Null pointer, we don't have to do that much... */
 	if (msg == NULL) {
-		if (maxLength > 0) { buffer[0] = '\0'; }
+		buffer[0] = '\0';
 		return;
 	}
 
+	count = nanoPubSub__Message_writeIovecs(msg, iovecs, &length);
+
 	/* Make sure the message string has a length */
-	assert(nanoPubSub__Message_length(msg) > 0);
+	assert(count > 0);
 
 	/* Make sure the message string will fit into the buffer */
-	assert(nanoPubSub__Message_length(msg) <= maxLength);
+	assert(length <= maxLength);
+
+	/* Copy the fields and delimiters, cutting the string short like
+	   snprintf() if the buffer is too small */
+	for (i = 0; i < count && pos < maxLength - 1; i++) {
+		part = iovecs[i].iov_len;
+		if (part > maxLength - 1 - pos) {
+			part = maxLength - 1 - pos;
+		}
+
+		memcpy(buffer + pos, iovecs[i].iov_base, part);
+		pos += part;
+	}
+
+	buffer[pos] = '\0';
+}
+
+
+/**
+ * Describes the string representation of the given message as a list of
+ * I/O vectors, e.g. for sendmsg(). The delimiters are static strings and
+ * the fields point to the message's own strings, so nothing is copied,
+ * and every field is scanned by strlen() once at most.
+ *
+ * @param msg The message to describe
+ * @param iovecs An array of at least NANOPUBSUB__MESSAGE_IOVECS I/O
+ *               vectors to fill in
+ * @param length Pointer to store the length of the string in (in bytes,
+ *               without a trailing Null character)
+ *
+ * @return The number of I/O vectors used, or 0 if the message is invalid
+ */
+int nanoPubSub__Message_writeIovecs(const nanoPubSub__Message *msg,
+	struct iovec *iovecs, size_t *length)
+{
+	const char *keyword;
+	size_t keywordLength, sum;
+	int count = 0, hasBody = 0, i;
 
 	switch (msg->type)
 	{
 		case NANOPUBSUB__STANDARD_MESSAGE:
-			snprintf(buffer, maxLength, "#msg#%s#%s#%s#",
-				msg->clientId, msg->topic, msg->body);
+			keyword = "#msg#";
+			hasBody = 1;
 			break;
 
 		case NANOPUBSUB__SUBSCRIBE_MESSAGE:
-			snprintf(buffer, maxLength, "#sub#%s#%s#",
-				msg->clientId, msg->topic);
+			keyword = "#sub#";
 			break;
 
 		case NANOPUBSUB__UNSUBSCRIBE_MESSAGE:
-			snprintf(buffer, maxLength, "#unsub#%s#%s#",
-				msg->clientId, msg->topic);
+			keyword = "#unsub#";
 			break;
+
+		case NANOPUBSUB__PING_MESSAGE:
+			keyword = "#ping#";
+			break;
+
+		case NANOPUBSUB__PONG_MESSAGE:
+			keyword = "#pong#";
+			break;
+
+		case NANOPUBSUB__REGISTER_MESSAGE:
+			keyword = "#reg#";
+			break;
+
+		case NANOPUBSUB__REPLAY_MESSAGE:
+			keyword = "#replay#";
+			hasBody = 1;
+			break;
+
+		default:
+			/* The message obviously has an invalid format */
+			return 0;
+	}
+
+	/* Either the client id, the topic or the body are Null strings. This
+	   is an error. */
+	if (msg->clientId == NULL || msg->topic == NULL
+			|| (hasBody && msg->body == NULL)) {
+		return 0;
+	}
+
+	keywordLength = strlen(keyword);
+
+	iovecs[count].iov_base   = (void*)keyword;
+	iovecs[count++].iov_len  = keywordLength;
+	iovecs[count].iov_base   = msg->clientId;
+	iovecs[count++].iov_len  = strlen(msg->clientId);
+	iovecs[count].iov_base   = (void*)(keyword + keywordLength - 1);
+	iovecs[count++].iov_len  = 1;
+	iovecs[count].iov_base   = msg->topic;
+	iovecs[count++].iov_len  = strlen(msg->topic);
+	iovecs[count].iov_base   = (void*)(keyword + keywordLength - 1);
+	iovecs[count++].iov_len  = 1;
+
+	if (hasBody) {
+		iovecs[count].iov_base  = msg->body;
+		iovecs[count++].iov_len = bodyLength(msg);
+		iovecs[count].iov_base  = (void*)(keyword + keywordLength - 1);
+		iovecs[count++].iov_len = 1;
+	}
+
+	sum = 0;
+	for (i = 0; i < count; i++) {
+		if (!nanoPubSub__Message_safeAdd(&sum, iovecs[i].iov_len)) {
+			return 0;
+		}
 	}
+
+	*length = sum;
+
+	return count;
 }
 
 
 /**
- * Parses a given string for a nanoPubSub message.
+ * Runs the parser's state machine over a given string and records the
+ * positions of the message's fields.
  *
- * @param string The Null-terminated string to parse
+ * Fields that have not been found are left untouched, so the caller must
+ * initialize the view. The view's type is only written once the type
+ * keyword has been recognized.
+ *
+ * @param string The string to parse
  * @param size The length of the string (in bytes) to parse
- * @param msg Pointer to the message to write the results into
+ * @param view Pointer to the view to write the results into
  *
  * @return 1 on success, 0 on error
  */
-int nanoPubSub__Message_parseString(const char* string,
-		const unsigned int size, nanoPubSub__Message *msg)
+int nanoPubSub__Message_parseFrameScalar(const char* string,
+		const unsigned int size, nanoPubSub__Message_view *view)
 {
 	int retval = 1;	/* the function's return value */
 	int done   = 0;	/* indicates whether or not we've finished parsing */
@@ -161,27 +231,21 @@ int nanoPubSub__Message_parseString(const char* string,
 
 	unsigned int pos = 0;		/* current string position */
 	unsigned int strStart = 0;	/* position of the start of the substring */
-	unsigned int strLength = 0;	/* length of the substring */
-	
+
 	/* current character */
 	char c, cl;
 
-	/* Make sure the message is not longer than the max. allowed length */
-	if (size > NANOPUBSUB__MAX_MESSAGE_LENGTH) {
-		return -1;
-	}
-
 	/* Iterate over the characters in the string */
 	for (pos = 0; pos < size && retval == 1 && done == 0; pos++) {
 		c  = string[pos];
 		
-		if (state < 10) {
+		if (state < 20) {
 			cl = tolower(c);
 		}
 		
 		switch (state)
 		{
-			/* STATES 0 - 10: DETERMINE MESSAGE TYPE */
+			/* STATES 0 - 20: DETERMINE MESSAGE TYPE */
 			
 			/* initial state: no message detected, yet */
 			case 0:
@@ -197,6 +261,8 @@ int nanoPubSub__Message_parseString(const char* string,
 				if (cl == 'm')      state = 2;
 				else if (cl == 's') state = 4;
 				else if (cl == 'u') state = 6;
+				else if (cl == 'p') state = 11;
+				else if (cl == 'r') state = 16;
 				else retval = 0;
 				break;
 				
@@ -209,8 +275,8 @@ int nanoPubSub__Message_parseString(const char* string,
 			/* state #3: "#ms" detected */
 			case 3:
 				if (cl == 'g') {
-					state = 10;
-					msg->type = NANOPUBSUB__STANDARD_MESSAGE;
+					state = 20;
+					view->type = NANOPUBSUB__STANDARD_MESSAGE;
 				}
 				else retval = 0;
 				break;
@@ -224,8 +290,8 @@ int nanoPubSub__Message_parseString(const char* string,
 			/* state #5: "#su" detected */
 			case 5:
 				if (cl == 'b') {
-					state = 10;
-					msg->type = NANOPUBSUB__SUBSCRIBE_MESSAGE;
+					state = 20;
+					view->type = NANOPUBSUB__SUBSCRIBE_MESSAGE;
 				} else retval = 0;
 				break;
 
@@ -250,84 +316,149 @@ int nanoPubSub__Message_parseString(const char* string,
 			/* state #9: "#unsu" detected */
 			case 9:
 				if (cl == 'b') {
-					state = 10;
-					msg->type = NANOPUBSUB__UNSUBSCRIBE_MESSAGE;
+					state = 20;
+					view->type = NANOPUBSUB__UNSUBSCRIBE_MESSAGE;
 				} else retval = 0;
 				break;
 
-			/* state #10: <type> detected */
+			/* state #11: "#p" detected */
+			case 11:
+				if (cl == 'i')      state = 12;
+				else if (cl == 'o') state = 14;
+				else retval = 0;
+				break;
+
+			/* state #12: "#pi" detected */
+			case 12:
+				if (cl == 'n') state = 13;
+				else retval = 0;
+				break;
+
+			/* state #13: "#pin" detected */
+			case 13:
+				if (cl == 'g') {
+					state = 20;
+					view->type = NANOPUBSUB__PING_MESSAGE;
+				} else retval = 0;
+				break;
+
+			/* state #14: "#po" detected */
+			case 14:
+				if (cl == 'n') state = 15;
+				else retval = 0;
+				break;
+
+			/* state #15: "#pon" detected */
+			case 15:
+				if (cl == 'g') {
+					state = 20;
+					view->type = NANOPUBSUB__PONG_MESSAGE;
+				} else retval = 0;
+				break;
+
+			/* state #16: "#r" detected */
+			case 16:
+				if (cl == 'e') state = 17;
+				else retval = 0;
+				break;
+
+			/* state #17: "#re" detected */
+			case 17:
+				if (cl == 'g') {
+					state = 20;
+					view->type = NANOPUBSUB__REGISTER_MESSAGE;
+				}
+				else if (cl == 'p') state = 18;
+				else retval = 0;
+				break;
+
+			/* state #18: "#rep" detected */
+			case 18:
+				if (cl == 'l') state = 19;
+				else retval = 0;
+				break;
+
+			/* state #19: "#repl" detected */
+			case 19:
+				if (cl == 'a') state = 10;
+				else retval = 0;
+				break;
+
+			/* state #10: "#repla" detected */
 			case 10:
-				if (c == '#') state = 11;
+				if (cl == 'y') {
+					state = 20;
+					view->type = NANOPUBSUB__REPLAY_MESSAGE;
+				} else retval = 0;
+				break;
+
+			/* state #20: <type> detected */
+			case 20:
+				if (c == '#') state = 21;
 				else retval = 0;
 				break;
 
 
-			/* STATES 11 - 12: READ CLIENT ID */
+			/* STATES 21 - 22: READ CLIENT ID */
 
-			/* state #11: <type># detected */
-			case 11:
+			/* state #21: <type># detected */
+			case 21:
 				strStart = pos; /* memorize the string's start position */
 				if (c == '#') retval = 0;
-				state = 12;
+				state = 22;
 				break;
 				
-			/* state #11: <type>#<clientid> detected */
-			case 12:
+			/* state #22: <type>#<clientid> detected */
+			case 22:
 				if (c == '#') {
-					strLength = pos - strStart;
-					if ((msg->clientId = (char*)malloc(strLength + 1))) {
-						strncpy(msg->clientId, string+strStart, strLength);
-						state = 13;
-					} else retval = 0;
+					view->clientId.data   = string + strStart;
+					view->clientId.length = pos - strStart;
+					state = 23;
 				}
 				break;
 
 
-			/* STATES 13 - 14: READ TOPIC */
+			/* STATES 23 - 24: READ TOPIC */
 
-			/* state #13: <type>#<clientid># detected */
-			case 13:
+			/* state #23: <type>#<clientid># detected */
+			case 23:
 				strStart = pos; /* memorize the string's start position */
 				if (c == '#') retval = 0;
-				state = 14;
+				state = 24;
 				break;
 
-			/* state #14: <type>#<clientid>#<topic> detected */
-			case 14:
+			/* state #24: <type>#<clientid>#<topic> detected */
+			case 24:
 				if (c == '#') {
-					strLength = pos - strStart;
-					if ((msg->topic = (char*)malloc(strLength + 1))) {
-						strncpy(msg->topic, string+strStart, strLength);
-						
-						/* only standard messages continue after here */
-						if (msg->type == NANOPUBSUB__STANDARD_MESSAGE)
-							state = 15;
-						else
-							done = 1;
-					} else retval = 0;
+					view->topic.data   = string + strStart;
+					view->topic.length = pos - strStart;
+
+					/* only messages with a body continue after here */
+					if (nanoPubSub__Message_hasBody(view->type))
+						state = 25;
+					else
+						done = 1;
 				}
 				break;
 
 
-			/* STATES 15 - 16: READ MESSAGE BODY */
+			/* STATES 25 - 26: READ MESSAGE BODY */
 
-			/* state #15: <type>#<clientid>#<topic># detected */
-			case 15:
+			/* state #25: <type>#<clientid>#<topic># detected */
+			case 25:
 				strStart = pos; /* memorize the string's start position */
 				if (c == '#') retval = 0;
-				state = 16;
+				state = 26;
 				break;
 
-			/* state #16: <type>#<clientid>#<topic>#<body> detected */
-			case 16:
+			/* state #26: <type>#<clientid>#<topic>#<body> detected */
+			case 26:
 				if (c == '#') {
-					strLength = pos - strStart;
-					if ((msg->body = (char*)malloc(strLength + 1))) {
-						strncpy(msg->body, string+strStart, strLength);
+					view->body.data   = string + strStart;
+					view->body.length = pos - strStart;
 
-						/* we're finished */
-						done = 1;
-					} else retval = 0;
+					/* we're finished */
+					done = 1;
 				}
 				break;
 				
@@ -335,6 +466,755 @@ int nanoPubSub__Message_parseString(const char* string,
 				break;
 		}
 	}
+
+	/* Remember where the message ended, if it was complete */
+	if (retval == 1 && done == 1) {
+		view->length = pos;
+	}
 	
 	return retval;
 }
+
+
+/**
+ * Packs up to eight characters into a word, so that keywords can be
+ * compared with a single instruction.
+ */
+static inline uint64_t packWord(const char *string, size_t length)
+{
+	uint64_t word = 0;
+
+	memcpy(&word, string, length);
+
+	return word;
+}
+
+
+/**
+ * Parses a complete message by locating all of its delimiters with the
+ * vectorized scanner and checking the type keyword with a single word
+ * compare.
+ *
+ * Only well-formed messages that start with a '#' are handled here. For
+ * anything else 0 is returned without touching the view, and the state
+ * machine has to decide what the string contains.
+ *
+ * @param string The string to parse
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 if a complete message was parsed, 0 otherwise
+ */
+int nanoPubSub__Message_parseFrameFast(const char* string,
+		const unsigned int size, nanoPubSub__Message_view *view)
+{
+	size_t delims[5];	/* positions of the message's delimiters */
+	size_t typeLength;
+	uint64_t keyword, lowercase;
+	unsigned int numDelims;
+	uint8_t type;
+
+	numDelims = nanoPubSub__Scan_delimiters(string, size, '#', delims, 5);
+
+	/* Every message has at least four delimiters, the first of which must
+	   be the string's first character */
+	if (numDelims < 4 || delims[0] != 0) {
+		return 0;
+	}
+
+	typeLength = delims[1] - 1;
+	if (typeLength < 3 || typeLength > 6) {
+		return 0;
+	}
+
+	/* Setting bit 5 of every byte turns upper case letters into lower
+	   case ones, just like tolower() does in the state machine */
+	lowercase = packWord("\x20\x20\x20\x20\x20\x20", typeLength);
+	keyword   = packWord(string + 1, typeLength) | lowercase;
+
+	if (keyword == packWord("msg", 3)) {
+		type = NANOPUBSUB__STANDARD_MESSAGE;
+	} else if (keyword == packWord("sub", 3)) {
+		type = NANOPUBSUB__SUBSCRIBE_MESSAGE;
+	} else if (keyword == packWord("unsub", 5)) {
+		type = NANOPUBSUB__UNSUBSCRIBE_MESSAGE;
+	} else if (keyword == packWord("ping", 4)) {
+		type = NANOPUBSUB__PING_MESSAGE;
+	} else if (keyword == packWord("pong", 4)) {
+		type = NANOPUBSUB__PONG_MESSAGE;
+	} else if (keyword == packWord("reg", 3)) {
+		type = NANOPUBSUB__REGISTER_MESSAGE;
+	} else if (keyword == packWord("replay", 6)) {
+		type = NANOPUBSUB__REPLAY_MESSAGE;
+	} else {
+		return 0;
+	}
+
+	/* Messages with a body have a fifth delimiter after it */
+	if (nanoPubSub__Message_hasBody(type) && numDelims < 5) {
+		return 0;
+	}
+
+	/* Empty fields are not allowed */
+	if (delims[2] == delims[1] + 1 || delims[3] == delims[2] + 1
+			|| (nanoPubSub__Message_hasBody(type)
+				&& delims[4] == delims[3] + 1)) {
+		return 0;
+	}
+
+	view->type            = type;
+	view->clientId.data   = string + delims[1] + 1;
+	view->clientId.length = delims[2] - delims[1] - 1;
+	view->topic.data      = string + delims[2] + 1;
+	view->topic.length    = delims[3] - delims[2] - 1;
+
+	if (nanoPubSub__Message_hasBody(type)) {
+		view->body.data   = string + delims[3] + 1;
+		view->body.length = delims[4] - delims[3] - 1;
+		view->length      = delims[4] + 1;
+	} else {
+		view->length      = delims[3] + 1;
+	}
+
+	return 1;
+}
+
+
+#ifndef NDEBUG
+/**
+ * Compares two views field by field. Used to check the fast path against
+ * the state machine in debug builds.
+ */
+static int sameView(const nanoPubSub__Message_view *a,
+		const nanoPubSub__Message_view *b)
+{
+	return a->type == b->type && a->length == b->length
+		&& a->clientId.data == b->clientId.data
+		&& a->clientId.length == b->clientId.length
+		&& a->topic.data == b->topic.data
+		&& a->topic.length == b->topic.length
+		&& a->body.data == b->body.data
+		&& a->body.length == b->body.length;
+}
+#endif
+
+
+/**
+ * Reads a length-prefixed field of a binary message.
+ *
+ * @return 1 on success, 0 if the field is truncated
+ */
+static inline int readField(const uint8_t *string, size_t size, size_t *pos,
+		nanoPubSub__Message_slice *slice)
+{
+	uint32_t length;
+
+	if (!nanoPubSub__Message_readVarint(string, size, pos, &length)
+			|| length > size - *pos) {
+		return 0;
+	}
+
+	slice->data   = (const char*)string + *pos;
+	slice->length = length;
+	*pos += length;
+
+	return 1;
+}
+
+
+/**
+ * Parses a binary message. Unlike the state machine, the view is only
+ * written if the message is complete.
+ *
+ * @param string The string to parse, starting with the magic byte
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 on success, 0 on error
+ */
+static int parseFrameBinary(const char* string, const unsigned int size,
+		nanoPubSub__Message_view *view)
+{
+	const uint8_t *bytes = (const uint8_t*)string;
+	nanoPubSub__Message_view result;
+	size_t pos = 2;
+	uint8_t header;
+
+	if (size < 2 || bytes[0] != NANOPUBSUB__BINARY_MAGIC) {
+		return 0;
+	}
+
+	/* The header's lower two bits and bit 3 hold the type, bit 2 the topic
+	   id flag and bit 4 the client id flag. All other bits are reserved and
+	   must be 0. */
+	header = bytes[1];
+	if ((header & ~(0x03 | NANOPUBSUB__BINARY_TOPIC_ID
+			| NANOPUBSUB__BINARY_TYPE_HIGH
+			| NANOPUBSUB__BINARY_CLIENT_ID)) != 0) {
+		return 0;
+	}
+
+	memset(&result, 0, sizeof(result));
+	result.type = (header & 0x03)
+		| (header & NANOPUBSUB__BINARY_TYPE_HIGH ? 0x04 : 0);
+
+	/* Ids are registered by their strings, so registrations never use
+	   ids themselves */
+	if ((result.type == NANOPUBSUB__REGISTER_MESSAGE
+			|| result.type == NANOPUBSUB__REGISTERED_MESSAGE)
+			&& (header & (NANOPUBSUB__BINARY_TOPIC_ID
+				| NANOPUBSUB__BINARY_CLIENT_ID)) != 0) {
+		return 0;
+	}
+
+	if (header & NANOPUBSUB__BINARY_CLIENT_ID) {
+		if (!nanoPubSub__Message_readVarint(bytes, size, &pos,
+				&result.clientNumber)
+				|| result.clientNumber == 0) {
+			return 0;
+		}
+	} else if (!readField(bytes, size, &pos, &result.clientId)
+			|| result.clientId.length == 0) {
+		return 0;
+	}
+
+	if (header & NANOPUBSUB__BINARY_TOPIC_ID) {
+		if (!nanoPubSub__Message_readVarint(bytes, size, &pos,
+				&result.topicId)
+				|| result.topicId == 0) {
+			return 0;
+		}
+	} else if (!readField(bytes, size, &pos, &result.topic)
+			|| result.topic.length == 0) {
+		return 0;
+	}
+
+	/* Binary bodies are raw bytes and may be empty. A registered
+	   message's body holds the assigned ids. */
+	if (nanoPubSub__Message_hasBody(result.type)
+			&& !readField(bytes, size, &pos, &result.body)) {
+		return 0;
+	}
+
+	result.length = pos;
+	*view = result;
+
+	return 1;
+}
+
+
+/**
+ * Parses a string for a message and records the positions of the
+ * message's fields. Binary messages are recognized by their magic byte.
+ * Well-formed text messages take the vectorized fast path, everything
+ * else goes through the state machine.
+ *
+ * @param string The string to parse
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 on success, 0 on error
+ */
+static int parseFrame(const char* string, const unsigned int size,
+		nanoPubSub__Message_view *view)
+{
+#ifndef NDEBUG
+	/* Debug builds parse every message twice and make sure both parsers
+	   agree */
+	nanoPubSub__Message_view check = *view;
+#endif
+
+	if (size > 0 && (uint8_t)string[0] == NANOPUBSUB__BINARY_MAGIC) {
+		return parseFrameBinary(string, size, view);
+	}
+
+	if (nanoPubSub__Message_parseFrameFast(string, size, view)) {
+		assert(nanoPubSub__Message_parseFrameScalar(string, size, &check)
+			== 1);
+		assert(sameView(view, &check));
+		return 1;
+	}
+
+	return nanoPubSub__Message_parseFrameScalar(string, size, view);
+}
+
+
+/**
+ * Copies a field of a message view into a Null-terminated string, taken
+ * from an arena if one is given and allocated on the heap otherwise.
+ *
+ * @param slice The field to copy
+ * @param string Pointer to the string pointer to write the copy to
+ * @param arena The arena to take the string from, or NULL
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+static int copySlice(const nanoPubSub__Message_slice *slice, char **string,
+		nanoPubSub__Arena *arena)
+{
+	if (arena != NULL) {
+		return (*string = nanoPubSub__Arena_copyString(arena, slice->data,
+			slice->length)) != NULL;
+	}
+
+	if ((*string = (char*)malloc(slice->length + 1)) == NULL) {
+		return 0;
+	}
+
+	memcpy(*string, slice->data, slice->length);
+	(*string)[slice->length] = '\0';
+
+	return 1;
+}
+
+
+/**
+ * Parses a string for a message and copies its fields, see
+ * nanoPubSub__Message_parseString.
+ *
+ * @param arena The arena to copy the fields into, or NULL to allocate them
+ *              on the heap
+ */
+static int parseStringInto(const char* string, const unsigned int size,
+		nanoPubSub__Message *msg, nanoPubSub__Arena *arena)
+{
+	nanoPubSub__Message_view view;
+	int retval;
+
+	/* Make sure the message is not longer than the max. allowed length */
+	if (size > NANOPUBSUB__MAX_MESSAGE_LENGTH) {
+		return -1;
+	}
+
+	memset(&view, 0, sizeof(view));
+	view.type = msg->type;
+
+	retval = parseFrame(string, size, &view);
+	msg->type           = view.type;
+	msg->bodyLength     = view.body.length;
+	msg->topicId        = view.topicId;
+	msg->clientNumber   = view.clientNumber;
+
+	/* Copy all fields that have been found, even if a later one failed */
+	if (view.clientId.data != NULL
+			&& !copySlice(&view.clientId, &msg->clientId, arena))
+		return 0;
+	if (view.topic.data != NULL && !copySlice(&view.topic, &msg->topic, arena))
+		return 0;
+	if (view.body.data != NULL && !copySlice(&view.body, &msg->body, arena))
+		return 0;
+
+	return retval;
+}
+
+
+/**
+ * Parses a given string for a nanoPubSub message.
+ *
+ * @param string The Null-terminated string to parse
+ * @param size The length of the string (in bytes) to parse
+ * @param msg Pointer to the message to write the results into
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Message_parseString(const char* string,
+		const unsigned int size, nanoPubSub__Message *msg)
+{
+	return parseStringInto(string, size, msg, NULL);
+}
+
+
+/**
+ * Does the same as nanoPubSub__Message_parseString, but copies the
+ * message's fields into an arena instead of allocating them one by one.
+ * The fields stay valid until the arena is reset.
+ *
+ * @param string The string to parse
+ * @param size The length of the string (in bytes) to parse
+ * @param msg Pointer to the message to write the results into
+ * @param arena The arena to copy the fields into
+ *
+ * @return 1 on success, 0 on error (including an exhausted arena)
+ */
+int nanoPubSub__Message_parseStringArena(const char* string,
+		const unsigned int size, nanoPubSub__Message *msg,
+		nanoPubSub__Arena *arena)
+{
+	return parseStringInto(string, size, msg, arena);
+}
+
+
+/**
+ * Parses a given string for a nanoPubSub message without allocating any
+ * memory. The fields of the resulting view point into the given string,
+ * so the string must outlive the view.
+ *
+ * Strings starting with NANOPUBSUB__BINARY_MAGIC are parsed as binary
+ * messages, all others as text messages.
+ *
+ * @param string The string to parse (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 if a complete message was found, 0 on error
+ */
+int nanoPubSub__Message_parseView(const char* string,
+		const unsigned int size, nanoPubSub__Message_view *view)
+{
+	/* Make sure the message is not longer than the max. allowed length */
+	if (size > NANOPUBSUB__MAX_MESSAGE_LENGTH) {
+		memset(view, 0, sizeof(*view));
+		return 0;
+	}
+
+	return nanoPubSub__Message_parseLargeView(string, size, view);
+}
+
+
+/**
+ * Does the same as nanoPubSub__Message_parseView, but accepts messages of
+ * up to NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH bytes, e.g. messages that
+ * have been reassembled from fragments.
+ *
+ * @param string The string to parse (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 if a complete message was found, 0 on error
+ */
+int nanoPubSub__Message_parseLargeView(const char* string,
+		const unsigned int size, nanoPubSub__Message_view *view)
+{
+	memset(view, 0, sizeof(*view));
+
+	if (size > NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH) {
+		return 0;
+	}
+
+	/* Only complete messages are accepted, as there is no other way for
+	   the caller to tell which fields are valid */
+	if (parseFrame(string, size, view) != 1 || view->length == 0) {
+		view->length = 0;
+		return 0;
+	}
+
+	view->frame = string;
+
+	return 1;
+}
+
+
+/**
+ * Fills a view with the fields of a message. The view points into the
+ * message's strings, so no memory is copied.
+ *
+ * @param msg The message to describe
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 on success, 0 if the message is incomplete
+ */
+int nanoPubSub__Message_toView(const nanoPubSub__Message *msg,
+		nanoPubSub__Message_view *view)
+{
+	memset(view, 0, sizeof(*view));
+
+	if (msg == NULL || (msg->clientId == NULL && msg->clientNumber == 0)
+			|| (msg->topic == NULL && msg->topicId == 0)
+			|| (nanoPubSub__Message_hasBody(msg->type)
+				&& msg->body == NULL)) {
+		return 0;
+	}
+
+	view->type         = msg->type;
+	view->topicId      = msg->topicId;
+	view->clientNumber = msg->clientNumber;
+
+	if (msg->clientNumber == 0) {
+		view->clientId.data   = msg->clientId;
+		view->clientId.length = strlen(msg->clientId);
+	}
+
+	if (msg->topicId == 0) {
+		view->topic.data   = msg->topic;
+		view->topic.length = strlen(msg->topic);
+	}
+
+	if (nanoPubSub__Message_hasBody(msg->type)) {
+		view->body.data   = msg->body;
+		view->body.length = bodyLength(msg);
+	}
+
+	return 1;
+}
+
+
+/**
+ * Calculates the length of the text representation of a message view
+ * (in bytes).
+ *
+ * @param view The message to calculate the length for
+ * @return The length of the message's text representation, or 0 if the
+ *         message cannot be represented as text
+ */
+size_t nanoPubSub__Message_viewLength(const nanoPubSub__Message_view *view)
+{
+	size_t length;
+
+	/* Ids and empty fields only exist in binary messages */
+	if (view->topicId != 0 || view->clientNumber != 0
+			|| view->clientId.length == 0 || view->topic.length == 0) {
+		return 0;
+	}
+
+	switch (view->type)
+	{
+		case NANOPUBSUB__STANDARD_MESSAGE:
+			if (view->body.length == 0) {
+				return 0;
+			}
+			length = 8 + view->body.length; /* 5x '#' + "msg" */
+			break;
+
+		case NANOPUBSUB__SUBSCRIBE_MESSAGE:
+			length = 7; /* 4x '#' + "sub" */
+			break;
+
+		case NANOPUBSUB__UNSUBSCRIBE_MESSAGE:
+			length = 9; /* 4x '#' + "unsub" */
+			break;
+
+		case NANOPUBSUB__PING_MESSAGE:
+		case NANOPUBSUB__PONG_MESSAGE:
+			length = 8; /* 4x '#' + "ping"/"pong" */
+			break;
+
+		case NANOPUBSUB__REGISTER_MESSAGE:
+			length = 7; /* 4x '#' + "reg" */
+			break;
+
+		case NANOPUBSUB__REPLAY_MESSAGE:
+			if (view->body.length == 0) {
+				return 0;
+			}
+			length = 11 + view->body.length; /* 5x '#' + "replay" */
+			break;
+
+		default:
+			return 0;
+	}
+
+	return length + view->clientId.length + view->topic.length;
+}
+
+
+/**
+ * Appends a field to a text message: the field's characters followed by
+ * a delimiter.
+ */
+static inline char *appendField(char *pos,
+		const nanoPubSub__Message_slice *slice)
+{
+	memcpy(pos, slice->data, slice->length);
+	pos[slice->length] = '#';
+
+	return pos + slice->length + 1;
+}
+
+
+/**
+ * Writes the text representation of a message view into a buffer. No
+ * Null character is appended.
+ *
+ * @param view The message to write
+ * @param buffer The buffer to write the message into
+ * @param maxLength The size of the buffer (in bytes)
+ *
+ * @return The number of bytes written, or 0 if the message cannot be
+ *         represented as text or does not fit into the buffer
+ */
+size_t nanoPubSub__Message_writeViewString(
+		const nanoPubSub__Message_view *view, char *buffer,
+		const size_t maxLength)
+{
+	size_t length = nanoPubSub__Message_viewLength(view);
+	char *pos = buffer;
+
+	if (length == 0 || length > maxLength) {
+		return 0;
+	}
+
+	/* Text messages must not contain the delimiter */
+	if (memchr(view->clientId.data, '#', view->clientId.length) != NULL
+			|| memchr(view->topic.data, '#', view->topic.length) != NULL
+			|| (nanoPubSub__Message_hasBody(view->type)
+				&& memchr(view->body.data, '#', view->body.length) != NULL)) {
+		return 0;
+	}
+
+	switch (view->type)
+	{
+		case NANOPUBSUB__STANDARD_MESSAGE:
+			memcpy(pos, "#msg#", 5);
+			pos += 5;
+			break;
+
+		case NANOPUBSUB__SUBSCRIBE_MESSAGE:
+			memcpy(pos, "#sub#", 5);
+			pos += 5;
+			break;
+
+		case NANOPUBSUB__UNSUBSCRIBE_MESSAGE:
+			memcpy(pos, "#unsub#", 7);
+			pos += 7;
+			break;
+
+		case NANOPUBSUB__PING_MESSAGE:
+			memcpy(pos, "#ping#", 6);
+			pos += 6;
+			break;
+
+		case NANOPUBSUB__PONG_MESSAGE:
+			memcpy(pos, "#pong#", 6);
+			pos += 6;
+			break;
+
+		case NANOPUBSUB__REGISTER_MESSAGE:
+			memcpy(pos, "#reg#", 5);
+			pos += 5;
+			break;
+
+		case NANOPUBSUB__REPLAY_MESSAGE:
+			memcpy(pos, "#replay#", 8);
+			pos += 8;
+			break;
+	}
+
+	pos = appendField(pos, &view->clientId);
+	pos = appendField(pos, &view->topic);
+
+	if (nanoPubSub__Message_hasBody(view->type)) {
+		pos = appendField(pos, &view->body);
+	}
+
+	assert((size_t)(pos - buffer) == length);
+
+	return length;
+}
+
+
+/**
+ * Calculates the length of the binary representation of a message view
+ * (in bytes).
+ *
+ * @param view The message to calculate the length for
+ * @return The length of the message's binary representation, or 0 if an
+ *         error occurred
+ */
+size_t nanoPubSub__Message_viewBinaryLength(
+		const nanoPubSub__Message_view *view)
+{
+	size_t length = 2; /* magic byte + header */
+
+	if (view->type > NANOPUBSUB__REPLAY_MESSAGE
+			|| view->clientId.length > UINT32_MAX
+			|| view->topic.length > UINT32_MAX
+			|| view->body.length > UINT32_MAX
+			|| (view->clientNumber == 0 && view->clientId.length == 0)
+			|| (view->topicId == 0 && view->topic.length == 0)) {
+		return 0;
+	}
+
+	/* Registrations carry the strings the ids are assigned to */
+	if ((view->type == NANOPUBSUB__REGISTER_MESSAGE
+			|| view->type == NANOPUBSUB__REGISTERED_MESSAGE)
+			&& (view->clientNumber != 0 || view->topicId != 0)) {
+		return 0;
+	}
+
+	if (view->clientNumber != 0) {
+		length += nanoPubSub__Message_varintLength(view->clientNumber);
+	} else {
+		length += nanoPubSub__Message_varintLength(view->clientId.length)
+			+ view->clientId.length;
+	}
+
+	if (view->topicId != 0) {
+		length += nanoPubSub__Message_varintLength(view->topicId);
+	} else {
+		length += nanoPubSub__Message_varintLength(view->topic.length)
+			+ view->topic.length;
+	}
+
+	if (nanoPubSub__Message_hasBody(view->type)) {
+		length += nanoPubSub__Message_varintLength(view->body.length)
+			+ view->body.length;
+	}
+
+	return length;
+}
+
+
+/**
+ * Appends a length-prefixed field to a binary message.
+ */
+static inline uint8_t *appendBinaryField(uint8_t *pos,
+		const nanoPubSub__Message_slice *slice)
+{
+	pos += nanoPubSub__Message_writeVarint(pos, slice->length);
+	memcpy(pos, slice->data, slice->length);
+
+	return pos + slice->length;
+}
+
+
+/**
+ * Writes the binary representation of a message view into a buffer.
+ *
+ * A binary message consists of NANOPUBSUB__BINARY_MAGIC, a header byte
+ * holding the message type and flags, and the length-prefixed fields.
+ * All lengths and the topic id are encoded as unsigned LEB128 varints.
+ *
+ * @param view The message to write
+ * @param buffer The buffer to write the message into
+ * @param maxLength The size of the buffer (in bytes)
+ *
+ * @return The number of bytes written, or 0 if the message is invalid or
+ *         does not fit into the buffer
+ */
+size_t nanoPubSub__Message_writeViewBinary(
+		const nanoPubSub__Message_view *view, char *buffer,
+		const size_t maxLength)
+{
+	size_t length = nanoPubSub__Message_viewBinaryLength(view);
+	uint8_t *pos = (uint8_t*)buffer;
+
+	if (length == 0 || length > maxLength) {
+		return 0;
+	}
+
+	*pos++ = NANOPUBSUB__BINARY_MAGIC;
+	*pos++ = (view->type & 0x03)
+		| (view->type & 0x04 ? NANOPUBSUB__BINARY_TYPE_HIGH : 0)
+		| (view->topicId != 0 ? NANOPUBSUB__BINARY_TOPIC_ID : 0)
+		| (view->clientNumber != 0 ? NANOPUBSUB__BINARY_CLIENT_ID : 0);
+
+	if (view->clientNumber != 0) {
+		pos += nanoPubSub__Message_writeVarint(pos, view->clientNumber);
+	} else {
+		pos = appendBinaryField(pos, &view->clientId);
+	}
+
+	if (view->topicId != 0) {
+		pos += nanoPubSub__Message_writeVarint(pos, view->topicId);
+	} else {
+		pos = appendBinaryField(pos, &view->topic);
+	}
+
+	if (nanoPubSub__Message_hasBody(view->type)) {
+		pos = appendBinaryField(pos, &view->body);
+	}
+
+	assert((size_t)(pos - (uint8_t*)buffer) == length);
+
+	return length;
+}
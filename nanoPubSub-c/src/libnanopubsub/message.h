@@ -22,6 +22,9 @@
 #include <stdint.h>
 #include <ctype.h>
 #include <assert.h>
+#include <sys/uio.h>
+
+#include "arena.h"
 
 #ifndef __LIBNANOPUBSUB__MESSAGE_H
 #define __LIBNANOPUBSUB__MESSAGE_H
@@ -30,6 +33,18 @@
 /** The maximum message length for nanoPubSub messages */
 #define NANOPUBSUB__MAX_MESSAGE_LENGTH	1024
 
+/**
+ * The maximum length of messages that are split into fragments of at most
+ * NANOPUBSUB__MAX_MESSAGE_LENGTH bytes for transmission
+ */
+#define NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH	262144
+
+/**
+ * The max. number of I/O vectors describing a message string, see
+ * nanoPubSub__Message_writeIovecs
+ */
+#define NANOPUBSUB__MESSAGE_IOVECS	7
+
 
 /** A standard (text) message */
 #define NANOPUBSUB__STANDARD_MESSAGE    0
@@ -40,17 +55,69 @@
 /** An unsubscribe message */
 #define NANOPUBSUB__UNSUBSCRIBE_MESSAGE 2
 
+/** A ping message, asking the receiver to answer with a pong message */
+#define NANOPUBSUB__PING_MESSAGE        3
+
+/** A pong message, answering a ping message */
+#define NANOPUBSUB__PONG_MESSAGE        4
+
+/**
+ * A register message, asking the broker to assign numeric ids to a client
+ * id and a topic
+ */
+#define NANOPUBSUB__REGISTER_MESSAGE    5
+
+/**
+ * A registered message, answering a register message with the assigned
+ * ids. Registered messages only exist in the binary format.
+ */
+#define NANOPUBSUB__REGISTERED_MESSAGE  6
+
+/**
+ * A replay message, asking the broker to send the messages of a topic
+ * recorded in its log from a given offset or time on
+ */
+#define NANOPUBSUB__REPLAY_MESSAGE      7
+
+
+/**
+ * The first byte of every binary message. It is neither '#' nor
+ * whitespace, so text parsers reject binary messages right away.
+ */
+#define NANOPUBSUB__BINARY_MAGIC        0xA5
+
+/** Flag in a binary message's header: the topic is sent as a numeric id */
+#define NANOPUBSUB__BINARY_TOPIC_ID     0x04
+
+/**
+ * Flag in a binary message's header: 4 is added to the type held by the
+ * header's lower two bits
+ */
+#define NANOPUBSUB__BINARY_TYPE_HIGH    0x08
+
+/**
+ * Flag in a binary message's header: the client id is sent as a numeric
+ * id
+ */
+#define NANOPUBSUB__BINARY_CLIENT_ID    0x10
+
 
 /**
  * This structure encapsulates a nanoPubSub message. A message can be
- * either a standard (text) message, a subscribe message or an
- * unsubscribe message.
+ * either a standard (text) message, a subscribe message, an unsubscribe
+ * message, a ping or pong message, a register or registered message, or
+ * a replay message. Ping and pong messages carry an opaque token in the
+ * topic field, which the pong echoes. Replay messages carry the position
+ * to replay from in the body field.
  */
 typedef struct
 {
 	/**
 	 * The type of the message. This must be NANOPUBSUB__STANDARD_MESSAGE,
-	 * NANOPUBSUB__SUBSCRIBE_MESSAGE or NANOPUBSUB_UNSUBSCRIBE_MESSAGE.
+	 * NANOPUBSUB__SUBSCRIBE_MESSAGE, NANOPUBSUB_UNSUBSCRIBE_MESSAGE,
+	 * NANOPUBSUB__PING_MESSAGE, NANOPUBSUB__PONG_MESSAGE,
+	 * NANOPUBSUB__REGISTER_MESSAGE, NANOPUBSUB__REGISTERED_MESSAGE or
+	 * NANOPUBSUB__REPLAY_MESSAGE.
 	 */
 	uint8_t type;
 
@@ -62,15 +129,102 @@ typedef struct
 
 	/** The message's body (Null-terminated string) */
 	char *body;	
+
+	/**
+	 * The length of the message's body (in bytes). Binary bodies may
+	 * contain Null characters and must set this; 0 means that the length
+	 * is determined with strlen().
+	 */
+	size_t bodyLength;
+
+	/**
+	 * A numeric id sent instead of the topic string, or 0 if the topic
+	 * string is used. Topic ids can only be sent in binary messages.
+	 */
+	uint32_t topicId;
+
+	/**
+	 * A numeric id sent instead of the client id string, or 0 if the
+	 * client id string is used. Like topic ids, client numbers are
+	 * assigned by the broker and can only be sent in binary messages.
+	 */
+	uint32_t clientNumber;
 } nanoPubSub__Message;
 
 
+/**
+ * A borrowed, non Null-terminated part of a string, described by a pointer
+ * to its first character and its length.
+ */
+typedef struct
+{
+	/** The first character of the slice, or NULL if it is not set */
+	const char *data;
+
+	/** The number of characters in the slice */
+	size_t length;
+} nanoPubSub__Message_slice;
+
+
+/**
+ * A parsed nanoPubSub message whose fields point into the buffer the
+ * message was parsed from. Views never own any memory, so they need not
+ * be freed, but they are only valid as long as the buffer is.
+ */
+typedef struct
+{
+	/**
+	 * The type of the message. This must be NANOPUBSUB__STANDARD_MESSAGE,
+	 * NANOPUBSUB__SUBSCRIBE_MESSAGE, NANOPUBSUB_UNSUBSCRIBE_MESSAGE,
+	 * NANOPUBSUB__PING_MESSAGE, NANOPUBSUB__PONG_MESSAGE,
+	 * NANOPUBSUB__REGISTER_MESSAGE, NANOPUBSUB__REGISTERED_MESSAGE or
+	 * NANOPUBSUB__REPLAY_MESSAGE.
+	 */
+	uint8_t type;
+
+	/** The id of the message's sender (unset if a client number is used) */
+	nanoPubSub__Message_slice clientId;
+
+	/**
+	 * The sender's numeric client id, or 0 if the client id string is
+	 * used
+	 */
+	uint32_t clientNumber;
+
+	/**
+	 * The message's topic (unset if a topic id is used), or the token of a
+	 * ping or pong message
+	 */
+	nanoPubSub__Message_slice topic;
+
+	/** The message's numeric topic id, or 0 if the topic string is used */
+	uint32_t topicId;
+
+	/**
+	 * The message's body (unset for messages of types without a body, see
+	 * nanoPubSub__Message_hasBody)
+	 */
+	nanoPubSub__Message_slice body;
+
+	/** The first byte of the string the message was parsed from */
+	const char *frame;
+
+	/**
+	 * The number of bytes from frame up to the end of the message, i.e.
+	 * up to and including a text message's last '#'
+	 */
+	size_t length;
+} nanoPubSub__Message_view;
+
+
 /**
  * Safely adds a number of type size_t to another number of type size_t.
  *
  * This function is used to avoid integer overflows. It first checks if the
  * result of the operation would be greater than the maximum value allowed
  * for the type size_t and only executes the operation if it is possible.
+ * Either number may be 0, so that sums can start at 0 and include empty
+ * fields; the sum is then never smaller than either number.
  *
  * @param numberA A pointer to the first number. The other number is added to
  *                the value pointed to by this pointer.
@@ -97,16 +251,112 @@ static inline int nanoPubSub__Message_safeAdd(size_t *numberA,
 	*numberA += numberB;
 
 	/* Make sure everything worked out. */
-	assert(*numberA > numberAOld);
-	assert(*numberA > numberB);
+	assert(*numberA >= numberAOld);
+	assert(*numberA >= numberB);
 
 	return 1;
 }
 
 
+/**
+ * Checks whether messages of a type have a body.
+ *
+ * @param type The message type
+ * @return 1 for standard, registered and replay messages, 0 otherwise
+ */
+static inline int nanoPubSub__Message_hasBody(uint8_t type)
+{
+	return type == NANOPUBSUB__STANDARD_MESSAGE
+		|| type == NANOPUBSUB__REGISTERED_MESSAGE
+		|| type == NANOPUBSUB__REPLAY_MESSAGE;
+}
+
+
+/**
+ * Reads an unsigned LEB128 varint of up to 32 bits.
+ *
+ * @param string The string to read from
+ * @param size The length of the string (in bytes)
+ * @param pos Pointer to the position to read at, advanced past the varint
+ * @param value Pointer to store the decoded value in
+ *
+ * @return 1 on success, 0 if the varint is truncated, too long or does
+ *         not fit into 32 bits
+ */
+static inline int nanoPubSub__Message_readVarint(const uint8_t *string,
+		size_t size, size_t *pos, uint32_t *value)
+{
+	uint32_t result = 0;
+	unsigned int shift;
+
+	for (shift = 0; shift < 35 && *pos < size; shift += 7) {
+		uint8_t byte = string[(*pos)++];
+
+		/* The fifth byte only has room for the top 4 bits */
+		if (shift == 28 && (byte & 0x70) != 0) {
+			return 0;
+		}
+
+		result |= (uint32_t)(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0) {
+			*value = result;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Calculates the number of bytes needed to encode a value as varint.
+ *
+ * @param value The value to encode
+ * @return The length of the encoded value (in bytes)
+ */
+static inline size_t nanoPubSub__Message_varintLength(uint32_t value)
+{
+	size_t length = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		length++;
+	}
+
+	return length;
+}
+
+
+/**
+ * Writes a value as unsigned LEB128 varint. The buffer must be large
+ * enough for nanoPubSub__Message_varintLength(value) bytes.
+ *
+ * @param buffer The buffer to write the varint into
+ * @param value The value to encode
+ *
+ * @return The number of bytes written
+ */
+static inline size_t nanoPubSub__Message_writeVarint(uint8_t *buffer,
+		uint32_t value)
+{
+	size_t length = 0;
+
+	while (value >= 0x80) {
+		buffer[length++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[length++] = (uint8_t)value;
+
+	return length;
+}
+
+
 /**
  * Calculates the length of a given nanoPubSub message (in bytes)
- * and returns it.
+ * and returns it. Callers that know the lengths of all fields should
+ * describe the message with a nanoPubSub__Message_view instead, whose
+ * functions never scan any strings.
  *
  * @param msg The message to calculate the length for
  * @return The length of the given message, or 0 if an error occurred
@@ -128,6 +378,24 @@ void nanoPubSub__Message_writeString(const nanoPubSub__Message *msg,
 	char *buffer, const size_t maxLength);
 
 
+/**
+ * Describes the string representation of the given message as a list of
+ * I/O vectors, e.g. for sendmsg(). The delimiters are static strings and
+ * the fields point to the message's own strings, so nothing is copied,
+ * and every field is scanned by strlen() once at most.
+ *
+ * @param msg The message to describe
+ * @param iovecs An array of at least NANOPUBSUB__MESSAGE_IOVECS I/O
+ *               vectors to fill in
+ * @param length Pointer to store the length of the string in (in bytes,
+ *               without a trailing Null character)
+ *
+ * @return The number of I/O vectors used, or 0 if the message is invalid
+ */
+int nanoPubSub__Message_writeIovecs(const nanoPubSub__Message *msg,
+	struct iovec *iovecs, size_t *length);
+
+
 /**
  * Parses a given string for a nanoPubSub message.
  *
@@ -141,4 +409,127 @@ int nanoPubSub__Message_parseString(const char* string,
 	const unsigned int size, nanoPubSub__Message *msg);
 
 
+/**
+ * Does the same as nanoPubSub__Message_parseString, but copies the
+ * message's fields into an arena instead of allocating them one by one.
+ * The fields stay valid until the arena is reset.
+ *
+ * @param string The string to parse
+ * @param size The length of the string (in bytes) to parse
+ * @param msg Pointer to the message to write the results into
+ * @param arena The arena to copy the fields into
+ *
+ * @return 1 on success, 0 on error (including an exhausted arena)
+ */
+int nanoPubSub__Message_parseStringArena(const char* string,
+	const unsigned int size, nanoPubSub__Message *msg,
+	nanoPubSub__Arena *arena);
+
+
+
+/**
+ * Parses a given string for a nanoPubSub message without allocating any
+ * memory. The fields of the resulting view point into the given string,
+ * so the string must outlive the view.
+ *
+ * Strings starting with NANOPUBSUB__BINARY_MAGIC are parsed as binary
+ * messages, all others as text messages.
+ *
+ * @param string The string to parse (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 if a complete message was found, 0 on error
+ */
+int nanoPubSub__Message_parseView(const char* string,
+	const unsigned int size, nanoPubSub__Message_view *view);
+
+
+
+/**
+ * Does the same as nanoPubSub__Message_parseView, but accepts messages of
+ * up to NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH bytes, e.g. messages that
+ * have been reassembled from fragments.
+ *
+ * @param string The string to parse (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 if a complete message was found, 0 on error
+ */
+int nanoPubSub__Message_parseLargeView(const char* string,
+	const unsigned int size, nanoPubSub__Message_view *view);
+
+
+/**
+ * Fills a view with the fields of a message. The view points into the
+ * message's strings, so no memory is copied.
+ *
+ * @param msg The message to describe
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 on success, 0 if the message is incomplete
+ */
+int nanoPubSub__Message_toView(const nanoPubSub__Message *msg,
+	nanoPubSub__Message_view *view);
+
+
+/**
+ * Calculates the length of the text representation of a message view
+ * (in bytes).
+ *
+ * @param view The message to calculate the length for
+ * @return The length of the message's text representation, or 0 if the
+ *         message cannot be represented as text
+ */
+size_t nanoPubSub__Message_viewLength(const nanoPubSub__Message_view *view);
+
+
+/**
+ * Writes the text representation of a message view into a buffer. No
+ * Null character is appended.
+ *
+ * @param view The message to write
+ * @param buffer The buffer to write the message into
+ * @param maxLength The size of the buffer (in bytes)
+ *
+ * @return The number of bytes written, or 0 if the message cannot be
+ *         represented as text or does not fit into the buffer
+ */
+size_t nanoPubSub__Message_writeViewString(
+	const nanoPubSub__Message_view *view, char *buffer,
+	const size_t maxLength);
+
+
+/**
+ * Calculates the length of the binary representation of a message view
+ * (in bytes).
+ *
+ * @param view The message to calculate the length for
+ * @return The length of the message's binary representation, or 0 if an
+ *         error occurred
+ */
+size_t nanoPubSub__Message_viewBinaryLength(
+	const nanoPubSub__Message_view *view);
+
+
+/**
+ * Writes the binary representation of a message view into a buffer.
+ *
+ * A binary message consists of NANOPUBSUB__BINARY_MAGIC, a header byte
+ * holding the message type and flags, and the length-prefixed fields.
+ * All lengths, the client number and the topic id are encoded as unsigned
+ * LEB128 varints.
+ *
+ * @param view The message to write
+ * @param buffer The buffer to write the message into
+ * @param maxLength The size of the buffer (in bytes)
+ *
+ * @return The number of bytes written, or 0 if the message is invalid or
+ *         does not fit into the buffer
+ */
+size_t nanoPubSub__Message_writeViewBinary(
+	const nanoPubSub__Message_view *view, char *buffer,
+	const size_t maxLength);
+
 #endif /* __LIBNANOPUBSUB__MESSAGE_H */
@@ -0,0 +1,147 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "metrics.h"
+
+
+/** The names of the counters, as written by nanoPubSub__Metrics_format */
+static const char *counterNames[NANOPUBSUB__METRIC_COUNTERS] = {
+	"received", "bytes_received", "parse_errors", "sent", "bytes_sent",
+	"dropped", "recv_errors", "send_errors"
+};
+
+/** The names of the histograms, as written by nanoPubSub__Metrics_format */
+static const char *histogramNames[NANOPUBSUB__METRIC_HISTOGRAMS] = {
+	"fan_out", "processing_ns"
+};
+
+
+/**
+ * Initializes metrics with all counters at 0 and empty histograms.
+ *
+ * @param metrics The metrics to initialize
+ */
+void nanoPubSub__Metrics_init(nanoPubSub__Metrics *metrics)
+{
+	unsigned int i;
+
+	memset(metrics->counters, 0, sizeof(metrics->counters));
+
+	for (i = 0; i < NANOPUBSUB__METRIC_HISTOGRAMS; i++) {
+		nanoPubSub__Histogram_init(&metrics->histograms[i]);
+	}
+}
+
+
+/**
+ * Adds the metrics of a thread to a total. The thread may update its
+ * metrics at the same time.
+ *
+ * @param total The metrics to add to, owned by the calling thread
+ * @param metrics The metrics to add
+ */
+void nanoPubSub__Metrics_aggregate(nanoPubSub__Metrics *total,
+		const nanoPubSub__Metrics *metrics)
+{
+	const nanoPubSub__Histogram *from;
+	nanoPubSub__Histogram *to;
+	uint64_t value;
+	unsigned int i, j;
+
+	for (i = 0; i < NANOPUBSUB__METRIC_COUNTERS; i++) {
+		total->counters[i] += __atomic_load_n(&metrics->counters[i],
+			__ATOMIC_RELAXED);
+	}
+
+	/* Values may be recorded while the histogram is read, so its count
+	   may be slightly off from the sum of its buckets */
+	for (i = 0; i < NANOPUBSUB__METRIC_HISTOGRAMS; i++) {
+		from = &metrics->histograms[i];
+		to   = &total->histograms[i];
+
+		for (j = 0; j < NANOPUBSUB__HISTOGRAM_BUCKETS; j++) {
+			to->counts[j] += __atomic_load_n(&from->counts[j],
+				__ATOMIC_RELAXED);
+		}
+
+		to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+		to->sum   += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+
+		if ((value = __atomic_load_n(&from->min, __ATOMIC_RELAXED))
+				< to->min) {
+			to->min = value;
+		}
+		if ((value = __atomic_load_n(&from->max, __ATOMIC_RELAXED))
+				> to->max) {
+			to->max = value;
+		}
+	}
+}
+
+
+/**
+ * Writes metrics as text: name=value pairs for all counters and for the
+ * mean, median, 99th percentile and maximum of all histograms.
+ *
+ * @param metrics The metrics to write, see nanoPubSub__Metrics_aggregate
+ * @param buffer The buffer to write the Null-terminated text into
+ * @param size The size of the buffer (in bytes)
+ * @param separator The character separating the pairs, e.g. ' ' or '\n'
+ *
+ * @return The length of the text, which is cut if it does not fit into the
+ *         buffer
+ */
+size_t nanoPubSub__Metrics_format(const nanoPubSub__Metrics *metrics,
+		char *buffer, size_t size, char separator)
+{
+	const nanoPubSub__Histogram *h;
+	size_t length = 0;
+	unsigned int i;
+	int n;
+
+	if (size == 0) {
+		return 0;
+	}
+	buffer[0] = '\0';
+
+	for (i = 0; i < NANOPUBSUB__METRIC_COUNTERS && length < size; i++) {
+		/* The separator is written before all pairs but the first */
+		n = snprintf(buffer + length, size - length, "%.*s%s=%llu", i > 0,
+			&separator, counterNames[i],
+			(unsigned long long)metrics->counters[i]);
+		length += n > 0 ? n : 0;
+	}
+
+	for (i = 0; i < NANOPUBSUB__METRIC_HISTOGRAMS && length < size; i++) {
+		h = &metrics->histograms[i];
+
+		n = snprintf(buffer + length, size - length,
+			"%c%s_mean=%llu%c%s_p50=%llu%c%s_p99=%llu%c%s_max=%llu",
+			separator, histogramNames[i], (unsigned long long)(h->count > 0
+				? h->sum / h->count : 0),
+			separator, histogramNames[i],
+			(unsigned long long)nanoPubSub__Histogram_valueAt(h, 50),
+			separator, histogramNames[i],
+			(unsigned long long)nanoPubSub__Histogram_valueAt(h, 99),
+			separator, histogramNames[i],
+			(unsigned long long)h->max);
+		length += n > 0 ? n : 0;
+	}
+
+	return length < size ? length : size - 1;
+}
@@ -0,0 +1,179 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#ifndef __LIBNANOPUBSUB__METRICS_H
+#define __LIBNANOPUBSUB__METRICS_H
+
+
+/** Counter: messages received, including the messages packed in batches */
+#define NANOPUBSUB__METRIC_RECEIVED       0
+
+/** Counter: bytes received in datagrams */
+#define NANOPUBSUB__METRIC_BYTES_RECEIVED 1
+
+/** Counter: datagrams and packed messages that are not valid messages */
+#define NANOPUBSUB__METRIC_PARSE_ERRORS   2
+
+/** Counter: messages sent */
+#define NANOPUBSUB__METRIC_SENT           3
+
+/** Counter: bytes sent */
+#define NANOPUBSUB__METRIC_BYTES_SENT     4
+
+/** Counter: valid messages that were dropped, e.g. with unknown ids */
+#define NANOPUBSUB__METRIC_DROPPED        5
+
+/** Counter: failed receive calls that were retried */
+#define NANOPUBSUB__METRIC_RECV_ERRORS    6
+
+/** Counter: messages that could not be sent to a destination */
+#define NANOPUBSUB__METRIC_SEND_ERRORS    7
+
+/** The number of counters */
+#define NANOPUBSUB__METRIC_COUNTERS       8
+
+/** Histogram: the number of subscribers a message is published to */
+#define NANOPUBSUB__METRIC_FAN_OUT         0
+
+/** Histogram: the time taken to handle a message (in nanoseconds) */
+#define NANOPUBSUB__METRIC_PROCESSING_TIME 1
+
+/** The number of histograms */
+#define NANOPUBSUB__METRIC_HISTOGRAMS      2
+
+
+/**
+ * Counters and histograms of a single thread. Only the owning thread
+ * updates them, so no update needs a lock or an atomic read-modify-write;
+ * values are stored atomically though, so that another thread may read
+ * them at any time with nanoPubSub__Metrics_aggregate. The histograms
+ * keep the counters of different threads far enough apart not to share
+ * cache lines.
+ */
+typedef struct
+{
+	/** The counters, see NANOPUBSUB__METRIC_RECEIVED etc. */
+	uint64_t counters[NANOPUBSUB__METRIC_COUNTERS];
+
+	/** The histograms, see NANOPUBSUB__METRIC_FAN_OUT etc. */
+	nanoPubSub__Histogram histograms[NANOPUBSUB__METRIC_HISTOGRAMS];
+} nanoPubSub__Metrics;
+
+
+/**
+ * Adds a value to a value only the calling thread modifies, so that
+ * concurrent readers never see a torn value.
+ */
+static inline void nanoPubSub__Metrics_add(uint64_t *target, uint64_t value)
+{
+	__atomic_store_n(target, __atomic_load_n(target, __ATOMIC_RELAXED)
+		+ value, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Adds to a counter. Must only be called by the thread owning the metrics.
+ *
+ * @param metrics The metrics, or NULL
+ * @param counter The counter, e.g. NANOPUBSUB__METRIC_RECEIVED
+ * @param value The value to add
+ */
+static inline void nanoPubSub__Metrics_count(nanoPubSub__Metrics *metrics,
+		unsigned int counter, uint64_t value)
+{
+	if (metrics != NULL) {
+		nanoPubSub__Metrics_add(&metrics->counters[counter], value);
+	}
+}
+
+
+/**
+ * Records a value in a histogram. Must only be called by the thread
+ * owning the metrics.
+ *
+ * @param metrics The metrics, or NULL
+ * @param histogram The histogram, e.g. NANOPUBSUB__METRIC_FAN_OUT
+ * @param value The value to record
+ */
+static inline void nanoPubSub__Metrics_observe(nanoPubSub__Metrics *metrics,
+		unsigned int histogram, uint64_t value)
+{
+	nanoPubSub__Histogram *h;
+
+	if (metrics == NULL) {
+		return;
+	}
+
+	h = &metrics->histograms[histogram];
+
+	nanoPubSub__Metrics_add(&h->counts[nanoPubSub__Histogram_bucket(value)],
+		1);
+	nanoPubSub__Metrics_add(&h->count, 1);
+	nanoPubSub__Metrics_add(&h->sum, value);
+
+	if (value < h->min) {
+		__atomic_store_n(&h->min, value, __ATOMIC_RELAXED);
+	}
+	if (value > h->max) {
+		__atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+	}
+}
+
+
+/**
+ * Initializes metrics with all counters at 0 and empty histograms.
+ *
+ * @param metrics The metrics to initialize
+ */
+void nanoPubSub__Metrics_init(nanoPubSub__Metrics *metrics);
+
+
+/**
+ * Adds the metrics of a thread to a total. The thread may update its
+ * metrics at the same time.
+ *
+ * @param total The metrics to add to, owned by the calling thread
+ * @param metrics The metrics to add
+ */
+void nanoPubSub__Metrics_aggregate(nanoPubSub__Metrics *total,
+	const nanoPubSub__Metrics *metrics);
+
+
+/**
+ * Writes metrics as text: name=value pairs for all counters and for the
+ * mean, median, 99th percentile and maximum of all histograms.
+ *
+ * @param metrics The metrics to write, see nanoPubSub__Metrics_aggregate
+ * @param buffer The buffer to write the Null-terminated text into
+ * @param size The size of the buffer (in bytes)
+ * @param separator The character separating the pairs, e.g. ' ' or '\n'
+ *
+ * @return The length of the text, which is cut if it does not fit into the
+ *         buffer
+ */
+size_t nanoPubSub__Metrics_format(const nanoPubSub__Metrics *metrics,
+	char *buffer, size_t size, char separator);
+
+
+#endif /* __LIBNANOPUBSUB__METRICS_H */
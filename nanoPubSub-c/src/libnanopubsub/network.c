@@ -19,6 +19,44 @@
 #include "network.h"
 
 
+/**
+ * Sends a message string that does not fit into a single datagram to
+ * another socket as a series of fragments.
+ *
+ * @return The length of the string on success. Otherwise, -1 is returned
+ *         and the global variable errno is set to indicate the error.
+ */
+static ssize_t sendFragments(int socket, const struct sockaddr *destAddr,
+		const char *string, size_t length)
+{
+	const struct sockaddr *destAddrs[1];
+
+	destAddrs[0] = destAddr;
+
+	if (nanoPubSub__Fragment_sendStringMulti(socket, destAddrs, 1, string,
+			length) != 1) {
+		return -1;
+	}
+
+	return length;
+}
+
+
+/**
+ * Copies the memory described by a list of I/O vectors into a buffer
+ * large enough to hold all of it.
+ */
+static void gatherIovecs(char *buffer, const struct iovec *iovecs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		memcpy(buffer, iovecs[i].iov_base, iovecs[i].iov_len);
+		buffer += iovecs[i].iov_len;
+	}
+}
+
+
 /**
  * Sends a given nanoPubSub message to another socket with the given
  * destination address.
@@ -34,27 +72,102 @@
 ssize_t nanoPubSub__Network_sendMessage(int socket,
 	const struct sockaddr *destAddr, const nanoPubSub__Message *msg)
 {
+	struct iovec iovecs[NANOPUBSUB__MESSAGE_IOVECS];
+	struct msghdr header;
 	size_t length;
 	ssize_t sendSize = 0;
 	char *stringbuffer;
+	int count;
 
 	/* We only have to send messages that are longer than 0 bytes */
-	if ((length = nanoPubSub__Message_length(msg)) > 0) {
-		/* Allocate memory for the string representation of the message */
-		if ((stringbuffer = (char*)malloc(length + 1)) != NULL) {
-			/* Copy the string to the newly allocated memory */
-			nanoPubSub__Message_writeString(msg, stringbuffer, length + 1);
-
-			/* Send the message ov the socket to destAddr */
-			sendSize = sendto(socket, stringbuffer, length, 0,
-			                  destAddr, sizeof(struct sockaddr));
-
-			/* Free the memory allocated for the message string */
-			free(stringbuffer);
-		} else {
-			/* An error occurred while trying to allocate memory */
-			sendSize = -1;
-		}
+	if (msg == NULL
+			|| (count = nanoPubSub__Message_writeIovecs(msg, iovecs,
+				&length)) == 0) {
+		return 0;
+	}
+
+	if (length > NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	/* Send the delimiters and the message's own strings to destAddr
+	   without copying them into a buffer first */
+	if (length <= NANOPUBSUB__MAX_MESSAGE_LENGTH) {
+		memset(&header, 0, sizeof(header));
+		header.msg_name    = (void*)destAddr;
+		header.msg_namelen = sizeof(struct sockaddr);
+		header.msg_iov     = iovecs;
+		header.msg_iovlen  = count;
+
+		return sendmsg(socket, &header, 0);
+	}
+
+	/* Only oversized messages are split into fragments, which need the
+	   string in one piece */
+	if ((stringbuffer = (char*)malloc(length)) == NULL) {
+		/* An error occurred while trying to allocate memory */
+		return -1;
+	}
+
+	gatherIovecs(stringbuffer, iovecs, count);
+	sendSize = sendFragments(socket, destAddr, stringbuffer, length);
+
+	/* Free the memory allocated for the message string */
+	free(stringbuffer);
+
+	return sendSize;
+}
+
+
+/**
+ * Sends a given nanoPubSub message in its binary representation to
+ * another socket with the given destination address.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address of the target
+ * @param msg The message to send
+ *
+ * @return Upon successful completion, the number of bytes which were sent is
+ *         returned. Otherwise, -1 is returned and the global variable errno is
+ *         set to indicate the error.
+ */
+ssize_t nanoPubSub__Network_sendBinaryMessage(int socket,
+	const struct sockaddr *destAddr, const nanoPubSub__Message *msg)
+{
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	char *binary = buffer;
+	nanoPubSub__Message_view view;
+	ssize_t sendSize;
+	size_t length;
+
+	if (!nanoPubSub__Message_toView(msg, &view)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	length = nanoPubSub__Message_viewBinaryLength(&view);
+	if (length == 0 || length > NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	/* Only oversized messages need memory from the heap */
+	if (length > sizeof(buffer) && (binary = malloc(length)) == NULL) {
+		return -1;
+	}
+
+	nanoPubSub__Message_writeViewBinary(&view, binary, length);
+
+	if (length <= NANOPUBSUB__MAX_MESSAGE_LENGTH) {
+		sendSize = sendto(socket, binary, length, 0, destAddr,
+			sizeof(struct sockaddr));
+	} else {
+		sendSize = sendFragments(socket, destAddr, binary, length);
+	}
+
+	if (binary != buffer) {
+		free(binary);
 	}
 
 	return sendSize;
@@ -65,7 +178,7 @@ int nanoPubSub__Network_recvMessage(int socket, struct sockaddr* fromAddr,
 		nanoPubSub__Message *msg)
 {
 	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
-	socklen_t fromAddrLength = sizeof(fromAddr);
+	socklen_t fromAddrLength = sizeof(struct sockaddr);
 	int bytesReceived;
 
 	bytesReceived = recvfrom(socket, &buffer, NANOPUBSUB__MAX_MESSAGE_LENGTH,
@@ -81,3 +194,629 @@ int nanoPubSub__Network_recvMessage(int socket, struct sockaddr* fromAddr,
 
 	return 1;
 }
+
+
+
+/**
+ * Receives a message and copies its fields into an arena, so that
+ * receiving does not allocate memory. The fields stay valid until the
+ * arena is reset.
+ *
+ * @param socket The file descriptor of the socket to receive from
+ * @param fromAddr Pointer to the address to store the sender's address in
+ * @param msg Pointer to the message to write the results into
+ * @param arena The arena to copy the message's fields into
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Network_recvMessageArena(int socket,
+		struct sockaddr *fromAddr, nanoPubSub__Message *msg,
+		nanoPubSub__Arena *arena)
+{
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	socklen_t fromAddrLength = sizeof(struct sockaddr);
+	ssize_t bytesReceived;
+
+	bytesReceived = recvfrom(socket, buffer, sizeof(buffer), 0,
+		fromAddr, &fromAddrLength);
+
+	if (bytesReceived == -1) {
+		return 0;
+	}
+
+	return nanoPubSub__Message_parseStringArena(buffer, bytesReceived, msg,
+		arena) == 1;
+}
+
+
+/**
+ * Receives a message into a caller-supplied buffer and parses it without
+ * allocating any memory. The view's fields point into the buffer.
+ *
+ * @param socket The file descriptor of the socket to receive from
+ * @param fromAddr Pointer to the address to store the sender's address in
+ * @param buffer The buffer to receive the message into
+ * @param bufferSize The size of the buffer (in bytes)
+ * @param view Pointer to the view to write the parsed message into
+ *
+ * @return 1 on success, 0 on error. If the message could not be received,
+ *         the global variable errno is set to indicate the error.
+ */
+int nanoPubSub__Network_recvView(int socket, struct sockaddr *fromAddr,
+		char *buffer, size_t bufferSize, nanoPubSub__Message_view *view)
+{
+	socklen_t fromAddrLength = sizeof(struct sockaddr);
+	ssize_t bytesReceived;
+
+	bytesReceived = recvfrom(socket, buffer, bufferSize, 0,
+		fromAddr, &fromAddrLength);
+
+	if (bytesReceived == -1) {
+		return 0;
+	}
+
+	return nanoPubSub__Message_parseView(buffer, bytesReceived, view);
+}
+
+
+/**
+ * Initializes a receive ring over a set of caller-supplied buffers.
+ *
+ * @param ring The ring to initialize
+ * @param buffers numSlots consecutive buffers of bufferSize bytes each
+ * @param bufferSize The size of a single buffer (in bytes)
+ * @param numSlots The number of buffers
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Network_initRecvRing(nanoPubSub__Network_recvRing *ring,
+		char *buffers, size_t bufferSize, unsigned int numSlots)
+{
+	unsigned int i;
+
+	assert(numSlots > 0);
+
+	ring->buffers    = buffers;
+	ring->bufferSize = bufferSize;
+	ring->numSlots   = numSlots;
+	ring->head       = 0;
+
+	ring->addrs   = calloc(numSlots, sizeof(*ring->addrs));
+	ring->views   = calloc(numSlots, sizeof(*ring->views));
+	ring->packed  = calloc(numSlots, sizeof(*ring->packed));
+	ring->headers = calloc(numSlots, sizeof(*ring->headers));
+	ring->iovecs  = calloc(numSlots, sizeof(*ring->iovecs));
+
+	ring->fragments = NULL;
+	ring->reliable  = NULL;
+	ring->metrics   = NULL;
+
+	if (ring->addrs == NULL || ring->views == NULL || ring->packed == NULL
+			|| ring->headers == NULL || ring->iovecs == NULL) {
+		nanoPubSub__Network_freeRecvRing(ring);
+		return 0;
+	}
+
+	/* The buffers never move, so the I/O vectors can be set up once */
+	for (i = 0; i < numSlots; i++) {
+		ring->iovecs[i].iov_base = buffers + (size_t)i * bufferSize;
+		ring->iovecs[i].iov_len  = bufferSize;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Frees the memory allocated by nanoPubSub__Network_initRecvRing. The
+ * caller's buffers are left untouched.
+ *
+ * @param ring The ring to free
+ */
+void nanoPubSub__Network_freeRecvRing(nanoPubSub__Network_recvRing *ring)
+{
+	free(ring->addrs);
+	free(ring->views);
+	free(ring->packed);
+	free(ring->headers);
+	free(ring->iovecs);
+
+	ring->addrs   = NULL;
+	ring->views   = NULL;
+	ring->packed  = NULL;
+	ring->headers = NULL;
+	ring->iovecs  = NULL;
+}
+
+
+/**
+ * Prepares a ring for the next batch: releases the messages reassembled
+ * during the previous batch and makes sure that the batch can occupy
+ * consecutive slots.
+ *
+ * @param ring The ring to receive into
+ * @param maxMessages The max. number of datagrams to receive, lowered to
+ *                    the number of slots if necessary
+ *
+ * @return The batch's first slot
+ */
+unsigned int nanoPubSub__Network_startBatch(
+		nanoPubSub__Network_recvRing *ring, unsigned int *maxMessages)
+{
+	if (*maxMessages > ring->numSlots) {
+		*maxMessages = ring->numSlots;
+	}
+
+	/* Messages reassembled during the previous batch are not needed
+	   anymore */
+	if (ring->fragments != NULL) {
+		nanoPubSub__Fragment_release(ring->fragments);
+	}
+
+	/* A batch must occupy consecutive slots, so wrap around early if the
+	   rest of the ring is too short */
+	if (ring->head + *maxMessages > ring->numSlots) {
+		ring->head = 0;
+	}
+
+	return ring->head;
+}
+
+
+/**
+ * Parses the datagrams received into the slots of a batch into views and
+ * advances the ring past the batch. The datagrams' lengths are taken from
+ * the msg_len fields of the slots' message headers, the senders from the
+ * slots' addresses. If the ring has a fragment pool, the slot holding the
+ * last fragment of a message gets the reassembled message's view; the
+ * other fragments' slots have a view length of 0. If the ring has a
+ * reliable endpoint, reliable datagrams are unwrapped and acknowledged.
+ * The slot of a datagram holding several packed messages gets the first
+ * message's view; nanoPubSub__Network_unpackNext yields the others.
+ * Datagrams whose message header has MSG_TRUNC set in msg_flags were cut
+ * off; their views have a length of 0 and they count as parse errors.
+ *
+ * @param ring The ring the batch was received into
+ * @param start The batch's first slot, see nanoPubSub__Network_startBatch
+ * @param received The number of datagrams received
+ */
+void nanoPubSub__Network_finishBatch(nanoPubSub__Network_recvRing *ring,
+		unsigned int start, unsigned int received)
+{
+	unsigned int i;
+
+	/* Parse every datagram. Invalid ones keep a view length of 0. */
+	for (i = 0; i < received; i++) {
+		const char *datagram = (const char*)ring->iovecs[start + i].iov_base;
+		const struct sockaddr *fromAddr =
+			(const struct sockaddr*)&ring->addrs[start + i];
+		nanoPubSub__Message_view *view = &ring->views[start + i];
+		nanoPubSub__Message_slice *packed = &ring->packed[start + i];
+		size_t size = ring->headers[start + i].msg_len, pos = 0;
+		const char *message;
+		size_t length;
+		int status;
+
+		packed->length = 0;
+		nanoPubSub__Metrics_count(ring->metrics,
+			NANOPUBSUB__METRIC_BYTES_RECEIVED, size);
+
+		/* A truncated datagram might still parse, but not as what was
+		   sent */
+		if (ring->headers[start + i].msg_hdr.msg_flags & MSG_TRUNC) {
+			memset(view, 0, sizeof(*view));
+			nanoPubSub__Metrics_count(ring->metrics,
+				NANOPUBSUB__METRIC_PARSE_ERRORS, 1);
+			continue;
+		}
+
+		/* Reliable datagrams are unwrapped first; acknowledgements and
+		   duplicates carry nothing to parse */
+		if (ring->reliable != NULL && size > 0
+				&& ((uint8_t)datagram[0] == NANOPUBSUB__RELIABLE_DATA_MAGIC
+				|| (uint8_t)datagram[0] == NANOPUBSUB__RELIABLE_ACK_MAGIC)) {
+			if (nanoPubSub__Reliable_receive(ring->reliable, fromAddr,
+					datagram, size, &message, &length) != 1) {
+				memset(view, 0, sizeof(*view));
+				continue;
+			}
+
+			datagram = message;
+			size     = length;
+		}
+
+		/* The slot of a batch gets the first message, the others are
+		   unpacked by the caller */
+		if (size > 0 && (uint8_t)datagram[0] == NANOPUBSUB__BATCH_MAGIC) {
+			if (nanoPubSub__Batch_next(datagram + 1, size - 1, &pos, view)) {
+				packed->data   = datagram + 1 + pos;
+				packed->length = size - 1 - pos;
+			} else {
+				memset(view, 0, sizeof(*view));
+			}
+		} else if (ring->fragments == NULL || size == 0
+				|| (uint8_t)datagram[0] != NANOPUBSUB__FRAGMENT_MAGIC) {
+			nanoPubSub__Message_parseView(datagram, size, view);
+		} else if ((status = nanoPubSub__Fragment_reassemble(ring->fragments,
+				fromAddr, datagram, size, &message, &length)) == 1) {
+			nanoPubSub__Message_parseLargeView(message, length, view);
+		} else {
+			/* A fragment that leaves its message incomplete is fine */
+			memset(view, 0, sizeof(*view));
+			if (status == 0) {
+				continue;
+			}
+		}
+
+		nanoPubSub__Metrics_count(ring->metrics, view->length > 0
+			? NANOPUBSUB__METRIC_RECEIVED : NANOPUBSUB__METRIC_PARSE_ERRORS,
+			1);
+	}
+
+	/* A single acknowledgement per sender covers the whole batch */
+	if (ring->reliable != NULL) {
+		nanoPubSub__Reliable_flushAcks(ring->reliable);
+	}
+
+	ring->head = (start + received) % ring->numSlots;
+}
+
+
+/**
+ * Receives up to maxMessages datagrams with a single system call and
+ * parses each of them into a view (see nanoPubSub__Network_finishBatch).
+ *
+ * @param socket The file descriptor of the socket to receive from
+ * @param ring The ring to receive into
+ * @param maxMessages The max. number of datagrams to receive
+ * @param flags Flags passed to recvmmsg(), e.g. MSG_WAITFORONE
+ * @param first Pointer to store the index of the batch's first slot in
+ *
+ * @return The number of datagrams received. Otherwise, -1 is returned and
+ *         the global variable errno is set to indicate the error.
+ */
+int nanoPubSub__Network_recvBatch(int socket,
+		nanoPubSub__Network_recvRing *ring, unsigned int maxMessages,
+		int flags, unsigned int *first)
+{
+	struct mmsghdr *headers;
+	unsigned int start, i;
+	int received;
+
+	start   = nanoPubSub__Network_startBatch(ring, &maxMessages);
+	headers = ring->headers + start;
+
+	for (i = 0; i < maxMessages; i++) {
+		headers[i].msg_hdr.msg_name       = &ring->addrs[start + i];
+		headers[i].msg_hdr.msg_namelen    = sizeof(struct sockaddr_storage);
+		headers[i].msg_hdr.msg_iov        = &ring->iovecs[start + i];
+		headers[i].msg_hdr.msg_iovlen     = 1;
+		headers[i].msg_hdr.msg_control    = NULL;
+		headers[i].msg_hdr.msg_controllen = 0;
+		headers[i].msg_hdr.msg_flags      = 0;
+	}
+
+	if ((received = recvmmsg(socket, headers, maxMessages, flags, NULL))
+			<= 0) {
+		return received;
+	}
+
+	nanoPubSub__Network_finishBatch(ring, start, received);
+	*first = start;
+
+	return received;
+}
+
+
+/**
+ * Replaces the view of a slot by the next message packed into the same
+ * datagram. Every slot of a batch should be handled like this:
+ *
+ *   do {
+ *       handle(&ring->views[slot]);
+ *   } while (nanoPubSub__Network_unpackNext(ring, slot));
+ *
+ * Views of invalid packed messages have a length of 0, like the views of
+ * invalid datagrams.
+ *
+ * @param ring The ring the batch was received into
+ * @param slot The slot to advance
+ *
+ * @return 1 if the slot's view holds the next message, 0 if the datagram
+ *         holds no more messages
+ */
+int nanoPubSub__Network_unpackNext(nanoPubSub__Network_recvRing *ring,
+		unsigned int slot)
+{
+	nanoPubSub__Message_slice *packed = &ring->packed[slot];
+	size_t pos = 0;
+
+	if (packed->length == 0) {
+		return 0;
+	}
+
+	if (!nanoPubSub__Batch_next(packed->data, packed->length, &pos,
+			&ring->views[slot])) {
+		nanoPubSub__Metrics_count(ring->metrics,
+			NANOPUBSUB__METRIC_PARSE_ERRORS, 1);
+		packed->length = 0;
+		return 0;
+	}
+
+	packed->data   += pos;
+	packed->length -= pos;
+	nanoPubSub__Metrics_count(ring->metrics, NANOPUBSUB__METRIC_RECEIVED, 1);
+
+	return 1;
+}
+
+
+/**
+ * Sends a prebuilt message string to a number of destinations, passing up
+ * to NANOPUBSUB__NETWORK_SEND_BATCH datagrams to the kernel per system
+ * call. A destination that cannot be reached is skipped, the others are
+ * still served. If the socket's send buffer is full, the send waits for it
+ * to drain up to NANOPUBSUB__NETWORK_SEND_ATTEMPTS times before the
+ * destination is skipped as well. Strings longer than
+ * NANOPUBSUB__MAX_MESSAGE_LENGTH are split into fragments.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes)
+ *
+ * @return The number of destinations the message was sent to.
+ */
+unsigned int nanoPubSub__Network_sendStringMulti(int socket,
+		const struct sockaddr *const *destAddrs, unsigned int numDestAddrs,
+		const char *string, size_t length)
+{
+	struct mmsghdr headers[NANOPUBSUB__NETWORK_SEND_BATCH];
+	struct iovec iovec;
+	struct pollfd pfd;
+	unsigned int pos = 0, numSent = 0, attempts = 0, count, i;
+	int sent;
+
+	/* Fragments fit into a datagram, so this does not recurse any further */
+	if (length > NANOPUBSUB__MAX_MESSAGE_LENGTH) {
+		sent = nanoPubSub__Fragment_sendStringMulti(socket, destAddrs,
+			numDestAddrs, string, length);
+
+		return sent < 0 ? 0 : sent;
+	}
+
+	/* All datagrams share the same payload */
+	iovec.iov_base = (void*)string;
+	iovec.iov_len  = length;
+
+	pfd.fd     = socket;
+	pfd.events = POLLOUT;
+
+	while (pos < numDestAddrs) {
+		count = numDestAddrs - pos;
+		if (count > NANOPUBSUB__NETWORK_SEND_BATCH) {
+			count = NANOPUBSUB__NETWORK_SEND_BATCH;
+		}
+
+		for (i = 0; i < count; i++) {
+			headers[i].msg_hdr.msg_name       = (void*)destAddrs[pos + i];
+			headers[i].msg_hdr.msg_namelen    = sizeof(struct sockaddr);
+			headers[i].msg_hdr.msg_iov        = &iovec;
+			headers[i].msg_hdr.msg_iovlen     = 1;
+			headers[i].msg_hdr.msg_control    = NULL;
+			headers[i].msg_hdr.msg_controllen = 0;
+			headers[i].msg_hdr.msg_flags      = 0;
+		}
+
+		/* sendmmsg() stops at the first datagram that fails, but only
+		   reports the error if no datagram was sent. Otherwise, the next
+		   call starts with the failed one and reports it. */
+		if ((sent = sendmmsg(socket, headers, count, 0)) >= 0) {
+			numSent += sent;
+			pos     += sent;
+			attempts = 0;
+			continue;
+		}
+
+		if (errno == EINTR) {
+			continue;
+		}
+
+		/* A full send buffer drains, so the destination is tried again.
+		   Other errors concern the destination only. */
+		if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+				&& ++attempts < NANOPUBSUB__NETWORK_SEND_ATTEMPTS) {
+			poll(&pfd, 1, NANOPUBSUB__NETWORK_SEND_WAIT);
+			continue;
+		}
+
+		pos++;
+		attempts = 0;
+	}
+
+	return numSent;
+}
+
+
+/**
+ * Serializes a given nanoPubSub message once and sends it to a number of
+ * destinations with nanoPubSub__Network_sendStringMulti.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param msg The message to send
+ *
+ * @return The number of destinations the message was sent to, or -1 if the
+ *         message could not be serialized.
+ */
+int nanoPubSub__Network_sendMessageMulti(int socket,
+		const struct sockaddr *const *destAddrs, unsigned int numDestAddrs,
+		const nanoPubSub__Message *msg)
+{
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH + 1];
+	char *stringbuffer = buffer;
+	size_t length = nanoPubSub__Message_length(msg);
+	unsigned int sent;
+
+	if (length == 0 || length > NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH) {
+		return -1;
+	}
+
+	/* Only messages that are split into fragments need the heap */
+	if (length >= sizeof(buffer)
+			&& (stringbuffer = malloc(length + 1)) == NULL) {
+		return -1;
+	}
+
+	nanoPubSub__Message_writeString(msg, stringbuffer, length + 1);
+
+	sent = nanoPubSub__Network_sendStringMulti(socket, destAddrs,
+		numDestAddrs, stringbuffer, length);
+
+	if (stringbuffer != buffer) {
+		free(stringbuffer);
+	}
+
+	return sent;
+}
+
+
+/**
+ * Sends a message view in a single datagram, either in its text or in its
+ * binary representation.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address of the target
+ * @param view The message to send
+ * @param binary 1 to send the binary representation, 0 for text
+ *
+ * @return Upon successful completion, the number of bytes which were sent is
+ *         returned. Otherwise, -1 is returned and the global variable errno is
+ *         set to indicate the error; EMSGSIZE means that the message cannot
+ *         be represented in the format or does not fit into a datagram.
+ */
+ssize_t nanoPubSub__Network_sendView(int socket,
+		const struct sockaddr *destAddr, const nanoPubSub__Message_view *view,
+		int binary)
+{
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	size_t length;
+
+	length = binary
+		? nanoPubSub__Message_writeViewBinary(view, buffer, sizeof(buffer))
+		: nanoPubSub__Message_writeViewString(view, buffer, sizeof(buffer));
+
+	if (length == 0) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	return sendto(socket, buffer, length, 0, destAddr,
+		sizeof(struct sockaddr));
+}
+
+
+/**
+ * Answers a ping message with a pong message carrying the same client id
+ * and token. The pong is sent in the format the ping was received in.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address the ping was received from
+ * @param ping The received ping message
+ *
+ * @return Upon successful completion, the number of bytes which were sent is
+ *         returned. Otherwise, -1 is returned and the global variable errno is
+ *         set to indicate the error.
+ */
+ssize_t nanoPubSub__Network_sendPong(int socket,
+		const struct sockaddr *destAddr, const nanoPubSub__Message_view *ping)
+{
+	nanoPubSub__Message_view pong = *ping;
+
+	assert(ping->type == NANOPUBSUB__PING_MESSAGE);
+
+	pong.type = NANOPUBSUB__PONG_MESSAGE;
+
+	return nanoPubSub__Network_sendView(socket, destAddr, &pong,
+		(uint8_t)ping->frame[0] == NANOPUBSUB__BINARY_MAGIC);
+}
+
+
+/**
+ * Registers a client id and a topic with the broker and waits for the
+ * numeric ids it assigns. The register message is repeated a few times if
+ * no answer arrives, as either datagram may be lost. Other datagrams
+ * received on the socket in the meantime are dropped.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address of the broker
+ * @param clientId The client id to register (Null-terminated string)
+ * @param topic The topic to register (Null-terminated string)
+ * @param clientNumber Pointer to store the client id's number in
+ * @param topicId Pointer to store the topic's id in
+ * @param timeoutMs The time to wait for an answer to each attempt
+ *
+ * @return 1 on success. Otherwise, 0 is returned and errno is set to
+ *         indicate the error; ETIMEDOUT means that the broker never answered.
+ */
+int nanoPubSub__Network_register(int socket,
+		const struct sockaddr *destAddr, const char *clientId,
+		const char *topic, uint32_t *clientNumber, uint32_t *topicId,
+		int timeoutMs)
+{
+	nanoPubSub__Message_view request, answer;
+	char buffer[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	struct pollfd pfd;
+	size_t pos;
+	ssize_t size;
+	int attempt;
+
+	memset(&request, 0, sizeof(request));
+	request.type            = NANOPUBSUB__REGISTER_MESSAGE;
+	request.clientId.data   = clientId;
+	request.clientId.length = strlen(clientId);
+	request.topic.data      = topic;
+	request.topic.length    = strlen(topic);
+
+	pfd.fd     = socket;
+	pfd.events = POLLIN;
+
+	for (attempt = 0; attempt < NANOPUBSUB__NETWORK_REGISTER_ATTEMPTS;
+			attempt++) {
+		if (nanoPubSub__Network_sendView(socket, destAddr, &request, 1)
+				== -1) {
+			return 0;
+		}
+
+		/* Wait for the answer to this registration */
+		while (poll(&pfd, 1, timeoutMs) > 0) {
+			if ((size = recv(socket, buffer, sizeof(buffer), 0)) <= 0
+					|| !nanoPubSub__Message_parseView(buffer, size, &answer)
+					|| answer.type != NANOPUBSUB__REGISTERED_MESSAGE
+					|| answer.clientId.length != request.clientId.length
+					|| answer.topic.length != request.topic.length
+					|| memcmp(answer.clientId.data, clientId,
+						answer.clientId.length) != 0
+					|| memcmp(answer.topic.data, topic,
+						answer.topic.length) != 0) {
+				continue;
+			}
+
+			pos = 0;
+			if (nanoPubSub__Message_readVarint(
+					(const uint8_t*)answer.body.data, answer.body.length,
+					&pos, clientNumber)
+					&& nanoPubSub__Message_readVarint(
+						(const uint8_t*)answer.body.data,
+						answer.body.length, &pos, topicId)
+					&& *clientNumber != 0 && *topicId != 0) {
+				return 1;
+			}
+		}
+	}
+
+	errno = ETIMEDOUT;
+	return 0;
+}
@@ -17,15 +17,107 @@
  */
 
 #include <stdlib.h>
+#include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
 
 #include "message.h"
+#include "fragment.h"
+#include "reliable.h"
+#include "batch.h"
+#include "metrics.h"
 
 
 #ifndef __LIBNANOPUBSUB__NETWORK_H
 #define __LIBNANOPUBSUB__NETWORK_H
 
 
+/** The max. number of datagrams passed to the kernel per sendmmsg() call */
+#define NANOPUBSUB__NETWORK_SEND_BATCH 64
+
+/** The number of register messages sent before a registration fails */
+#define NANOPUBSUB__NETWORK_REGISTER_ATTEMPTS 3
+
+/**
+ * The number of times a send waits for a full send buffer to drain before
+ * the destination is given up
+ */
+#define NANOPUBSUB__NETWORK_SEND_ATTEMPTS 3
+
+/** The time a send waits for a full send buffer to drain (in ms) */
+#define NANOPUBSUB__NETWORK_SEND_WAIT 10
+
+
+/**
+ * A ring of receive buffers for nanoPubSub__Network_recvBatch. The buffers
+ * are owned by the caller; the ring only holds the bookkeeping needed to
+ * receive into them with a single system call.
+ *
+ * Slot i consists of the i-th buffer, addrs[i] and views[i]. A batch
+ * always occupies consecutive slots, so a ring with more slots than the
+ * batch size allows the views of the previous batch to stay valid while
+ * the next one is received.
+ */
+typedef struct
+{
+	/** The caller's buffers, numSlots * bufferSize bytes */
+	char *buffers;
+
+	/** The size of a single buffer (in bytes) */
+	size_t bufferSize;
+
+	/** The number of slots in the ring */
+	unsigned int numSlots;
+
+	/** The slot the next batch is received into */
+	unsigned int head;
+
+	/** The senders' addresses */
+	struct sockaddr_storage *addrs;
+
+	/**
+	 * The parsed messages. Slots holding a datagram that is not a valid
+	 * message have a view length of 0.
+	 */
+	nanoPubSub__Message_view *views;
+
+	/**
+	 * The messages of a batch datagram that follow the one in the slot's
+	 * view, see nanoPubSub__Network_unpackNext. Empty for all other
+	 * datagrams.
+	 */
+	nanoPubSub__Message_slice *packed;
+
+	/** Message headers passed to recvmmsg() */
+	struct mmsghdr *headers;
+
+	/** I/O vectors referenced by the message headers */
+	struct iovec *iovecs;
+
+	/**
+	 * The pool fragments are reassembled in, or NULL to drop fragments.
+	 * The view of a reassembled message points into the pool and stays
+	 * valid until the next batch is received.
+	 */
+	nanoPubSub__Fragment_pool *fragments;
+
+	/**
+	 * The endpoint reliable datagrams are unwrapped and acknowledged by, or
+	 * NULL to drop them. Acknowledgements are sent over the endpoint's
+	 * socket.
+	 */
+	nanoPubSub__Reliable_endpoint *reliable;
+
+	/**
+	 * The metrics received messages, bytes and parse errors are counted
+	 * in, or NULL. They must be owned by the thread receiving into the
+	 * ring.
+	 */
+	nanoPubSub__Metrics *metrics;
+} nanoPubSub__Network_recvRing;
+
+
 /**
  * Sends a given nanoPubSub message to another socket with the given
  * destination address.
@@ -42,8 +134,252 @@ ssize_t nanoPubSub__Network_sendMessage(int socket,
 	const struct sockaddr *destAddr, const nanoPubSub__Message *msg);
 
 
+
+/**
+ * Sends a given nanoPubSub message in its binary representation to
+ * another socket with the given destination address.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address of the target
+ * @param msg The message to send
+ *
+ * @return Upon successful completion, the number of bytes which were sent is
+ *         returned. Otherwise, -1 is returned and the global variable errno is
+ *         set to indicate the error.
+ */
+ssize_t nanoPubSub__Network_sendBinaryMessage(int socket,
+	const struct sockaddr *destAddr, const nanoPubSub__Message *msg);
+
 int nanoPubSub__Network_recvMessage(int socket, struct sockaddr* fromAddr,
 	nanoPubSub__Message *msg);
 
 
+
+/**
+ * Receives a message and copies its fields into an arena, so that
+ * receiving does not allocate memory. The fields stay valid until the
+ * arena is reset.
+ *
+ * @param socket The file descriptor of the socket to receive from
+ * @param fromAddr Pointer to the address to store the sender's address in
+ * @param msg Pointer to the message to write the results into
+ * @param arena The arena to copy the message's fields into
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Network_recvMessageArena(int socket,
+	struct sockaddr *fromAddr, nanoPubSub__Message *msg,
+	nanoPubSub__Arena *arena);
+
+
+/**
+ * Receives a message into a caller-supplied buffer and parses it without
+ * allocating any memory. The view's fields point into the buffer.
+ *
+ * @param socket The file descriptor of the socket to receive from
+ * @param fromAddr Pointer to the address to store the sender's address in
+ * @param buffer The buffer to receive the message into
+ * @param bufferSize The size of the buffer (in bytes)
+ * @param view Pointer to the view to write the parsed message into
+ *
+ * @return 1 on success, 0 on error. If the message could not be received,
+ *         the global variable errno is set to indicate the error.
+ */
+int nanoPubSub__Network_recvView(int socket, struct sockaddr *fromAddr,
+	char *buffer, size_t bufferSize, nanoPubSub__Message_view *view);
+
+
+/**
+ * Initializes a receive ring over a set of caller-supplied buffers.
+ *
+ * @param ring The ring to initialize
+ * @param buffers numSlots consecutive buffers of bufferSize bytes each
+ * @param bufferSize The size of a single buffer (in bytes)
+ * @param numSlots The number of buffers
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Network_initRecvRing(nanoPubSub__Network_recvRing *ring,
+	char *buffers, size_t bufferSize, unsigned int numSlots);
+
+
+/**
+ * Frees the memory allocated by nanoPubSub__Network_initRecvRing. The
+ * caller's buffers are left untouched.
+ *
+ * @param ring The ring to free
+ */
+void nanoPubSub__Network_freeRecvRing(nanoPubSub__Network_recvRing *ring);
+
+
+/**
+ * Prepares a ring for the next batch: releases the messages reassembled
+ * during the previous batch and makes sure that the batch can occupy
+ * consecutive slots.
+ *
+ * @param ring The ring to receive into
+ * @param maxMessages The max. number of datagrams to receive, lowered to
+ *                    the number of slots if necessary
+ *
+ * @return The batch's first slot
+ */
+unsigned int nanoPubSub__Network_startBatch(
+	nanoPubSub__Network_recvRing *ring, unsigned int *maxMessages);
+
+
+/**
+ * Parses the datagrams received into the slots of a batch into views and
+ * advances the ring past the batch. The datagrams' lengths are taken from
+ * the msg_len fields of the slots' message headers, the senders from the
+ * slots' addresses. If the ring has a fragment pool, the slot holding the
+ * last fragment of a message gets the reassembled message's view; the
+ * other fragments' slots have a view length of 0. If the ring has a
+ * reliable endpoint, reliable datagrams are unwrapped and acknowledged.
+ * The slot of a datagram holding several packed messages gets the first
+ * message's view; nanoPubSub__Network_unpackNext yields the others.
+ * Datagrams whose message header has MSG_TRUNC set in msg_flags were cut
+ * off; their views have a length of 0 and they count as parse errors.
+ *
+ * @param ring The ring the batch was received into
+ * @param start The batch's first slot, see nanoPubSub__Network_startBatch
+ * @param received The number of datagrams received
+ */
+void nanoPubSub__Network_finishBatch(nanoPubSub__Network_recvRing *ring,
+	unsigned int start, unsigned int received);
+
+
+/**
+ * Receives up to maxMessages datagrams with a single system call and
+ * parses each of them into a view (see nanoPubSub__Network_finishBatch).
+ *
+ * @param socket The file descriptor of the socket to receive from
+ * @param ring The ring to receive into
+ * @param maxMessages The max. number of datagrams to receive
+ * @param flags Flags passed to recvmmsg(), e.g. MSG_WAITFORONE
+ * @param first Pointer to store the index of the batch's first slot in
+ *
+ * @return The number of datagrams received. Otherwise, -1 is returned and
+ *         the global variable errno is set to indicate the error.
+ */
+int nanoPubSub__Network_recvBatch(int socket,
+	nanoPubSub__Network_recvRing *ring, unsigned int maxMessages, int flags,
+	unsigned int *first);
+
+
+/**
+ * Replaces the view of a slot by the next message packed into the same
+ * datagram. Every slot of a batch should be handled like this:
+ *
+ *   do {
+ *       handle(&ring->views[slot]);
+ *   } while (nanoPubSub__Network_unpackNext(ring, slot));
+ *
+ * Views of invalid packed messages have a length of 0, like the views of
+ * invalid datagrams.
+ *
+ * @param ring The ring the batch was received into
+ * @param slot The slot to advance
+ *
+ * @return 1 if the slot's view holds the next message, 0 if the datagram
+ *         holds no more messages
+ */
+int nanoPubSub__Network_unpackNext(nanoPubSub__Network_recvRing *ring,
+	unsigned int slot);
+
+
+/**
+ * Sends a prebuilt message string to a number of destinations, passing up
+ * to NANOPUBSUB__NETWORK_SEND_BATCH datagrams to the kernel per system
+ * call. A destination that cannot be reached is skipped, the others are
+ * still served. If the socket's send buffer is full, the send waits for it
+ * to drain up to NANOPUBSUB__NETWORK_SEND_ATTEMPTS times before the
+ * destination is skipped as well. Strings longer than
+ * NANOPUBSUB__MAX_MESSAGE_LENGTH are split into fragments.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes)
+ *
+ * @return The number of destinations the message was sent to.
+ */
+unsigned int nanoPubSub__Network_sendStringMulti(int socket,
+	const struct sockaddr *const *destAddrs, unsigned int numDestAddrs,
+	const char *string, size_t length);
+
+
+/**
+ * Serializes a given nanoPubSub message once and sends it to a number of
+ * destinations with nanoPubSub__Network_sendStringMulti.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param msg The message to send
+ *
+ * @return The number of destinations the message was sent to, or -1 if the
+ *         message could not be serialized.
+ */
+int nanoPubSub__Network_sendMessageMulti(int socket,
+	const struct sockaddr *const *destAddrs, unsigned int numDestAddrs,
+	const nanoPubSub__Message *msg);
+
+
+/**
+ * Sends a message view in a single datagram, either in its text or in its
+ * binary representation.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address of the target
+ * @param view The message to send
+ * @param binary 1 to send the binary representation, 0 for text
+ *
+ * @return Upon successful completion, the number of bytes which were sent is
+ *         returned. Otherwise, -1 is returned and the global variable errno is
+ *         set to indicate the error; EMSGSIZE means that the message cannot
+ *         be represented in the format or does not fit into a datagram.
+ */
+ssize_t nanoPubSub__Network_sendView(int socket,
+	const struct sockaddr *destAddr, const nanoPubSub__Message_view *view,
+	int binary);
+
+
+/**
+ * Answers a ping message with a pong message carrying the same client id
+ * and token. The pong is sent in the format the ping was received in.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address the ping was received from
+ * @param ping The received ping message
+ *
+ * @return Upon successful completion, the number of bytes which were sent is
+ *         returned. Otherwise, -1 is returned and the global variable errno is
+ *         set to indicate the error.
+ */
+ssize_t nanoPubSub__Network_sendPong(int socket,
+	const struct sockaddr *destAddr, const nanoPubSub__Message_view *ping);
+
+
+/**
+ * Registers a client id and a topic with the broker and waits for the
+ * numeric ids it assigns. The register message is repeated a few times if
+ * no answer arrives, as either datagram may be lost. Other datagrams
+ * received on the socket in the meantime are dropped.
+ *
+ * @param socket The file descriptor of the socket to use for the transmission
+ * @param destAddr The address of the broker
+ * @param clientId The client id to register (Null-terminated string)
+ * @param topic The topic to register (Null-terminated string)
+ * @param clientNumber Pointer to store the client id's number in
+ * @param topicId Pointer to store the topic's id in
+ * @param timeoutMs The time to wait for an answer to each attempt
+ *
+ * @return 1 on success. Otherwise, 0 is returned and errno is set to
+ *         indicate the error; ETIMEDOUT means that the broker never answered.
+ */
+int nanoPubSub__Network_register(int socket,
+	const struct sockaddr *destAddr, const char *clientId, const char *topic,
+	uint32_t *clientNumber, uint32_t *topicId, int timeoutMs);
+
 #endif /* _LIBNANOPUBSUB__NETWORK_H */
\ No newline at end of file
@@ -0,0 +1,68 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * The text parsers behind nanoPubSub__Message_parseView. They are not
+ * part of the library's interface and are only exposed so that test
+ * programs can check them against each other.
+ */
+
+#include "message.h"
+
+#ifndef __LIBNANOPUBSUB__PARSER_H
+#define __LIBNANOPUBSUB__PARSER_H
+
+
+/**
+ * Runs the parser's state machine over a given string and records the
+ * positions of the message's fields.
+ *
+ * Fields that have not been found are left untouched, so the caller must
+ * initialize the view. The view's type is only written once the type
+ * keyword has been recognized.
+ *
+ * @param string The string to parse
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Message_parseFrameScalar(const char* string,
+	const unsigned int size, nanoPubSub__Message_view *view);
+
+
+/**
+ * Parses a complete message by locating all of its delimiters with the
+ * vectorized scanner and checking the type keyword with a single word
+ * compare.
+ *
+ * Only well-formed messages that start with a '#' are handled here. For
+ * anything else 0 is returned without touching the view, and the state
+ * machine has to decide what the string contains.
+ *
+ * @param string The string to parse
+ * @param size The length of the string (in bytes) to parse
+ * @param view Pointer to the view to write the results into
+ *
+ * @return 1 if a complete message was parsed, 0 otherwise
+ */
+int nanoPubSub__Message_parseFrameFast(const char* string,
+	const unsigned int size, nanoPubSub__Message_view *view);
+
+
+#endif /* __LIBNANOPUBSUB__PARSER_H */
@@ -0,0 +1,319 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "queue.h"
+
+
+/**
+ * The header of every slot, followed by the message's bytes. A slot at
+ * position pos is free for the producer of pos if its sequence is pos,
+ * and holds a message for the consumer if its sequence is pos + 1.
+ */
+typedef struct
+{
+	uint32_t sequence;
+	uint32_t length;
+} slotHeader;
+
+
+/**
+ * Returns the slot for a given position.
+ */
+static inline slotHeader *getSlot(const nanoPubSub__Queue *queue,
+		uint32_t pos)
+{
+	return (slotHeader*)(queue->slots
+		+ (size_t)(pos & queue->mask) * queue->slotStride);
+}
+
+
+/**
+ * Puts the calling thread to sleep as long as a futex word has the
+ * given value.
+ */
+static inline void futexWait(uint32_t *word, uint32_t value)
+{
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+
+/**
+ * Wakes up to count threads sleeping on a futex word.
+ */
+static inline void futexWake(uint32_t *word, int count)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+
+/**
+ * Initializes an empty queue and allocates its slots.
+ *
+ * @param queue The queue to initialize
+ * @param numSlots The number of slots (a power of two)
+ * @param slotSize The max. length of a message (in bytes)
+ * @param type NANOPUBSUB__QUEUE_SPSC or NANOPUBSUB__QUEUE_MPSC
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Queue_init(nanoPubSub__Queue *queue, unsigned int numSlots,
+		size_t slotSize, int type)
+{
+	void *slots;
+	uint32_t i;
+
+	assert(numSlots > 0 && (numSlots & (numSlots - 1)) == 0);
+	assert(type == NANOPUBSUB__QUEUE_SPSC || type == NANOPUBSUB__QUEUE_MPSC);
+
+	memset(queue, 0, sizeof(*queue));
+
+	/* Slots start on a cache line of their own, so producers writing to
+	   neighbouring slots do not slow each other down */
+	queue->slotSize   = slotSize;
+	queue->slotStride = (sizeof(slotHeader) + slotSize
+		+ NANOPUBSUB__QUEUE_CACHE_LINE - 1)
+		& ~(size_t)(NANOPUBSUB__QUEUE_CACHE_LINE - 1);
+	queue->mask       = numSlots - 1;
+	queue->type       = type;
+
+	if (posix_memalign(&slots, NANOPUBSUB__QUEUE_CACHE_LINE,
+			(size_t)numSlots * queue->slotStride) != 0) {
+		return 0;
+	}
+
+	queue->slots = slots;
+
+	for (i = 0; i < numSlots; i++) {
+		getSlot(queue, i)->sequence = i;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Frees the slots of a queue. No thread may use the queue anymore.
+ *
+ * @param queue The queue to free
+ */
+void nanoPubSub__Queue_free(nanoPubSub__Queue *queue)
+{
+	free(queue->slots);
+	queue->slots = NULL;
+}
+
+
+/**
+ * Copies a message into the next free slot without blocking.
+ *
+ * @param queue The queue to push to
+ * @param data The message
+ * @param length The length of the message (in bytes)
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the message is
+ *         longer than a slot
+ */
+int nanoPubSub__Queue_push(nanoPubSub__Queue *queue, const void *data,
+		size_t length)
+{
+	uint32_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	slotHeader *slot;
+	int32_t diff;
+
+	if (length > queue->slotSize) {
+		return -1;
+	}
+
+	/* Claim the slot at the tail. Other producers may claim it first, in
+	   which case the next position is tried. */
+	for (;;) {
+		slot = getSlot(queue, pos);
+		diff = (int32_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE)
+			- pos);
+
+		if (diff < 0) {
+			/* The consumer has not popped the slot's last message yet */
+			return 0;
+		}
+
+		if (diff > 0) {
+			pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+		} else if (queue->type == NANOPUBSUB__QUEUE_SPSC) {
+			__atomic_store_n(&queue->tail, pos + 1, __ATOMIC_RELAXED);
+			break;
+		} else if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+
+	memcpy(slot + 1, data, length);
+	slot->length = length;
+
+	/* Publish the message */
+	__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+	/* Wake the consumer if it went to sleep on an empty queue. The fence
+	   pairs with the one in nanoPubSub__Queue_frontWait: either the
+	   consumer sees the message, or this thread sees the consumer
+	   waiting. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&queue->consumerWaiting, __ATOMIC_RELAXED)
+			&& __atomic_exchange_n(&queue->consumerWaiting, 0,
+				__ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&queue->pushCount, 1, __ATOMIC_RELAXED);
+		futexWake(&queue->pushCount, 1);
+	}
+
+	return 1;
+}
+
+
+/**
+ * Copies a message into the next free slot, waiting for one to become
+ * free if the queue is full.
+ *
+ * @param queue The queue to push to
+ * @param data The message
+ * @param length The length of the message (in bytes)
+ *
+ * @return 1 on success, or -1 if the message is longer than a slot
+ */
+int nanoPubSub__Queue_pushWait(nanoPubSub__Queue *queue, const void *data,
+		size_t length)
+{
+	uint32_t count;
+	int i, result;
+
+	for (;;) {
+		for (i = 0; i < NANOPUBSUB__QUEUE_SPIN_COUNT; i++) {
+			if ((result = nanoPubSub__Queue_push(queue, data, length)) != 0) {
+				return result;
+			}
+		}
+
+		/* Announce that a producer is waiting, then check once more
+		   before going to sleep */
+		count = __atomic_load_n(&queue->popCount, __ATOMIC_RELAXED);
+		__atomic_store_n(&queue->producersWaiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		if ((result = nanoPubSub__Queue_push(queue, data, length)) != 0) {
+			return result;
+		}
+
+		futexWait(&queue->popCount, count);
+	}
+}
+
+
+/**
+ * Returns the oldest message without removing it or blocking. Only the
+ * consumer may call this function.
+ *
+ * @param queue The queue to read from
+ * @param length Pointer to store the length of the message in
+ *
+ * @return The message, which stays valid until nanoPubSub__Queue_pop is
+ *         called, or NULL if the queue is empty
+ */
+const char *nanoPubSub__Queue_front(nanoPubSub__Queue *queue, size_t *length)
+{
+	uint32_t pos = queue->head;
+	slotHeader *slot = getSlot(queue, pos);
+
+	if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) {
+		return NULL;
+	}
+
+	*length = slot->length;
+
+	return (const char*)(slot + 1);
+}
+
+
+/**
+ * Returns the oldest message without removing it, waiting for one to
+ * arrive if the queue is empty. Only the consumer may call this function.
+ *
+ * @param queue The queue to read from
+ * @param length Pointer to store the length of the message in
+ *
+ * @return The message, which stays valid until nanoPubSub__Queue_pop is
+ *         called
+ */
+const char *nanoPubSub__Queue_frontWait(nanoPubSub__Queue *queue,
+		size_t *length)
+{
+	const char *message;
+	uint32_t count;
+	int i;
+
+	for (;;) {
+		for (i = 0; i < NANOPUBSUB__QUEUE_SPIN_COUNT; i++) {
+			if ((message = nanoPubSub__Queue_front(queue, length)) != NULL) {
+				return message;
+			}
+		}
+
+		/* Announce that the consumer is waiting, then check once more
+		   before going to sleep */
+		count = __atomic_load_n(&queue->pushCount, __ATOMIC_RELAXED);
+		__atomic_store_n(&queue->consumerWaiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		if ((message = nanoPubSub__Queue_front(queue, length)) != NULL) {
+			return message;
+		}
+
+		futexWait(&queue->pushCount, count);
+	}
+}
+
+
+/**
+ * Removes the oldest message, which must have been returned by
+ * nanoPubSub__Queue_front or nanoPubSub__Queue_frontWait, and hands its
+ * slot back to the producers.
+ *
+ * @param queue The queue to remove the message from
+ */
+void nanoPubSub__Queue_pop(nanoPubSub__Queue *queue)
+{
+	uint32_t pos = queue->head;
+
+	/* The slot is free for the producer one lap ahead */
+	__atomic_store_n(&getSlot(queue, pos)->sequence, pos + queue->mask + 1,
+		__ATOMIC_RELEASE);
+	queue->head = pos + 1;
+
+	/* Wake producers that went to sleep on a full queue, see
+	   nanoPubSub__Queue_push */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&queue->producersWaiting, __ATOMIC_RELAXED)
+			&& __atomic_exchange_n(&queue->producersWaiting, 0,
+				__ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&queue->popCount, 1, __ATOMIC_RELAXED);
+		futexWake(&queue->popCount, INT_MAX);
+	}
+}
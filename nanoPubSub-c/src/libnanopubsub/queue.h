@@ -0,0 +1,193 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#ifndef __LIBNANOPUBSUB__QUEUE_H
+#define __LIBNANOPUBSUB__QUEUE_H
+
+
+/** A queue with a single producer and a single consumer */
+#define NANOPUBSUB__QUEUE_SPSC 0
+
+/** A queue with multiple producers and a single consumer */
+#define NANOPUBSUB__QUEUE_MPSC 1
+
+/** The assumed size of a cache line (in bytes) */
+#define NANOPUBSUB__QUEUE_CACHE_LINE 64
+
+/**
+ * The number of times a blocking call checks the queue again before it
+ * goes to sleep. Waking up a thread costs far more than a few checks.
+ */
+#define NANOPUBSUB__QUEUE_SPIN_COUNT 256
+
+
+/**
+ * A bounded, lock-free ring of pre-sized message slots for passing
+ * messages between threads. Every slot carries a sequence number telling
+ * producers and the consumer whose turn it is, so neither side ever takes
+ * a lock. The indices written by producers and by the consumer are kept
+ * on separate cache lines.
+ *
+ * Producers and the consumer may also block until the queue has room or
+ * messages, respectively. Waiting threads sleep on a futex and are only
+ * woken if they announced that they are waiting, so the fast path never
+ * enters the kernel, and every announcement causes one wake-up at most.
+ */
+typedef struct
+{
+	/** The slots, numSlots * slotStride bytes */
+	char *slots;
+
+	/** The max. length of a message in a slot (in bytes) */
+	size_t slotSize;
+
+	/** The distance between two slots (in bytes) */
+	size_t slotStride;
+
+	/** The number of slots minus one (the number is a power of two) */
+	uint32_t mask;
+
+	/** NANOPUBSUB__QUEUE_SPSC or NANOPUBSUB__QUEUE_MPSC */
+	int type;
+
+	char padding1[NANOPUBSUB__QUEUE_CACHE_LINE];
+
+	/** The position of the next message to push */
+	uint32_t tail;
+
+	/**
+	 * Futex word the consumer waits on. It is a wake-up sequence number,
+	 * not a message count: a push only increments it when it wakes the
+	 * consumer.
+	 */
+	uint32_t pushCount;
+
+	/** Set while producers are waiting for room, cleared on wake-up */
+	uint32_t producersWaiting;
+
+	char padding2[NANOPUBSUB__QUEUE_CACHE_LINE];
+
+	/** The position of the next message to pop */
+	uint32_t head;
+
+	/**
+	 * Futex word producers wait on. It is a wake-up sequence number, not a
+	 * message count: a pop only increments it when it wakes producers.
+	 */
+	uint32_t popCount;
+
+	/** Set while the consumer is waiting for messages, cleared on wake-up */
+	uint32_t consumerWaiting;
+
+	char padding3[NANOPUBSUB__QUEUE_CACHE_LINE];
+} nanoPubSub__Queue;
+
+
+/**
+ * Initializes an empty queue and allocates its slots.
+ *
+ * @param queue The queue to initialize
+ * @param numSlots The number of slots (a power of two)
+ * @param slotSize The max. length of a message (in bytes)
+ * @param type NANOPUBSUB__QUEUE_SPSC or NANOPUBSUB__QUEUE_MPSC
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Queue_init(nanoPubSub__Queue *queue, unsigned int numSlots,
+	size_t slotSize, int type);
+
+
+/**
+ * Frees the slots of a queue. No thread may use the queue anymore.
+ *
+ * @param queue The queue to free
+ */
+void nanoPubSub__Queue_free(nanoPubSub__Queue *queue);
+
+
+/**
+ * Copies a message into the next free slot without blocking.
+ *
+ * @param queue The queue to push to
+ * @param data The message
+ * @param length The length of the message (in bytes)
+ *
+ * @return 1 on success, 0 if the queue is full, or -1 if the message is
+ *         longer than a slot
+ */
+int nanoPubSub__Queue_push(nanoPubSub__Queue *queue, const void *data,
+	size_t length);
+
+
+/**
+ * Copies a message into the next free slot, waiting for one to become
+ * free if the queue is full.
+ *
+ * @param queue The queue to push to
+ * @param data The message
+ * @param length The length of the message (in bytes)
+ *
+ * @return 1 on success, or -1 if the message is longer than a slot
+ */
+int nanoPubSub__Queue_pushWait(nanoPubSub__Queue *queue, const void *data,
+	size_t length);
+
+
+/**
+ * Returns the oldest message without removing it or blocking. Only the
+ * consumer may call this function.
+ *
+ * @param queue The queue to read from
+ * @param length Pointer to store the length of the message in
+ *
+ * @return The message, which stays valid until nanoPubSub__Queue_pop is
+ *         called, or NULL if the queue is empty
+ */
+const char *nanoPubSub__Queue_front(nanoPubSub__Queue *queue, size_t *length);
+
+
+/**
+ * Returns the oldest message without removing it, waiting for one to
+ * arrive if the queue is empty. Only the consumer may call this function.
+ *
+ * @param queue The queue to read from
+ * @param length Pointer to store the length of the message in
+ *
+ * @return The message, which stays valid until nanoPubSub__Queue_pop is
+ *         called
+ */
+const char *nanoPubSub__Queue_frontWait(nanoPubSub__Queue *queue,
+	size_t *length);
+
+
+/**
+ * Removes the oldest message, which must have been returned by
+ * nanoPubSub__Queue_front or nanoPubSub__Queue_frontWait, and hands its
+ * slot back to the producers.
+ *
+ * @param queue The queue to remove the message from
+ */
+void nanoPubSub__Queue_pop(nanoPubSub__Queue *queue);
+
+
+#endif /* __LIBNANOPUBSUB__QUEUE_H */
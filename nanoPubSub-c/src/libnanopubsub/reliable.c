@@ -0,0 +1,855 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <unistd.h>
+
+#include "reliable.h"
+#include "util.h"
+
+
+/**
+ * Writes a 32 bit number in little endian byte order.
+ */
+static inline void writeUint32(uint8_t *buffer, uint32_t value)
+{
+	buffer[0] = value;
+	buffer[1] = value >> 8;
+	buffer[2] = value >> 16;
+	buffer[3] = value >> 24;
+}
+
+
+/**
+ * Reads a 32 bit number in little endian byte order.
+ */
+static inline uint32_t readUint32(const uint8_t *buffer)
+{
+	return (uint32_t)buffer[0] | (uint32_t)buffer[1] << 8
+		| (uint32_t)buffer[2] << 16 | (uint32_t)buffer[3] << 24;
+}
+
+
+/**
+ * Hashes the address of a peer.
+ */
+static unsigned int hashAddress(const struct sockaddr *addr)
+{
+	return nanoPubSub__Util_hash((const char*)addr,
+		sizeof(struct sockaddr));
+}
+
+
+/**
+ * Removes the least recently used peer without unacknowledged datagrams
+ * from the hash table, so that its entry can be reused.
+ *
+ * @return The evicted peer, or NULL if all peers are busy
+ */
+static nanoPubSub__Reliable_peer *evictPeer(
+		nanoPubSub__Reliable_endpoint *endpoint)
+{
+	nanoPubSub__Reliable_peer *peer = NULL, **link;
+	unsigned int i, bucket;
+
+	for (i = 0; i < endpoint->numPeers; i++) {
+		nanoPubSub__Reliable_peer *candidate = &endpoint->peers[i];
+
+		if (!candidate->active && !candidate->ackPending
+				&& (peer == NULL || candidate->lastUsed < peer->lastUsed)) {
+			peer = candidate;
+		}
+	}
+
+	if (peer == NULL) {
+		return NULL;
+	}
+
+	bucket = hashAddress((const struct sockaddr*)&peer->addr)
+		& (endpoint->numBuckets - 1);
+
+	for (link = &endpoint->buckets[bucket]; *link != peer;
+			link = &(*link)->next) {
+		/* Find the pointer to the peer */
+	}
+
+	*link = peer->next;
+
+	return peer;
+}
+
+
+/**
+ * Looks up the peer with the given address. If the table is full, an
+ * unknown peer replaces the least recently used idle one.
+ *
+ * @param create If not 0, the peer is added if it is unknown
+ * @param now The current time (in us)
+ *
+ * @return The peer, or NULL if it is unknown and cannot be added
+ */
+static nanoPubSub__Reliable_peer *findPeer(
+		nanoPubSub__Reliable_endpoint *endpoint,
+		const struct sockaddr *addr, int create, uint64_t now)
+{
+	unsigned int bucket = hashAddress(addr) & (endpoint->numBuckets - 1);
+	nanoPubSub__Reliable_peer *peer;
+	nanoPubSub__Reliable_slot *slots;
+	char *buffers;
+
+	for (peer = endpoint->buckets[bucket]; peer != NULL; peer = peer->next) {
+		if (memcmp(&peer->addr, addr, sizeof(struct sockaddr)) == 0) {
+			peer->lastUsed = now;
+			return peer;
+		}
+	}
+
+	if (!create) {
+		return NULL;
+	}
+
+	if (endpoint->numPeers < endpoint->maxPeers) {
+		peer = &endpoint->peers[endpoint->numPeers++];
+	} else if ((peer = evictPeer(endpoint)) == NULL) {
+		return NULL;
+	}
+
+	/* An evicted peer's window is free and can be reused as it is */
+	slots   = peer->slots;
+	buffers = peer->buffers;
+
+	memset(peer, 0, sizeof(*peer));
+	memcpy(&peer->addr, addr, sizeof(struct sockaddr));
+	peer->session  = endpoint->nextSession++;
+	peer->rto      = NANOPUBSUB__RELIABLE_INITIAL_RTO;
+	peer->lastUsed = now;
+	peer->slots    = slots;
+	peer->buffers  = buffers;
+
+	peer->next = endpoint->buckets[bucket];
+	endpoint->buckets[bucket] = peer;
+
+	return peer;
+}
+
+
+/**
+ * Sends a datagram unless the drop shim decides to discard it. Datagrams
+ * the kernel refuses are treated as lost as well.
+ */
+static void sendDatagram(nanoPubSub__Reliable_endpoint *endpoint,
+		const nanoPubSub__Reliable_peer *peer, const char *datagram,
+		size_t length)
+{
+	uint32_t x;
+
+	if (endpoint->dropRate > 0) {
+		/* xorshift32 */
+		x = endpoint->dropState;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		endpoint->dropState = x;
+
+		if (x / 4294967296.0 < endpoint->dropRate) {
+			endpoint->stats.dropped++;
+			return;
+		}
+	}
+
+	sendto(endpoint->socket, datagram, length, 0,
+		(const struct sockaddr*)&peer->addr, sizeof(struct sockaddr));
+}
+
+
+/**
+ * Updates the round trip time estimate of a peer with a new sample and
+ * recalculates its retransmission timeout (RFC 6298).
+ */
+static void updateRtt(nanoPubSub__Reliable_peer *peer, uint64_t rtt)
+{
+	uint64_t delta;
+
+	if (rtt == 0) {
+		rtt = 1;
+	}
+
+	if (peer->srtt == 0) {
+		peer->srtt   = rtt;
+		peer->rttvar = rtt / 2;
+	} else {
+		delta = peer->srtt > rtt ? peer->srtt - rtt : rtt - peer->srtt;
+		peer->rttvar = (3 * peer->rttvar + delta) / 4;
+		peer->srtt   = (7 * peer->srtt + rtt) / 8;
+	}
+
+	peer->rto = peer->srtt + 4 * peer->rttvar;
+
+	if (peer->rto < NANOPUBSUB__RELIABLE_MIN_RTO) {
+		peer->rto = NANOPUBSUB__RELIABLE_MIN_RTO;
+	} else if (peer->rto > NANOPUBSUB__RELIABLE_MAX_RTO) {
+		peer->rto = NANOPUBSUB__RELIABLE_MAX_RTO;
+	}
+}
+
+
+/**
+ * Sends an unacknowledged datagram again.
+ */
+static void retransmit(nanoPubSub__Reliable_endpoint *endpoint,
+		nanoPubSub__Reliable_peer *peer, uint32_t sequence, uint64_t now)
+{
+	unsigned int index = sequence % NANOPUBSUB__RELIABLE_WINDOW;
+	nanoPubSub__Reliable_slot *slot = &peer->slots[index];
+
+	sendDatagram(endpoint, peer,
+		peer->buffers + (size_t)index * NANOPUBSUB__MAX_MESSAGE_LENGTH,
+		slot->length);
+
+	slot->sentAt = now;
+	slot->order  = peer->numTransmissions++;
+	slot->transmissions++;
+	endpoint->stats.retransmitted++;
+}
+
+
+/**
+ * Frees the slot of an acknowledged datagram. Only datagrams sent once
+ * yield an RTT sample, as the acknowledgement of a retransmitted one
+ * cannot be attributed to a transmission (Karn's algorithm).
+ *
+ * @return 1 if the datagram had not been acknowledged before, 0 otherwise
+ */
+static int acknowledge(nanoPubSub__Reliable_peer *peer,
+		uint32_t sequence, uint64_t now)
+{
+	nanoPubSub__Reliable_slot *slot =
+		&peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW];
+
+	if (slot->length == 0) {
+		return 0;
+	}
+
+	if (slot->transmissions == 1) {
+		updateRtt(peer, now - slot->sentAt);
+	}
+
+	slot->length = 0;
+
+	return 1;
+}
+
+
+/**
+ * Moves a peer's window past all datagrams that have been acknowledged or
+ * given up.
+ */
+static void advanceWindow(nanoPubSub__Reliable_peer *peer)
+{
+	while (peer->firstUnacked != peer->nextSequence
+			&& peer->slots[peer->firstUnacked
+				% NANOPUBSUB__RELIABLE_WINDOW].length == 0) {
+		peer->firstUnacked++;
+	}
+}
+
+
+/**
+ * Handles an acknowledgement received from a peer: acknowledged datagrams
+ * are freed, and datagrams missing although later ones have arrived are
+ * retransmitted right away.
+ */
+static void handleAck(nanoPubSub__Reliable_endpoint *endpoint,
+		nanoPubSub__Reliable_peer *peer, uint32_t cumulative,
+		uint64_t received)
+{
+	uint32_t inFlight = peer->nextSequence - peer->firstUnacked;
+	uint32_t sequence, highest;
+	nanoPubSub__Reliable_slot *slot;
+	uint64_t now = nanoPubSub__Util_currentTimeUs(CLOCK_MONOTONIC);
+	uint32_t newest = 0;
+	unsigned int i, later;
+	int hasNewest = 0;
+
+	/* Ignore acknowledgements overtaken by later ones */
+	if (cumulative - peer->firstUnacked > inFlight) {
+		return;
+	}
+
+	for (sequence = peer->firstUnacked; sequence != cumulative; sequence++) {
+		acknowledge(peer, sequence, now);
+	}
+
+	highest = cumulative;
+
+	for (i = 0; i < 64; i++) {
+		sequence = cumulative + 1 + i;
+
+		if (sequence - peer->firstUnacked >= inFlight) {
+			break;
+		}
+
+		slot = &peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW];
+
+		if ((received & ((uint64_t)1 << i))
+				&& acknowledge(peer, sequence, now)) {
+			if (!hasNewest || (int32_t)(slot->order - newest) > 0) {
+				newest    = slot->order;
+				hasNewest = 1;
+			}
+			highest = sequence;
+		}
+	}
+
+	/* A gap is considered lost once enough later datagrams have been
+	   acknowledged, one of them sent after the missing one. The latter
+	   also detects lost retransmissions without waiting for a timeout,
+	   while a retransmission still on its way is not sent again. */
+	later = 0;
+	for (sequence = highest; hasNewest && sequence != cumulative - 1;
+			sequence--) {
+		slot = &peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW];
+
+		if (slot->length == 0) {
+			later++;
+		} else if (later >= NANOPUBSUB__RELIABLE_FAST_RETRANSMIT
+				&& (int32_t)(newest - slot->order) > 0) {
+			retransmit(endpoint, peer, sequence, now);
+		}
+	}
+
+	advanceWindow(peer);
+}
+
+
+/**
+ * Moves a peer's cumulative sequence number forward to at least target,
+ * and beyond it as long as the following datagrams have been received.
+ */
+static void advanceCumulative(nanoPubSub__Reliable_peer *peer,
+		uint32_t target)
+{
+	int more;
+
+	do {
+		peer->cumulative++;
+		more = peer->received & 1;
+		peer->received >>= 1;
+	} while (more || (int32_t)(target - peer->cumulative) > 0);
+}
+
+
+/**
+ * Initializes a reliable endpoint on a socket.
+ *
+ * @param endpoint The endpoint to initialize
+ * @param socket The file descriptor of the socket to send datagrams over
+ * @param maxPeers The max. number of addresses datagrams are exchanged with
+ *                 at the same time; idle ones are replaced when it is
+ *                 reached
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Reliable_init(nanoPubSub__Reliable_endpoint *endpoint,
+		int socket, unsigned int maxPeers)
+{
+	uint64_t now;
+	uint32_t session;
+
+	assert(maxPeers > 0);
+
+	memset(endpoint, 0, sizeof(*endpoint));
+
+	endpoint->socket   = socket;
+	endpoint->maxPeers = maxPeers;
+
+	endpoint->numBuckets = 1;
+	while (endpoint->numBuckets < maxPeers) {
+		endpoint->numBuckets <<= 1;
+	}
+
+	endpoint->peers       = calloc(maxPeers, sizeof(*endpoint->peers));
+	endpoint->buckets     = calloc(endpoint->numBuckets,
+		sizeof(*endpoint->buckets));
+	endpoint->activePeers = calloc(maxPeers, sizeof(*endpoint->activePeers));
+	endpoint->ackPeers    = calloc(maxPeers, sizeof(*endpoint->ackPeers));
+
+	if (endpoint->peers == NULL || endpoint->buckets == NULL
+			|| endpoint->activePeers == NULL || endpoint->ackPeers == NULL) {
+		nanoPubSub__Reliable_free(endpoint);
+		return 0;
+	}
+
+	/* Receivers tell a restarted sender from the previous one by its
+	   session, so sessions must differ between processes and endpoints */
+	now     = nanoPubSub__Util_currentTimeNs(CLOCK_REALTIME);
+	session = (uint32_t)now ^ (uint32_t)(now >> 32)
+		^ (uint32_t)getpid() << 16 ^ (uint32_t)(uintptr_t)endpoint;
+	session ^= session >> 16;
+	session *= 0x45d9f3bu;
+	session ^= session >> 16;
+
+	endpoint->nextSession = session;
+
+	return 1;
+}
+
+
+/**
+ * Frees all memory owned by a reliable endpoint. The socket is left open.
+ *
+ * @param endpoint The endpoint to free
+ */
+void nanoPubSub__Reliable_free(nanoPubSub__Reliable_endpoint *endpoint)
+{
+	unsigned int i;
+
+	if (endpoint->peers != NULL) {
+		for (i = 0; i < endpoint->numPeers; i++) {
+			free(endpoint->peers[i].slots);
+			free(endpoint->peers[i].buffers);
+		}
+	}
+
+	free(endpoint->peers);
+	free(endpoint->buckets);
+	free(endpoint->activePeers);
+	free(endpoint->ackPeers);
+
+	endpoint->peers       = NULL;
+	endpoint->buckets     = NULL;
+	endpoint->activePeers = NULL;
+	endpoint->ackPeers    = NULL;
+	endpoint->numPeers    = 0;
+}
+
+
+/**
+ * Makes an endpoint discard a share of its outgoing datagrams, including
+ * retransmissions and acknowledgements, as if the network had lost them.
+ *
+ * @param endpoint The endpoint
+ * @param rate The probability of discarding a datagram, 0 to disable
+ * @param seed The seed of the random number generator
+ */
+void nanoPubSub__Reliable_setDropRate(nanoPubSub__Reliable_endpoint *endpoint,
+		double rate, unsigned int seed)
+{
+	endpoint->dropRate  = rate;
+	endpoint->dropState = seed * 2654435761u | 1;
+}
+
+
+/**
+ * Sends a message string reliably. Messages longer than
+ * NANOPUBSUB__RELIABLE_MAX_PAYLOAD_LENGTH are split into fragments, each
+ * of which is sent reliably.
+ *
+ * @param endpoint The endpoint to send the message from
+ * @param destAddr The address of the target
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes), at most
+ *               NANOPUBSUB__RELIABLE_MAX_LENGTH
+ *
+ * @return 1 if the message has been sent, 0 if the window to the target is
+ *         too full to take it, or -1 if the message is too long or no more
+ *         peers can be tracked. errno is set in the latter cases.
+ */
+int nanoPubSub__Reliable_sendString(nanoPubSub__Reliable_endpoint *endpoint,
+		const struct sockaddr *destAddr, const char *string, size_t length)
+{
+	nanoPubSub__Reliable_peer *peer;
+	nanoPubSub__Reliable_slot *slot;
+	unsigned int count, i, index;
+	uint32_t messageId = 0;
+	uint64_t now;
+	uint8_t *datagram;
+	size_t headerLength;
+
+	if (length == 0 || length > NANOPUBSUB__RELIABLE_MAX_LENGTH) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	if ((peer = findPeer(endpoint, destAddr, 1,
+			nanoPubSub__Util_currentTimeUs(CLOCK_MONOTONIC))) == NULL) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	/* The window is only needed for peers messages are sent to */
+	if (peer->slots == NULL) {
+		peer->slots   = calloc(NANOPUBSUB__RELIABLE_WINDOW,
+			sizeof(*peer->slots));
+		peer->buffers = malloc((size_t)NANOPUBSUB__RELIABLE_WINDOW
+			* NANOPUBSUB__MAX_MESSAGE_LENGTH);
+
+		if (peer->slots == NULL || peer->buffers == NULL) {
+			free(peer->slots);
+			free(peer->buffers);
+			peer->slots   = NULL;
+			peer->buffers = NULL;
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	if (length <= NANOPUBSUB__RELIABLE_MAX_PAYLOAD_LENGTH) {
+		count = 1;
+	} else {
+		count     = nanoPubSub__Fragment_count(length);
+		messageId = nanoPubSub__Fragment_nextMessageId();
+	}
+
+	if (peer->nextSequence - peer->firstUnacked + count
+			> NANOPUBSUB__RELIABLE_WINDOW) {
+		return 0;
+	}
+
+	now = nanoPubSub__Util_currentTimeUs(CLOCK_MONOTONIC);
+
+	for (i = 0; i < count; i++) {
+		index    = peer->nextSequence % NANOPUBSUB__RELIABLE_WINDOW;
+		slot     = &peer->slots[index];
+		datagram = (uint8_t*)peer->buffers
+			+ (size_t)index * NANOPUBSUB__MAX_MESSAGE_LENGTH;
+
+		headerLength = 0;
+		datagram[headerLength++] = NANOPUBSUB__RELIABLE_DATA_MAGIC;
+		writeUint32(datagram + headerLength, peer->session);
+		headerLength += 4;
+		headerLength += nanoPubSub__Message_writeVarint(
+			datagram + headerLength, peer->nextSequence);
+		headerLength += nanoPubSub__Message_writeVarint(
+			datagram + headerLength, peer->nextSequence - peer->firstUnacked);
+
+		if (count == 1) {
+			memcpy(datagram + headerLength, string, length);
+			slot->length = headerLength + length;
+		} else {
+			slot->length = headerLength + nanoPubSub__Fragment_write(messageId,
+				string, length, i, (char*)datagram + headerLength);
+		}
+
+		slot->sentAt        = now;
+		slot->order         = peer->numTransmissions++;
+		slot->transmissions = 1;
+
+		sendDatagram(endpoint, peer, (const char*)datagram, slot->length);
+
+		peer->nextSequence++;
+		endpoint->stats.sent++;
+	}
+
+	if (!peer->active) {
+		peer->active = 1;
+		endpoint->activePeers[endpoint->numActivePeers++] = peer;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Handles a received reliable datagram or acknowledgement.
+ *
+ * @param endpoint The endpoint that received the datagram
+ * @param fromAddr The address the datagram was received from
+ * @param datagram The received datagram
+ * @param size The size of the datagram (in bytes)
+ * @param payload Pointer to store the carried message's bytes in, they
+ *                point into the datagram
+ * @param length Pointer to store the carried message's length in
+ *
+ * @return 1 if the datagram carries a new message, 0 if it was an
+ *         acknowledgement or a duplicate, or -1 if it is invalid
+ */
+int nanoPubSub__Reliable_receive(nanoPubSub__Reliable_endpoint *endpoint,
+		const struct sockaddr *fromAddr, const char *datagram, size_t size,
+		const char **payload, size_t *length)
+{
+	const uint8_t *bytes = (const uint8_t*)datagram;
+	nanoPubSub__Reliable_peer *peer;
+	uint32_t session, sequence, distance, base, offset;
+	uint64_t received;
+	size_t pos = 5;
+	int i;
+
+	if (size < pos || (bytes[0] != NANOPUBSUB__RELIABLE_DATA_MAGIC
+			&& bytes[0] != NANOPUBSUB__RELIABLE_ACK_MAGIC)) {
+		return -1;
+	}
+
+	session = readUint32(bytes + 1);
+
+	if (bytes[0] == NANOPUBSUB__RELIABLE_ACK_MAGIC) {
+		if (!nanoPubSub__Message_readVarint(bytes, size, &pos, &sequence)
+				|| size - pos != 8) {
+			return -1;
+		}
+
+		/* Acknowledgements of an earlier session's datagrams are stale */
+		if ((peer = findPeer(endpoint, fromAddr, 0,
+				nanoPubSub__Util_currentTimeUs(CLOCK_MONOTONIC))) == NULL
+				|| peer->slots == NULL || session != peer->session) {
+			return 0;
+		}
+
+		received = 0;
+		for (i = 7; i >= 0; i--) {
+			received = received << 8 | bytes[pos + i];
+		}
+
+		handleAck(endpoint, peer, sequence, received);
+		return 0;
+	}
+
+	if (!nanoPubSub__Message_readVarint(bytes, size, &pos, &sequence)
+			|| !nanoPubSub__Message_readVarint(bytes, size, &pos, &distance)
+			|| distance >= NANOPUBSUB__RELIABLE_WINDOW || pos == size) {
+		return -1;
+	}
+
+	*payload = datagram + pos;
+	*length  = size - pos;
+
+	/* Without a peer, the message is delivered without being acknowledged.
+	   The sender retransmits it, so it may arrive more than once. */
+	if ((peer = findPeer(endpoint, fromAddr, 1,
+			nanoPubSub__Util_currentTimeUs(CLOCK_MONOTONIC))) == NULL) {
+		endpoint->stats.delivered++;
+		return 1;
+	}
+
+	/* Everything older than the sender's window has been acknowledged or
+	   given up, so the receiver starts there, or catches up to it */
+	base = sequence - distance;
+
+	if (!peer->hasRemoteSession || peer->remoteSession != session) {
+		peer->hasRemoteSession = 1;
+		peer->remoteSession    = session;
+		peer->cumulative       = base;
+		peer->received         = 0;
+	} else if ((int32_t)(base - peer->cumulative) > 64) {
+		peer->cumulative = base;
+		peer->received   = 0;
+	} else if ((int32_t)(base - peer->cumulative) > 0) {
+		advanceCumulative(peer, base);
+	}
+
+	/* Duplicates are acknowledged as well, as the sender apparently missed
+	   the previous acknowledgement */
+	if (!peer->ackPending) {
+		peer->ackPending = 1;
+		endpoint->ackPeers[endpoint->numAckPeers++] = peer;
+	}
+
+	offset = sequence - peer->cumulative;
+
+	if ((int32_t)offset < 0) {
+		endpoint->stats.duplicates++;
+		return 0;
+	}
+
+	if (offset == 0) {
+		advanceCumulative(peer, peer->cumulative + 1);
+	} else if (offset <= 64) {
+		if (peer->received & ((uint64_t)1 << (offset - 1))) {
+			endpoint->stats.duplicates++;
+			return 0;
+		}
+
+		peer->received |= (uint64_t)1 << (offset - 1);
+	} else {
+		/* Beyond the window; the datagram is sent again later */
+		return 0;
+	}
+
+	endpoint->stats.delivered++;
+
+	return 1;
+}
+
+
+/**
+ * Sends one acknowledgement to every peer datagrams have been received
+ * from since the last call. Calling this once per received batch instead
+ * of once per datagram coalesces the acknowledgements.
+ *
+ * @param endpoint The endpoint
+ */
+void nanoPubSub__Reliable_flushAcks(nanoPubSub__Reliable_endpoint *endpoint)
+{
+	uint8_t ack[1 + 4 + 5 + 8];
+	nanoPubSub__Reliable_peer *peer;
+	size_t length;
+	unsigned int i, j;
+
+	for (i = 0; i < endpoint->numAckPeers; i++) {
+		peer = endpoint->ackPeers[i];
+
+		length = 0;
+		ack[length++] = NANOPUBSUB__RELIABLE_ACK_MAGIC;
+		writeUint32(ack + length, peer->remoteSession);
+		length += 4;
+		length += nanoPubSub__Message_writeVarint(ack + length,
+			peer->cumulative);
+
+		for (j = 0; j < 8; j++) {
+			ack[length++] = (uint8_t)(peer->received >> (8 * j));
+		}
+
+		sendDatagram(endpoint, peer, (const char*)ack, length);
+
+		peer->ackPending = 0;
+		endpoint->stats.acksSent++;
+	}
+
+	endpoint->numAckPeers = 0;
+}
+
+
+/**
+ * Retransmits the oldest datagram whose timeout has expired for every
+ * peer. Once a datagram has been sent too often, the peer is considered
+ * unreachable and all of its datagrams are given up.
+ *
+ * @param endpoint The endpoint
+ *
+ * @return The time until the next timeout expires (in milliseconds), or -1
+ *         if no datagram is waiting for its acknowledgement
+ */
+int nanoPubSub__Reliable_tick(nanoPubSub__Reliable_endpoint *endpoint)
+{
+	nanoPubSub__Reliable_peer *peer;
+	nanoPubSub__Reliable_slot *slot;
+	uint64_t now = nanoPubSub__Util_currentTimeUs(CLOCK_MONOTONIC);
+	uint64_t next = UINT64_MAX;
+	uint32_t sequence, expired = 0;
+	unsigned int i = 0;
+	int hasExpired, giveUp;
+
+	while (i < endpoint->numActivePeers) {
+		peer       = endpoint->activePeers[i];
+		hasExpired = 0;
+		giveUp     = 0;
+
+		/* Look for the oldest datagram whose timeout has expired */
+		for (sequence = peer->firstUnacked; sequence != peer->nextSequence;
+				sequence++) {
+			slot = &peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW];
+
+			if (slot->length > 0 && now - slot->sentAt >= peer->rto) {
+				expired    = sequence;
+				hasExpired = 1;
+				giveUp     = slot->transmissions
+					>= NANOPUBSUB__RELIABLE_MAX_TRANSMISSIONS;
+				break;
+			}
+		}
+
+		if (giveUp) {
+			/* The peer is unreachable, so all of its datagrams are given
+			   up rather than one after the other */
+			for (sequence = peer->firstUnacked;
+					sequence != peer->nextSequence; sequence++) {
+				slot = &peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW];
+
+				if (slot->length > 0) {
+					slot->length = 0;
+					endpoint->stats.failed++;
+				}
+			}
+		} else if (hasExpired) {
+			/* Only the oldest datagram is sent again, as the others may
+			   only lack a lost acknowledgement: the acknowledgement of the
+			   retransmission tells which ones are really missing, and
+			   those are recovered by fast retransmits. The other timers
+			   restart. */
+			peer->rto = peer->rto * 2 < NANOPUBSUB__RELIABLE_MAX_RTO
+				? peer->rto * 2 : NANOPUBSUB__RELIABLE_MAX_RTO;
+
+			for (sequence = peer->firstUnacked;
+					sequence != peer->nextSequence; sequence++) {
+				slot = &peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW];
+
+				if (slot->length > 0) {
+					slot->sentAt = now;
+				}
+			}
+
+			retransmit(endpoint, peer, expired, now);
+			endpoint->stats.timeouts++;
+		}
+
+		advanceWindow(peer);
+
+		/* Peers without unacknowledged datagrams leave the list */
+		if (peer->firstUnacked == peer->nextSequence) {
+			peer->active = 0;
+			endpoint->activePeers[i] =
+				endpoint->activePeers[--endpoint->numActivePeers];
+			continue;
+		}
+
+		for (sequence = peer->firstUnacked; sequence != peer->nextSequence;
+				sequence++) {
+			slot = &peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW];
+
+			if (slot->length > 0 && slot->sentAt + peer->rto < next) {
+				next = slot->sentAt + peer->rto;
+			}
+		}
+
+		i++;
+	}
+
+	if (next == UINT64_MAX) {
+		return -1;
+	}
+
+	return next <= now ? 0 : (int)((next - now + 999) / 1000);
+}
+
+
+/**
+ * Counts the datagrams waiting for their acknowledgement.
+ *
+ * @param endpoint The endpoint
+ *
+ * @return The number of unacknowledged datagrams
+ */
+unsigned int nanoPubSub__Reliable_inFlight(
+		const nanoPubSub__Reliable_endpoint *endpoint)
+{
+	const nanoPubSub__Reliable_peer *peer;
+	unsigned int i, count = 0;
+	uint32_t sequence;
+
+	for (i = 0; i < endpoint->numActivePeers; i++) {
+		peer = endpoint->activePeers[i];
+
+		for (sequence = peer->firstUnacked; sequence != peer->nextSequence;
+				sequence++) {
+			if (peer->slots[sequence % NANOPUBSUB__RELIABLE_WINDOW].length > 0) {
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
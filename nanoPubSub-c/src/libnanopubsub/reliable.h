@@ -0,0 +1,365 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "message.h"
+#include "fragment.h"
+
+#ifndef __LIBNANOPUBSUB__RELIABLE_H
+#define __LIBNANOPUBSUB__RELIABLE_H
+
+
+/**
+ * The first byte of a reliable datagram. It is followed by the session the
+ * sender uses towards the receiver (4 bytes, little endian), the datagram's sequence number as a
+ * varint, the distance to the oldest datagram the sender has not seen
+ * acknowledged as a varint and the message or fragment it carries.
+ */
+#define NANOPUBSUB__RELIABLE_DATA_MAGIC 0xA7
+
+/**
+ * The first byte of an acknowledgement. It is followed by the session
+ * being acknowledged (4 bytes, little endian), the next sequence number
+ * expected as a varint and an 8 byte bitmap of the datagrams received
+ * beyond it.
+ */
+#define NANOPUBSUB__RELIABLE_ACK_MAGIC 0xA8
+
+/** The max. length of the header of a reliable datagram (in bytes) */
+#define NANOPUBSUB__RELIABLE_HEADER_LENGTH 11
+
+/** The max. length of a message carried by a single reliable datagram */
+#define NANOPUBSUB__RELIABLE_MAX_PAYLOAD_LENGTH \
+	(NANOPUBSUB__MAX_MESSAGE_LENGTH - NANOPUBSUB__RELIABLE_HEADER_LENGTH)
+
+/**
+ * The max. number of unacknowledged datagrams per destination. It matches
+ * the width of the acknowledgement bitmap, so a receiver can always tell
+ * new datagrams from duplicates.
+ */
+#define NANOPUBSUB__RELIABLE_WINDOW 64
+
+/** The max. length of a message sent reliably (in bytes) */
+#define NANOPUBSUB__RELIABLE_MAX_LENGTH \
+	(NANOPUBSUB__RELIABLE_WINDOW * NANOPUBSUB__FRAGMENT_PAYLOAD_LENGTH)
+
+/** The retransmission timeout used before the first RTT sample (in us) */
+#define NANOPUBSUB__RELIABLE_INITIAL_RTO 200000
+
+/** The lower bound of the retransmission timeout (in us) */
+#define NANOPUBSUB__RELIABLE_MIN_RTO 1000
+
+/** The upper bound of the retransmission timeout (in us) */
+#define NANOPUBSUB__RELIABLE_MAX_RTO 2000000
+
+/**
+ * The number of transmissions after which a datagram is given up, and
+ * with it all datagrams to the same peer
+ */
+#define NANOPUBSUB__RELIABLE_MAX_TRANSMISSIONS 12
+
+/**
+ * The number of later datagrams that must be acknowledged before a missing
+ * one is retransmitted without waiting for its timeout.
+ */
+#define NANOPUBSUB__RELIABLE_FAST_RETRANSMIT 3
+
+
+/**
+ * A datagram waiting for its acknowledgement.
+ */
+typedef struct
+{
+	/** The time the datagram was last sent at (in us) */
+	uint64_t sentAt;
+
+	/** The length of the datagram (in bytes), 0 if the slot is free */
+	size_t length;
+
+	/** The number of times the datagram has been sent */
+	unsigned int transmissions;
+
+	/** The peer's transmission count when the datagram was last sent */
+	uint32_t order;
+} nanoPubSub__Reliable_slot;
+
+
+/**
+ * The state kept for every address datagrams are exchanged with. A peer
+ * is a sender and a receiver at the same time.
+ */
+typedef struct nanoPubSub__Reliable_peer
+{
+	/** The peer's address */
+	struct sockaddr_storage addr;
+
+	/** The next peer in the same hash bucket */
+	struct nanoPubSub__Reliable_peer *next;
+
+	/** 1 once a datagram has been received from the peer */
+	int hasRemoteSession;
+
+	/** The session of the peer's datagrams received last */
+	uint32_t remoteSession;
+
+	/** The session of the datagrams sent to the peer */
+	uint32_t session;
+
+	/** The next sequence number expected from the peer */
+	uint32_t cumulative;
+
+	/** Bit i is set if datagram cumulative + 1 + i has been received */
+	uint64_t received;
+
+	/** 1 if datagrams have been received since the last acknowledgement */
+	int ackPending;
+
+	/** The sequence number of the next datagram sent to the peer */
+	uint32_t nextSequence;
+
+	/** The oldest sequence number not acknowledged by the peer, yet */
+	uint32_t firstUnacked;
+
+	/** The number of datagrams sent to the peer, retransmissions included */
+	uint32_t numTransmissions;
+
+	/** The smoothed round trip time (in us), 0 before the first sample */
+	uint64_t srtt;
+
+	/** The round trip time variation (in us) */
+	uint64_t rttvar;
+
+	/** The retransmission timeout (in us) */
+	uint64_t rto;
+
+	/** The time the peer was last looked up at (in us) */
+	uint64_t lastUsed;
+
+	/** 1 if the peer is in the endpoint's list of active peers */
+	int active;
+
+	/** The unacknowledged datagrams, allocated on the first send */
+	nanoPubSub__Reliable_slot *slots;
+
+	/** NANOPUBSUB__RELIABLE_WINDOW buffers holding the datagrams */
+	char *buffers;
+} nanoPubSub__Reliable_peer;
+
+
+/**
+ * Counters describing the work done by an endpoint.
+ */
+typedef struct
+{
+	/** Datagrams sent for the first time */
+	unsigned long sent;
+
+	/** Datagrams sent again after a timeout or a gap in the acks */
+	unsigned long retransmitted;
+
+	/** Retransmission timeouts that expired */
+	unsigned long timeouts;
+
+	/** Datagrams given up because their peer is unreachable */
+	unsigned long failed;
+
+	/** Acknowledgements sent */
+	unsigned long acksSent;
+
+	/** Datagrams received and delivered */
+	unsigned long delivered;
+
+	/** Datagrams received more than once */
+	unsigned long duplicates;
+
+	/** Outgoing datagrams discarded by the drop shim */
+	unsigned long dropped;
+} nanoPubSub__Reliable_stats;
+
+
+/**
+ * A socket's reliable delivery state. Every datagram sent through the
+ * endpoint carries a sequence number and is kept until the destination
+ * acknowledges it; datagrams that are not acknowledged in time are sent
+ * again. Received datagrams are delivered once and in any order, and are
+ * acknowledged selectively. An endpoint must only be used by one thread.
+ */
+typedef struct
+{
+	/** The socket datagrams are sent over */
+	int socket;
+
+	/**
+	 * The session of the next peer added. A peer's session distinguishes
+	 * its datagrams from those of a previous endpoint or a previous peer
+	 * with the same address, so it starts at a random number.
+	 */
+	uint32_t nextSession;
+
+	/** The peers, allocated when the endpoint is initialized */
+	nanoPubSub__Reliable_peer *peers;
+
+	/** The number of peers in use */
+	unsigned int numPeers;
+
+	/** The max. number of peers */
+	unsigned int maxPeers;
+
+	/** Hash buckets over the peers' addresses */
+	nanoPubSub__Reliable_peer **buckets;
+
+	/** The number of hash buckets, a power of two */
+	unsigned int numBuckets;
+
+	/** Peers with unacknowledged datagrams */
+	nanoPubSub__Reliable_peer **activePeers;
+
+	/** The number of active peers */
+	unsigned int numActivePeers;
+
+	/** Peers owed an acknowledgement */
+	nanoPubSub__Reliable_peer **ackPeers;
+
+	/** The number of peers owed an acknowledgement */
+	unsigned int numAckPeers;
+
+	/** The probability of discarding an outgoing datagram, for testing */
+	double dropRate;
+
+	/** The state of the drop shim's random number generator */
+	uint32_t dropState;
+
+	/** The endpoint's counters */
+	nanoPubSub__Reliable_stats stats;
+} nanoPubSub__Reliable_endpoint;
+
+
+/**
+ * Initializes a reliable endpoint on a socket.
+ *
+ * @param endpoint The endpoint to initialize
+ * @param socket The file descriptor of the socket to send datagrams over
+ * @param maxPeers The max. number of addresses datagrams are exchanged with
+ *                 at the same time; idle ones are replaced when it is
+ *                 reached
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Reliable_init(nanoPubSub__Reliable_endpoint *endpoint,
+	int socket, unsigned int maxPeers);
+
+
+/**
+ * Frees all memory owned by a reliable endpoint. The socket is left open.
+ *
+ * @param endpoint The endpoint to free
+ */
+void nanoPubSub__Reliable_free(nanoPubSub__Reliable_endpoint *endpoint);
+
+
+/**
+ * Makes an endpoint discard a share of its outgoing datagrams, including
+ * retransmissions and acknowledgements, as if the network had lost them.
+ *
+ * @param endpoint The endpoint
+ * @param rate The probability of discarding a datagram, 0 to disable
+ * @param seed The seed of the random number generator
+ */
+void nanoPubSub__Reliable_setDropRate(nanoPubSub__Reliable_endpoint *endpoint,
+	double rate, unsigned int seed);
+
+
+/**
+ * Sends a message string reliably. Messages longer than
+ * NANOPUBSUB__RELIABLE_MAX_PAYLOAD_LENGTH are split into fragments, each
+ * of which is sent reliably.
+ *
+ * @param endpoint The endpoint to send the message from
+ * @param destAddr The address of the target
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes), at most
+ *               NANOPUBSUB__RELIABLE_MAX_LENGTH
+ *
+ * @return 1 if the message has been sent, 0 if the window to the target is
+ *         too full to take it, or -1 if the message is too long or no more
+ *         peers can be tracked. errno is set in the latter cases.
+ */
+int nanoPubSub__Reliable_sendString(nanoPubSub__Reliable_endpoint *endpoint,
+	const struct sockaddr *destAddr, const char *string, size_t length);
+
+
+/**
+ * Handles a received reliable datagram or acknowledgement.
+ *
+ * @param endpoint The endpoint that received the datagram
+ * @param fromAddr The address the datagram was received from
+ * @param datagram The received datagram
+ * @param size The size of the datagram (in bytes)
+ * @param payload Pointer to store the carried message's bytes in, they
+ *                point into the datagram
+ * @param length Pointer to store the carried message's length in
+ *
+ * @return 1 if the datagram carries a new message, 0 if it was an
+ *         acknowledgement or a duplicate, or -1 if it is invalid
+ */
+int nanoPubSub__Reliable_receive(nanoPubSub__Reliable_endpoint *endpoint,
+	const struct sockaddr *fromAddr, const char *datagram, size_t size,
+	const char **payload, size_t *length);
+
+
+/**
+ * Sends one acknowledgement to every peer datagrams have been received
+ * from since the last call. Calling this once per received batch instead
+ * of once per datagram coalesces the acknowledgements.
+ *
+ * @param endpoint The endpoint
+ */
+void nanoPubSub__Reliable_flushAcks(nanoPubSub__Reliable_endpoint *endpoint);
+
+
+/**
+ * Retransmits the oldest datagram whose timeout has expired for every
+ * peer. Once a datagram has been sent too often, the peer is considered
+ * unreachable and all of its datagrams are given up.
+ *
+ * @param endpoint The endpoint
+ *
+ * @return The time until the next timeout expires (in milliseconds), or -1
+ *         if no datagram is waiting for its acknowledgement
+ */
+int nanoPubSub__Reliable_tick(nanoPubSub__Reliable_endpoint *endpoint);
+
+
+/**
+ * Counts the datagrams waiting for their acknowledgement.
+ *
+ * @param endpoint The endpoint
+ *
+ * @return The number of unacknowledged datagrams
+ */
+unsigned int nanoPubSub__Reliable_inFlight(
+	const nanoPubSub__Reliable_endpoint *endpoint);
+
+
+#endif /* __LIBNANOPUBSUB__RELIABLE_H */
@@ -0,0 +1,175 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "scan.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define NANOPUBSUB__SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Does the same as nanoPubSub__Scan_delimiters, but always scans the
+ * string one byte at a time.
+ *
+ * @param string The string to scan (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to scan
+ * @param delimiter The character to search for
+ * @param positions The array to write the delimiters' positions into
+ * @param maxPositions The max. number of positions to find
+ *
+ * @return The number of positions written into the array
+ */
+unsigned int nanoPubSub__Scan_delimitersScalar(const char *string,
+		size_t size, char delimiter, size_t *positions,
+		unsigned int maxPositions)
+{
+	unsigned int found = 0;
+	size_t pos;
+
+	for (pos = 0; pos < size && found < maxPositions; pos++) {
+		if (string[pos] == delimiter) {
+			positions[found++] = pos;
+		}
+	}
+
+	return found;
+}
+
+
+#ifdef NANOPUBSUB__SCAN_X86
+
+/**
+ * Scans a string in 16 byte blocks. SSE2 is part of every x86-64 CPU, so
+ * this needs no runtime check.
+ */
+static unsigned int scanSSE2(const char *string, size_t size,
+		char delimiter, size_t *positions, unsigned int maxPositions)
+{
+	const __m128i needle = _mm_set1_epi8(delimiter);
+	unsigned int found = 0;
+	size_t pos = 0;
+
+	for (; pos + 16 <= size && found < maxPositions; pos += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)(string + pos));
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+
+		/* Every set bit marks a delimiter within the block */
+		while (mask != 0 && found < maxPositions) {
+			positions[found++] = pos + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+
+	/* Never read past the end of the string; do the rest byte by byte */
+	if (found < maxPositions) {
+		unsigned int i, n = nanoPubSub__Scan_delimitersScalar(string + pos,
+			size - pos, delimiter, positions + found, maxPositions - found);
+
+		for (i = 0; i < n; i++) {
+			positions[found + i] += pos;
+		}
+		found += n;
+	}
+
+	return found;
+}
+
+
+/**
+ * Scans a string in 32 byte blocks. Only called if the CPU supports AVX2.
+ */
+__attribute__((target("avx2")))
+static unsigned int scanAVX2(const char *string, size_t size,
+		char delimiter, size_t *positions, unsigned int maxPositions)
+{
+	const __m256i needle = _mm256_set1_epi8(delimiter);
+	unsigned int found = 0;
+	size_t pos = 0;
+
+	for (; pos + 32 <= size && found < maxPositions; pos += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)(string + pos));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+
+		/* Every set bit marks a delimiter within the block */
+		while (mask != 0 && found < maxPositions) {
+			positions[found++] = pos + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+
+	/* The rest is shorter than 32 bytes, which is SSE2's job */
+	if (found < maxPositions) {
+		unsigned int i, n = scanSSE2(string + pos, size - pos, delimiter,
+			positions + found, maxPositions - found);
+
+		for (i = 0; i < n; i++) {
+			positions[found + i] += pos;
+		}
+		found += n;
+	}
+
+	return found;
+}
+
+#endif /* NANOPUBSUB__SCAN_X86 */
+
+
+/** A function scanning a string for delimiters */
+typedef unsigned int (*scanFunction)(const char*, size_t, char, size_t*,
+	unsigned int);
+
+/**
+ * The scanner picked for this CPU, set up on first use. Threads may parse
+ * concurrently, so it is only accessed atomically.
+ */
+static scanFunction scanImpl = NULL;
+
+
+/**
+ * Finds the positions of the first occurrences of a delimiter character in
+ * a string. Depending on the CPU, the string is scanned in 32 byte (AVX2)
+ * or 16 byte (SSE2) blocks, otherwise one byte at a time.
+ *
+ * @param string The string to scan (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to scan
+ * @param delimiter The character to search for
+ * @param positions The array to write the delimiters' positions into
+ * @param maxPositions The max. number of positions to find
+ *
+ * @return The number of positions written into the array
+ */
+unsigned int nanoPubSub__Scan_delimiters(const char *string, size_t size,
+		char delimiter, size_t *positions, unsigned int maxPositions)
+{
+	scanFunction scan = __atomic_load_n(&scanImpl, __ATOMIC_ACQUIRE);
+
+	/* Threads racing here all store the same function */
+	if (scan == NULL) {
+#ifdef NANOPUBSUB__SCAN_X86
+		__builtin_cpu_init();
+		scan = __builtin_cpu_supports("avx2") ? scanAVX2 : scanSSE2;
+#else
+		scan = nanoPubSub__Scan_delimitersScalar;
+#endif
+		__atomic_store_n(&scanImpl, scan, __ATOMIC_RELEASE);
+	}
+
+	return scan(string, size, delimiter, positions, maxPositions);
+}
@@ -0,0 +1,60 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifndef __LIBNANOPUBSUB__SCAN_H
+#define __LIBNANOPUBSUB__SCAN_H
+
+
+/**
+ * Finds the positions of the first occurrences of a delimiter character in
+ * a string. Depending on the CPU, the string is scanned in 32 byte (AVX2)
+ * or 16 byte (SSE2) blocks, otherwise one byte at a time.
+ *
+ * @param string The string to scan (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to scan
+ * @param delimiter The character to search for
+ * @param positions The array to write the delimiters' positions into
+ * @param maxPositions The max. number of positions to find
+ *
+ * @return The number of positions written into the array
+ */
+unsigned int nanoPubSub__Scan_delimiters(const char *string, size_t size,
+	char delimiter, size_t *positions, unsigned int maxPositions);
+
+
+/**
+ * Does the same as nanoPubSub__Scan_delimiters, but always scans the
+ * string one byte at a time.
+ *
+ * @param string The string to scan (need not be Null-terminated)
+ * @param size The length of the string (in bytes) to scan
+ * @param delimiter The character to search for
+ * @param positions The array to write the delimiters' positions into
+ * @param maxPositions The max. number of positions to find
+ *
+ * @return The number of positions written into the array
+ */
+unsigned int nanoPubSub__Scan_delimitersScalar(const char *string,
+	size_t size, char delimiter, size_t *positions,
+	unsigned int maxPositions);
+
+
+#endif /* __LIBNANOPUBSUB__SCAN_H */
@@ -0,0 +1,217 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "timer.h"
+#include "util.h"
+
+
+/**
+ * Initializes a timer wheel and allocates its slots.
+ *
+ * @param wheel The wheel to initialize
+ * @param numSlots The number of slots (a power of two)
+ * @param resolutionMs The length of a tick (in milliseconds)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Timer_initWheel(nanoPubSub__Timer_wheel *wheel,
+		unsigned int numSlots, unsigned int resolutionMs)
+{
+	assert(numSlots > 0 && (numSlots & (numSlots - 1)) == 0);
+	assert(resolutionMs > 0);
+
+	if ((wheel->slots = calloc(numSlots, sizeof(*wheel->slots))) == NULL) {
+		return 0;
+	}
+
+	wheel->mask         = numSlots - 1;
+	wheel->resolutionMs = resolutionMs;
+	wheel->current      = nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC)
+		/ resolutionMs;
+	wheel->numTimers    = 0;
+
+	return 1;
+}
+
+
+/**
+ * Frees the slots of a timer wheel. The timers themselves are owned by the
+ * caller.
+ *
+ * @param wheel The wheel to free
+ */
+void nanoPubSub__Timer_freeWheel(nanoPubSub__Timer_wheel *wheel)
+{
+	free(wheel->slots);
+	wheel->slots     = NULL;
+	wheel->numTimers = 0;
+}
+
+
+/**
+ * Initializes a timer that is not scheduled.
+ *
+ * @param timer The timer to initialize
+ * @param data The owner of the timer
+ */
+void nanoPubSub__Timer_init(nanoPubSub__Timer *timer, void *data)
+{
+	timer->expires = 0;
+	timer->data    = data;
+	timer->next    = NULL;
+	timer->pprev   = NULL;
+}
+
+
+/**
+ * Schedules a timer to expire after a delay. A timer that is already
+ * scheduled is moved.
+ *
+ * @param wheel The wheel to schedule the timer on
+ * @param timer The timer to schedule
+ * @param delayMs The delay (in milliseconds), rounded up to whole ticks
+ */
+void nanoPubSub__Timer_schedule(nanoPubSub__Timer_wheel *wheel,
+		nanoPubSub__Timer *timer, unsigned int delayMs)
+{
+	nanoPubSub__Timer **slot;
+
+	nanoPubSub__Timer_cancel(wheel, timer);
+
+	timer->expires = nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC)
+		/ wheel->resolutionMs
+		+ (delayMs + wheel->resolutionMs - 1) / wheel->resolutionMs;
+
+	/* The wheel never goes back, so a timer must not expire before the
+	   tick it is at */
+	if (timer->expires < wheel->current) {
+		timer->expires = wheel->current;
+	}
+
+	slot = &wheel->slots[timer->expires & wheel->mask];
+
+	timer->next = *slot;
+	if (*slot != NULL) {
+		(*slot)->pprev = &timer->next;
+	}
+	*slot = timer;
+	timer->pprev = slot;
+
+	wheel->numTimers++;
+}
+
+
+/**
+ * Cancels a timer. Cancelling a timer that is not scheduled does nothing.
+ *
+ * @param wheel The wheel the timer is scheduled on
+ * @param timer The timer to cancel
+ */
+void nanoPubSub__Timer_cancel(nanoPubSub__Timer_wheel *wheel,
+		nanoPubSub__Timer *timer)
+{
+	if (timer->pprev == NULL) {
+		return;
+	}
+
+	*timer->pprev = timer->next;
+	if (timer->next != NULL) {
+		timer->next->pprev = timer->pprev;
+	}
+
+	timer->next  = NULL;
+	timer->pprev = NULL;
+
+	wheel->numTimers--;
+}
+
+
+/**
+ * Advances the wheel to the current time and removes the next expired
+ * timer from it. Call this function until it returns NULL to handle all
+ * expired timers; timers may be scheduled again in between.
+ *
+ * @param wheel The wheel to advance
+ * @return An expired timer, or NULL if no timer has expired
+ */
+nanoPubSub__Timer *nanoPubSub__Timer_expire(nanoPubSub__Timer_wheel *wheel)
+{
+	uint64_t target = nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC)
+		/ wheel->resolutionMs;
+	nanoPubSub__Timer *timer;
+
+	/* An empty wheel can skip any number of ticks at once */
+	if (wheel->numTimers == 0) {
+		wheel->current = target;
+		return NULL;
+	}
+
+	for (;;) {
+		/* Timers that are a full turn or more away stay in the slot */
+		for (timer = wheel->slots[wheel->current & wheel->mask];
+				timer != NULL; timer = timer->next) {
+			if (timer->expires <= wheel->current) {
+				nanoPubSub__Timer_cancel(wheel, timer);
+				return timer;
+			}
+		}
+
+		if (wheel->current >= target) {
+			return NULL;
+		}
+
+		wheel->current++;
+	}
+}
+
+
+/**
+ * Calculates the time until the next timer expires, e.g. to be passed as
+ * timeout to poll() or epoll_wait().
+ *
+ * @param wheel The wheel to check
+ * @return The time until the next timer expires (in milliseconds), or -1
+ *         if no timer is scheduled
+ */
+int nanoPubSub__Timer_nextTimeout(const nanoPubSub__Timer_wheel *wheel)
+{
+	const nanoPubSub__Timer *timer;
+	uint64_t now, tick, expiresMs;
+
+	if (wheel->numTimers == 0) {
+		return -1;
+	}
+
+	/* Look for the first tick with an expiring timer. If every timer is a
+	   full turn or more away, the wheel wakes up once per turn. */
+	for (tick = wheel->current; tick <= wheel->current + wheel->mask;
+			tick++) {
+		for (timer = wheel->slots[tick & wheel->mask]; timer != NULL;
+				timer = timer->next) {
+			if (timer->expires <= tick) {
+				goto found;
+			}
+		}
+	}
+
+found:
+	now       = nanoPubSub__Util_currentTimeMs(CLOCK_MONOTONIC);
+	expiresMs = tick * wheel->resolutionMs;
+
+	return expiresMs > now ? (int)(expiresMs - now) : 0;
+}
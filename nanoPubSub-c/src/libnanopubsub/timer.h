@@ -0,0 +1,164 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <time.h>
+
+#ifndef __LIBNANOPUBSUB__TIMER_H
+#define __LIBNANOPUBSUB__TIMER_H
+
+
+/**
+ * A timer that can be scheduled on a timer wheel. Timers are embedded in
+ * the structures they belong to, so scheduling one never allocates memory.
+ */
+typedef struct nanoPubSub__Timer
+{
+	/** The tick of the wheel the timer expires at */
+	uint64_t expires;
+
+	/** The owner of the timer, left to the caller */
+	void *data;
+
+	/** The next timer in the same slot */
+	struct nanoPubSub__Timer *next;
+
+	/**
+	 * The pointer pointing to this timer, or NULL if the timer is not
+	 * scheduled
+	 */
+	struct nanoPubSub__Timer **pprev;
+} nanoPubSub__Timer;
+
+
+/**
+ * A hashed timer wheel. Time is divided into ticks of a fixed resolution,
+ * and every timer is kept in the slot its expiry tick maps to, so that
+ * scheduling and cancelling take constant time no matter how many timers
+ * there are. Timers further in the future than a full turn of the wheel
+ * stay in their slot until the wheel has come round often enough.
+ */
+typedef struct
+{
+	/** The slots, each a list of timers */
+	nanoPubSub__Timer **slots;
+
+	/** The number of slots minus one (the number is a power of two) */
+	uint64_t mask;
+
+	/** The length of a tick (in milliseconds) */
+	unsigned int resolutionMs;
+
+	/** The tick up to which timers have been expired */
+	uint64_t current;
+
+	/** The number of scheduled timers */
+	size_t numTimers;
+} nanoPubSub__Timer_wheel;
+
+
+/**
+ * Checks whether a timer is scheduled.
+ *
+ * @param timer The timer to check
+ * @return 1 if the timer is scheduled, 0 otherwise
+ */
+static inline int nanoPubSub__Timer_isScheduled(const nanoPubSub__Timer *timer)
+{
+	return timer->pprev != NULL;
+}
+
+
+/**
+ * Initializes a timer wheel and allocates its slots.
+ *
+ * @param wheel The wheel to initialize
+ * @param numSlots The number of slots (a power of two)
+ * @param resolutionMs The length of a tick (in milliseconds)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__Timer_initWheel(nanoPubSub__Timer_wheel *wheel,
+	unsigned int numSlots, unsigned int resolutionMs);
+
+
+/**
+ * Frees the slots of a timer wheel. The timers themselves are owned by the
+ * caller.
+ *
+ * @param wheel The wheel to free
+ */
+void nanoPubSub__Timer_freeWheel(nanoPubSub__Timer_wheel *wheel);
+
+
+/**
+ * Initializes a timer that is not scheduled.
+ *
+ * @param timer The timer to initialize
+ * @param data The owner of the timer
+ */
+void nanoPubSub__Timer_init(nanoPubSub__Timer *timer, void *data);
+
+
+/**
+ * Schedules a timer to expire after a delay. A timer that is already
+ * scheduled is moved.
+ *
+ * @param wheel The wheel to schedule the timer on
+ * @param timer The timer to schedule
+ * @param delayMs The delay (in milliseconds), rounded up to whole ticks
+ */
+void nanoPubSub__Timer_schedule(nanoPubSub__Timer_wheel *wheel,
+	nanoPubSub__Timer *timer, unsigned int delayMs);
+
+
+/**
+ * Cancels a timer. Cancelling a timer that is not scheduled does nothing.
+ *
+ * @param wheel The wheel the timer is scheduled on
+ * @param timer The timer to cancel
+ */
+void nanoPubSub__Timer_cancel(nanoPubSub__Timer_wheel *wheel,
+	nanoPubSub__Timer *timer);
+
+
+/**
+ * Advances the wheel to the current time and removes the next expired
+ * timer from it. Call this function until it returns NULL to handle all
+ * expired timers; timers may be scheduled again in between.
+ *
+ * @param wheel The wheel to advance
+ * @return An expired timer, or NULL if no timer has expired
+ */
+nanoPubSub__Timer *nanoPubSub__Timer_expire(nanoPubSub__Timer_wheel *wheel);
+
+
+/**
+ * Calculates the time until the next timer expires, e.g. to be passed as
+ * timeout to poll() or epoll_wait().
+ *
+ * @param wheel The wheel to check
+ * @return The time until the next timer expires (in milliseconds), or -1
+ *         if no timer is scheduled
+ */
+int nanoPubSub__Timer_nextTimeout(const nanoPubSub__Timer_wheel *wheel);
+
+
+#endif /* __LIBNANOPUBSUB__TIMER_H */
@@ -0,0 +1,614 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "topic.h"
+#include "util.h"
+
+
+/**
+ * Calculates the hash of a child node from its parent and its level: the
+ * FNV-1a hash of the level, seeded with the parent's address.
+ */
+static inline uint32_t hashChild(const nanoPubSub__Topic_node *parent,
+		const char *level, size_t length)
+{
+	uint64_t seed = (uintptr_t)parent;
+
+	return nanoPubSub__Util_hashSeeded(level, length,
+		NANOPUBSUB__UTIL_HASH_BASIS ^ (uint32_t)(seed ^ (seed >> 29)));
+}
+
+
+/**
+ * Checks whether a level consists of the given wildcard only.
+ */
+static inline int isWildcard(const char *level, size_t length, char wildcard)
+{
+	return length == 1 && level[0] == wildcard;
+}
+
+
+/**
+ * Looks up the child of a node for a given level.
+ *
+ * @return The child, or NULL if there is none
+ */
+static nanoPubSub__Topic_node *findChild(const nanoPubSub__Topic_trie *trie,
+		const nanoPubSub__Topic_node *parent, const char *level,
+		size_t length)
+{
+	uint32_t bucket = hashChild(parent, level, length)
+		& (trie->numBuckets - 1);
+	nanoPubSub__Topic_node *node;
+
+	for (node = trie->buckets[bucket]; node != NULL; node = node->next) {
+		if (node->parent == parent && node->levelLength == length
+				&& memcmp(node->level, level, length) == 0) {
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Doubles the number of hash buckets and rehashes all nodes.
+ */
+static int growBuckets(nanoPubSub__Topic_trie *trie)
+{
+	size_t numBuckets = trie->numBuckets * 2;
+	nanoPubSub__Topic_node **buckets, *node, *next;
+	size_t i;
+
+	if ((buckets = calloc(numBuckets, sizeof(*buckets))) == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < trie->numBuckets; i++) {
+		for (node = trie->buckets[i]; node != NULL; node = next) {
+			uint32_t bucket = hashChild(node->parent, node->level,
+				node->levelLength) & (numBuckets - 1);
+			next = node->next;
+			node->next = buckets[bucket];
+			buckets[bucket] = node;
+		}
+	}
+
+	free(trie->buckets);
+	trie->buckets    = buckets;
+	trie->numBuckets = numBuckets;
+
+	return 1;
+}
+
+
+/**
+ * Creates the child of a node for a given level and adds it to the hash
+ * table. Wildcard children are linked to their parent as well.
+ *
+ * @return The new child, or NULL if no memory could be allocated
+ */
+static nanoPubSub__Topic_node *addChild(nanoPubSub__Topic_trie *trie,
+		nanoPubSub__Topic_node *parent, const char *level, size_t length)
+{
+	nanoPubSub__Topic_node *node;
+	uint32_t bucket;
+
+	if (trie->numNodes >= trie->numBuckets && !growBuckets(trie)) {
+		return NULL;
+	}
+
+	if ((node = calloc(1, sizeof(*node))) == NULL) {
+		return NULL;
+	}
+
+	if ((node->level = malloc(length + 1)) == NULL) {
+		free(node);
+		return NULL;
+	}
+
+	memcpy(node->level, level, length);
+	node->level[length] = '\0';
+	node->levelLength   = length;
+	node->parent        = parent;
+
+	bucket = hashChild(parent, level, length) & (trie->numBuckets - 1);
+	node->next = trie->buckets[bucket];
+	trie->buckets[bucket] = node;
+	trie->numNodes++;
+
+	if (isWildcard(level, length, NANOPUBSUB__TOPIC_SINGLE_LEVEL)) {
+		parent->singleLevel = node;
+	} else if (isWildcard(level, length, NANOPUBSUB__TOPIC_MULTI_LEVEL)) {
+		parent->multiLevel = node;
+	}
+
+	parent->numChildren++;
+
+	return node;
+}
+
+
+/**
+ * Frees a node and all of its ancestors that are left without
+ * subscribers and children. The root is never freed.
+ */
+static void pruneNode(nanoPubSub__Topic_trie *trie,
+		nanoPubSub__Topic_node *node)
+{
+	nanoPubSub__Topic_node **link, *parent;
+
+	while (node != &trie->root && node->numSubscribers == 0
+			&& node->numChildren == 0) {
+		parent = node->parent;
+
+		/* Unlink the node from its hash bucket */
+		link = &trie->buckets[hashChild(parent, node->level,
+			node->levelLength) & (trie->numBuckets - 1)];
+		while (*link != node) {
+			link = &(*link)->next;
+		}
+		*link = node->next;
+		trie->numNodes--;
+
+		if (parent->singleLevel == node) {
+			parent->singleLevel = NULL;
+		} else if (parent->multiLevel == node) {
+			parent->multiLevel = NULL;
+		}
+
+		parent->numChildren--;
+
+		free(node->subscribers);
+		free(node->level);
+		free(node);
+
+		node = parent;
+	}
+}
+
+
+/**
+ * Initializes an empty topic trie.
+ *
+ * @param trie The trie to initialize
+ * @param numBuckets The initial number of hash buckets (a power of two)
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Topic_init(nanoPubSub__Topic_trie *trie, size_t numBuckets)
+{
+	assert(numBuckets > 0 && (numBuckets & (numBuckets - 1)) == 0);
+
+	memset(trie, 0, sizeof(*trie));
+
+	if ((trie->buckets = calloc(numBuckets, sizeof(*trie->buckets)))
+			== NULL) {
+		return 0;
+	}
+
+	trie->numBuckets = numBuckets;
+
+	return 1;
+}
+
+
+/**
+ * Frees all memory owned by a topic trie. The subscribers themselves are
+ * left untouched.
+ *
+ * @param trie The trie to destroy
+ */
+void nanoPubSub__Topic_destroy(nanoPubSub__Topic_trie *trie)
+{
+	nanoPubSub__Topic_node *node, *next;
+	size_t i;
+
+	/* Every node but the root is in the hash table */
+	for (i = 0; i < trie->numBuckets; i++) {
+		for (node = trie->buckets[i]; node != NULL; node = next) {
+			next = node->next;
+			free(node->subscribers);
+			free(node->level);
+			free(node);
+		}
+	}
+
+	free(trie->buckets);
+	memset(trie, 0, sizeof(*trie));
+}
+
+
+/**
+ * Checks whether a string is a valid subscription filter: wildcards must
+ * make up a whole level, and the multi-level wildcard may only be used as
+ * the last level.
+ *
+ * @param filter The filter to check
+ *
+ * @return 1 if the filter is valid, 0 otherwise
+ */
+int nanoPubSub__Topic_isValidFilter(const nanoPubSub__Message_slice *filter)
+{
+	const char *level = filter->data, *end = filter->data + filter->length;
+	const char *separator;
+	size_t i, length;
+
+	for (;;) {
+		separator = memchr(level, NANOPUBSUB__TOPIC_SEPARATOR, end - level);
+		length    = (separator != NULL ? separator : end) - level;
+
+		for (i = 0; i < length; i++) {
+			if ((level[i] == NANOPUBSUB__TOPIC_SINGLE_LEVEL
+					|| level[i] == NANOPUBSUB__TOPIC_MULTI_LEVEL)
+					&& length != 1) {
+				return 0;
+			}
+		}
+
+		if (separator == NULL) {
+			return 1;
+		}
+
+		if (isWildcard(level, length, NANOPUBSUB__TOPIC_MULTI_LEVEL)) {
+			return 0;
+		}
+
+		level = separator + 1;
+	}
+}
+
+
+/**
+ * Checks whether a single topic matches a filter, following the same
+ * rules as nanoPubSub__Topic_match. Used where filters are not kept in a
+ * trie, e.g. to find the stored messages a new subscription matches.
+ *
+ * @param filter The filter (see nanoPubSub__Topic_isValidFilter)
+ * @param topic The topic (must not contain wildcards)
+ *
+ * @return 1 if the topic matches the filter, 0 otherwise
+ */
+int nanoPubSub__Topic_matchesFilter(const nanoPubSub__Message_slice *filter,
+		const nanoPubSub__Message_slice *topic)
+{
+	const char *level = filter->data, *end = filter->data + filter->length;
+	const char *topicLevel = topic->data;
+	const char *topicEnd = topic->data + topic->length;
+	const char *separator, *topicSeparator;
+	size_t length, topicLength;
+	int reserved;
+
+	/* Wildcards at the first level skip the broker's own topics */
+	reserved = topic->length > 0 && topic->data[0] == '$';
+
+	for (;;) {
+		separator = memchr(level, NANOPUBSUB__TOPIC_SEPARATOR, end - level);
+		length    = (separator != NULL ? separator : end) - level;
+
+		/* The multi-level wildcard matches the rest, even if it is empty */
+		if (isWildcard(level, length, NANOPUBSUB__TOPIC_MULTI_LEVEL)) {
+			return !reserved;
+		}
+
+		if (topicLevel == NULL) {
+			return 0;
+		}
+
+		topicSeparator = memchr(topicLevel, NANOPUBSUB__TOPIC_SEPARATOR,
+			topicEnd - topicLevel);
+		topicLength    = (topicSeparator != NULL ? topicSeparator : topicEnd)
+			- topicLevel;
+
+		if (isWildcard(level, length, NANOPUBSUB__TOPIC_SINGLE_LEVEL)) {
+			if (reserved) {
+				return 0;
+			}
+		} else if (length != topicLength
+				|| memcmp(level, topicLevel, length) != 0
+				|| isWildcard(topicLevel, topicLength,
+					NANOPUBSUB__TOPIC_SINGLE_LEVEL)
+				|| isWildcard(topicLevel, topicLength,
+					NANOPUBSUB__TOPIC_MULTI_LEVEL)) {
+			return 0;
+		}
+
+		if (separator == NULL) {
+			return topicSeparator == NULL;
+		}
+
+		level      = separator + 1;
+		topicLevel = topicSeparator != NULL ? topicSeparator + 1 : NULL;
+		reserved   = 0;
+	}
+}
+
+
+/**
+ * Adds a subscriber to a filter. Subscribing twice to the same filter is
+ * a no-op.
+ *
+ * @param trie The trie to modify
+ * @param filter The filter to subscribe to
+ * @param subscriber The subscriber (any non-NULL pointer)
+ *
+ * @return 1 on success, 0 if the filter is invalid or no memory could be
+ *         allocated
+ */
+int nanoPubSub__Topic_subscribe(nanoPubSub__Topic_trie *trie,
+		const nanoPubSub__Message_slice *filter, void *subscriber)
+{
+	const char *level = filter->data, *end = filter->data + filter->length;
+	nanoPubSub__Topic_node *node = &trie->root, *child;
+	const char *separator;
+	size_t i, length;
+
+	assert(subscriber != NULL);
+
+	if (!nanoPubSub__Topic_isValidFilter(filter)) {
+		return 0;
+	}
+
+	/* Walk down the trie, creating the nodes that are missing */
+	for (;;) {
+		separator = memchr(level, NANOPUBSUB__TOPIC_SEPARATOR, end - level);
+		length    = (separator != NULL ? separator : end) - level;
+
+		if ((child = findChild(trie, node, level, length)) == NULL
+				&& (child = addChild(trie, node, level, length)) == NULL) {
+			pruneNode(trie, node);
+			return 0;
+		}
+
+		node = child;
+
+		if (separator == NULL) {
+			break;
+		}
+
+		level = separator + 1;
+	}
+
+	for (i = 0; i < node->numSubscribers; i++) {
+		if (node->subscribers[i] == subscriber) {
+			return 1;
+		}
+	}
+
+	if (node->numSubscribers == node->maxSubscribers) {
+		size_t max = node->maxSubscribers > 0 ? node->maxSubscribers * 2 : 4;
+		void **subscribers;
+
+		if ((subscribers = realloc(node->subscribers,
+				max * sizeof(*subscribers))) == NULL) {
+			pruneNode(trie, node);
+			return 0;
+		}
+
+		node->subscribers    = subscribers;
+		node->maxSubscribers = max;
+	}
+
+	node->subscribers[node->numSubscribers++] = subscriber;
+	trie->numSubscriptions++;
+
+	return 1;
+}
+
+
+/**
+ * Removes a subscriber from a filter. Nodes left without subscribers and
+ * children are freed.
+ *
+ * @param trie The trie to modify
+ * @param filter The filter to unsubscribe from
+ * @param subscriber The subscriber
+ *
+ * @return 1 if the subscription was removed, 0 if it did not exist
+ */
+int nanoPubSub__Topic_unsubscribe(nanoPubSub__Topic_trie *trie,
+		const nanoPubSub__Message_slice *filter, void *subscriber)
+{
+	const char *level = filter->data, *end = filter->data + filter->length;
+	nanoPubSub__Topic_node *node = &trie->root;
+	const char *separator;
+	size_t i, length;
+
+	for (;;) {
+		separator = memchr(level, NANOPUBSUB__TOPIC_SEPARATOR, end - level);
+		length    = (separator != NULL ? separator : end) - level;
+
+		if ((node = findChild(trie, node, level, length)) == NULL) {
+			return 0;
+		}
+
+		if (separator == NULL) {
+			break;
+		}
+
+		level = separator + 1;
+	}
+
+	for (i = 0; i < node->numSubscribers; i++) {
+		if (node->subscribers[i] == subscriber) {
+			/* The order of subscribers doesn't matter, so just move the
+			   last one into the gap */
+			node->subscribers[i] = node->subscribers[--node->numSubscribers];
+			trie->numSubscriptions--;
+			pruneNode(trie, node);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Removes a subscriber from every filter it is subscribed to. Nodes left
+ * without subscribers and children are freed. The whole trie is walked,
+ * so this is meant for subscribers that go away, not for the fast path.
+ *
+ * @param trie The trie to modify
+ * @param subscriber The subscriber
+ *
+ * @return The number of subscriptions removed
+ */
+size_t nanoPubSub__Topic_unsubscribeAll(nanoPubSub__Topic_trie *trie,
+		void *subscriber)
+{
+	nanoPubSub__Topic_node **link, *node, *parent;
+	size_t i, j, removed = 0;
+	int pruned;
+
+	/* Every node but the root is in the hash table, and the root has no
+	   subscribers, as every filter has at least one level */
+	for (i = 0; i < trie->numBuckets; i++) {
+		for (node = trie->buckets[i]; node != NULL; node = node->next) {
+			for (j = 0; j < node->numSubscribers; j++) {
+				if (node->subscribers[j] == subscriber) {
+					node->subscribers[j] =
+						node->subscribers[--node->numSubscribers];
+					removed++;
+					break;
+				}
+			}
+		}
+	}
+
+	trie->numSubscriptions -= removed;
+
+	/* Free the nodes left empty. Freeing a node may leave its parent
+	   empty, which might sit in a bucket that has been passed already, so
+	   sweep until nothing is freed; that takes as many sweeps as the
+	   deepest filter has levels. */
+	do {
+		pruned = 0;
+
+		for (i = 0; i < trie->numBuckets; i++) {
+			link = &trie->buckets[i];
+			while ((node = *link) != NULL) {
+				if (node->numSubscribers > 0 || node->numChildren > 0) {
+					link = &node->next;
+					continue;
+				}
+
+				*link = node->next;
+				trie->numNodes--;
+
+				parent = node->parent;
+				if (parent->singleLevel == node) {
+					parent->singleLevel = NULL;
+				} else if (parent->multiLevel == node) {
+					parent->multiLevel = NULL;
+				}
+				parent->numChildren--;
+
+				free(node->subscribers);
+				free(node->level);
+				free(node);
+				pruned = 1;
+			}
+		}
+	} while (pruned);
+
+	return removed;
+}
+
+
+/**
+ * Matches the remaining levels of a topic against the filters below a
+ * node.
+ *
+ * @param level The first remaining level, or NULL if the topic ends at
+ *              the node
+ * @param end The end of the topic
+ *
+ * @return The number of matching filters
+ */
+static size_t matchNode(const nanoPubSub__Topic_trie *trie,
+		const nanoPubSub__Topic_node *node, const char *level,
+		const char *end, nanoPubSub__Topic_visitor visitor, void *arg)
+{
+	const nanoPubSub__Topic_node *child;
+	const char *separator, *next;
+	size_t length, numMatches = 0;
+	int reserved;
+
+	/* Wildcards at the first level skip the broker's own topics */
+	reserved = node == &trie->root && level != NULL && level < end
+		&& *level == '$';
+
+	/* The multi-level wildcard matches the node's own level as well */
+	if (node->multiLevel != NULL && !reserved
+			&& node->multiLevel->numSubscribers > 0) {
+		visitor(node->multiLevel->subscribers,
+			node->multiLevel->numSubscribers, arg);
+		numMatches++;
+	}
+
+	if (level == NULL) {
+		if (node->numSubscribers > 0) {
+			visitor(node->subscribers, node->numSubscribers, arg);
+			numMatches++;
+		}
+		return numMatches;
+	}
+
+	separator = memchr(level, NANOPUBSUB__TOPIC_SEPARATOR, end - level);
+	length    = (separator != NULL ? separator : end) - level;
+	next      = separator != NULL ? separator + 1 : NULL;
+
+	/* Topics never contain wildcards, so wildcard levels must not be
+	   matched literally */
+	if (!isWildcard(level, length, NANOPUBSUB__TOPIC_SINGLE_LEVEL)
+			&& !isWildcard(level, length, NANOPUBSUB__TOPIC_MULTI_LEVEL)
+			&& (child = findChild(trie, node, level, length)) != NULL) {
+		numMatches += matchNode(trie, child, next, end, visitor, arg);
+	}
+
+	if (node->singleLevel != NULL && !reserved) {
+		numMatches += matchNode(trie, node->singleLevel, next, end,
+			visitor, arg);
+	}
+
+	return numMatches;
+}
+
+
+/**
+ * Finds all filters matching a topic and passes their subscribers to a
+ * visitor. A subscriber of several matching filters is visited once per
+ * filter. Wildcards at the first level do not match topics starting with
+ * '$', which are reserved for the broker's own topics.
+ *
+ * @param trie The trie to search
+ * @param topic The topic to match (must not contain wildcards)
+ * @param visitor The function to call for every matching filter
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching filters
+ */
+size_t nanoPubSub__Topic_match(const nanoPubSub__Topic_trie *trie,
+		const nanoPubSub__Message_slice *topic,
+		nanoPubSub__Topic_visitor visitor, void *arg)
+{
+	return matchNode(trie, &trie->root, topic->data,
+		topic->data + topic->length, visitor, arg);
+}
@@ -0,0 +1,225 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "message.h"
+
+#ifndef __LIBNANOPUBSUB__TOPIC_H
+#define __LIBNANOPUBSUB__TOPIC_H
+
+
+/** The character separating the levels of a topic */
+#define NANOPUBSUB__TOPIC_SEPARATOR '/'
+
+/** A filter level matching exactly one topic level */
+#define NANOPUBSUB__TOPIC_SINGLE_LEVEL '+'
+
+/**
+ * A filter level matching any number of topic levels, including none. It
+ * must be the last level of a filter. '#' cannot be used, as it delimits
+ * the fields of text messages.
+ */
+#define NANOPUBSUB__TOPIC_MULTI_LEVEL '*'
+
+
+/**
+ * A node of a topic trie, standing for one level of a subscription
+ * filter. Children matching a literal level are kept in the trie's hash
+ * table, wildcard children are linked directly.
+ */
+typedef struct nanoPubSub__Topic_node
+{
+	/** The node's level (not Null-terminated) */
+	char *level;
+
+	/** The length of the node's level */
+	size_t levelLength;
+
+	/** The parent node, NULL for the root */
+	struct nanoPubSub__Topic_node *parent;
+
+	/** The next node in the same hash bucket */
+	struct nanoPubSub__Topic_node *next;
+
+	/** The child for the single-level wildcard */
+	struct nanoPubSub__Topic_node *singleLevel;
+
+	/** The child for the multi-level wildcard */
+	struct nanoPubSub__Topic_node *multiLevel;
+
+	/** The number of children, including wildcard children */
+	size_t numChildren;
+
+	/** The subscribers of the filter ending at this node */
+	void **subscribers;
+
+	/** The number of entries used in the subscriber list */
+	size_t numSubscribers;
+
+	/** The number of entries allocated for the subscriber list */
+	size_t maxSubscribers;
+} nanoPubSub__Topic_node;
+
+
+/**
+ * A trie over '/'-separated subscription filters. The children of all
+ * nodes share one chained hash table keyed by parent and level, so every
+ * level of a topic is matched with a single hash lookup.
+ */
+typedef struct
+{
+	/** The root node, standing for the empty filter */
+	nanoPubSub__Topic_node root;
+
+	/** The hash table of literal child nodes */
+	nanoPubSub__Topic_node **buckets;
+
+	/** The number of hash buckets (a power of two) */
+	size_t numBuckets;
+
+	/** The number of nodes in the hash table */
+	size_t numNodes;
+
+	/** The number of subscriptions */
+	size_t numSubscriptions;
+} nanoPubSub__Topic_trie;
+
+
+/**
+ * Called by nanoPubSub__Topic_match for every filter matching a topic.
+ *
+ * @param subscribers The subscribers of the filter
+ * @param numSubscribers The number of subscribers
+ * @param arg The argument passed to nanoPubSub__Topic_match
+ */
+typedef void (*nanoPubSub__Topic_visitor)(void *const *subscribers,
+	size_t numSubscribers, void *arg);
+
+
+/**
+ * Initializes an empty topic trie.
+ *
+ * @param trie The trie to initialize
+ * @param numBuckets The initial number of hash buckets (a power of two)
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__Topic_init(nanoPubSub__Topic_trie *trie, size_t numBuckets);
+
+
+/**
+ * Frees all memory owned by a topic trie. The subscribers themselves are
+ * left untouched.
+ *
+ * @param trie The trie to destroy
+ */
+void nanoPubSub__Topic_destroy(nanoPubSub__Topic_trie *trie);
+
+
+/**
+ * Checks whether a string is a valid subscription filter: wildcards must
+ * make up a whole level, and the multi-level wildcard may only be used as
+ * the last level.
+ *
+ * @param filter The filter to check
+ *
+ * @return 1 if the filter is valid, 0 otherwise
+ */
+int nanoPubSub__Topic_isValidFilter(const nanoPubSub__Message_slice *filter);
+
+
+/**
+ * Checks whether a single topic matches a filter, following the same
+ * rules as nanoPubSub__Topic_match. Used where filters are not kept in a
+ * trie, e.g. to find the stored messages a new subscription matches.
+ *
+ * @param filter The filter (see nanoPubSub__Topic_isValidFilter)
+ * @param topic The topic (must not contain wildcards)
+ *
+ * @return 1 if the topic matches the filter, 0 otherwise
+ */
+int nanoPubSub__Topic_matchesFilter(const nanoPubSub__Message_slice *filter,
+	const nanoPubSub__Message_slice *topic);
+
+
+/**
+ * Adds a subscriber to a filter. Subscribing twice to the same filter is
+ * a no-op.
+ *
+ * @param trie The trie to modify
+ * @param filter The filter to subscribe to
+ * @param subscriber The subscriber (any non-NULL pointer)
+ *
+ * @return 1 on success, 0 if the filter is invalid or no memory could be
+ *         allocated
+ */
+int nanoPubSub__Topic_subscribe(nanoPubSub__Topic_trie *trie,
+	const nanoPubSub__Message_slice *filter, void *subscriber);
+
+
+/**
+ * Removes a subscriber from a filter. Nodes left without subscribers and
+ * children are freed.
+ *
+ * @param trie The trie to modify
+ * @param filter The filter to unsubscribe from
+ * @param subscriber The subscriber
+ *
+ * @return 1 if the subscription was removed, 0 if it did not exist
+ */
+int nanoPubSub__Topic_unsubscribe(nanoPubSub__Topic_trie *trie,
+	const nanoPubSub__Message_slice *filter, void *subscriber);
+
+
+/**
+ * Removes a subscriber from every filter it is subscribed to. Nodes left
+ * without subscribers and children are freed. The whole trie is walked,
+ * so this is meant for subscribers that go away, not for the fast path.
+ *
+ * @param trie The trie to modify
+ * @param subscriber The subscriber
+ *
+ * @return The number of subscriptions removed
+ */
+size_t nanoPubSub__Topic_unsubscribeAll(nanoPubSub__Topic_trie *trie,
+	void *subscriber);
+
+
+/**
+ * Finds all filters matching a topic and passes their subscribers to a
+ * visitor. A subscriber of several matching filters is visited once per
+ * filter. Wildcards at the first level do not match topics starting with
+ * '$', which are reserved for the broker's own topics.
+ *
+ * @param trie The trie to search
+ * @param topic The topic to match (must not contain wildcards)
+ * @param visitor The function to call for every matching filter
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching filters
+ */
+size_t nanoPubSub__Topic_match(const nanoPubSub__Topic_trie *trie,
+	const nanoPubSub__Message_slice *topic, nanoPubSub__Topic_visitor visitor,
+	void *arg);
+
+
+#endif /* __LIBNANOPUBSUB__TOPIC_H */
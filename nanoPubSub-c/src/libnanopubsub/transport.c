@@ -0,0 +1,694 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "transport.h"
+
+
+/**
+ * Sets up an io_uring instance and maps its queues.
+ *
+ * @param uring The instance to set up
+ * @param entries The number of submission queue entries
+ * @param cqEntries The number of completion queue entries, or 0 for the
+ *                  kernel's default
+ *
+ * @return 1 on success, 0 on error (errno is set)
+ */
+static int setupUring(nanoPubSub__Transport_uring *uring,
+		unsigned int entries, unsigned int cqEntries)
+{
+	struct io_uring_params params;
+	char *sqRing, *cqRing;
+
+	memset(&params, 0, sizeof(params));
+	if (cqEntries > 0) {
+		params.flags      = IORING_SETUP_CQSIZE;
+		params.cq_entries = cqEntries;
+	}
+
+	if ((uring->fd = syscall(__NR_io_uring_setup, entries, &params)) == -1) {
+		return 0;
+	}
+
+	uring->sqRingSize = params.sq_off.array
+		+ params.sq_entries * sizeof(unsigned int);
+	uring->cqRingSize = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+
+	/* Both rings share a single mapping if the kernel supports it */
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (uring->cqRingSize > uring->sqRingSize) {
+			uring->sqRingSize = uring->cqRingSize;
+		}
+		uring->cqRingSize = uring->sqRingSize;
+	}
+
+	uring->sqRing = mmap(NULL, uring->sqRingSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+	if (uring->sqRing == MAP_FAILED) {
+		uring->sqRing = NULL;
+		return 0;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		uring->cqRing = uring->sqRing;
+	} else {
+		uring->cqRing = mmap(NULL, uring->cqRingSize,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+			IORING_OFF_CQ_RING);
+		if (uring->cqRing == MAP_FAILED) {
+			uring->cqRing = NULL;
+			return 0;
+		}
+	}
+
+	uring->sqes = mmap(NULL, params.sq_entries * sizeof(*uring->sqes),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+		IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED) {
+		uring->sqes = NULL;
+		return 0;
+	}
+
+	sqRing = uring->sqRing;
+	cqRing = uring->cqRing;
+
+	uring->sqEntries   = params.sq_entries;
+	uring->sqHead      = (unsigned int*)(sqRing + params.sq_off.head);
+	uring->sqTail      = (unsigned int*)(sqRing + params.sq_off.tail);
+	uring->sqArray     = (unsigned int*)(sqRing + params.sq_off.array);
+	uring->sqMask      = *(unsigned int*)(sqRing + params.sq_off.ring_mask);
+	uring->sqLocalTail = *uring->sqTail;
+	uring->toSubmit    = 0;
+
+	uring->cqHead = (unsigned int*)(cqRing + params.cq_off.head);
+	uring->cqTail = (unsigned int*)(cqRing + params.cq_off.tail);
+	uring->cqes   = (struct io_uring_cqe*)(cqRing + params.cq_off.cqes);
+	uring->cqMask = *(unsigned int*)(cqRing + params.cq_off.ring_mask);
+
+	return 1;
+}
+
+
+/**
+ * Unmaps the queues of an io_uring instance and closes it.
+ */
+static void freeUring(nanoPubSub__Transport_uring *uring)
+{
+	if (uring->sqes != NULL) {
+		munmap(uring->sqes, uring->sqEntries * sizeof(*uring->sqes));
+	}
+
+	if (uring->cqRing != NULL && uring->cqRing != uring->sqRing) {
+		munmap(uring->cqRing, uring->cqRingSize);
+	}
+
+	if (uring->sqRing != NULL) {
+		munmap(uring->sqRing, uring->sqRingSize);
+	}
+
+	if (uring->fd != -1) {
+		close(uring->fd);
+	}
+
+	memset(uring, 0, sizeof(*uring));
+	uring->fd = -1;
+}
+
+
+/**
+ * Returns the next free submission queue entry, cleared. The entry is
+ * submitted with the next call of submit().
+ *
+ * @return The entry, or NULL if the submission queue is full
+ */
+static struct io_uring_sqe *nextSqe(nanoPubSub__Transport_uring *uring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int index;
+
+	if (uring->sqLocalTail - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE)
+			>= uring->sqEntries) {
+		return NULL;
+	}
+
+	index = uring->sqLocalTail & uring->sqMask;
+	sqe   = &uring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+
+	uring->sqArray[index] = index;
+	uring->sqLocalTail++;
+	uring->toSubmit++;
+
+	return sqe;
+}
+
+
+/**
+ * Hands the new submission queue entries to the kernel and waits for a
+ * number of completions.
+ *
+ * @return 1 on success, 0 on error (errno is set)
+ */
+static int submit(nanoPubSub__Transport_uring *uring,
+		unsigned int minComplete)
+{
+	int submitted;
+
+	__atomic_store_n(uring->sqTail, uring->sqLocalTail, __ATOMIC_RELEASE);
+
+	submitted = syscall(__NR_io_uring_enter, uring->fd, uring->toSubmit,
+		minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+	if (submitted == -1) {
+		return 0;
+	}
+
+	uring->toSubmit -= submitted;
+
+	return 1;
+}
+
+
+/**
+ * Takes back the submission queue entries the kernel has not consumed
+ * because submit() failed.
+ *
+ * @return The number of entries taken back, which were the last ones
+ *         returned by nextSqe()
+ */
+static unsigned int withdrawSqes(nanoPubSub__Transport_uring *uring)
+{
+	unsigned int withdrawn = uring->toSubmit;
+
+	uring->sqLocalTail -= withdrawn;
+	uring->toSubmit     = 0;
+	__atomic_store_n(uring->sqTail, uring->sqLocalTail, __ATOMIC_RELEASE);
+
+	return withdrawn;
+}
+
+
+/**
+ * Hands a provided buffer (back) to the kernel. The buffer becomes
+ * visible to the kernel with the next call of publishBuffers().
+ */
+static void provideBuffer(nanoPubSub__Transport *transport, unsigned int id)
+{
+	struct io_uring_buf *buffer = &transport->buffers->bufs[
+		transport->bufferTail & (NANOPUBSUB__TRANSPORT_RECV_BUFFERS - 1)];
+
+	buffer->addr = (uintptr_t)(transport->bufferData
+		+ id * NANOPUBSUB__TRANSPORT_RECV_BUFFER_SIZE);
+	buffer->len  = NANOPUBSUB__TRANSPORT_RECV_BUFFER_SIZE;
+	buffer->bid  = id;
+
+	transport->bufferTail++;
+}
+
+
+/**
+ * Makes the buffers handed over by provideBuffer() visible to the kernel.
+ */
+static void publishBuffers(nanoPubSub__Transport *transport)
+{
+	__atomic_store_n(&transport->buffers->tail, transport->bufferTail,
+		__ATOMIC_RELEASE);
+}
+
+
+/**
+ * Arms the multishot recvmsg operation, which stays armed until it runs
+ * out of provided buffers or completion queue entries.
+ *
+ * @return 1 on success, 0 on error (errno is set)
+ */
+static int armRecv(nanoPubSub__Transport *transport)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = nextSqe(&transport->recvUring)) == NULL) {
+		errno = EBUSY;
+		return 0;
+	}
+
+	sqe->opcode    = IORING_OP_RECVMSG;
+	sqe->fd        = transport->socket;
+	sqe->addr      = (uintptr_t)&transport->recvHeader;
+	sqe->ioprio    = IORING_RECV_MULTISHOT;
+	sqe->flags     = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = NANOPUBSUB__TRANSPORT_BUFFER_GROUP;
+
+	if (!submit(&transport->recvUring, 0)) {
+		return 0;
+	}
+
+	transport->recvArmed = 1;
+
+	return 1;
+}
+
+
+/**
+ * Sets up the io_uring instances, the provided buffers and the eventfd
+ * of an io_uring transport and arms the multishot recvmsg operation.
+ *
+ * @return 1 on success, 0 on error (errno is set)
+ */
+static int openUring(nanoPubSub__Transport *transport)
+{
+	struct io_uring_buf_reg registration;
+	unsigned int i;
+
+	/* Every datagram takes a completion queue entry until it is reaped.
+	   Running out of them or of buffers only disarms the receive
+	   operation, it is armed again after the next batch. */
+	if (!setupUring(&transport->recvUring, 4,
+				2 * NANOPUBSUB__TRANSPORT_RECV_BUFFERS)
+			|| !setupUring(&transport->sendUring,
+				NANOPUBSUB__NETWORK_SEND_BATCH, 0)) {
+		return 0;
+	}
+
+	transport->buffers = mmap(NULL, NANOPUBSUB__TRANSPORT_RECV_BUFFERS
+		* sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (transport->buffers == MAP_FAILED) {
+		transport->buffers = NULL;
+		return 0;
+	}
+
+	if ((transport->bufferData = malloc(NANOPUBSUB__TRANSPORT_RECV_BUFFERS
+			* NANOPUBSUB__TRANSPORT_RECV_BUFFER_SIZE)) == NULL) {
+		errno = ENOMEM;
+		return 0;
+	}
+
+	memset(&registration, 0, sizeof(registration));
+	registration.ring_addr    = (uintptr_t)transport->buffers;
+	registration.ring_entries = NANOPUBSUB__TRANSPORT_RECV_BUFFERS;
+	registration.bgid         = NANOPUBSUB__TRANSPORT_BUFFER_GROUP;
+
+	if (syscall(__NR_io_uring_register, transport->recvUring.fd,
+			IORING_REGISTER_PBUF_RING, &registration, 1) == -1) {
+		return 0;
+	}
+
+	for (i = 0; i < NANOPUBSUB__TRANSPORT_RECV_BUFFERS; i++) {
+		provideBuffer(transport, i);
+	}
+	publishBuffers(transport);
+
+	if ((transport->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1
+			|| syscall(__NR_io_uring_register, transport->recvUring.fd,
+				IORING_REGISTER_EVENTFD, &transport->eventfd, 1) == -1) {
+		return 0;
+	}
+
+	/* The kernel reserves room for the sender's address in front of
+	   every datagram */
+	memset(&transport->recvHeader, 0, sizeof(transport->recvHeader));
+	transport->recvHeader.msg_namelen = sizeof(struct sockaddr_storage);
+
+	return armRecv(transport);
+}
+
+
+/**
+ * Sets a transport up for a non-blocking socket. If io_uring is requested
+ * but not available, the transport falls back to the socket calls.
+ *
+ * @param transport The transport to set up
+ * @param socket The socket, which stays owned by the caller
+ * @param type NANOPUBSUB__TRANSPORT_SOCKET or NANOPUBSUB__TRANSPORT_IO_URING
+ *
+ * @return 1 if the transport uses the requested type. Otherwise, 0 is
+ *         returned, the transport uses the socket calls and the global
+ *         variable errno is set to indicate why io_uring is not used.
+ */
+int nanoPubSub__Transport_open(nanoPubSub__Transport *transport,
+		int socket, int type)
+{
+	int error;
+
+	memset(transport, 0, sizeof(*transport));
+	transport->type         = NANOPUBSUB__TRANSPORT_SOCKET;
+	transport->socket       = socket;
+	transport->eventfd      = -1;
+	transport->recvUring.fd = -1;
+	transport->sendUring.fd = -1;
+
+	if (type != NANOPUBSUB__TRANSPORT_IO_URING) {
+		return 1;
+	}
+
+	if (!openUring(transport)) {
+		error = errno;
+		nanoPubSub__Transport_close(transport);
+		transport->socket = socket;
+		errno = error;
+		return 0;
+	}
+
+	transport->type = NANOPUBSUB__TRANSPORT_IO_URING;
+
+	return 1;
+}
+
+
+/**
+ * Frees the resources of a transport. The socket is not closed.
+ *
+ * @param transport The transport to free
+ */
+void nanoPubSub__Transport_close(nanoPubSub__Transport *transport)
+{
+	/* Closing the io_uring cancels the receive operation */
+	freeUring(&transport->recvUring);
+	freeUring(&transport->sendUring);
+
+	if (transport->eventfd != -1) {
+		close(transport->eventfd);
+	}
+
+	if (transport->buffers != NULL) {
+		munmap(transport->buffers, NANOPUBSUB__TRANSPORT_RECV_BUFFERS
+			* sizeof(struct io_uring_buf));
+	}
+
+	free(transport->bufferData);
+
+	transport->type       = NANOPUBSUB__TRANSPORT_SOCKET;
+	transport->eventfd    = -1;
+	transport->buffers    = NULL;
+	transport->bufferData = NULL;
+	transport->recvArmed  = 0;
+}
+
+
+/**
+ * Returns the file descriptor that becomes readable when datagrams can
+ * be received: the socket, or the eventfd of the io_uring transport.
+ *
+ * @param transport The transport
+ *
+ * @return The file descriptor
+ */
+int nanoPubSub__Transport_fd(const nanoPubSub__Transport *transport)
+{
+	return transport->type == NANOPUBSUB__TRANSPORT_IO_URING
+		? transport->eventfd : transport->socket;
+}
+
+
+/**
+ * Points a slot of a ring at the datagram of a receive completion. The
+ * completion's provided buffer is held until the next batch is received.
+ *
+ * @return 1 if the slot holds a datagram, 0 if the completion carries
+ *         none
+ */
+static int reapDatagram(nanoPubSub__Transport *transport,
+		const struct io_uring_cqe *cqe, nanoPubSub__Network_recvRing *ring,
+		unsigned int slot)
+{
+	const struct io_uring_recvmsg_out *out;
+	const char *name, *payload;
+	unsigned int id;
+	size_t size;
+
+	if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+		return 0;
+	}
+
+	id  = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	out = (const struct io_uring_recvmsg_out*)(transport->bufferData
+		+ id * NANOPUBSUB__TRANSPORT_RECV_BUFFER_SIZE);
+
+	/* The buffer holds the header, the reserved room for the address and
+	   the datagram, which may have been truncated */
+	name    = (const char*)(out + 1);
+	payload = name + transport->recvHeader.msg_namelen;
+	size    = out->payloadlen;
+
+	if (size > (size_t)cqe->res - (payload - (const char*)out)) {
+		size = (size_t)cqe->res - (payload - (const char*)out);
+	}
+
+	memcpy(&ring->addrs[slot], name,
+		out->namelen < sizeof(ring->addrs[slot])
+			? out->namelen : sizeof(ring->addrs[slot]));
+	ring->iovecs[slot].iov_base = (void*)payload;
+	ring->headers[slot].msg_len = size;
+	ring->headers[slot].msg_hdr.msg_flags = size < out->payloadlen
+		? out->flags | MSG_TRUNC : out->flags;
+
+	transport->heldBuffers[transport->numHeld++] = id;
+
+	return 1;
+}
+
+
+/**
+ * Hands the provided buffers of the last batch back to the kernel and
+ * points the I/O vectors of its slots at the ring's buffers again.
+ */
+static void releaseBuffers(nanoPubSub__Transport *transport)
+{
+	nanoPubSub__Network_recvRing *ring = transport->heldRing;
+	unsigned int i, slot;
+
+	for (i = 0; i < transport->numHeld; i++) {
+		slot = transport->heldStart + i;
+		ring->iovecs[slot].iov_base = ring->buffers
+			+ (size_t)slot * ring->bufferSize;
+
+		provideBuffer(transport, transport->heldBuffers[i]);
+	}
+
+	transport->numHeld = 0;
+	publishBuffers(transport);
+}
+
+
+/**
+ * Receives a batch from the completions of the multishot recvmsg
+ * operation.
+ */
+static int recvUringBatch(nanoPubSub__Transport *transport,
+		nanoPubSub__Network_recvRing *ring, unsigned int maxMessages,
+		unsigned int *first)
+{
+	nanoPubSub__Transport_uring *uring = &transport->recvUring;
+	const struct io_uring_cqe *cqe;
+	unsigned int start, head, received = 0;
+	uint64_t count;
+	int error = EAGAIN, reset = 0;
+
+	/* The views of the last batch are not needed anymore */
+	releaseBuffers(transport);
+
+	start = nanoPubSub__Network_startBatch(ring, &maxMessages);
+	head  = *uring->cqHead;
+
+	transport->heldRing  = ring;
+	transport->heldStart = start;
+
+	while (received < maxMessages) {
+		if (head == __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE)) {
+			/* Reset the eventfd before looking a last time, so that a
+			   completion arriving in between signals it again */
+			if (received > 0 || reset) {
+				break;
+			}
+			if (read(transport->eventfd, &count, sizeof(count)) == -1) {
+				/* The eventfd has not been signaled */
+			}
+			reset = 1;
+			continue;
+		}
+
+		cqe = &uring->cqes[head & uring->cqMask];
+		head++;
+
+		/* Running out of buffers ends the operation; other errors do
+		   as well and are reported */
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			transport->recvArmed = 0;
+			if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+				error = -cqe->res;
+			}
+		}
+
+		received += reapDatagram(transport, cqe, ring, start + received);
+	}
+
+	__atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+
+	if (!transport->recvArmed && error == EAGAIN && !armRecv(transport)) {
+		error = errno;
+	}
+
+	if (received == 0) {
+		errno = error;
+		return -1;
+	}
+
+	nanoPubSub__Network_finishBatch(ring, start, received);
+	*first = start;
+
+	return received;
+}
+
+
+/**
+ * Receives up to maxMessages datagrams without blocking and parses them
+ * into the views of a ring, like nanoPubSub__Network_recvBatch. The io_uring
+ * transport does not copy the datagrams into the ring's buffers: the
+ * slots' I/O vectors and views point into the provided buffers, which stay
+ * valid until the next batch is received.
+ *
+ * @param transport The transport to receive from
+ * @param ring The ring to receive into
+ * @param maxMessages The max. number of datagrams to receive
+ * @param first Pointer to store the index of the batch's first slot in
+ *
+ * @return The number of datagrams received. Otherwise, -1 is returned and
+ *         the global variable errno is set to indicate the error (EAGAIN
+ *         if there are no datagrams).
+ */
+int nanoPubSub__Transport_recvBatch(nanoPubSub__Transport *transport,
+		nanoPubSub__Network_recvRing *ring, unsigned int maxMessages,
+		unsigned int *first)
+{
+	if (transport->type == NANOPUBSUB__TRANSPORT_IO_URING) {
+		return recvUringBatch(transport, ring, maxMessages, first);
+	}
+
+	return nanoPubSub__Network_recvBatch(transport->socket, ring,
+		maxMessages, MSG_DONTWAIT, first);
+}
+
+
+/**
+ * Sends a message string to up to NANOPUBSUB__NETWORK_SEND_BATCH
+ * destinations with one sendmsg operation each, submitted and completed
+ * with a single system call. Destinations that cannot be sent to through
+ * io_uring, e.g. because the submission failed, are sent to with the
+ * socket calls.
+ *
+ * @return The number of destinations the message was sent to
+ */
+static unsigned int sendUringBatch(nanoPubSub__Transport *transport,
+		const struct sockaddr *const *destAddrs, unsigned int count)
+{
+	nanoPubSub__Transport_uring *uring = &transport->sendUring;
+	const char *string = transport->sendIovec.iov_base;
+	size_t length = transport->sendIovec.iov_len;
+	struct io_uring_sqe *sqe;
+	struct msghdr *header;
+	unsigned int head, queued, completed = 0, numSent = 0;
+
+	for (queued = 0; queued < count; queued++) {
+		if ((sqe = nextSqe(uring)) == NULL) {
+			break;
+		}
+
+		header = &transport->sendHeaders[queued];
+		memset(header, 0, sizeof(*header));
+		header->msg_name    = (void*)destAddrs[queued];
+		header->msg_namelen = sizeof(struct sockaddr);
+		header->msg_iov     = &transport->sendIovec;
+		header->msg_iovlen  = 1;
+
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd     = transport->socket;
+		sqe->addr   = (uintptr_t)header;
+	}
+
+	/* The headers, the payload and the addresses are only valid until
+	   this function returns, so every operation the kernel has taken is
+	   waited for. UDP sends complete right away. After a failed
+	   submission, the operations the kernel has not taken are taken back
+	   and sent with the socket calls. */
+	while (completed < queued) {
+		if (!submit(uring, queued - completed) && errno != EINTR
+				&& uring->toSubmit > 0) {
+			queued -= withdrawSqes(uring);
+		}
+
+		head = *uring->cqHead;
+		while (head != __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE)) {
+			if (uring->cqes[head & uring->cqMask].res >= 0) {
+				numSent++;
+			}
+			head++;
+			completed++;
+		}
+		__atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	if (queued < count) {
+		numSent += nanoPubSub__Network_sendStringMulti(transport->socket,
+			destAddrs + queued, count - queued, string, length);
+	}
+
+	return numSent;
+}
+
+
+/**
+ * Sends a prebuilt message string to a number of destinations, like
+ * nanoPubSub__Network_sendStringMulti.
+ *
+ * @param transport The transport to send over
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes)
+ *
+ * @return The number of destinations the message was sent to.
+ */
+unsigned int nanoPubSub__Transport_sendStringMulti(
+		nanoPubSub__Transport *transport,
+		const struct sockaddr *const *destAddrs, unsigned int numDestAddrs,
+		const char *string, size_t length)
+{
+	unsigned int pos, count, numSent = 0;
+
+	/* Fragmented messages are rare enough for the socket calls */
+	if (transport->type != NANOPUBSUB__TRANSPORT_IO_URING
+			|| length > NANOPUBSUB__MAX_MESSAGE_LENGTH) {
+		return nanoPubSub__Network_sendStringMulti(transport->socket,
+			destAddrs, numDestAddrs, string, length);
+	}
+
+	transport->sendIovec.iov_base = (void*)string;
+	transport->sendIovec.iov_len  = length;
+
+	for (pos = 0; pos < numDestAddrs; pos += count) {
+		count = numDestAddrs - pos;
+		if (count > NANOPUBSUB__NETWORK_SEND_BATCH) {
+			count = NANOPUBSUB__NETWORK_SEND_BATCH;
+		}
+
+		numSent += sendUringBatch(transport, destAddrs + pos, count);
+	}
+
+	return numSent;
+}
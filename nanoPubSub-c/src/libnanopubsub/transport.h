@@ -0,0 +1,264 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include "message.h"
+#include "network.h"
+
+#ifndef __LIBNANOPUBSUB__TRANSPORT_H
+#define __LIBNANOPUBSUB__TRANSPORT_H
+
+
+/** Datagrams are sent and received with the socket system calls */
+#define NANOPUBSUB__TRANSPORT_SOCKET 0
+
+/** Datagrams are sent and received through io_uring (Linux 6.0 or later) */
+#define NANOPUBSUB__TRANSPORT_IO_URING 1
+
+/**
+ * The number of buffers provided to the kernel to receive datagrams into
+ * (a power of two)
+ */
+#define NANOPUBSUB__TRANSPORT_RECV_BUFFERS 512
+
+/**
+ * The size of a provided buffer (in bytes): the header the kernel puts
+ * in front of a datagram, the sender's address and the datagram
+ */
+#define NANOPUBSUB__TRANSPORT_RECV_BUFFER_SIZE \
+	(sizeof(struct io_uring_recvmsg_out) \
+		+ sizeof(struct sockaddr_storage) + NANOPUBSUB__MAX_MESSAGE_LENGTH)
+
+/** The id of the group the provided buffers are registered as */
+#define NANOPUBSUB__TRANSPORT_BUFFER_GROUP 0
+
+
+/**
+ * An io_uring instance: the submission and completion queues shared
+ * with the kernel.
+ */
+typedef struct
+{
+	/** The io_uring's file descriptor, or -1 */
+	int fd;
+
+	/** The mapped submission queue ring, or NULL */
+	void *sqRing;
+
+	/** The size of the mapped submission queue ring (in bytes) */
+	size_t sqRingSize;
+
+	/**
+	 * The mapped completion queue ring, which may be the same mapping as
+	 * the submission queue ring, or NULL
+	 */
+	void *cqRing;
+
+	/** The size of the mapped completion queue ring (in bytes) */
+	size_t cqRingSize;
+
+	/** The mapped submission queue entries, or NULL */
+	struct io_uring_sqe *sqes;
+
+	/** The number of submission queue entries */
+	unsigned int sqEntries;
+
+	/** The submission queue's head, advanced by the kernel */
+	unsigned int *sqHead;
+
+	/** The submission queue's tail, advanced when submitting */
+	unsigned int *sqTail;
+
+	/** The submission queue's index array */
+	unsigned int *sqArray;
+
+	/** The mask giving the index of a submission queue position */
+	unsigned int sqMask;
+
+	/** The tail including the entries not yet made visible */
+	unsigned int sqLocalTail;
+
+	/** The number of entries not yet submitted */
+	unsigned int toSubmit;
+
+	/** The completion queue's head, advanced when reaping */
+	unsigned int *cqHead;
+
+	/** The completion queue's tail, advanced by the kernel */
+	unsigned int *cqTail;
+
+	/** The completion queue entries */
+	struct io_uring_cqe *cqes;
+
+	/** The mask giving the index of a completion queue position */
+	unsigned int cqMask;
+} nanoPubSub__Transport_uring;
+
+
+/**
+ * The way a socket's datagrams are sent and received, chosen at runtime.
+ *
+ * The socket transport calls recvmmsg() and sendmmsg() for every batch.
+ * The io_uring transport keeps a single multishot recvmsg operation armed,
+ * which makes the kernel receive every datagram into one of a ring of
+ * registered provided buffers without any system call; receiving a batch
+ * only reaps the completions. Sends to many destinations are queued as
+ * sendmsg operations and submitted with a single system call. An eventfd
+ * signals new completions, so callers wait for it to become readable
+ * instead of the socket.
+ */
+typedef struct
+{
+	/** NANOPUBSUB__TRANSPORT_SOCKET or NANOPUBSUB__TRANSPORT_IO_URING */
+	int type;
+
+	/** The socket */
+	int socket;
+
+	/** The eventfd signaling receive completions, or -1 */
+	int eventfd;
+
+	/** The io_uring datagrams are received through */
+	nanoPubSub__Transport_uring recvUring;
+
+	/** The io_uring datagrams are sent through */
+	nanoPubSub__Transport_uring sendUring;
+
+	/** The ring of provided buffers shared with the kernel, or NULL */
+	struct io_uring_buf_ring *buffers;
+
+	/** The memory of the provided buffers, or NULL */
+	char *bufferData;
+
+	/** The provided buffers' tail */
+	uint16_t bufferTail;
+
+	/** The message header describing the layout of the provided buffers */
+	struct msghdr recvHeader;
+
+	/** 1 while the multishot recvmsg operation is armed */
+	int recvArmed;
+
+	/**
+	 * The provided buffers the datagrams of the last batch are parsed
+	 * from, in the order of the batch's slots. They are handed back to
+	 * the kernel when the next batch is received.
+	 */
+	uint16_t heldBuffers[NANOPUBSUB__TRANSPORT_RECV_BUFFERS];
+
+	/** The number of held buffers */
+	unsigned int numHeld;
+
+	/** The ring the last batch was received into, or NULL */
+	nanoPubSub__Network_recvRing *heldRing;
+
+	/** The last batch's first slot */
+	unsigned int heldStart;
+
+	/** The message headers of the send operations of a batch */
+	struct msghdr sendHeaders[NANOPUBSUB__NETWORK_SEND_BATCH];
+
+	/** The I/O vector shared by the send operations of a batch */
+	struct iovec sendIovec;
+} nanoPubSub__Transport;
+
+
+/**
+ * Sets a transport up for a non-blocking socket. If io_uring is requested
+ * but not available, the transport falls back to the socket calls.
+ *
+ * @param transport The transport to set up
+ * @param socket The socket, which stays owned by the caller
+ * @param type NANOPUBSUB__TRANSPORT_SOCKET or NANOPUBSUB__TRANSPORT_IO_URING
+ *
+ * @return 1 if the transport uses the requested type. Otherwise, 0 is
+ *         returned, the transport uses the socket calls and the global
+ *         variable errno is set to indicate why io_uring is not used.
+ */
+int nanoPubSub__Transport_open(nanoPubSub__Transport *transport,
+	int socket, int type);
+
+
+/**
+ * Frees the resources of a transport. The socket is not closed.
+ *
+ * @param transport The transport to free
+ */
+void nanoPubSub__Transport_close(nanoPubSub__Transport *transport);
+
+
+/**
+ * Returns the file descriptor that becomes readable when datagrams can
+ * be received: the socket, or the eventfd of the io_uring transport.
+ *
+ * @param transport The transport
+ *
+ * @return The file descriptor
+ */
+int nanoPubSub__Transport_fd(const nanoPubSub__Transport *transport);
+
+
+/**
+ * Receives up to maxMessages datagrams without blocking and parses them
+ * into the views of a ring, like nanoPubSub__Network_recvBatch. The io_uring
+ * transport does not copy the datagrams into the ring's buffers: the
+ * slots' I/O vectors and views point into the provided buffers, which stay
+ * valid until the next batch is received.
+ *
+ * @param transport The transport to receive from
+ * @param ring The ring to receive into
+ * @param maxMessages The max. number of datagrams to receive
+ * @param first Pointer to store the index of the batch's first slot in
+ *
+ * @return The number of datagrams received. Otherwise, -1 is returned and
+ *         the global variable errno is set to indicate the error (EAGAIN
+ *         if there are no datagrams).
+ */
+int nanoPubSub__Transport_recvBatch(nanoPubSub__Transport *transport,
+	nanoPubSub__Network_recvRing *ring, unsigned int maxMessages,
+	unsigned int *first);
+
+
+/**
+ * Sends a prebuilt message string to a number of destinations, like
+ * nanoPubSub__Network_sendStringMulti.
+ *
+ * @param transport The transport to send over
+ * @param destAddrs The addresses of the targets
+ * @param numDestAddrs The number of targets
+ * @param string The message string to send
+ * @param length The length of the message string (in bytes)
+ *
+ * @return The number of destinations the message was sent to.
+ */
+unsigned int nanoPubSub__Transport_sendStringMulti(
+	nanoPubSub__Transport *transport, const struct sockaddr *const *destAddrs,
+	unsigned int numDestAddrs, const char *string, size_t length);
+
+
+#endif /* __LIBNANOPUBSUB__TRANSPORT_H */
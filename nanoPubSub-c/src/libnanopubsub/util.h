@@ -0,0 +1,124 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef __LIBNANOPUBSUB__UTIL_H
+#define __LIBNANOPUBSUB__UTIL_H
+
+
+/** The offset basis of the FNV-1a hash, see nanoPubSub__Util_hash */
+#define NANOPUBSUB__UTIL_HASH_BASIS	2166136261u
+
+
+/**
+ * Continues the FNV-1a hash of a string slice. Hashes starting from other
+ * values than NANOPUBSUB__UTIL_HASH_BASIS are seeded with them.
+ *
+ * @param string The string to hash
+ * @param length The length of the string (in bytes)
+ * @param hash The hash so far
+ *
+ * @return The hash including the string
+ */
+static inline uint32_t nanoPubSub__Util_hashSeeded(const char *string,
+		size_t length, uint32_t hash)
+{
+	while (length-- > 0) {
+		hash ^= (uint8_t)*string++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+/**
+ * Calculates the FNV-1a hash of a string slice, which is used for the
+ * hash tables of client ids, topics and topic filters.
+ *
+ * @param string The string to hash
+ * @param length The length of the string (in bytes)
+ *
+ * @return The hash of the string
+ */
+static inline uint32_t nanoPubSub__Util_hash(const char *string,
+		size_t length)
+{
+	return nanoPubSub__Util_hashSeeded(string, length,
+		NANOPUBSUB__UTIL_HASH_BASIS);
+}
+
+
+/**
+ * Returns the time of a clock in milliseconds.
+ *
+ * @param clock CLOCK_MONOTONIC for timeouts, CLOCK_REALTIME for
+ *              timestamps since the epoch
+ *
+ * @return The clock's time in milliseconds
+ */
+static inline uint64_t nanoPubSub__Util_currentTimeMs(clockid_t clock)
+{
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/**
+ * Returns the time of a clock in microseconds.
+ *
+ * @param clock CLOCK_MONOTONIC for timeouts, CLOCK_REALTIME for
+ *              timestamps since the epoch
+ *
+ * @return The clock's time in microseconds
+ */
+static inline uint64_t nanoPubSub__Util_currentTimeUs(clockid_t clock)
+{
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+/**
+ * Returns the time of a clock in nanoseconds.
+ *
+ * @param clock CLOCK_MONOTONIC for durations, CLOCK_REALTIME for
+ *              timestamps since the epoch
+ *
+ * @return The clock's time in nanoseconds
+ */
+static inline uint64_t nanoPubSub__Util_currentTimeNs(clockid_t clock)
+{
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+
+#endif /* __LIBNANOPUBSUB__UTIL_H */
@@ -0,0 +1,342 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "worker.h"
+
+
+/**
+ * Opens a UDP socket bound to a port that other sockets may be bound to
+ * as well.
+ *
+ * @return The socket, or -1 on error
+ */
+static int openSocket(unsigned short port)
+{
+	struct sockaddr_in addr;
+	int socketfd, one = 1, error;
+
+	if ((socketfd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+		return -1;
+	}
+
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(port);
+	addr.sin_addr.s_addr = INADDR_ANY;
+	memset(addr.sin_zero, '\0', sizeof(addr.sin_zero));
+
+	if (setsockopt(socketfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))
+			== -1
+			|| bind(socketfd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		error = errno;
+		close(socketfd);
+		errno = error;
+		return -1;
+	}
+
+	return socketfd;
+}
+
+
+/**
+ * Passes the message in a slot of the worker's ring to the handler.
+ * Invalid messages are skipped and pings are answered right away, so the
+ * sender knows the worker is still alive. Standard messages not matching
+ * the worker's filter are dropped before the handler sees them.
+ */
+static void handleView(nanoPubSub__Worker *worker, unsigned int slot)
+{
+	const nanoPubSub__Message_view *view = &worker->ring.views[slot];
+	const struct sockaddr *fromAddr =
+		(const struct sockaddr*)&worker->ring.addrs[slot];
+
+	if (view->length == 0) {
+		return;
+	}
+
+	if (view->type == NANOPUBSUB__PING_MESSAGE) {
+		nanoPubSub__Network_sendPong(worker->socket, fromAddr, view);
+		return;
+	}
+
+	/* Topics sent as numeric ids cannot be matched */
+	if (worker->filter != NULL
+			&& view->type == NANOPUBSUB__STANDARD_MESSAGE
+			&& view->topic.data != NULL
+			&& !nanoPubSub__Filter_matches(worker->filter, &view->topic)) {
+		nanoPubSub__Metrics_count(&worker->metrics,
+			NANOPUBSUB__METRIC_DROPPED, 1);
+		return;
+	}
+
+	worker->handler(worker->index, fromAddr, view, worker->arg);
+}
+
+
+/**
+ * Receives messages in batches and passes them to the worker's handler
+ * until the worker is stopped. Receive errors, e.g. ENOBUFS or an
+ * ECONNREFUSED reported by ICMP, are counted and do not end the worker,
+ * as the kernel keeps spreading datagrams over all sockets of the port.
+ */
+static void *runWorker(void *arg)
+{
+	nanoPubSub__Worker *worker = arg;
+	unsigned int first;
+	int i, received;
+
+	for (;;) {
+		received = nanoPubSub__Network_recvBatch(worker->socket,
+			&worker->ring, NANOPUBSUB__WORKER_RECV_BATCH, MSG_WAITFORONE,
+			&first);
+
+		/* A shut down socket returns an empty datagram at once, so the
+		   flag must be checked after every call */
+		if (received == 0
+				|| __atomic_load_n(&worker->stopping, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		if (received == -1) {
+			if (errno != EINTR) {
+				nanoPubSub__Metrics_count(&worker->metrics,
+					NANOPUBSUB__METRIC_RECV_ERRORS, 1);
+			}
+			continue;
+		}
+
+		for (i = 0; i < received; i++) {
+			/* The messages packed into a datagram take turns in its
+			   slot's view */
+			do {
+				handleView(worker, first + i);
+			} while (nanoPubSub__Network_unpackNext(&worker->ring,
+				first + i));
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Opens the workers' sockets on a UDP port and starts a thread for every
+ * worker.
+ *
+ * @param group The group to start
+ * @param port The UDP port to listen on
+ * @param numWorkers The number of workers
+ * @param pin 1 to pin every worker to a core of its own (as long as there
+ *            are enough cores), 0 to let the scheduler decide
+ * @param handler The function handling received messages
+ * @param arg An argument passed to the handler
+ * @param filter The filters the topics of standard messages must match,
+ *               or NULL to pass all messages to the handler. The filters
+ *               are shared by all workers and must not be changed until
+ *               the workers have stopped.
+ *
+ * @return 1 on success. Otherwise, 0 is returned, no worker is running and
+ *         the global variable errno is set to indicate the error.
+ */
+int nanoPubSub__Worker_start(nanoPubSub__Worker_group *group,
+		unsigned short port, unsigned int numWorkers, int pin,
+		nanoPubSub__Worker_handler handler, void *arg,
+		const nanoPubSub__Filter *filter)
+{
+	nanoPubSub__Worker *worker;
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	unsigned int i;
+	int cpu = -1, error;
+
+	assert(numWorkers > 0);
+
+	if ((group->workers = calloc(numWorkers, sizeof(*group->workers)))
+			== NULL) {
+		errno = ENOMEM;
+		return 0;
+	}
+
+	group->numWorkers = numWorkers;
+	nanoPubSub__Metrics_init(&group->metrics);
+
+	for (i = 0; i < numWorkers; i++) {
+		group->workers[i].socket = -1;
+		nanoPubSub__Metrics_init(&group->workers[i].metrics);
+	}
+
+	/* The workers get the cores the process may run on in turn */
+	if (pin && sched_getaffinity(0, sizeof(cpus), &cpus) == -1) {
+		pin = 0;
+	}
+
+	/* Set everything up before the first thread is started, so that
+	   errors need not be reported from within a thread */
+	for (i = 0; i < numWorkers; i++) {
+		worker = &group->workers[i];
+
+		worker->index   = i;
+		worker->handler = handler;
+		worker->arg     = arg;
+		worker->filter  = filter;
+		worker->cpu     = -1;
+
+		if (pin) {
+			while (++cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &cpus)) {
+				/* Skip cores the process must not run on */
+			}
+
+			if (cpu < CPU_SETSIZE) {
+				worker->cpu = cpu;
+			}
+		}
+
+		if ((worker->socket = openSocket(port)) == -1) {
+			goto error;
+		}
+
+		if ((worker->buffers = malloc(NANOPUBSUB__WORKER_RECV_BATCH
+				* NANOPUBSUB__MAX_MESSAGE_LENGTH)) == NULL
+				|| !nanoPubSub__Network_initRecvRing(&worker->ring,
+					worker->buffers, NANOPUBSUB__MAX_MESSAGE_LENGTH,
+					NANOPUBSUB__WORKER_RECV_BATCH)
+				|| !nanoPubSub__Fragment_initPool(&worker->fragments,
+					NANOPUBSUB__WORKER_FRAGMENT_SLOTS,
+					NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH,
+					NANOPUBSUB__WORKER_FRAGMENT_TIMEOUT)
+				|| !nanoPubSub__Reliable_init(&worker->reliable,
+					worker->socket, NANOPUBSUB__WORKER_RELIABLE_PEERS)) {
+			errno = ENOMEM;
+			goto error;
+		}
+
+		worker->ring.fragments = &worker->fragments;
+		worker->ring.reliable  = &worker->reliable;
+		worker->ring.metrics   = &worker->metrics;
+	}
+
+	for (i = 0; i < numWorkers; i++) {
+		worker = &group->workers[i];
+
+		pthread_attr_init(&attr);
+
+		/* Pin the thread before it starts, so that it never runs on
+		   another core */
+		if (worker->cpu >= 0) {
+			CPU_ZERO(&cpus);
+			CPU_SET(worker->cpu, &cpus);
+			pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+		}
+
+		error = pthread_create(&worker->thread, &attr, runWorker, worker);
+		pthread_attr_destroy(&attr);
+
+		if (error != 0) {
+			errno = error;
+			goto error;
+		}
+
+		worker->started = 1;
+	}
+
+	return 1;
+
+error:
+	error = errno;
+	nanoPubSub__Worker_stop(group);
+	nanoPubSub__Worker_wait(group);
+	errno = error;
+
+	return 0;
+}
+
+
+/**
+ * Makes all workers of a group stop receiving. Workers finish handling
+ * their current batch of messages first. This function is
+ * async-signal-safe.
+ *
+ * @param group The group to stop
+ */
+void nanoPubSub__Worker_stop(nanoPubSub__Worker_group *group)
+{
+	unsigned int i;
+
+	/* Shutting a socket down wakes up a worker blocked in recvmmsg() */
+	for (i = 0; i < group->numWorkers; i++) {
+		__atomic_store_n(&group->workers[i].stopping, 1, __ATOMIC_RELEASE);
+
+		if (group->workers[i].socket != -1) {
+			shutdown(group->workers[i].socket, SHUT_RDWR);
+		}
+	}
+}
+
+
+/**
+ * Waits for all workers of a group to stop and frees the group's
+ * resources. Workers stop after nanoPubSub__Worker_stop has been called.
+ * The workers' metrics are kept in the group's metrics.
+ *
+ * @param group The group to wait for
+ */
+void nanoPubSub__Worker_wait(nanoPubSub__Worker_group *group)
+{
+	nanoPubSub__Worker *worker;
+	unsigned int i;
+
+	for (i = 0; i < group->numWorkers; i++) {
+		worker = &group->workers[i];
+
+		if (worker->started) {
+			pthread_join(worker->thread, NULL);
+		}
+
+		nanoPubSub__Metrics_aggregate(&group->metrics, &worker->metrics);
+
+		if (worker->socket != -1) {
+			close(worker->socket);
+		}
+
+		nanoPubSub__Network_freeRecvRing(&worker->ring);
+		nanoPubSub__Fragment_freePool(&worker->fragments);
+		nanoPubSub__Reliable_free(&worker->reliable);
+		free(worker->buffers);
+	}
+
+	free(group->workers);
+	group->workers    = NULL;
+	group->numWorkers = 0;
+}
+
+
+/**
+ * Adds the metrics of all workers of a running group to a total. The
+ * workers keep receiving meanwhile.
+ *
+ * @param group The group
+ * @param total The metrics to add to
+ */
+void nanoPubSub__Worker_aggregateMetrics(
+		const nanoPubSub__Worker_group *group, nanoPubSub__Metrics *total)
+{
+	unsigned int i;
+
+	for (i = 0; i < group->numWorkers; i++) {
+		nanoPubSub__Metrics_aggregate(total, &group->workers[i].metrics);
+	}
+}
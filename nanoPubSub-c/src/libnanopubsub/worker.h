@@ -0,0 +1,201 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "message.h"
+#include "network.h"
+#include "fragment.h"
+#include "reliable.h"
+#include "metrics.h"
+#include "filter.h"
+
+#ifndef __LIBNANOPUBSUB__WORKER_H
+#define __LIBNANOPUBSUB__WORKER_H
+
+
+/** The max. number of messages a worker receives with a single system call */
+#define NANOPUBSUB__WORKER_RECV_BATCH 32
+
+/** The max. number of messages a worker reassembles at the same time */
+#define NANOPUBSUB__WORKER_FRAGMENT_SLOTS 4
+
+/** The time after which incomplete messages are dropped (in milliseconds) */
+#define NANOPUBSUB__WORKER_FRAGMENT_TIMEOUT 2000
+
+/** The max. number of senders a worker acknowledges reliable messages of */
+#define NANOPUBSUB__WORKER_RELIABLE_PEERS 16
+
+
+/**
+ * Called by a worker for every valid message it receives, except for
+ * ping messages, which the worker answers with a pong message itself,
+ * and standard messages whose topic does not match the worker's filter.
+ * Handlers of different workers run concurrently.
+ *
+ * @param worker The index of the worker that received the message
+ * @param fromAddr The address the message was received from
+ * @param view The received message, valid until the handler returns
+ * @param arg The argument passed to nanoPubSub__Worker_start
+ */
+typedef void (*nanoPubSub__Worker_handler)(unsigned int worker,
+	const struct sockaddr *fromAddr, const nanoPubSub__Message_view *view,
+	void *arg);
+
+
+/**
+ * A thread receiving messages on a socket of its own.
+ */
+typedef struct
+{
+	/** The index of the worker within its group */
+	unsigned int index;
+
+	/** The worker's socket */
+	int socket;
+
+	/** The core the worker is pinned to, or -1 */
+	int cpu;
+
+	/** The worker's thread */
+	pthread_t thread;
+
+	/** 1 once the thread has been started */
+	int started;
+
+	/** Set to make the worker stop */
+	int stopping;
+
+	/** The buffers messages are received into */
+	char *buffers;
+
+	/** The receive ring set up over the buffers */
+	nanoPubSub__Network_recvRing ring;
+
+	/** The pool fragmented messages are reassembled in */
+	nanoPubSub__Fragment_pool fragments;
+
+	/** The endpoint acknowledging reliable messages */
+	nanoPubSub__Reliable_endpoint reliable;
+
+	/** The function handling received messages */
+	nanoPubSub__Worker_handler handler;
+
+	/** The argument passed to the handler */
+	void *arg;
+
+	/**
+	 * The filters the topics of standard messages must match, or NULL to
+	 * pass all messages to the handler
+	 */
+	const nanoPubSub__Filter *filter;
+
+	/**
+	 * The messages, bytes, parse errors and receive errors of the
+	 * worker
+	 */
+	nanoPubSub__Metrics metrics;
+} nanoPubSub__Worker;
+
+
+/**
+ * A group of workers sharing a UDP port. Every worker has a socket of its
+ * own bound with SO_REUSEPORT, so the kernel spreads incoming datagrams
+ * over the workers by their sender's address, and the workers never
+ * share any state. Datagrams from the same sender always reach the same
+ * worker and keep their order.
+ */
+typedef struct
+{
+	/** The workers */
+	nanoPubSub__Worker *workers;
+
+	/** The number of workers */
+	unsigned int numWorkers;
+
+	/**
+	 * The metrics of all workers, added up by nanoPubSub__Worker_wait once
+	 * the workers have stopped
+	 */
+	nanoPubSub__Metrics metrics;
+} nanoPubSub__Worker_group;
+
+
+/**
+ * Opens the workers' sockets on a UDP port and starts a thread for every
+ * worker.
+ *
+ * @param group The group to start
+ * @param port The UDP port to listen on
+ * @param numWorkers The number of workers
+ * @param pin 1 to pin every worker to a core of its own (as long as there
+ *            are enough cores), 0 to let the scheduler decide
+ * @param handler The function handling received messages
+ * @param arg An argument passed to the handler
+ * @param filter The filters the topics of standard messages must match,
+ *               or NULL to pass all messages to the handler. The filters
+ *               are shared by all workers and must not be changed until
+ *               the workers have stopped.
+ *
+ * @return 1 on success. Otherwise, 0 is returned, no worker is running and
+ *         the global variable errno is set to indicate the error.
+ */
+int nanoPubSub__Worker_start(nanoPubSub__Worker_group *group,
+	unsigned short port, unsigned int numWorkers, int pin,
+	nanoPubSub__Worker_handler handler, void *arg,
+	const nanoPubSub__Filter *filter);
+
+
+/**
+ * Makes all workers of a group stop receiving. Workers finish handling
+ * their current batch of messages first. This function is
+ * async-signal-safe.
+ *
+ * @param group The group to stop
+ */
+void nanoPubSub__Worker_stop(nanoPubSub__Worker_group *group);
+
+
+/**
+ * Waits for all workers of a group to stop and frees the group's
+ * resources. Workers stop after nanoPubSub__Worker_stop has been called.
+ * The workers' metrics are kept in the group's metrics.
+ *
+ * @param group The group to wait for
+ */
+void nanoPubSub__Worker_wait(nanoPubSub__Worker_group *group);
+
+
+/**
+ * Adds the metrics of all workers of a running group to a total. The
+ * workers keep receiving meanwhile.
+ *
+ * @param group The group
+ * @param total The metrics to add to
+ */
+void nanoPubSub__Worker_aggregateMetrics(
+	const nanoPubSub__Worker_group *group, nanoPubSub__Metrics *total);
+
+
+#endif /* __LIBNANOPUBSUB__WORKER_H */
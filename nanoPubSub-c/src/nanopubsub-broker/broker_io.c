@@ -0,0 +1,214 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "broker_io.h"
+
+
+int nanoPubSub__BrokerIO_getCLOptions(int argc, char **argv,
+		nanoPubSub__BrokerIO_options *opts)
+{
+	/* Make sure opts is not a Null pointer */
+	assert(opts != NULL);
+
+	struct option long_options[] =
+	{
+		{"port",       required_argument, NULL, 'p'},
+		{"clientport", required_argument, NULL, 'c'},
+		{"log",        required_argument, NULL, 'L'},
+		{"retain",     no_argument,       NULL, 'r'},
+		{"stats",      required_argument, NULL, 's'},
+		{"io-uring",   no_argument,       NULL, 'u'},
+		{"version",    no_argument,       NULL, 'v'},
+		{"help",       no_argument,       NULL, '?'},
+		{0, 0, 0, 0}
+	};
+
+	int c;
+
+	do {
+		c = getopt_long(argc, argv, "p:c:L:rs:u?", long_options, NULL);
+
+		switch (c)
+		{
+			case 'p':
+				opts->port = strtol(optarg, 0, 10);
+				break;
+
+			case 'c':
+				opts->clientPort = strtol(optarg, 0, 10);
+				break;
+
+			case 'L':
+				opts->logDirectory = optarg;
+				break;
+
+			case 'r':
+				opts->retain = true;
+				break;
+
+			case 's':
+				opts->statsInterval = strtoul(optarg, 0, 10);
+				break;
+
+			case 'u':
+				opts->ioUring = true;
+				break;
+
+			case 'v':
+				opts->version = true;
+				break;
+
+			case '?':
+				opts->help = true;
+				break;
+
+			default:
+				break;
+		}
+	} while (c != -1);
+
+	return 1;
+}
+
+
+/**
+ * Prints the program version to the standard output (stdout).
+ */
+void nanoPubSub__BrokerIO_printVersion(void)
+{
+	printf("nanoPubSub broker, Version %s\n", NANOPUBSUB__BROKER_VERSION);
+}
+
+
+/**
+ * Prints information about how to use the program to the standard
+ * output (stdout).
+ */
+void nanoPubSub__BrokerIO_printUsage(void)
+{
+	printf("Usage: nanopubsub-broker [options]\n\n");
+
+	printf("Options:\n");
+	printf("  --port, -p        The port number to listen on for incoming\n"
+	       "                    messages\n");
+	printf("  --clientport, -c  The port number subscribed clients listen on\n"
+	       "                    for published messages\n");
+	printf("  --log, -L         A directory to record published messages in,\n"
+	       "                    so that clients can have them replayed\n");
+	printf("  --retain, -r      Keep the last message of every topic and send\n"
+	       "                    it to clients subscribing to the topic\n");
+	printf("  --stats, -s       The interval the broker's metrics are\n"
+	       "                    published in on " NANOPUBSUB__BROKER_STATS_TOPIC "\n"
+	       "                    (seconds, default %u, 0 to disable). SIGUSR1\n"
+	       "                    prints them.\n", NANOPUBSUB__BROKER_STATS_INTERVAL);
+	printf("  --io-uring, -u    Receive and publish messages through io_uring\n"
+	       "                    instead of the socket calls\n");
+	printf("  --version, -v     Display version information\n");
+	printf("  --help, -?        Display this message\n");
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that an error occurred while trying to create a socket.
+ */
+void nanoPubSub__BrokerIO_printErrSocket(void)
+{
+	printf("Could not create socket!\n");
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that an error occurred while trying to bind to an address.
+ */
+void nanoPubSub__BrokerIO_printErrBind(void)
+{
+	printf("Could not bind to address!\n");
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the event loop could not be set up.
+ */
+void nanoPubSub__BrokerIO_printErrEventLoop(void)
+{
+	printf("Could not set up the event loop!\n");
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the broker ran out of memory.
+ */
+void nanoPubSub__BrokerIO_printErrMemory(void)
+{
+	printf("Out of memory!\n");
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the message log could not be opened.
+ *
+ * @param directory The directory of the log
+ */
+void nanoPubSub__BrokerIO_printErrLog(const char *directory)
+{
+	printf("Could not open the message log in %s: %s\n", directory,
+		strerror(errno));
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that io_uring cannot be used and the socket calls are used instead.
+ *
+ * @param reason The reason io_uring cannot be used
+ */
+void nanoPubSub__BrokerIO_printErrTransport(const char *reason)
+{
+	printf("Could not set up io_uring (%s), using the socket calls!\n",
+		reason);
+}
+
+
+/**
+ * Prints a message to the standard output (stdout), informing the user
+ * that the broker is ready to receive messages.
+ *
+ * @param port The port number the broker listens on
+ */
+void nanoPubSub__BrokerIO_printListening(unsigned short port)
+{
+	printf("nanoPubSub broker listening on port %hu.\n", port);
+	fflush(stdout);
+}
+
+
+/**
+ * Prints the broker's metrics to the standard output (stdout).
+ *
+ * @param text The metrics, see nanoPubSub__Metrics_format
+ */
+void nanoPubSub__BrokerIO_printMetrics(const char *text)
+{
+	printf("%s\n", text);
+	fflush(stdout);
+}
@@ -0,0 +1,128 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <assert.h>
+
+#include "defs.h"
+
+
+typedef struct
+{
+	unsigned short port;
+
+	unsigned short clientPort;
+
+	char *logDirectory;
+
+	bool retain;
+
+	unsigned int statsInterval;
+
+	bool ioUring;
+
+	bool version;
+
+	bool help;
+} nanoPubSub__BrokerIO_options;
+
+
+int nanoPubSub__BrokerIO_getCLOptions(int argc, char **argv,
+	nanoPubSub__BrokerIO_options *opts);
+
+
+/**
+ * Prints the program version to the standard output (stdout).
+ */
+void nanoPubSub__BrokerIO_printVersion(void);
+
+
+/**
+ * Prints information about how to use the program to the standard
+ * output (stdout).
+ */
+void nanoPubSub__BrokerIO_printUsage(void);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that an error occurred while trying to create a socket.
+ */
+void nanoPubSub__BrokerIO_printErrSocket(void);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that an error occurred while trying to bind to an address.
+ */
+void nanoPubSub__BrokerIO_printErrBind(void);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the event loop could not be set up.
+ */
+void nanoPubSub__BrokerIO_printErrEventLoop(void);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the broker ran out of memory.
+ */
+void nanoPubSub__BrokerIO_printErrMemory(void);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the message log could not be opened.
+ *
+ * @param directory The directory of the log
+ */
+void nanoPubSub__BrokerIO_printErrLog(const char *directory);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that io_uring cannot be used and the socket calls are used instead.
+ *
+ * @param reason The reason io_uring cannot be used
+ */
+void nanoPubSub__BrokerIO_printErrTransport(const char *reason);
+
+
+/**
+ * Prints a message to the standard output (stdout), informing the user
+ * that the broker is ready to receive messages.
+ *
+ * @param port The port number the broker listens on
+ */
+void nanoPubSub__BrokerIO_printListening(unsigned short port);
+
+
+/**
+ * Prints the broker's metrics to the standard output (stdout).
+ *
+ * @param text The metrics, see nanoPubSub__Metrics_format
+ */
+void nanoPubSub__BrokerIO_printMetrics(const char *text);
@@ -0,0 +1,110 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef __NANOPUBSUBBROKER__DEFS_H
+#define __NANOPUBSUBBROKER__DEFS_H
+
+
+#define NANOPUBSUB__BROKER_VERSION "0.1"
+
+/** The UDP port the broker listens on for incoming messages */
+#define NANOPUBSUB__BROKER_DEFAULT_PORT 11011
+
+/** The UDP port subscribed clients listen on for published messages */
+#define NANOPUBSUB__BROKER_DEFAULT_CLIENT_PORT 11011
+
+/** The max. number of events fetched from the kernel per epoll_wait call */
+#define NANOPUBSUB__BROKER_MAX_EVENTS 16
+
+/** The max. number of messages received with a single system call */
+#define NANOPUBSUB__BROKER_RECV_BATCH 64
+
+/** The max. number of messages reassembled from fragments at the same time */
+#define NANOPUBSUB__BROKER_FRAGMENT_SLOTS 16
+
+/** The time after which incomplete messages are dropped (in milliseconds) */
+#define NANOPUBSUB__BROKER_FRAGMENT_TIMEOUT 2000
+
+/** The max. number of clients reliable messages are exchanged with */
+#define NANOPUBSUB__BROKER_RELIABLE_PEERS 1024
+
+/** The number of slots of the timer wheel keepalive pings are driven by */
+#define NANOPUBSUB__BROKER_TIMER_SLOTS 256
+
+/** The length of a tick of the timer wheel (in milliseconds) */
+#define NANOPUBSUB__BROKER_TIMER_RESOLUTION 100
+
+/** The time between two pings sent to a client (in milliseconds) */
+#define NANOPUBSUB__BROKER_PING_INTERVAL 5000
+
+/** The time between two pings sent to a dormant client (in milliseconds) */
+#define NANOPUBSUB__BROKER_DORMANT_PING_INTERVAL 30000
+
+/**
+ * The number of pings in a row a client may leave unanswered before it
+ * becomes dormant and no longer receives published messages
+ */
+#define NANOPUBSUB__BROKER_MAX_MISSED_PINGS 3
+
+/**
+ * The number of pings a dormant client may leave unanswered before it is
+ * removed together with its subscriptions
+ */
+#define NANOPUBSUB__BROKER_MAX_DORMANT_PINGS 20
+
+/**
+ * The max. number of client ids and of topics numeric ids are assigned to
+ * (each)
+ */
+#define NANOPUBSUB__BROKER_MAX_NAMES 65536
+
+/** The size of the segments of the message log (in bytes) */
+#define NANOPUBSUB__BROKER_LOG_SEGMENT_SIZE (64 * 1024 * 1024)
+
+/**
+ * The max. number of messages sent for a single replay message, so that a
+ * replay never stalls the broker for long
+ */
+#define NANOPUBSUB__BROKER_MAX_REPLAY 4096
+
+/** The max. number of topics whose last message is retained */
+#define NANOPUBSUB__BROKER_RETAINED_TOPICS 65536
+
+/** The max. memory taken by the retained messages (in bytes) */
+#define NANOPUBSUB__BROKER_RETAINED_BYTES (16 * 1024 * 1024)
+
+/** The default interval the broker's metrics are published in (seconds) */
+#define NANOPUBSUB__BROKER_STATS_INTERVAL 10
+
+/**
+ * The topic the broker's metrics are published on. Filters starting with
+ * a wildcard do not match it, so only clients asking for it get it.
+ */
+#define NANOPUBSUB__BROKER_STATS_TOPIC "$SYS/broker/stats"
+
+/** The client id the broker's metrics are published with */
+#define NANOPUBSUB__BROKER_STATS_CLIENT_ID "$SYS"
+
+/**
+ * The max. length of the broker's metrics as text (in bytes). Published
+ * with the topic and client id above, they still fit into a datagram.
+ */
+#define NANOPUBSUB__BROKER_STATS_LENGTH 768
+
+
+#endif /* __NANOPUBSUBBROKER__DEFS_H */
@@ -0,0 +1,876 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "nanopubsub-broker.h"
+
+
+int main(int argc, char **argv)
+{
+	/* Initialize program options with safe defaults */
+	options.port          = NANOPUBSUB__BROKER_DEFAULT_PORT;
+	options.clientPort    = NANOPUBSUB__BROKER_DEFAULT_CLIENT_PORT;
+	options.logDirectory  = NULL;
+	options.retain        = false;
+	options.statsInterval = NANOPUBSUB__BROKER_STATS_INTERVAL;
+	options.ioUring       = false;
+	options.version       = false;
+	options.help          = false;
+
+	/* Parse command line parameters */
+	if (nanoPubSub__BrokerIO_getCLOptions(argc, argv, &options) == 0) {
+		nanoPubSub__BrokerIO_printUsage();
+		return 1;
+	}
+
+	/* Display version information if requested */
+	if (options.version) {
+		nanoPubSub__BrokerIO_printVersion();
+	}
+
+	/* Display a help message if requested */
+	if (options.help) {
+		nanoPubSub__BrokerIO_printUsage();
+		return 0;
+	}
+
+	/* Make sure we have valid port numbers */
+	if (options.port == 0) {
+		options.port = NANOPUBSUB__BROKER_DEFAULT_PORT;
+	}
+
+	if (options.clientPort == 0) {
+		options.clientPort = NANOPUBSUB__BROKER_DEFAULT_CLIENT_PORT;
+	}
+
+	return runBroker();
+}
+
+
+/**
+ * Sets up the broker's socket and runs the event loop until the process
+ * receives SIGINT or SIGTERM.
+ * @return 0 on success, 1 otherwise
+ */
+static int runBroker(void)
+{
+	int socketfd, signalfd_, epollfd, timeout, nextTimeout;
+	struct sockaddr_in myAddr;
+	struct epoll_event event, events[NANOPUBSUB__BROKER_MAX_EVENTS];
+	struct signalfd_siginfo signal;
+	nanoPubSub__Timer *timer;
+	sigset_t signals;
+	int running = 1;
+	int retval = 0;
+	int i, n;
+
+	/* Create a non-blocking socket, so the event loop can drain it */
+	if ((socketfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1) {
+		nanoPubSub__BrokerIO_printErrSocket();
+		return 1;
+	}
+
+	/* Bind the socket to a network address */
+	myAddr.sin_family      = AF_INET;
+	myAddr.sin_port        = htons(options.port);
+	myAddr.sin_addr.s_addr = INADDR_ANY;
+	memset(myAddr.sin_zero, '\0', sizeof(myAddr.sin_zero));
+
+	if (bind(socketfd, (struct sockaddr*)&myAddr, sizeof(myAddr)) == -1) {
+		nanoPubSub__BrokerIO_printErrBind();
+		close(socketfd);
+		return 1;
+	}
+
+	if (!nanoPubSub__BrokerRouting_init(&routing, 256)) {
+		nanoPubSub__BrokerIO_printErrMemory();
+		close(socketfd);
+		return 1;
+	}
+
+	if (!nanoPubSub__Network_initRecvRing(&recvRing, (char*)recvBuffers,
+			NANOPUBSUB__MAX_MESSAGE_LENGTH, NANOPUBSUB__BROKER_RECV_BATCH)) {
+		nanoPubSub__BrokerIO_printErrMemory();
+		nanoPubSub__BrokerRouting_destroy(&routing);
+		close(socketfd);
+		return 1;
+	}
+
+	/* Messages split into fragments are reassembled before routing */
+	if (!nanoPubSub__Fragment_initPool(&fragments,
+			NANOPUBSUB__BROKER_FRAGMENT_SLOTS,
+			NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH,
+			NANOPUBSUB__BROKER_FRAGMENT_TIMEOUT)) {
+		nanoPubSub__BrokerIO_printErrMemory();
+		nanoPubSub__Network_freeRecvRing(&recvRing);
+		nanoPubSub__BrokerRouting_destroy(&routing);
+		close(socketfd);
+		return 1;
+	}
+
+	recvRing.fragments = &fragments;
+
+	/* Reliable messages are acknowledged while they are received */
+	if (!nanoPubSub__Reliable_init(&reliable, socketfd,
+			NANOPUBSUB__BROKER_RELIABLE_PEERS)) {
+		nanoPubSub__BrokerIO_printErrMemory();
+		nanoPubSub__Fragment_freePool(&fragments);
+		nanoPubSub__Network_freeRecvRing(&recvRing);
+		nanoPubSub__BrokerRouting_destroy(&routing);
+		close(socketfd);
+		return 1;
+	}
+
+	recvRing.reliable = &reliable;
+
+	/* Received messages, bytes and parse errors are counted while
+	   receiving */
+	nanoPubSub__Metrics_init(&metrics);
+	recvRing.metrics = &metrics;
+
+	/* Subscribed clients are pinged to find out whether they are alive */
+	if (!nanoPubSub__Timer_initWheel(&timers, NANOPUBSUB__BROKER_TIMER_SLOTS,
+			NANOPUBSUB__BROKER_TIMER_RESOLUTION)) {
+		nanoPubSub__BrokerIO_printErrMemory();
+		nanoPubSub__Reliable_free(&reliable);
+		nanoPubSub__Fragment_freePool(&fragments);
+		nanoPubSub__Network_freeRecvRing(&recvRing);
+		nanoPubSub__BrokerRouting_destroy(&routing);
+		close(socketfd);
+		return 1;
+	}
+
+	/* Datagrams are received and published through io_uring if
+	   requested. The socket calls are used if it is not available. */
+	if (!nanoPubSub__Transport_open(&transport, socketfd, options.ioUring
+			? NANOPUBSUB__TRANSPORT_IO_URING : NANOPUBSUB__TRANSPORT_SOCKET)) {
+		nanoPubSub__BrokerIO_printErrTransport(strerror(errno));
+	}
+
+	/* Deliver SIGINT and SIGTERM through the event loop, so the broker can
+	   shut down cleanly */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+
+	signalfd_ = signalfd(-1, &signals, SFD_NONBLOCK);
+	epollfd   = epoll_create1(0);
+
+	if (signalfd_ == -1 || epollfd == -1) {
+		nanoPubSub__BrokerIO_printErrEventLoop();
+		retval = 1;
+		goto cleanup;
+	}
+
+	event.events  = EPOLLIN;
+	event.data.fd = nanoPubSub__Transport_fd(&transport);
+	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, event.data.fd, &event) == -1) {
+		nanoPubSub__BrokerIO_printErrEventLoop();
+		retval = 1;
+		goto cleanup;
+	}
+
+	event.events  = EPOLLIN;
+	event.data.fd = signalfd_;
+	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, signalfd_, &event) == -1) {
+		nanoPubSub__BrokerIO_printErrEventLoop();
+		retval = 1;
+		goto cleanup;
+	}
+
+	/* Published messages are recorded for replay if requested */
+	if (options.logDirectory != NULL) {
+		if (!nanoPubSub__Log_open(&messageLog, options.logDirectory,
+				NANOPUBSUB__BROKER_LOG_SEGMENT_SIZE)) {
+			nanoPubSub__BrokerIO_printErrLog(options.logDirectory);
+			retval = 1;
+			goto cleanup;
+		}
+		isLogging = 1;
+	}
+
+	/* The last message of every topic is sent to new subscribers if
+	   requested */
+	if (options.retain) {
+		if (!nanoPubSub__BrokerRetained_init(&retained,
+				NANOPUBSUB__BROKER_RETAINED_TOPICS,
+				NANOPUBSUB__BROKER_RETAINED_BYTES)) {
+			nanoPubSub__BrokerIO_printErrMemory();
+			retval = 1;
+			goto cleanup;
+		}
+		isRetaining = 1;
+	}
+
+	/* The metrics are published periodically unless disabled */
+	nanoPubSub__Timer_init(&statsTimer, NULL);
+	if (options.statsInterval > 0) {
+		nanoPubSub__Timer_schedule(&timers, &statsTimer,
+			options.statsInterval * 1000);
+	}
+
+	nanoPubSub__BrokerIO_printListening(options.port);
+
+	while (running) {
+		/* Wake up in time to retransmit unacknowledged messages and to
+		   send the next ping */
+		timeout     = nanoPubSub__Reliable_tick(&reliable);
+		nextTimeout = nanoPubSub__Timer_nextTimeout(&timers);
+		if (timeout == -1 || (nextTimeout != -1 && nextTimeout < timeout)) {
+			timeout = nextTimeout;
+		}
+
+		n = epoll_wait(epollfd, events, NANOPUBSUB__BROKER_MAX_EVENTS,
+			timeout);
+
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			retval = 1;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == signalfd_) {
+				/* SIGUSR1 asks for the metrics, all others for the end */
+				while (read(signalfd_, &signal, sizeof(signal))
+						== sizeof(signal)) {
+					if (signal.ssi_signo == SIGUSR1) {
+						nanoPubSub__Metrics_format(&metrics, statsText,
+							sizeof(statsText), '\n');
+						nanoPubSub__BrokerIO_printMetrics(statsText);
+					} else {
+						running = 0;
+					}
+				}
+			} else {
+				drainSocket(socketfd);
+			}
+		}
+
+		while ((timer = nanoPubSub__Timer_expire(&timers)) != NULL) {
+			if (timer == &statsTimer) {
+				publishStats();
+			} else {
+				pingClient(socketfd, timer->data);
+			}
+		}
+	}
+
+cleanup:
+	if (epollfd != -1)   { close(epollfd); }
+	if (signalfd_ != -1) { close(signalfd_); }
+	nanoPubSub__Transport_close(&transport);
+	close(socketfd);
+	nanoPubSub__Network_freeRecvRing(&recvRing);
+	nanoPubSub__Fragment_freePool(&fragments);
+	nanoPubSub__Reliable_free(&reliable);
+	nanoPubSub__Timer_freeWheel(&timers);
+	nanoPubSub__BrokerRouting_destroy(&routing);
+
+	if (isLogging) {
+		nanoPubSub__Log_close(&messageLog);
+	}
+
+	if (isRetaining) {
+		nanoPubSub__BrokerRetained_destroy(&retained);
+	}
+
+	return retval;
+}
+
+
+/**
+ * Receives and handles messages in batches until the socket's receive
+ * queue is empty.
+ *
+ * @param socketfd The non-blocking socket to read from
+ */
+static void drainSocket(int socketfd)
+{
+	unsigned int first, slot;
+	int i, received;
+	uint64_t start;
+
+	do {
+		received = nanoPubSub__Transport_recvBatch(&transport, &recvRing,
+			NANOPUBSUB__BROKER_RECV_BATCH, &first);
+
+		for (i = 0; i < received; i++) {
+			slot = first + i;
+
+			/* The messages packed into a datagram take turns in its
+			   slot's view */
+			do {
+				/* Skip datagrams that are not valid messages */
+				if (recvRing.views[slot].length > 0) {
+					start = nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+					handleMessage(socketfd,
+						(const struct sockaddr_in*)&recvRing.addrs[slot],
+						&recvRing.views[slot],
+						*(const uint8_t*)recvRing.iovecs[slot].iov_base
+							== NANOPUBSUB__RELIABLE_DATA_MAGIC);
+					nanoPubSub__Metrics_observe(&metrics,
+						NANOPUBSUB__METRIC_PROCESSING_TIME,
+						nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC) - start);
+				}
+			} while (nanoPubSub__Network_unpackNext(&recvRing, slot));
+		}
+
+		/* A short batch means the queue is empty */
+	} while (received == NANOPUBSUB__BROKER_RECV_BATCH
+		|| (received == -1 && errno == EINTR));
+}
+
+
+/**
+ * Sends a published message to a chunk of destinations and counts the
+ * destinations it could not be sent to.
+ *
+ * @param destAddrs The addresses of the destinations
+ * @param numDestAddrs The number of destinations
+ * @param frame The message string to send
+ * @param length The length of the message string (in bytes)
+ */
+static void sendPublication(const struct sockaddr *const *destAddrs,
+		unsigned int numDestAddrs, const char *frame, size_t length)
+{
+	unsigned int sent = nanoPubSub__Transport_sendStringMulti(&transport,
+		destAddrs, numDestAddrs, frame, length);
+
+	nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_SEND_ERRORS,
+		numDestAddrs - sent);
+}
+
+
+/**
+ * Adds the subscribers of a filter matching a published message to the
+ * message's destinations. Whenever a chunk of destinations is complete,
+ * it is handed to the kernel with a single system call. Clients that
+ * subscribed reliably are sent the message on their own.
+ *
+ * @param subscribers The subscribed clients
+ * @param numSubscribers The number of subscribed clients
+ * @param arg The publication the subscribers are added to
+ */
+static void collectSubscribers(void *const *subscribers,
+		size_t numSubscribers, void *arg)
+{
+	nanoPubSub__Broker_publication *pub = arg;
+	const nanoPubSub__Message_view *view = pub->view;
+	nanoPubSub__BrokerRouting_client *client;
+	int format;
+	size_t i;
+
+	for (i = 0; i < numSubscribers; i++) {
+		client = subscribers[i];
+		format = client->binary;
+
+		/* The sending client does not receive its own message, no client
+		   receives it twice, and dormant clients do not receive it at
+		   all */
+		if (client == pub->sender || client->publishMark == pub->mark
+				|| client->dormant) {
+			continue;
+		}
+
+		client->publishMark = pub->mark;
+
+		/* Convert the message when the first subscriber needs it */
+		if (format != pub->binary && !pub->isConverted) {
+			pub->frameLengths[format] = pub->binary
+				? nanoPubSub__Message_writeViewString(view, converted,
+					sizeof(converted))
+				: nanoPubSub__Message_writeViewBinary(view, converted,
+					sizeof(converted));
+			pub->isConverted = 1;
+		}
+
+		if (pub->frameLengths[format] == 0) {
+			continue;
+		}
+
+		pub->fanOut++;
+		pub->bytesSent += pub->frameLengths[format];
+
+		/* Every reliable client has a window of its own. If it is full,
+		   the client misses the message. */
+		if (client->reliable) {
+			nanoPubSub__Reliable_sendString(&reliable,
+				(const struct sockaddr*)&client->addr, pub->frames[format],
+				pub->frameLengths[format]);
+			continue;
+		}
+
+		pub->destAddrs[format][pub->numDestAddrs[format]++] =
+			(const struct sockaddr*)&client->addr;
+
+		if (pub->numDestAddrs[format] == NANOPUBSUB__NETWORK_SEND_BATCH) {
+			sendPublication(pub->destAddrs[format],
+				pub->numDestAddrs[format], pub->frames[format],
+				pub->frameLengths[format]);
+			pub->numDestAddrs[format] = 0;
+		}
+	}
+}
+
+
+/**
+ * Sends a standard message to all subscribers of its topic except the
+ * sender and dormant clients. Every subscriber receives the message in the
+ * format it subscribed with; text subscribers are skipped if a binary
+ * message cannot be represented as text.
+ *
+ * @param view The received message
+ * @param sender The sending client, or NULL if it never subscribed to
+ *               anything
+ * @param topicId The id the message referred to its topic by, 0 if it
+ *                carried the topic as a string
+ */
+static void publishMessage(const nanoPubSub__Message_view *view,
+		const nanoPubSub__BrokerRouting_client *sender, uint32_t topicId)
+{
+	nanoPubSub__Broker_publication pub;
+	int format;
+
+	pub.view   = view;
+	pub.sender = sender;
+	pub.mark   = ++publishCount;
+
+	/* The message is forwarded as it was received to subscribers using the
+	   same format and converted once for the others */
+	pub.binary      = (uint8_t)view->frame[0] == NANOPUBSUB__BINARY_MAGIC;
+	pub.isConverted = 0;
+
+	pub.frames[pub.binary]        = view->frame;
+	pub.frameLengths[pub.binary]  = view->length;
+	pub.frames[!pub.binary]       = converted;
+	pub.frameLengths[!pub.binary] = 0;
+
+	pub.numDestAddrs[0] = 0;
+	pub.numDestAddrs[1] = 0;
+	pub.fanOut          = 0;
+	pub.bytesSent       = 0;
+
+	/* Registered topics are routed by their ids */
+	if (topicId != 0) {
+		nanoPubSub__BrokerRouting_matchId(&routing, topicId,
+			collectSubscribers, &pub);
+	} else {
+		nanoPubSub__BrokerRouting_match(&routing, &view->topic,
+			collectSubscribers, &pub);
+	}
+
+	for (format = 0; format < 2; format++) {
+		if (pub.numDestAddrs[format] > 0) {
+			sendPublication(pub.destAddrs[format], pub.numDestAddrs[format],
+				pub.frames[format], pub.frameLengths[format]);
+		}
+	}
+
+	nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_SENT, pub.fanOut);
+	nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_BYTES_SENT,
+		pub.bytesSent);
+	nanoPubSub__Metrics_observe(&metrics, NANOPUBSUB__METRIC_FAN_OUT,
+		pub.fanOut);
+}
+
+
+/**
+ * Publishes the broker's metrics on NANOPUBSUB__BROKER_STATS_TOPIC and
+ * schedules the next publication.
+ */
+static void publishStats(void)
+{
+	nanoPubSub__Message_view stats, view;
+	size_t length;
+
+	nanoPubSub__Timer_schedule(&timers, &statsTimer,
+		options.statsInterval * 1000);
+
+	/* The lengths of all fields are known, so the message is described by
+	   a view right away */
+	memset(&stats, 0, sizeof(stats));
+	stats.type            = NANOPUBSUB__STANDARD_MESSAGE;
+	stats.clientId.data   = NANOPUBSUB__BROKER_STATS_CLIENT_ID;
+	stats.clientId.length = sizeof(NANOPUBSUB__BROKER_STATS_CLIENT_ID) - 1;
+	stats.topic.data      = NANOPUBSUB__BROKER_STATS_TOPIC;
+	stats.topic.length    = sizeof(NANOPUBSUB__BROKER_STATS_TOPIC) - 1;
+	stats.body.data       = statsText;
+	stats.body.length     = nanoPubSub__Metrics_format(&metrics, statsText,
+		sizeof(statsText), ' ');
+
+	length = nanoPubSub__Message_writeViewString(&stats, statsFrame,
+		sizeof(statsFrame));
+	if (length == 0 || !nanoPubSub__Message_parseView(statsFrame, length,
+			&view)) {
+		return;
+	}
+
+	/* Late subscribers get the latest metrics right away */
+	if (isRetaining) {
+		nanoPubSub__BrokerRetained_store(&retained, &view);
+	}
+	publishMessage(&view, NULL, 0);
+}
+
+
+/**
+ * Sends a ping to a client whose keepalive timer has expired and schedules
+ * the next one. A client that left too many pings unanswered becomes
+ * dormant and is pinged less often, and is removed once it stayed silent
+ * for NANOPUBSUB__BROKER_MAX_DORMANT_PINGS more pings.
+ *
+ * @param socketfd The socket to send the ping over
+ * @param client The client to ping
+ */
+static void pingClient(int socketfd, nanoPubSub__BrokerRouting_client *client)
+{
+	nanoPubSub__Message_view ping;
+	char token[24];
+
+	/* The client's timer has expired, so it need not be cancelled */
+	if (client->missedPings >= NANOPUBSUB__BROKER_MAX_MISSED_PINGS
+			+ NANOPUBSUB__BROKER_MAX_DORMANT_PINGS) {
+		nanoPubSub__BrokerRouting_removeClient(&routing, client);
+		return;
+	}
+
+	if (client->missedPings >= NANOPUBSUB__BROKER_MAX_MISSED_PINGS) {
+		client->dormant = 1;
+	}
+	client->missedPings++;
+
+	memset(&ping, 0, sizeof(ping));
+	ping.type            = NANOPUBSUB__PING_MESSAGE;
+	ping.clientId.data   = client->clientId;
+	ping.clientId.length = client->clientIdLength;
+	ping.topic.data      = token;
+	ping.topic.length    = snprintf(token, sizeof(token), "%lu",
+		++pingCount);
+
+	/* Pings are never sent reliably; a lost ping counts as missed */
+	nanoPubSub__Network_sendView(socketfd,
+		(const struct sockaddr*)&client->addr, &ping, client->binary);
+
+	nanoPubSub__Timer_schedule(&timers, &client->keepalive, client->dormant
+		? NANOPUBSUB__BROKER_DORMANT_PING_INTERVAL
+		: NANOPUBSUB__BROKER_PING_INTERVAL);
+}
+
+
+/**
+ * Assigns numeric ids to the client id and topic of a register message
+ * and answers with a registered message holding the ids.
+ *
+ * @param socketfd The socket to send the answer over
+ * @param fromAddr The address the register message was received from
+ * @param view The register message
+ */
+static void registerNames(int socketfd, const struct sockaddr_in *fromAddr,
+		const nanoPubSub__Message_view *view)
+{
+	nanoPubSub__Message_view registered;
+	uint32_t clientNumber, topicId;
+	uint8_t ids[10];
+	size_t length;
+
+	/* Once all ids are taken, the client keeps using strings */
+	if (!nanoPubSub__BrokerRouting_register(&routing, &view->clientId,
+			&view->topic, &clientNumber, &topicId)) {
+		return;
+	}
+
+	length  = nanoPubSub__Message_writeVarint(ids, clientNumber);
+	length += nanoPubSub__Message_writeVarint(ids + length, topicId);
+
+	/* The answer echoes the strings, so the client can tell which of its
+	   registrations it belongs to */
+	registered = *view;
+	registered.type        = NANOPUBSUB__REGISTERED_MESSAGE;
+	registered.body.data   = (const char*)ids;
+	registered.body.length = length;
+
+	nanoPubSub__Network_sendView(socketfd, (const struct sockaddr*)fromAddr,
+		&registered, 1);
+}
+
+
+/**
+ * Sends a stored message to a single client in the client's format. The
+ * message is converted if it was stored in the other format, and split
+ * into fragments if it is too long for a datagram.
+ *
+ * @param socketfd The socket to send the message over
+ * @param destAddr The address of the client
+ * @param view The stored message
+ * @param binary 1 if the client expects binary messages, 0 for text
+ * @param isReliable 1 if the message is to be sent reliably
+ *
+ * @return 1 if the message has been sent, 0 otherwise
+ */
+static int sendStored(int socketfd, const struct sockaddr_in *destAddr,
+		const nanoPubSub__Message_view *view, int binary, int isReliable)
+{
+	const struct sockaddr *addr = (const struct sockaddr*)destAddr;
+	const char *frame = view->frame;
+	size_t length = view->length;
+	int sent;
+
+	/* Messages in the other format are converted, all others are sent
+	   without being copied */
+	if (((uint8_t)frame[0] == NANOPUBSUB__BINARY_MAGIC) != binary) {
+		frame  = converted;
+		length = binary
+			? nanoPubSub__Message_writeViewBinary(view, converted,
+				sizeof(converted))
+			: nanoPubSub__Message_writeViewString(view, converted,
+				sizeof(converted));
+	}
+
+	if (length == 0) {
+		return 0;
+	}
+
+	if (isReliable) {
+		sent = nanoPubSub__Reliable_sendString(&reliable, addr, frame,
+			length) == 1;
+	} else if (length <= NANOPUBSUB__MAX_MESSAGE_LENGTH) {
+		sent = sendto(socketfd, frame, length, 0, addr,
+			sizeof(*destAddr)) != -1;
+	} else {
+		sent = nanoPubSub__Fragment_sendStringMulti(socketfd, &addr, 1,
+			frame, length) == 1;
+	}
+
+	if (sent) {
+		nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_SENT, 1);
+		nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_BYTES_SENT,
+			length);
+	}
+
+	return sent;
+}
+
+
+/**
+ * Sends a client that has just subscribed the retained messages of the
+ * topics matching its filter.
+ *
+ * @param view The retained message
+ * @param arg The subscriber the message is sent to
+ */
+static void sendRetained(const nanoPubSub__Message_view *view, void *arg)
+{
+	const nanoPubSub__Broker_subscriber *subscriber = arg;
+
+	sendStored(subscriber->socketfd, &subscriber->client->addr, view,
+		subscriber->client->binary, subscriber->client->reliable);
+}
+
+
+/**
+ * Sends a client the recorded messages of a topic, starting at the
+ * offset or time given by a replay message. The messages are sent
+ * straight from the log, in the format of the replay message.
+ *
+ * @param socketfd The socket to send the messages over
+ * @param fromAddr The address the replay message was received from
+ * @param view The replay message
+ */
+static void replayMessages(int socketfd, const struct sockaddr_in *fromAddr,
+		const nanoPubSub__Message_view *view)
+{
+	nanoPubSub__Log_cursor cursor;
+	nanoPubSub__Log_record record;
+	struct sockaddr_in clientAddr;
+	int binary = (uint8_t)view->frame[0] == NANOPUBSUB__BINARY_MAGIC;
+	unsigned int count = 0;
+	char position[24], *end;
+	uint64_t from;
+
+	if (!isLogging || view->body.length == 0
+			|| view->body.length >= sizeof(position)) {
+		return;
+	}
+
+	/* The position is an offset, or a time in ms since the epoch
+	   prefixed with '@' */
+	memcpy(position, view->body.data, view->body.length);
+	position[view->body.length] = '\0';
+
+	from = strtoull(position + (position[0] == '@'), &end, 10);
+	if (*end != '\0') {
+		return;
+	}
+
+	if (position[0] == '@') {
+		nanoPubSub__Log_seekTime(&messageLog, &cursor, from);
+	} else {
+		nanoPubSub__Log_seek(&messageLog, &cursor, &view->topic, from);
+	}
+
+	/* Replayed messages go where published messages would go */
+	clientAddr = *fromAddr;
+	clientAddr.sin_port = htons(options.clientPort);
+
+	while (count < NANOPUBSUB__BROKER_MAX_REPLAY
+			&& nanoPubSub__Log_next(&messageLog, &cursor, &view->topic,
+				&record)) {
+		count += sendStored(socketfd, &clientAddr, &record.view, binary, 0);
+	}
+}
+
+
+/**
+ * Handles a single message: subscriptions are recorded in the routing
+ * table, standard messages are published to the subscribers of their
+ * topic (and recorded, if enabled), and pings, registrations and replay
+ * requests are answered. Numeric ids are replaced by their strings
+ * first. Any message from a known client proves that the client is alive.
+ *
+ * @param socketfd The socket to send published messages over
+ * @param fromAddr The address the message was received from
+ * @param view The received message
+ * @param isReliable 1 if the message was received reliably
+ */
+static void handleMessage(int socketfd, const struct sockaddr_in *fromAddr,
+		const nanoPubSub__Message_view *view, int isReliable)
+{
+	nanoPubSub__BrokerRouting_client *client;
+	nanoPubSub__Broker_subscriber subscriber;
+	nanoPubSub__Message_view resolved;
+	struct sockaddr_in clientAddr;
+	uint32_t topicId = view->topicId;
+
+	/* Messages using ids are rewritten into binary messages carrying the
+	   strings, so that subscribers need not know the ids, but are still
+	   routed by their topic ids. Messages with unknown ids are
+	   dropped. */
+	if (view->clientNumber != 0 || view->topicId != 0) {
+		if (!nanoPubSub__BrokerRouting_resolve(&routing, view, &resolved)) {
+			nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_DROPPED, 1);
+			return;
+		}
+
+		resolved.frame  = expanded;
+		resolved.length = nanoPubSub__Message_writeViewBinary(&resolved,
+			expanded, sizeof(expanded));
+
+		if (resolved.length == 0) {
+			nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_DROPPED, 1);
+			return;
+		}
+		view = &resolved;
+	}
+
+	/* A dormant client that speaks again is pinged at the normal interval
+	   and receives published messages again */
+	client = nanoPubSub__BrokerRouting_getClient(&routing, &view->clientId);
+	if (client != NULL) {
+		if (client->dormant) {
+			client->dormant = 0;
+			nanoPubSub__Timer_schedule(&timers, &client->keepalive,
+				NANOPUBSUB__BROKER_PING_INTERVAL);
+		}
+		client->missedPings = 0;
+	}
+
+	switch (view->type)
+	{
+		case NANOPUBSUB__STANDARD_MESSAGE:
+			/* A message that cannot be recorded is published anyway */
+			if (isLogging) {
+				nanoPubSub__Log_append(&messageLog, view, NULL);
+			}
+			if (isRetaining) {
+				nanoPubSub__BrokerRetained_store(&retained, view);
+			}
+			publishMessage(view, client, topicId);
+			break;
+
+		case NANOPUBSUB__PING_MESSAGE:
+			nanoPubSub__Network_sendPong(socketfd,
+				(const struct sockaddr*)fromAddr, view);
+			break;
+
+		case NANOPUBSUB__SUBSCRIBE_MESSAGE:
+			/* Published messages go to the client's listening port, not to
+			   the port the subscribe message was sent from */
+			clientAddr = *fromAddr;
+			clientAddr.sin_port = htons(options.clientPort);
+
+			/* Filters with misplaced wildcards are ignored */
+			if (!nanoPubSub__Topic_isValidFilter(&view->topic)) {
+				nanoPubSub__Metrics_count(&metrics, NANOPUBSUB__METRIC_DROPPED,
+					1);
+				break;
+			}
+
+			/* Clients get published messages in the format they
+			   subscribed with */
+			if (!nanoPubSub__BrokerRouting_subscribe(&routing,
+					&view->clientId, &view->topic, &clientAddr,
+					(uint8_t)view->frame[0] == NANOPUBSUB__BINARY_MAGIC,
+					isReliable)) {
+				nanoPubSub__BrokerIO_printErrMemory();
+				break;
+			}
+
+			/* New clients are pinged from now on */
+			client = nanoPubSub__BrokerRouting_getClient(&routing,
+				&view->clientId);
+			if (!nanoPubSub__Timer_isScheduled(&client->keepalive)) {
+				nanoPubSub__Timer_schedule(&timers, &client->keepalive,
+					NANOPUBSUB__BROKER_PING_INTERVAL);
+			}
+
+			/* The client gets the last message of every matching topic
+			   right away */
+			if (isRetaining) {
+				subscriber.socketfd = socketfd;
+				subscriber.client   = client;
+				nanoPubSub__BrokerRetained_match(&retained, &view->topic,
+					sendRetained, &subscriber);
+			}
+			break;
+
+		case NANOPUBSUB__UNSUBSCRIBE_MESSAGE:
+			/* Clients without subscriptions are no longer pinged */
+			if (nanoPubSub__BrokerRouting_unsubscribe(&routing,
+					&view->clientId, &view->topic)
+					&& client->numSubscriptions == 0) {
+				nanoPubSub__Timer_cancel(&timers, &client->keepalive);
+				nanoPubSub__BrokerRouting_removeClient(&routing, client);
+			}
+			break;
+
+		case NANOPUBSUB__REGISTER_MESSAGE:
+			registerNames(socketfd, fromAddr, view);
+			break;
+
+		case NANOPUBSUB__REPLAY_MESSAGE:
+			replayMessages(socketfd, fromAddr, view);
+			break;
+
+		default:
+			break;
+	}
+}
@@ -0,0 +1,316 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#include <message.h>
+#include <network.h>
+#include <fragment.h>
+#include <topic.h>
+#include <reliable.h>
+#include <timer.h>
+#include <log.h>
+#include <metrics.h>
+#include <transport.h>
+#include <util.h>
+
+#include "defs.h"
+#include "broker_io.h"
+#include "routing.h"
+#include "retained.h"
+
+/**
+ * A standard message being published. The state is shared by the calls
+ * of collectSubscribers for all filters matching the message's topic.
+ */
+typedef struct
+{
+	/** The received message */
+	const nanoPubSub__Message_view *view;
+
+	/** The sending client, or NULL if it never subscribed to anything */
+	const nanoPubSub__BrokerRouting_client *sender;
+
+	/** The number of the publication, see publishMark */
+	unsigned long mark;
+
+	/** 1 if the message was received as a binary message, 0 for text */
+	int binary;
+
+	/** 1 once the message has been converted into the other format */
+	int isConverted;
+
+	/** The message as text (index 0) and binary message (index 1) */
+	const char *frames[2];
+
+	/** The lengths of the frames, 0 if not available */
+	size_t frameLengths[2];
+
+	/** The destinations collected per format */
+	const struct sockaddr *destAddrs[2][NANOPUBSUB__NETWORK_SEND_BATCH];
+
+	/** The number of destinations collected per format */
+	unsigned int numDestAddrs[2];
+
+	/** The number of subscribers the message is sent to */
+	unsigned int fanOut;
+
+	/** The number of bytes sent to the subscribers */
+	uint64_t bytesSent;
+} nanoPubSub__Broker_publication;
+
+
+/**
+ * A client that has just subscribed and is sent the retained messages
+ * matching its filter
+ */
+typedef struct
+{
+	/** The socket to send the messages over */
+	int socketfd;
+
+	/** The subscribed client */
+	const nanoPubSub__BrokerRouting_client *client;
+} nanoPubSub__Broker_subscriber;
+
+
+/** Program options */
+static nanoPubSub__BrokerIO_options options;
+
+/** The table of known clients and their subscriptions */
+static nanoPubSub__BrokerRouting_table routing;
+
+/** The buffers incoming messages are received into */
+static char recvBuffers[NANOPUBSUB__BROKER_RECV_BATCH]
+                       [NANOPUBSUB__MAX_MESSAGE_LENGTH];
+
+/** The receive ring set up over recvBuffers */
+static nanoPubSub__Network_recvRing recvRing;
+
+/** The way datagrams are received and published */
+static nanoPubSub__Transport transport;
+
+/** The number of messages published so far */
+static unsigned long publishCount;
+
+/** The pool messages split into fragments are reassembled in */
+static nanoPubSub__Fragment_pool fragments;
+
+/**
+ * The endpoint reliable messages are acknowledged by, and published
+ * messages are sent reliably from to clients that subscribed reliably
+ */
+static nanoPubSub__Reliable_endpoint reliable;
+
+/** The wheel the clients' keepalive timers are scheduled on */
+static nanoPubSub__Timer_wheel timers;
+
+/** The number of pings sent so far, used as the pings' tokens */
+static unsigned long pingCount;
+
+/** The log published messages are recorded in, if enabled */
+static nanoPubSub__Log messageLog;
+
+/** 1 if published messages are recorded in messageLog */
+static int isLogging;
+
+/** The last message published to every topic, if enabled */
+static nanoPubSub__BrokerRetained_cache retained;
+
+/** 1 if the last message of every topic is kept in retained */
+static int isRetaining;
+
+/** The broker's counters and histograms */
+static nanoPubSub__Metrics metrics;
+
+/** The timer the broker's metrics are published by */
+static nanoPubSub__Timer statsTimer;
+
+/**
+ * The buffer published messages are converted into for subscribers using
+ * the other format. It is too large for the stack, as reassembled
+ * messages may be converted as well.
+ */
+static char converted[NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH];
+
+/**
+ * The buffer messages using numeric ids are rewritten into, with the ids
+ * replaced by the strings they have been assigned to
+ */
+static char expanded[NANOPUBSUB__MAX_LARGE_MESSAGE_LENGTH];
+
+/** The broker's metrics as text, as published or printed */
+static char statsText[NANOPUBSUB__BROKER_STATS_LENGTH];
+
+/** The message the broker's metrics are published in */
+static char statsFrame[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+
+
+/**
+ * Sets up the broker's socket and runs the event loop until the process
+ * receives SIGINT or SIGTERM.
+ * @return 0 on success, 1 otherwise
+ */
+static int runBroker(void);
+
+
+/**
+ * Receives and handles messages in batches until the socket's receive
+ * queue is empty.
+ *
+ * @param socketfd The non-blocking socket to read from
+ */
+static void drainSocket(int socketfd);
+
+
+/**
+ * Sends a published message to a chunk of destinations and counts the
+ * destinations it could not be sent to.
+ *
+ * @param destAddrs The addresses of the destinations
+ * @param numDestAddrs The number of destinations
+ * @param frame The message string to send
+ * @param length The length of the message string (in bytes)
+ */
+static void sendPublication(const struct sockaddr *const *destAddrs,
+	unsigned int numDestAddrs, const char *frame, size_t length);
+
+
+/**
+ * Adds the subscribers of a filter matching a published message to the
+ * message's destinations. Whenever a chunk of destinations is complete,
+ * it is handed to the kernel with a single system call. Clients that
+ * subscribed reliably are sent the message on their own.
+ *
+ * @param subscribers The subscribed clients
+ * @param numSubscribers The number of subscribed clients
+ * @param arg The publication the subscribers are added to
+ */
+static void collectSubscribers(void *const *subscribers,
+	size_t numSubscribers, void *arg);
+
+
+/**
+ * Sends a standard message to all subscribers of its topic except the
+ * sender and dormant clients. Every subscriber receives the message in the
+ * format it subscribed with; text subscribers are skipped if a binary
+ * message cannot be represented as text.
+ *
+ * @param view The received message
+ * @param sender The sending client, or NULL if it never subscribed to
+ *               anything
+ * @param topicId The id the message referred to its topic by, 0 if it
+ *                carried the topic as a string
+ */
+static void publishMessage(const nanoPubSub__Message_view *view,
+	const nanoPubSub__BrokerRouting_client *sender, uint32_t topicId);
+
+
+/**
+ * Publishes the broker's metrics on NANOPUBSUB__BROKER_STATS_TOPIC and
+ * schedules the next publication.
+ */
+static void publishStats(void);
+
+
+/**
+ * Sends a ping to a client whose keepalive timer has expired and schedules
+ * the next one. A client that left too many pings unanswered becomes
+ * dormant and is pinged less often, and is removed once it stayed silent
+ * for NANOPUBSUB__BROKER_MAX_DORMANT_PINGS more pings.
+ *
+ * @param socketfd The socket to send the ping over
+ * @param client The client to ping
+ */
+static void pingClient(int socketfd,
+	nanoPubSub__BrokerRouting_client *client);
+
+
+/**
+ * Assigns numeric ids to the client id and topic of a register message
+ * and answers with a registered message holding the ids.
+ *
+ * @param socketfd The socket to send the answer over
+ * @param fromAddr The address the register message was received from
+ * @param view The register message
+ */
+static void registerNames(int socketfd, const struct sockaddr_in *fromAddr,
+	const nanoPubSub__Message_view *view);
+
+
+/**
+ * Sends a stored message to a single client in the client's format. The
+ * message is converted if it was stored in the other format, and split
+ * into fragments if it is too long for a datagram.
+ *
+ * @param socketfd The socket to send the message over
+ * @param destAddr The address of the client
+ * @param view The stored message
+ * @param binary 1 if the client expects binary messages, 0 for text
+ * @param isReliable 1 if the message is to be sent reliably
+ *
+ * @return 1 if the message has been sent, 0 otherwise
+ */
+static int sendStored(int socketfd, const struct sockaddr_in *destAddr,
+	const nanoPubSub__Message_view *view, int binary, int isReliable);
+
+
+/**
+ * Sends a client that has just subscribed the retained messages of the
+ * topics matching its filter.
+ *
+ * @param view The retained message
+ * @param arg The subscriber the message is sent to
+ */
+static void sendRetained(const nanoPubSub__Message_view *view, void *arg);
+
+
+/**
+ * Sends a client the recorded messages of a topic, starting at the
+ * offset or time given by a replay message. The messages are sent
+ * straight from the log, in the format of the replay message.
+ *
+ * @param socketfd The socket to send the messages over
+ * @param fromAddr The address the replay message was received from
+ * @param view The replay message
+ */
+static void replayMessages(int socketfd, const struct sockaddr_in *fromAddr,
+	const nanoPubSub__Message_view *view);
+
+
+/**
+ * Handles a single message: subscriptions are recorded in the routing
+ * table, standard messages are published to the subscribers of their
+ * topic (and recorded and retained, if enabled), and pings, registrations
+ * and replay requests are answered. Numeric ids are replaced by their strings
+ * first. Any message from a known client proves that the client is alive.
+ *
+ * @param socketfd The socket to send published messages over
+ * @param fromAddr The address the message was received from
+ * @param view The received message
+ * @param isReliable 1 if the message was received reliably
+ */
+static void handleMessage(int socketfd, const struct sockaddr_in *fromAddr,
+	const nanoPubSub__Message_view *view, int isReliable);
@@ -0,0 +1,281 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <util.h>
+
+#include "retained.h"
+
+
+/**
+ * Calculates the FNV-1a hash of a topic. 0 marks empty slots, so it is
+ * never returned.
+ */
+static inline uint32_t hashTopic(const char *topic, size_t length)
+{
+	uint32_t hash = nanoPubSub__Util_hash(topic, length);
+
+	return hash != 0 ? hash : 1;
+}
+
+
+/**
+ * Finds the slot holding a topic's message, or the empty slot it belongs
+ * into.
+ */
+static nanoPubSub__BrokerRetained_slot *findSlot(
+		const nanoPubSub__BrokerRetained_cache *cache, uint32_t hash,
+		const nanoPubSub__Message_slice *topic)
+{
+	nanoPubSub__BrokerRetained_slot *slot;
+	uint32_t i = hash & cache->mask;
+
+	/* The table is never more than half full, so an empty slot is always
+	   found */
+	for (;;) {
+		slot = &cache->slots[i];
+
+		if (slot->hash == 0 || (slot->hash == hash
+				&& slot->topicLength == topic->length
+				&& memcmp(slot->frame + slot->topicOffset, topic->data,
+					topic->length) == 0)) {
+			return slot;
+		}
+
+		i = (i + 1) & cache->mask;
+	}
+}
+
+
+/**
+ * Empties a slot and moves the slots following it back, so that no probe
+ * sequence is interrupted by the gap.
+ */
+static void removeSlot(nanoPubSub__BrokerRetained_cache *cache,
+		nanoPubSub__BrokerRetained_slot *slot)
+{
+	uint32_t gap = slot - cache->slots, i = gap, home;
+
+	cache->numBytes -= slot->length;
+	cache->numMessages--;
+	free(slot->frame);
+
+	for (;;) {
+		i = (i + 1) & cache->mask;
+
+		if (cache->slots[i].hash == 0) {
+			break;
+		}
+
+		/* A slot may fill the gap if its home is not between the gap and
+		   the slot itself */
+		home = cache->slots[i].hash & cache->mask;
+		if (((i - home) & cache->mask) >= ((i - gap) & cache->mask)) {
+			cache->slots[gap] = cache->slots[i];
+			gap = i;
+		}
+	}
+
+	memset(&cache->slots[gap], 0, sizeof(cache->slots[gap]));
+}
+
+
+/**
+ * Initializes an empty cache and allocates its slots.
+ *
+ * @param cache The cache to initialize
+ * @param maxMessages The max. number of retained messages
+ * @param maxBytes The max. memory taken by the retained messages (in bytes)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__BrokerRetained_init(nanoPubSub__BrokerRetained_cache *cache,
+		size_t maxMessages, size_t maxBytes)
+{
+	size_t numSlots = 16;
+
+	assert(maxMessages > 0 && maxMessages <= UINT32_MAX / 2);
+
+	while (numSlots < maxMessages * 2) {
+		numSlots *= 2;
+	}
+
+	if ((cache->slots = calloc(numSlots, sizeof(*cache->slots))) == NULL) {
+		return 0;
+	}
+
+	cache->mask        = numSlots - 1;
+	cache->numMessages = 0;
+	cache->maxMessages = maxMessages;
+	cache->numBytes    = 0;
+	cache->maxBytes    = maxBytes;
+
+	return 1;
+}
+
+
+/**
+ * Frees all memory owned by a cache.
+ *
+ * @param cache The cache to destroy
+ */
+void nanoPubSub__BrokerRetained_destroy(
+		nanoPubSub__BrokerRetained_cache *cache)
+{
+	uint32_t i;
+
+	if (cache->slots == NULL) {
+		return;
+	}
+
+	for (i = 0; i <= cache->mask; i++) {
+		free(cache->slots[i].frame);
+	}
+
+	free(cache->slots);
+	cache->slots = NULL;
+}
+
+
+/**
+ * Retains a standard message as the last message of its topic, replacing
+ * the one retained before. A message with an empty body removes the
+ * topic's retained message instead.
+ *
+ * @param cache The cache to modify
+ * @param view The message, which must have a frame and a topic string
+ *
+ * @return 1 on success, 0 if the cache is full or no memory could be
+ *         allocated
+ */
+int nanoPubSub__BrokerRetained_store(nanoPubSub__BrokerRetained_cache *cache,
+		const nanoPubSub__Message_view *view)
+{
+	uint32_t hash = hashTopic(view->topic.data, view->topic.length);
+	nanoPubSub__BrokerRetained_slot *slot;
+	size_t numBytes;
+	char *frame;
+
+	assert(view->frame != NULL && view->topic.length > 0);
+
+	slot = findSlot(cache, hash, &view->topic);
+
+	if (view->body.length == 0) {
+		if (slot->hash != 0) {
+			removeSlot(cache, slot);
+		}
+		return 1;
+	}
+
+	/* The message replaced does not count against the bound */
+	numBytes = cache->numBytes - (slot->hash != 0 ? slot->length : 0);
+
+	if ((slot->hash == 0 && cache->numMessages == cache->maxMessages)
+			|| view->length > cache->maxBytes - numBytes) {
+		return 0;
+	}
+
+	if ((frame = malloc(view->length)) == NULL) {
+		return 0;
+	}
+
+	memcpy(frame, view->frame, view->length);
+
+	if (slot->hash == 0) {
+		cache->numMessages++;
+	}
+	free(slot->frame);
+
+	slot->hash        = hash;
+	slot->length      = view->length;
+	slot->topicOffset = view->topic.data - view->frame;
+	slot->topicLength = view->topic.length;
+	slot->frame       = frame;
+	cache->numBytes   = numBytes + view->length;
+
+	return 1;
+}
+
+
+/**
+ * Passes the message of a slot to a visitor.
+ */
+static size_t visitSlot(const nanoPubSub__BrokerRetained_slot *slot,
+		nanoPubSub__BrokerRetained_visitor visitor, void *arg)
+{
+	nanoPubSub__Message_view view;
+
+	if (!nanoPubSub__Message_parseLargeView(slot->frame, slot->length,
+			&view)) {
+		return 0;
+	}
+
+	visitor(&view, arg);
+
+	return 1;
+}
+
+
+/**
+ * Finds the retained messages whose topics match a filter and passes them
+ * to a visitor. Filters without wildcards take a single lookup, all
+ * others a walk over the whole table.
+ *
+ * @param cache The cache to search
+ * @param filter The filter (see nanoPubSub__Topic_isValidFilter)
+ * @param visitor The function to call for every matching message
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching messages
+ */
+size_t nanoPubSub__BrokerRetained_match(
+		const nanoPubSub__BrokerRetained_cache *cache,
+		const nanoPubSub__Message_slice *filter,
+		nanoPubSub__BrokerRetained_visitor visitor, void *arg)
+{
+	const nanoPubSub__BrokerRetained_slot *slot;
+	nanoPubSub__Message_slice topic;
+	size_t numMatches = 0;
+	uint32_t i;
+
+	/* In a valid filter, wildcard characters always make up a level */
+	if (memchr(filter->data, NANOPUBSUB__TOPIC_SINGLE_LEVEL,
+			filter->length) == NULL
+			&& memchr(filter->data, NANOPUBSUB__TOPIC_MULTI_LEVEL,
+				filter->length) == NULL) {
+		slot = findSlot(cache, hashTopic(filter->data, filter->length),
+			filter);
+		return slot->hash != 0 ? visitSlot(slot, visitor, arg) : 0;
+	}
+
+	for (i = 0; i <= cache->mask; i++) {
+		slot = &cache->slots[i];
+
+		if (slot->hash == 0) {
+			continue;
+		}
+
+		topic.data   = slot->frame + slot->topicOffset;
+		topic.length = slot->topicLength;
+
+		if (nanoPubSub__Topic_matchesFilter(filter, &topic)) {
+			numMatches += visitSlot(slot, visitor, arg);
+		}
+	}
+
+	return numMatches;
+}
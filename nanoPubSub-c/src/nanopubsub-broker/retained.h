@@ -0,0 +1,148 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <message.h>
+#include <topic.h>
+
+#ifndef __NANOPUBSUBBROKER__RETAINED_H
+#define __NANOPUBSUBBROKER__RETAINED_H
+
+
+/**
+ * A slot of the retained message cache. The slot only holds what is
+ * needed to compare topics, so that probing touches as little memory as
+ * possible.
+ */
+typedef struct
+{
+	/** The hash of the message's topic, 0 if the slot is empty */
+	uint32_t hash;
+
+	/** The length of the message (in bytes) */
+	uint32_t length;
+
+	/** The position of the topic within the message */
+	uint32_t topicOffset;
+
+	/** The length of the topic */
+	uint32_t topicLength;
+
+	/** A copy of the message as it was received */
+	char *frame;
+} nanoPubSub__BrokerRetained_slot;
+
+
+/**
+ * The last message published to every topic, kept in an open addressing
+ * hash table with linear probing. The table never grows: both the number
+ * of topics and the memory taken by the messages are bounded, and
+ * messages of new topics are not retained once either bound is reached.
+ */
+typedef struct
+{
+	nanoPubSub__BrokerRetained_slot *slots;
+
+	/** The number of slots minus one (a power of two) */
+	uint32_t mask;
+
+	/** The number of retained messages */
+	size_t numMessages;
+
+	/** The max. number of retained messages */
+	size_t maxMessages;
+
+	/** The memory taken by the retained messages (in bytes) */
+	size_t numBytes;
+
+	/** The max. memory taken by the retained messages (in bytes) */
+	size_t maxBytes;
+} nanoPubSub__BrokerRetained_cache;
+
+
+/**
+ * Called by nanoPubSub__BrokerRetained_match for every retained message
+ * matching a filter.
+ *
+ * @param view The retained message, valid until the cache is modified
+ * @param arg The argument passed to nanoPubSub__BrokerRetained_match
+ */
+typedef void (*nanoPubSub__BrokerRetained_visitor)(
+	const nanoPubSub__Message_view *view, void *arg);
+
+
+/**
+ * Initializes an empty cache and allocates its slots.
+ *
+ * @param cache The cache to initialize
+ * @param maxMessages The max. number of retained messages
+ * @param maxBytes The max. memory taken by the retained messages (in bytes)
+ *
+ * @return 1 on success, 0 if no memory could be allocated
+ */
+int nanoPubSub__BrokerRetained_init(nanoPubSub__BrokerRetained_cache *cache,
+	size_t maxMessages, size_t maxBytes);
+
+
+/**
+ * Frees all memory owned by a cache.
+ *
+ * @param cache The cache to destroy
+ */
+void nanoPubSub__BrokerRetained_destroy(
+	nanoPubSub__BrokerRetained_cache *cache);
+
+
+/**
+ * Retains a standard message as the last message of its topic, replacing
+ * the one retained before. A message with an empty body removes the
+ * topic's retained message instead.
+ *
+ * @param cache The cache to modify
+ * @param view The message, which must have a frame and a topic string
+ *
+ * @return 1 on success, 0 if the cache is full or no memory could be
+ *         allocated
+ */
+int nanoPubSub__BrokerRetained_store(nanoPubSub__BrokerRetained_cache *cache,
+	const nanoPubSub__Message_view *view);
+
+
+/**
+ * Finds the retained messages whose topics match a filter and passes them
+ * to a visitor. Filters without wildcards take a single lookup, all
+ * others a walk over the whole table.
+ *
+ * @param cache The cache to search
+ * @param filter The filter (see nanoPubSub__Topic_isValidFilter)
+ * @param visitor The function to call for every matching message
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching messages
+ */
+size_t nanoPubSub__BrokerRetained_match(
+	const nanoPubSub__BrokerRetained_cache *cache,
+	const nanoPubSub__Message_slice *filter,
+	nanoPubSub__BrokerRetained_visitor visitor, void *arg);
+
+
+#endif /* __NANOPUBSUBBROKER__RETAINED_H */
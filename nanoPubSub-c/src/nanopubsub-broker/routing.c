@@ -0,0 +1,510 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <util.h>
+
+#include "routing.h"
+
+
+/**
+ * Copies a string slice into a newly allocated, Null-terminated string.
+ */
+static char *copyString(const nanoPubSub__Message_slice *slice)
+{
+	char *copy;
+
+	if ((copy = (char*)malloc(slice->length + 1)) != NULL) {
+		memcpy(copy, slice->data, slice->length);
+		copy[slice->length] = '\0';
+	}
+
+	return copy;
+}
+
+
+/**
+ * Doubles the number of client buckets and rehashes all clients.
+ */
+static int growClients(nanoPubSub__BrokerRouting_table *table)
+{
+	size_t numBuckets = table->numClientBuckets * 2;
+	nanoPubSub__BrokerRouting_client **buckets, *client, *next;
+	size_t i;
+
+	if ((buckets = calloc(numBuckets, sizeof(*buckets))) == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < table->numClientBuckets; i++) {
+		for (client = table->clients[i]; client != NULL; client = next) {
+			uint32_t bucket = nanoPubSub__Util_hash(client->clientId,
+				client->clientIdLength) & (numBuckets - 1);
+			next = client->next;
+			client->next = buckets[bucket];
+			buckets[bucket] = client;
+		}
+	}
+
+	free(table->clients);
+	table->clients = buckets;
+	table->numClientBuckets = numBuckets;
+
+	return 1;
+}
+
+
+/**
+ * Adds the number of subscribers of a filter matching a topic to a count.
+ */
+static void countSubscribers(void *const *subscribers, size_t numSubscribers,
+		void *arg)
+{
+	(void)subscribers;
+	*(size_t*)arg += numSubscribers;
+}
+
+
+/**
+ * Appends the subscribers of a filter matching a topic to a route, which
+ * has room for them.
+ */
+static void collectRoute(void *const *subscribers, size_t numSubscribers,
+		void *arg)
+{
+	nanoPubSub__BrokerRouting_route *route = arg;
+
+	memcpy(route->clients + route->numClients, subscribers,
+		numSubscribers * sizeof(*route->clients));
+	route->numClients += numSubscribers;
+}
+
+
+/**
+ * Initializes an empty routing table.
+ *
+ * @param table The table to initialize
+ * @param numBuckets The initial number of hash buckets (a power of two)
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__BrokerRouting_init(nanoPubSub__BrokerRouting_table *table,
+		size_t numBuckets)
+{
+	assert(numBuckets > 0 && (numBuckets & (numBuckets - 1)) == 0);
+
+	if ((table->clients = calloc(numBuckets, sizeof(*table->clients)))
+			== NULL) {
+		return 0;
+	}
+
+	if (!nanoPubSub__Topic_init(&table->topics, numBuckets)) {
+		free(table->clients);
+		return 0;
+	}
+
+	if (!nanoPubSub__Intern_init(&table->clientNames,
+			NANOPUBSUB__BROKER_MAX_NAMES)) {
+		nanoPubSub__Topic_destroy(&table->topics);
+		free(table->clients);
+		return 0;
+	}
+
+	if (!nanoPubSub__Intern_init(&table->topicNames,
+			NANOPUBSUB__BROKER_MAX_NAMES)) {
+		nanoPubSub__Intern_destroy(&table->clientNames);
+		nanoPubSub__Topic_destroy(&table->topics);
+		free(table->clients);
+		return 0;
+	}
+
+	table->numClientBuckets = numBuckets;
+	table->numClients       = 0;
+	table->routes           = NULL;
+	table->numRoutes        = 0;
+	table->generation       = 1;
+
+	return 1;
+}
+
+
+/**
+ * Frees all memory owned by a routing table.
+ *
+ * @param table The table to destroy
+ */
+void nanoPubSub__BrokerRouting_destroy(nanoPubSub__BrokerRouting_table *table)
+{
+	nanoPubSub__BrokerRouting_client *client, *nextClient;
+	size_t i;
+
+	nanoPubSub__Topic_destroy(&table->topics);
+	nanoPubSub__Intern_destroy(&table->clientNames);
+	nanoPubSub__Intern_destroy(&table->topicNames);
+
+	for (i = 0; i < table->numClientBuckets; i++) {
+		for (client = table->clients[i]; client != NULL; client = nextClient) {
+			nextClient = client->next;
+			free(client->clientId);
+			free(client);
+		}
+	}
+
+	for (i = 0; i < table->numRoutes; i++) {
+		free(table->routes[i].clients);
+	}
+
+	free(table->clients);
+	free(table->routes);
+	table->clients = NULL;
+	table->routes  = NULL;
+}
+
+
+/**
+ * Looks up a client by its id.
+ *
+ * @param table The table to search
+ * @param clientId The client's id
+ *
+ * @return The client, or NULL if it is unknown
+ */
+nanoPubSub__BrokerRouting_client *nanoPubSub__BrokerRouting_getClient(
+		const nanoPubSub__BrokerRouting_table *table,
+		const nanoPubSub__Message_slice *clientId)
+{
+	uint32_t bucket = nanoPubSub__Util_hash(clientId->data, clientId->length)
+		& (table->numClientBuckets - 1);
+	nanoPubSub__BrokerRouting_client *client;
+
+	for (client = table->clients[bucket]; client != NULL;
+			client = client->next) {
+		if (client->clientIdLength == clientId->length
+				&& memcmp(client->clientId, clientId->data,
+					clientId->length) == 0) {
+			return client;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Finds the clients subscribed to a topic, directly or through a filter
+ * with wildcards, and passes them to a visitor.
+ *
+ * @param table The table to search
+ * @param topic The topic to match
+ * @param visitor The function to call with the subscribers of every
+ *                matching filter
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching filters
+ */
+size_t nanoPubSub__BrokerRouting_match(
+		const nanoPubSub__BrokerRouting_table *table,
+		const nanoPubSub__Message_slice *topic,
+		nanoPubSub__Topic_visitor visitor, void *arg)
+{
+	return nanoPubSub__Topic_match(&table->topics, topic, visitor, arg);
+}
+
+
+/**
+ * Finds the clients subscribed to a registered topic, directly or through
+ * a filter with wildcards, and passes them to a visitor. The topic is not
+ * matched against the filters again as long as the subscriptions do not
+ * change.
+ *
+ * @param table The table to search
+ * @param topicId The topic's id
+ * @param visitor The function to call with the subscribers
+ * @param arg An argument passed to the visitor
+ *
+ * @return 1 on success, 0 if the id is unknown
+ */
+int nanoPubSub__BrokerRouting_matchId(nanoPubSub__BrokerRouting_table *table,
+		uint32_t topicId, nanoPubSub__Topic_visitor visitor, void *arg)
+{
+	const nanoPubSub__Message_slice *topic;
+	nanoPubSub__BrokerRouting_route *route, *routes;
+	nanoPubSub__BrokerRouting_client **clients;
+	size_t numRoutes, numClients = 0;
+
+	if ((topic = nanoPubSub__Intern_get(&table->topicNames, topicId))
+			== NULL) {
+		return 0;
+	}
+
+	/* Make room for the routes of all topics registered so far. Without
+	   memory the topic is matched against the filters instead. */
+	if (topicId > table->numRoutes) {
+		numRoutes = table->topicNames.maxStrings;
+		if ((routes = realloc(table->routes, numRoutes * sizeof(*routes)))
+				== NULL) {
+			nanoPubSub__Topic_match(&table->topics, topic, visitor, arg);
+			return 1;
+		}
+		memset(routes + table->numRoutes, 0,
+			(numRoutes - table->numRoutes) * sizeof(*routes));
+		table->routes    = routes;
+		table->numRoutes = numRoutes;
+	}
+
+	route = &table->routes[topicId - 1];
+
+	/* Collect the subscribers again after the subscriptions changed */
+	if (route->generation != table->generation) {
+		nanoPubSub__Topic_match(&table->topics, topic, countSubscribers,
+			&numClients);
+
+		if (numClients > route->maxClients) {
+			if ((clients = realloc(route->clients,
+					numClients * sizeof(*clients))) == NULL) {
+				nanoPubSub__Topic_match(&table->topics, topic, visitor, arg);
+				return 1;
+			}
+			route->clients    = clients;
+			route->maxClients = numClients;
+		}
+
+		route->numClients = 0;
+		nanoPubSub__Topic_match(&table->topics, topic, collectRoute, route);
+		route->generation = table->generation;
+	}
+
+	if (route->numClients > 0) {
+		visitor((void *const *)route->clients, route->numClients, arg);
+	}
+
+	return 1;
+}
+
+
+/**
+ * Subscribes a client to a topic or a filter with wildcards. Unknown
+ * clients are added to the table, known clients have their address,
+ * message format and delivery mode updated.
+ *
+ * @param table The table to modify
+ * @param clientId The subscribing client's id
+ * @param topic The topic or filter to subscribe to (see
+ *              nanoPubSub__Topic_isValidFilter)
+ * @param addr The address to send published messages to
+ * @param binary 1 if the client wants binary messages, 0 for text
+ * @param reliable 1 if published messages are sent to the client reliably
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__BrokerRouting_subscribe(nanoPubSub__BrokerRouting_table *table,
+		const nanoPubSub__Message_slice *clientId,
+		const nanoPubSub__Message_slice *topic, const struct sockaddr_in *addr,
+		int binary, int reliable)
+{
+	nanoPubSub__BrokerRouting_client *client;
+	size_t numSubscriptions = table->topics.numSubscriptions;
+	uint32_t bucket;
+
+	/* Look up the client and register it if it is unknown */
+	if ((client = nanoPubSub__BrokerRouting_getClient(table, clientId))
+			== NULL) {
+		if (table->numClients >= table->numClientBuckets
+				&& !growClients(table)) {
+			return 0;
+		}
+
+		if ((client = malloc(sizeof(*client))) == NULL) {
+			return 0;
+		}
+
+		if ((client->clientId = copyString(clientId)) == NULL) {
+			free(client);
+			return 0;
+		}
+
+		bucket = nanoPubSub__Util_hash(clientId->data, clientId->length)
+			& (table->numClientBuckets - 1);
+		client->clientIdLength   = clientId->length;
+		client->numSubscriptions = 0;
+		client->publishMark      = 0;
+		client->missedPings      = 0;
+		client->dormant          = 0;
+		nanoPubSub__Timer_init(&client->keepalive, client);
+		client->next = table->clients[bucket];
+		table->clients[bucket] = client;
+		table->numClients++;
+	}
+
+	client->addr     = *addr;
+	client->binary   = binary;
+	client->reliable = reliable;
+
+	/* Subscribing twice to the same filter leaves the number of
+	   subscriptions unchanged. A new client whose first subscription
+	   failed is removed again. */
+	if (!nanoPubSub__Topic_subscribe(&table->topics, topic, client)) {
+		if (client->numSubscriptions == 0) {
+			nanoPubSub__BrokerRouting_removeClient(table, client);
+		}
+		return 0;
+	}
+
+	if (table->topics.numSubscriptions != numSubscriptions) {
+		client->numSubscriptions++;
+		table->generation++;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Removes a client's subscription to a topic.
+ *
+ * @param table The table to modify
+ * @param clientId The unsubscribing client's id
+ * @param topic The topic or filter to unsubscribe from
+ *
+ * @return 1 if the subscription was removed, 0 if it did not exist
+ */
+int nanoPubSub__BrokerRouting_unsubscribe(
+		nanoPubSub__BrokerRouting_table *table,
+		const nanoPubSub__Message_slice *clientId,
+		const nanoPubSub__Message_slice *topic)
+{
+	nanoPubSub__BrokerRouting_client *client;
+
+	if ((client = nanoPubSub__BrokerRouting_getClient(table, clientId))
+			== NULL) {
+		return 0;
+	}
+
+	if (!nanoPubSub__Topic_unsubscribe(&table->topics, topic, client)) {
+		return 0;
+	}
+
+	client->numSubscriptions--;
+	table->generation++;
+
+	return 1;
+}
+
+
+/**
+ * Removes a client from the table, together with all of its
+ * subscriptions, and frees it. The caller must cancel the client's
+ * keepalive timer first.
+ *
+ * @param table The table to modify
+ * @param client The client to remove
+ */
+void nanoPubSub__BrokerRouting_removeClient(
+		nanoPubSub__BrokerRouting_table *table,
+		nanoPubSub__BrokerRouting_client *client)
+{
+	nanoPubSub__BrokerRouting_client **link;
+	uint32_t bucket = nanoPubSub__Util_hash(client->clientId,
+		client->clientIdLength) & (table->numClientBuckets - 1);
+
+	assert(!nanoPubSub__Timer_isScheduled(&client->keepalive));
+
+	/* Routes must not refer to the client any longer */
+	if (client->numSubscriptions > 0) {
+		nanoPubSub__Topic_unsubscribeAll(&table->topics, client);
+		table->generation++;
+	}
+
+	link = &table->clients[bucket];
+	while (*link != client) {
+		link = &(*link)->next;
+	}
+	*link = client->next;
+	table->numClients--;
+
+	free(client->clientId);
+	free(client);
+}
+
+
+/**
+ * Assigns numeric ids to a client id and a topic. Registering the same
+ * strings again returns the same ids.
+ *
+ * @param table The table to register the strings in
+ * @param clientId The client id
+ * @param topic The topic
+ * @param clientNumber Pointer to store the client id's number in
+ * @param topicId Pointer to store the topic's id in
+ *
+ * @return 1 on success, 0 if no more ids can be assigned
+ */
+int nanoPubSub__BrokerRouting_register(nanoPubSub__BrokerRouting_table *table,
+		const nanoPubSub__Message_slice *clientId,
+		const nanoPubSub__Message_slice *topic, uint32_t *clientNumber,
+		uint32_t *topicId)
+{
+	*clientNumber = nanoPubSub__Intern_add(&table->clientNames, clientId);
+	*topicId      = nanoPubSub__Intern_add(&table->topicNames, topic);
+
+	return *clientNumber != 0 && *topicId != 0;
+}
+
+
+/**
+ * Replaces the numeric ids of a message with the strings they have been
+ * assigned to. Fields sent as strings are copied unchanged.
+ *
+ * @param table The table the ids have been registered in
+ * @param view The received message
+ * @param resolved Pointer to the view to write the resolved message into;
+ *                 its frame and length are left unset
+ *
+ * @return 1 on success, 0 if an id is unknown
+ */
+int nanoPubSub__BrokerRouting_resolve(
+		const nanoPubSub__BrokerRouting_table *table,
+		const nanoPubSub__Message_view *view,
+		nanoPubSub__Message_view *resolved)
+{
+	const nanoPubSub__Message_slice *name;
+
+	*resolved = *view;
+	resolved->frame  = NULL;
+	resolved->length = 0;
+
+	/* Ids are indexes into the interned strings */
+	if (view->clientNumber != 0) {
+		if ((name = nanoPubSub__Intern_get(&table->clientNames,
+				view->clientNumber)) == NULL) {
+			return 0;
+		}
+		resolved->clientId     = *name;
+		resolved->clientNumber = 0;
+	}
+
+	if (view->topicId != 0) {
+		if ((name = nanoPubSub__Intern_get(&table->topicNames,
+				view->topicId)) == NULL) {
+			return 0;
+		}
+		resolved->topic   = *name;
+		resolved->topicId = 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,304 @@
+/*
+ *   nanoPubSub - embedded Publish Subscribe Messaging
+ *
+ *   Version: 0.1 (2008-09-19)
+ *   Author:  Sebastian Boschert <sebastian@2007.org>
+ *
+ *   (c) 2008 STZ Building Technology
+ * 
+ *   nanoPubSub is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ * 
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <netinet/in.h>
+
+#include <message.h>
+#include <topic.h>
+#include <timer.h>
+#include <intern.h>
+
+#include "defs.h"
+
+#ifndef __NANOPUBSUBBROKER__ROUTING_H
+#define __NANOPUBSUBBROKER__ROUTING_H
+
+
+/**
+ * A client known to the broker. Clients are registered with the first
+ * subscribe message they send and are removed once they have no
+ * subscriptions left, or once they have been dormant for too long.
+ */
+typedef struct nanoPubSub__BrokerRouting_client
+{
+	/** The client's id (Null-terminated string) */
+	char *clientId;
+
+	/** The length of the client's id */
+	size_t clientIdLength;
+
+	/** The number of topics and filters the client is subscribed to */
+	size_t numSubscriptions;
+
+	/** The address published messages are sent to */
+	struct sockaddr_in addr;
+
+	/**
+	 * The format published messages are sent in: 1 if the client
+	 * subscribed with a binary message, 0 for text messages
+	 */
+	int binary;
+
+	/**
+	 * 1 if published messages are sent to the client reliably, because it
+	 * subscribed with a reliable datagram
+	 */
+	int reliable;
+
+	/**
+	 * The number of the last message published to the client. A client
+	 * with several subscriptions matching a topic is found more than once,
+	 * but must receive every message only once.
+	 */
+	unsigned long publishMark;
+
+	/**
+	 * The number of pings sent to the client since it was last heard
+	 * from
+	 */
+	unsigned int missedPings;
+
+	/**
+	 * 1 if the client left too many pings unanswered. Dormant clients are
+	 * skipped when messages are published, until they are heard from
+	 * again or are removed.
+	 */
+	int dormant;
+
+	/** The timer the next ping is sent by, owned by the broker */
+	nanoPubSub__Timer keepalive;
+
+	/** The next client in the same hash bucket */
+	struct nanoPubSub__BrokerRouting_client *next;
+} nanoPubSub__BrokerRouting_client;
+
+
+/**
+ * The subscribers of a registered topic, collected from the topic trie
+ * when a message refers to the topic by its id.
+ */
+typedef struct
+{
+	/**
+	 * The clients subscribed to the topic. A client subscribed through
+	 * several filters is listed more than once.
+	 */
+	nanoPubSub__BrokerRouting_client **clients;
+
+	/** The number of clients */
+	size_t numClients;
+
+	/** The number of entries allocated for the clients */
+	size_t maxClients;
+
+	/**
+	 * The generation of the table the clients were collected in, 0 if
+	 * they never were
+	 */
+	unsigned long generation;
+} nanoPubSub__BrokerRouting_route;
+
+
+/**
+ * The broker's routing table. Clients are kept in a chained hash table
+ * which is grown whenever it is filled up, subscriptions in a topic trie
+ * whose subscribers are pointers into the client table. Client ids and
+ * topics that have been registered are interned, so that messages may
+ * refer to them by numeric ids. Messages carrying a topic id are routed
+ * through an array indexed by the id, which holds the topic's subscribers
+ * until the subscriptions change.
+ */
+typedef struct
+{
+	nanoPubSub__BrokerRouting_client **clients;
+	size_t numClientBuckets;
+	size_t numClients;
+
+	nanoPubSub__Topic_trie topics;
+
+	nanoPubSub__Intern_table clientNames;
+	nanoPubSub__Intern_table topicNames;
+
+	/** The subscribers of the registered topics, indexed by id - 1 */
+	nanoPubSub__BrokerRouting_route *routes;
+	size_t numRoutes;
+
+	/**
+	 * Incremented whenever a subscription is added or removed, which
+	 * outdates all routes
+	 */
+	unsigned long generation;
+} nanoPubSub__BrokerRouting_table;
+
+
+/**
+ * Initializes an empty routing table.
+ *
+ * @param table The table to initialize
+ * @param numBuckets The initial number of hash buckets (a power of two)
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__BrokerRouting_init(nanoPubSub__BrokerRouting_table *table,
+	size_t numBuckets);
+
+
+/**
+ * Frees all memory owned by a routing table.
+ *
+ * @param table The table to destroy
+ */
+void nanoPubSub__BrokerRouting_destroy(nanoPubSub__BrokerRouting_table *table);
+
+
+/**
+ * Looks up a client by its id.
+ *
+ * @param table The table to search
+ * @param clientId The client's id
+ *
+ * @return The client, or NULL if it is unknown
+ */
+nanoPubSub__BrokerRouting_client *nanoPubSub__BrokerRouting_getClient(
+	const nanoPubSub__BrokerRouting_table *table,
+	const nanoPubSub__Message_slice *clientId);
+
+
+/**
+ * Finds the clients subscribed to a topic, directly or through a filter
+ * with wildcards, and passes them to a visitor.
+ *
+ * @param table The table to search
+ * @param topic The topic to match
+ * @param visitor The function to call with the subscribers of every
+ *                matching filter
+ * @param arg An argument passed to the visitor
+ *
+ * @return The number of matching filters
+ */
+size_t nanoPubSub__BrokerRouting_match(
+	const nanoPubSub__BrokerRouting_table *table,
+	const nanoPubSub__Message_slice *topic, nanoPubSub__Topic_visitor visitor,
+	void *arg);
+
+
+/**
+ * Finds the clients subscribed to a registered topic, directly or through
+ * a filter with wildcards, and passes them to a visitor. The topic is not
+ * matched against the filters again as long as the subscriptions do not
+ * change.
+ *
+ * @param table The table to search
+ * @param topicId The topic's id
+ * @param visitor The function to call with the subscribers
+ * @param arg An argument passed to the visitor
+ *
+ * @return 1 on success, 0 if the id is unknown
+ */
+int nanoPubSub__BrokerRouting_matchId(nanoPubSub__BrokerRouting_table *table,
+	uint32_t topicId, nanoPubSub__Topic_visitor visitor, void *arg);
+
+
+/**
+ * Subscribes a client to a topic or a filter with wildcards. Unknown
+ * clients are added to the table, known clients have their address,
+ * message format and delivery mode updated.
+ *
+ * @param table The table to modify
+ * @param clientId The subscribing client's id
+ * @param topic The topic or filter to subscribe to (see
+ *              nanoPubSub__Topic_isValidFilter)
+ * @param addr The address to send published messages to
+ * @param binary 1 if the client wants binary messages, 0 for text
+ * @param reliable 1 if published messages are sent to the client reliably
+ *
+ * @return 1 on success, 0 on error
+ */
+int nanoPubSub__BrokerRouting_subscribe(nanoPubSub__BrokerRouting_table *table,
+	const nanoPubSub__Message_slice *clientId,
+	const nanoPubSub__Message_slice *topic, const struct sockaddr_in *addr,
+	int binary, int reliable);
+
+
+/**
+ * Removes a client's subscription to a topic.
+ *
+ * @param table The table to modify
+ * @param clientId The unsubscribing client's id
+ * @param topic The topic or filter to unsubscribe from
+ *
+ * @return 1 if the subscription was removed, 0 if it did not exist
+ */
+int nanoPubSub__BrokerRouting_unsubscribe(
+	nanoPubSub__BrokerRouting_table *table,
+	const nanoPubSub__Message_slice *clientId,
+	const nanoPubSub__Message_slice *topic);
+
+
+/**
+ * Removes a client from the table, together with all of its
+ * subscriptions, and frees it. The caller must cancel the client's
+ * keepalive timer first.
+ *
+ * @param table The table to modify
+ * @param client The client to remove
+ */
+void nanoPubSub__BrokerRouting_removeClient(
+	nanoPubSub__BrokerRouting_table *table,
+	nanoPubSub__BrokerRouting_client *client);
+
+
+/**
+ * Assigns numeric ids to a client id and a topic. Registering the same
+ * strings again returns the same ids.
+ *
+ * @param table The table to register the strings in
+ * @param clientId The client id
+ * @param topic The topic
+ * @param clientNumber Pointer to store the client id's number in
+ * @param topicId Pointer to store the topic's id in
+ *
+ * @return 1 on success, 0 if no more ids can be assigned
+ */
+int nanoPubSub__BrokerRouting_register(nanoPubSub__BrokerRouting_table *table,
+	const nanoPubSub__Message_slice *clientId,
+	const nanoPubSub__Message_slice *topic, uint32_t *clientNumber,
+	uint32_t *topicId);
+
+
+/**
+ * Replaces the numeric ids of a message with the strings they have been
+ * assigned to. Fields sent as strings are copied unchanged.
+ *
+ * @param table The table the ids have been registered in
+ * @param view The received message
+ * @param resolved Pointer to the view to write the resolved message into;
+ *                 its frame and length are left unset
+ *
+ * @return 1 on success, 0 if an id is unknown
+ */
+int nanoPubSub__BrokerRouting_resolve(
+	const nanoPubSub__BrokerRouting_table *table,
+	const nanoPubSub__Message_view *view, nanoPubSub__Message_view *resolved);
+
+
+#endif /* __NANOPUBSUBBROKER__ROUTING_H */
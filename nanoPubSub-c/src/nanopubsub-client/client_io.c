@@ -31,11 +31,22 @@ int nanoPubSub__ClientIO_getCLOptions(int argc, char **argv,
 		{"sub",      no_argument,       NULL, 's'},
 		{"unsub",    no_argument,       NULL, 'u'},
 		{"msg",      no_argument,       NULL, 'm'},
+		{"replay",   required_argument, NULL, 'R'},
 		{"host",     required_argument, NULL, 'h'},
 		{"port",     required_argument, NULL, 'p'},
 		{"topic",    required_argument, NULL, 't'},
 		{"clientid", required_argument, NULL, 'i'},
 		{"body",     required_argument, NULL, 'b'},
+		{"binary",   no_argument,       NULL, 'B'},
+		{"reliable", no_argument,       NULL, 'r'},
+		{"intern",   no_argument,       NULL, 'I'},
+		{"threads",  required_argument, NULL, 'T'},
+		{"count",    required_argument, NULL, 'n'},
+		{"rate",     required_argument, NULL, 'a'},
+		{"size",     required_argument, NULL, 'z'},
+		{"duration", required_argument, NULL, 'd'},
+		{"probe",    no_argument,       NULL, 'P'},
+		{"filter",   required_argument, NULL, 'f'},
 		{"version",  no_argument,       NULL, 'v'},
 		{"help",     no_argument,       NULL, '?'},
 		{0, 0, 0, 0}
@@ -43,9 +54,11 @@ int nanoPubSub__ClientIO_getCLOptions(int argc, char **argv,
 
 	int c;
 	size_t size;
+	char **filters;
 	
 	do {
-		c = getopt_long(argc, argv, "lsumh:p:t:i:b:?", long_options, NULL);
+		c = getopt_long(argc, argv, "lsumR:h:p:t:i:b:BrIT:n:a:z:d:Pf:?",
+			long_options, NULL);
 
 		switch (c)
 		{
@@ -64,11 +77,19 @@ int nanoPubSub__ClientIO_getCLOptions(int argc, char **argv,
 			case 'u':
 				opts->programMode = NANOPUBSUB__CLIENT_MODE_UNSUB;
 				break;
+
+			case 'R':
+				opts->programMode = NANOPUBSUB__CLIENT_MODE_REPLAY;
+				size = strlen(optarg);
+				if (opts->replayFrom != NULL) { free(opts->replayFrom); }
+				opts->replayFrom = (char*)malloc(size + 1);
+				strcpy(opts->replayFrom, optarg);
+				break;
 			
 			case 'h':
 				size = strlen(optarg);
 				if (opts->host != NULL) { free(opts->host); }
-				opts->host = (char*)malloc(size);
+				opts->host = (char*)malloc(size + 1);
 				strcpy(opts->host, optarg);
 				break;
 
@@ -79,24 +100,71 @@ int nanoPubSub__ClientIO_getCLOptions(int argc, char **argv,
 			case 'i':
 				size = strlen(optarg);
 				if (opts->clientid != NULL) { free(opts->clientid); }
-				opts->clientid = (char*)malloc(size);
+				opts->clientid = (char*)malloc(size + 1);
 				strcpy(opts->clientid, optarg);
 				break;
 
 			case 't':
 				size = strlen(optarg);
 				if (opts->topic != NULL) { free(opts->topic); }
-				opts->topic = (char*)malloc(size);
+				opts->topic = (char*)malloc(size + 1);
 				strcpy(opts->topic, optarg);
 				break;
 
 			case 'b':
 				size = strlen(optarg);
 				if (opts->body != NULL) { free(opts->body); }
-				opts->body = (char*)malloc(size);
+				opts->body = (char*)malloc(size + 1);
 				strcpy(opts->body, optarg);
 				break;
 
+			case 'B':
+				opts->binary = true;
+				break;
+
+			case 'r':
+				opts->reliable = true;
+				break;
+
+			case 'I':
+				opts->intern = true;
+				break;
+
+			case 'T':
+				opts->threads = strtol(optarg, 0, 10);
+				break;
+
+			case 'n':
+				opts->count = strtoul(optarg, 0, 10);
+				break;
+
+			case 'a':
+				opts->rate = strtod(optarg, 0);
+				break;
+
+			case 'z':
+				opts->size = strtoul(optarg, 0, 10);
+				break;
+
+			case 'd':
+				opts->duration = strtod(optarg, 0);
+				break;
+
+			case 'P':
+				opts->probe = true;
+				break;
+
+			case 'f':
+				size = strlen(optarg);
+				filters = (char**)realloc(opts->filters,
+					(opts->numFilters + 1) * sizeof(*filters));
+				if (filters == NULL) { return 0; }
+				opts->filters = filters;
+				opts->filters[opts->numFilters] = (char*)malloc(size + 1);
+				if (opts->filters[opts->numFilters] == NULL) { return 0; }
+				strcpy(opts->filters[opts->numFilters++], optarg);
+				break;
+
 			case 'v':
 				opts->version = true;
 				break;
@@ -136,6 +204,9 @@ void nanoPubSub__ClientIO_printUsage(void)
 	printf("  --sub, -s       Send a subscribe message to the server\n");
 	printf("  --unsub, -u     Send an unsubscribe message to the server\n");
 	printf("  --msg, -m       Send a standard (text) message to the server\n");
+	printf("  --replay, -R    Ask the server to send the recorded messages of\n"
+	       "                  the topic again, from the given offset or from\n"
+	       "                  @<ms since the epoch> on\n");
 	printf("  --host, -h      The host name of the server to send a message"
 	                          " to\n");
 	printf("  --port, -p      The port number of the server or the port number\n"
@@ -143,6 +214,28 @@ void nanoPubSub__ClientIO_printUsage(void)
 	printf("  --topic, -t     The message topic\n");
 	printf("  --clientid, -i  The client id for this client\n");
 	printf("  --body, -b      The body (text part) of the message to send\n");
+	printf("  --binary, -B    Send the message in the binary format\n");
+	printf("  --reliable, -r  Send the message reliably and wait until the\n"
+	       "                  server has acknowledged it\n");
+	printf("  --intern, -I    Have the server assign numeric ids to the\n"
+	       "                  client id and topic, and send the message with\n"
+	       "                  the ids (implies --binary)\n");
+	printf("  --threads, -T   The number of threads to listen with, each on\n"
+	       "                  a socket and core of its own (default 1)\n");
+	printf("  --count, -n     The number of messages to send (default 1,\n"
+	       "                  0 for no limit)\n");
+	printf("  --rate, -a      The number of messages to send per second\n"
+	       "                  (default: as fast as possible)\n");
+	printf("  --size, -z      Pad or cut the body to the given number of\n"
+	       "                  bytes\n");
+	printf("  --duration, -d  Stop sending or listening after the given\n"
+	       "                  number of seconds\n");
+	printf("  --probe, -P     Send messages carrying their send time, or\n"
+	       "                  listen for them and print a latency histogram\n"
+	       "                  on exit\n");
+	printf("  --filter, -f    Only handle received messages whose topic\n"
+	       "                  matches the filter (may be given several\n"
+	       "                  times)\n");
 	printf("  --version, -v   Display version information\n");
 	printf("  --help, -?      Display this message\n");
 }
@@ -155,20 +248,20 @@ void nanoPubSub__ClientIO_printUsage(void)
  */
 void nanoPubSub__ClientIO_printErrMsgOptions(void)
 {
-	printf("--host, --clientid, --topic and --body must be supplied when"
-	       " sending a message!\n");
+	printf("--host, --clientid, --topic and --body (or --size or --probe)"
+	       " must be supplied when sending a message!\n");
 }
 
 
 /**
  * Prints an error message to the standard output (stdout), indicating
  * that at least one of the parameters required for sending a
- * subscribe/unsubscribe message is missing.
+ * subscribe/unsubscribe/replay message is missing.
  */
 void nanoPubSub__ClientIO_printErrSubOptions(void)
 {
 	printf("--clientid and --topic must be supplied when sending a"
-	       " subscribe/unsubscribe message!\n");
+	       " subscribe/unsubscribe/replay message!\n");
 }
 
 
@@ -212,6 +305,38 @@ void nanoPubSub__ClientIO_printErrSend(void)
 }
 
 
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that a message sent reliably was never acknowledged.
+ */
+void nanoPubSub__ClientIO_printErrAck(void)
+{
+	printf("The message was sent, but *NOT* acknowledged!\n");
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the server did not assign ids to the client id and topic.
+ */
+void nanoPubSub__ClientIO_printErrRegister(void)
+{
+	printf("The server did *NOT* assign ids to the client id and topic!\n");
+}
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that a filter given with --filter is not a valid subscription filter.
+ *
+ * @param filter The invalid filter
+ */
+void nanoPubSub__ClientIO_printErrFilter(const char *filter)
+{
+	printf("\"%s\" is not a valid filter!\n", filter);
+}
+
+
 /**
  * Prints a message to the standard output (stdout), informing
  * the user that a message was successfully sent.
@@ -224,6 +349,67 @@ void nanoPubSub__ClientIO_printSuccessSend(unsigned int bytesSent)
 }
 
 
+/**
+ * Prints a summary of the messages sent in a loop to the standard output
+ * (stdout).
+ *
+ * @param numSent The number of messages sent
+ * @param numFailed The number of messages that could not be sent
+ * @param bytesSent The number of bytes sent
+ * @param seconds The time taken (in seconds)
+ */
+void nanoPubSub__ClientIO_printLoadSummary(unsigned long numSent,
+		unsigned long numFailed, unsigned long long bytesSent, double seconds)
+{
+	printf("Sent %lu messages (%llu bytes) in %.3f s, %.0f messages/s,"
+	       " %lu failed.\n", numSent, bytesSent, seconds,
+	       seconds > 0 ? numSent / seconds : 0.0, numFailed);
+}
+
+
+/**
+ * Prints the latencies of received probe messages to the standard output
+ * (stdout): a summary and the percentile distribution in the style of
+ * HdrHistogram, with values in microseconds.
+ *
+ * @param histogram The latencies (in nanoseconds)
+ * @param highestSequence The highest sequence number received
+ */
+void nanoPubSub__ClientIO_printHistogram(
+		const nanoPubSub__Histogram *histogram, unsigned long highestSequence)
+{
+	double percentile, remaining;
+
+	printf("Received %llu probes, highest sequence number %lu\n",
+		(unsigned long long)histogram->count, highestSequence);
+
+	if (histogram->count == 0) {
+		return;
+	}
+
+	printf("Latency (us): min %.1f, mean %.1f, p50 %.1f, p99 %.1f,"
+	       " p99.9 %.1f, max %.1f\n\n", histogram->min / 1e3,
+		(double)histogram->sum / histogram->count / 1e3,
+		nanoPubSub__Histogram_valueAt(histogram, 50) / 1e3,
+		nanoPubSub__Histogram_valueAt(histogram, 99) / 1e3,
+		nanoPubSub__Histogram_valueAt(histogram, 99.9) / 1e3,
+		histogram->max / 1e3);
+
+	printf("%12s %14s %12s\n", "Value", "Percentile", "1/(1-P)");
+
+	/* Every line halves the share of values above the percentile, until
+	   less than one value is left */
+	for (remaining = 1; remaining * histogram->count >= 1; remaining /= 2) {
+		percentile = 1 - remaining;
+		printf("%12.1f %14.6f %12.1f\n",
+			nanoPubSub__Histogram_valueAt(histogram, percentile * 100) / 1e3,
+			percentile, 1 / remaining);
+	}
+
+	printf("%12.1f %14.6f\n", histogram->max / 1e3, 1.0);
+}
+
+
 /**
  * Prints the given local time to the standard output (stdout).
  *
@@ -273,3 +459,67 @@ void nanoPubSub__ClientIO_printMessage(const nanoPubSub__Message *msg,
 	
 	free(buffer);
 }
+
+
+/**
+ * Prints a parsed message view to the standard output (stdout).
+ *
+ * @param view The message to print
+ * @param timestamp If true, a timestamp is output before the message
+ */
+void nanoPubSub__ClientIO_printView(const nanoPubSub__Message_view *view,
+		bool timestamp)
+{
+	if (timestamp) {
+		time_t t = time(NULL);
+		printf("[");
+		nanoPubSub__ClientIO_printLocaltime( &t );
+		printf("] ");
+	}
+
+	/* Ids are printed as numbers */
+	if (view->topicId != 0 || view->clientNumber != 0) {
+		printf("#%s#", view->type == NANOPUBSUB__STANDARD_MESSAGE ? "msg"
+			: view->type == NANOPUBSUB__SUBSCRIBE_MESSAGE ? "sub" : "unsub");
+
+		if (view->clientNumber != 0) {
+			printf("%u#", (unsigned int)view->clientNumber);
+		} else {
+			printf("%.*s#", (int)view->clientId.length, view->clientId.data);
+		}
+
+		if (view->topicId != 0) {
+			printf("%u#", (unsigned int)view->topicId);
+		} else {
+			printf("%.*s#", (int)view->topic.length, view->topic.data);
+		}
+
+		if (view->type == NANOPUBSUB__STANDARD_MESSAGE) {
+			printf("%.*s#", (int)view->body.length, view->body.data);
+		}
+		printf("\n");
+		return;
+	}
+
+	switch (view->type)
+	{
+		case NANOPUBSUB__STANDARD_MESSAGE:
+			printf("#msg#%.*s#%.*s#%.*s#\n",
+				(int)view->clientId.length, view->clientId.data,
+				(int)view->topic.length, view->topic.data,
+				(int)view->body.length, view->body.data);
+			break;
+
+		case NANOPUBSUB__SUBSCRIBE_MESSAGE:
+			printf("#sub#%.*s#%.*s#\n",
+				(int)view->clientId.length, view->clientId.data,
+				(int)view->topic.length, view->topic.data);
+			break;
+
+		case NANOPUBSUB__UNSUBSCRIBE_MESSAGE:
+			printf("#unsub#%.*s#%.*s#\n",
+				(int)view->clientId.length, view->clientId.data,
+				(int)view->topic.length, view->topic.data);
+			break;
+	}
+}
@@ -27,6 +27,7 @@
 #include <time.h>
 
 #include <message.h>
+#include <histogram.h>
 
 #include "defs.h"
 
@@ -45,6 +46,30 @@ typedef struct
 	
 	char *body;
 
+	char *replayFrom;
+
+	bool binary;
+
+	bool reliable;
+
+	bool intern;
+
+	unsigned int threads;
+
+	unsigned long count;
+
+	double rate;
+
+	unsigned int size;
+
+	double duration;
+
+	bool probe;
+
+	char **filters;
+
+	unsigned int numFilters;
+
 	bool version;
 
 	bool help;
@@ -79,7 +104,7 @@ void nanoPubSub__ClientIO_printErrMsgOptions(void);
 /**
  * Prints an error message to the standard output (stdout), indicating
  * that at least one of the parameters required for sending a
- * subscribe/unsubscribe message is missing.
+ * subscribe/unsubscribe/replay message is missing.
  */
 void nanoPubSub__ClientIO_printErrSubOptions(void);
 
@@ -112,6 +137,29 @@ void nanoPubSub__ClientIO_printErrBind(void);
 void nanoPubSub__ClientIO_printErrSend(void);
 
 
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that a message sent reliably was never acknowledged.
+ */
+void nanoPubSub__ClientIO_printErrAck(void);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that the server did not assign ids to the client id and topic.
+ */
+void nanoPubSub__ClientIO_printErrRegister(void);
+
+
+/**
+ * Prints an error message to the standard output (stdout), indicating
+ * that a filter given with --filter is not a valid subscription filter.
+ *
+ * @param filter The invalid filter
+ */
+void nanoPubSub__ClientIO_printErrFilter(const char *filter);
+
+
 /**
  * Prints a message to the standard output (stdout), informing
  * the user that a message was successfully sent.
@@ -121,6 +169,31 @@ void nanoPubSub__ClientIO_printErrSend(void);
 void nanoPubSub__ClientIO_printSuccessSend(unsigned int bytesSent);
 
 
+/**
+ * Prints a summary of the messages sent in a loop to the standard output
+ * (stdout).
+ *
+ * @param numSent The number of messages sent
+ * @param numFailed The number of messages that could not be sent
+ * @param bytesSent The number of bytes sent
+ * @param seconds The time taken (in seconds)
+ */
+void nanoPubSub__ClientIO_printLoadSummary(unsigned long numSent,
+	unsigned long numFailed, unsigned long long bytesSent, double seconds);
+
+
+/**
+ * Prints the latencies of received probe messages to the standard output
+ * (stdout): a summary and the percentile distribution in the style of
+ * HdrHistogram, with values in microseconds.
+ *
+ * @param histogram The latencies (in nanoseconds)
+ * @param highestSequence The highest sequence number received
+ */
+void nanoPubSub__ClientIO_printHistogram(
+	const nanoPubSub__Histogram *histogram, unsigned long highestSequence);
+
+
 /**
  * Prints the given local time to the standard output (stdout).
  *
@@ -137,3 +210,13 @@ void nanoPubSub__ClientIO_printLocaltime(const time_t *clock);
  */
 void nanoPubSub__ClientIO_printMessage(const nanoPubSub__Message *msg,
 	bool timestamp);
+
+
+/**
+ * Prints a parsed message view to the standard output (stdout).
+ *
+ * @param view The message to print
+ * @param timestamp If true, a timestamp is output before the message
+ */
+void nanoPubSub__ClientIO_printView(const nanoPubSub__Message_view *view,
+	bool timestamp);
@@ -26,8 +26,21 @@
 #define NANOPUBSUB__CLIENT_MODE_MSG    1
 #define NANOPUBSUB__CLIENT_MODE_SUB    2
 #define NANOPUBSUB__CLIENT_MODE_UNSUB  3
+#define NANOPUBSUB__CLIENT_MODE_REPLAY 4
 
 #define NANOPUBSUB__CLIENT_DEFAULT_PORT 11011
 
+/** The time to wait for the server to assign ids (in milliseconds) */
+#define NANOPUBSUB__CLIENT_REGISTER_TIMEOUT 500
+
+/**
+ * The start of the body of a probe message, which is followed by
+ * <sequence number>:<send time in ns since the epoch>
+ */
+#define NANOPUBSUB__CLIENT_PROBE_PREFIX "probe:"
+
+/** The number of hash buckets the filters given with --filter start with */
+#define NANOPUBSUB__CLIENT_LISTEN_FILTER_BUCKETS 16
+
 
 #endif /* __NANOPUBSUBCLIENT__DEFS_H */
@@ -28,6 +28,18 @@ int main(int argc, char **argv)
 	options.clientid    = NULL;
 	options.topic       = NULL;
 	options.body        = NULL;
+	options.replayFrom  = NULL;
+	options.binary      = false;
+	options.reliable    = false;
+	options.intern      = false;
+	options.threads     = 1;
+	options.count       = 1;
+	options.rate        = 0;
+	options.size        = 0;
+	options.duration    = 0;
+	options.probe       = false;
+	options.filters     = NULL;
+	options.numFilters  = 0;
 	options.version     = false;
 	options.help        = false;
 
@@ -53,12 +65,18 @@ int main(int argc, char **argv)
 		options.port = NANOPUBSUB__CLIENT_DEFAULT_PORT;
 	}
 
+	/* Listen with at least one thread */
+	if (options.threads == 0) {
+		options.threads = 1;
+	}
+
 	/* Check the user-supplied options for completeness and call the correct
 	   function to continue the program */
 	switch (options.programMode)
 	{
 		case NANOPUBSUB__CLIENT_MODE_MSG:
-			if ((char*)(options.body && options.clientid && options.topic)) {
+			if ((char*)((options.body || options.size || options.probe)
+					&& options.clientid && options.topic)) {
 				return sendMessage();
 			} else {
 				nanoPubSub__ClientIO_printErrMsgOptions();
@@ -68,6 +86,7 @@ int main(int argc, char **argv)
 
 		case NANOPUBSUB__CLIENT_MODE_SUB:
 		case NANOPUBSUB__CLIENT_MODE_UNSUB:
+		case NANOPUBSUB__CLIENT_MODE_REPLAY:
 			if ((char*)(options.clientid && options.topic)) {
 				return sendMessage();
 			} else {
@@ -96,11 +115,13 @@ inline static int sendMessage(void)
 {
 	struct hostent *hostinfo;
 	struct sockaddr_in remoteAddr;
-	int socketfd;
+	int socketfd, retval;
 	ssize_t bytesSent;
 	nanoPubSub__Message msg;
 
 	/* Create the message to send */
+	memset(&msg, 0, sizeof(msg));
+
 	switch (options.programMode)
 	{
 		case NANOPUBSUB__CLIENT_MODE_MSG:
@@ -121,6 +142,13 @@ inline static int sendMessage(void)
 			msg.clientId = options.clientid;
 			msg.topic    = options.topic;
 			break;
+
+		case NANOPUBSUB__CLIENT_MODE_REPLAY:
+			msg.type     = NANOPUBSUB__REPLAY_MESSAGE;
+			msg.clientId = options.clientid;
+			msg.topic    = options.topic;
+			msg.body     = options.replayFrom;
+			break;
 			
 		default:
 			return 1;	/* This line should never be reached */
@@ -136,7 +164,6 @@ inline static int sendMessage(void)
 
 	/* Create a socket */
 	if ((socketfd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-		free(hostinfo);
 		nanoPubSub__ClientIO_printErrSocket();
 		return 1;
 	}
@@ -147,15 +174,53 @@ inline static int sendMessage(void)
 	remoteAddr.sin_addr   = *((struct in_addr *)hostinfo->h_addr);
 	memset(remoteAddr.sin_zero, '\0', sizeof(remoteAddr.sin_zero));
 
-	bytesSent = nanoPubSub__Network_sendMessage(
-					socketfd, (const struct sockaddr*)&remoteAddr, &msg);
+	/* Replace the client id and topic by the ids the server assigns. Ids
+	   only exist in binary messages. */
+	if (options.intern) {
+		if (!nanoPubSub__Network_register(socketfd,
+				(const struct sockaddr*)&remoteAddr, options.clientid,
+				options.topic, &msg.clientNumber, &msg.topicId,
+				NANOPUBSUB__CLIENT_REGISTER_TIMEOUT)) {
+			close(socketfd);
+			nanoPubSub__ClientIO_printErrRegister();
+			return 1;
+		}
+
+		msg.clientId   = NULL;
+		msg.topic      = NULL;
+		options.binary = true;
+	}
+
+	/* Several messages, generated bodies and probes are sent in a loop
+	   over the same socket */
+	if (options.programMode == NANOPUBSUB__CLIENT_MODE_MSG
+			&& (options.count != 1 || options.rate > 0 || options.size > 0
+				|| options.duration > 0 || options.probe)) {
+		retval = sendMessages(socketfd, (const struct sockaddr*)&remoteAddr,
+			&msg);
+		close(socketfd);
+		return retval;
+	}
+
+	if (options.reliable) {
+		bytesSent = sendReliably(socketfd,
+						(const struct sockaddr*)&remoteAddr, &msg);
+	} else if (options.binary) {
+		bytesSent = nanoPubSub__Network_sendBinaryMessage(
+						socketfd, (const struct sockaddr*)&remoteAddr, &msg);
+	} else {
+		bytesSent = nanoPubSub__Network_sendMessage(
+						socketfd, (const struct sockaddr*)&remoteAddr, &msg);
+	}
 
-	/* Close the socket and free dynamically allocated memory */
+	/* Close the socket */
 	close(socketfd);
-	free(hostinfo);
 
 	/* Check if an error occurred while sending the message */
-	if (bytesSent < 0) {
+	if (bytesSent < 0 && errno == ETIMEDOUT) {
+		nanoPubSub__ClientIO_printErrAck();
+		return 1;
+	} else if (bytesSent < 0) {
 		nanoPubSub__ClientIO_printErrSend();
 		return 1;
 	}
@@ -165,45 +230,400 @@ inline static int sendMessage(void)
 }
 
 
+/**
+ * Sends messages in a loop over the same socket, as many and as fast as
+ * specified in the static variable options. Probe messages carry their
+ * sequence number and send time in the body.
+ *
+ * @param socketfd The socket to send the messages over
+ * @param destAddr The address of the server
+ * @param msg The message to send; its body is replaced
+ *
+ * @return 0 if all messages have been sent, 1 otherwise
+ */
+static int sendMessages(int socketfd, const struct sockaddr *destAddr,
+		nanoPubSub__Message *msg)
+{
+	unsigned long numSent = 0, numFailed = 0, attempts;
+	unsigned long long bytesSent = 0;
+	uint64_t start, end, dueNs;
+	size_t length, bodyLength, prefixLength, maxLength;
+	struct timespec due;
+	ssize_t size;
+	char *body;
+
+	length     = options.body != NULL ? strlen(options.body) : 0;
+	bodyLength = options.size > 0 ? options.size : length;
+
+	/* Probe messages need room for their prefix even if the body is
+	   shorter */
+	maxLength = bodyLength + 64;
+
+	if ((body = malloc(maxLength + 1)) == NULL) {
+		printf("Out of memory!\n");
+		return 1;
+	}
+
+	/* The body is cut to the size or padded with dots */
+	memset(body, '.', bodyLength);
+	if (options.body != NULL) {
+		memcpy(body, options.body, length < bodyLength ? length : bodyLength);
+	}
+	body[bodyLength] = '\0';
+	msg->body       = body;
+	msg->bodyLength = bodyLength;
+
+	start = nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC);
+	end   = start + (uint64_t)(options.duration * 1e9);
+
+	for (attempts = 0; options.count == 0 || attempts < options.count;
+			attempts++) {
+		if (options.duration > 0
+				&& nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC) >= end) {
+			break;
+		}
+
+		/* Wait until the message is due, unless sending has fallen
+		   behind */
+		if (options.rate > 0) {
+			dueNs = start + (uint64_t)(attempts / options.rate * 1e9);
+			if (options.duration > 0 && dueNs >= end) {
+				break;
+			}
+
+			due.tv_sec  = dueNs / 1000000000u;
+			due.tv_nsec = dueNs % 1000000000u;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+		}
+
+		if (options.probe) {
+			prefixLength = snprintf(body, maxLength + 1,
+				NANOPUBSUB__CLIENT_PROBE_PREFIX "%lu:%llu", attempts + 1,
+				(unsigned long long)nanoPubSub__Util_currentTimeNs(
+					CLOCK_REALTIME));
+			if (prefixLength < bodyLength) {
+				memset(body + prefixLength, '.', bodyLength - prefixLength);
+				body[bodyLength] = '\0';
+			}
+
+			msg->bodyLength = prefixLength < bodyLength
+				? bodyLength : prefixLength;
+		}
+
+		if (options.reliable) {
+			size = sendReliably(socketfd, destAddr, msg);
+		} else if (options.binary) {
+			size = nanoPubSub__Network_sendBinaryMessage(socketfd, destAddr,
+				msg);
+		} else {
+			size = nanoPubSub__Network_sendMessage(socketfd, destAddr, msg);
+		}
+
+		if (size < 0) {
+			numFailed++;
+		} else {
+			numSent++;
+			bytesSent += size;
+		}
+	}
+
+	nanoPubSub__ClientIO_printLoadSummary(numSent, numFailed, bytesSent,
+		(nanoPubSub__Util_currentTimeNs(CLOCK_MONOTONIC) - start) / 1e9);
+
+	free(body);
+
+	return numFailed > 0;
+}
+
+
+/**
+ * Sends a message reliably and waits until the server has acknowledged
+ * it, retransmitting it as often as necessary.
+ *
+ * @param socketfd The socket to send the message over
+ * @param destAddr The address of the server
+ * @param msg The message to send
+ *
+ * @return The length of the message (in bytes). Otherwise, -1 is returned
+ *         and errno is set; ETIMEDOUT means the message was never
+ *         acknowledged.
+ */
+static ssize_t sendReliably(int socketfd, const struct sockaddr *destAddr,
+		const nanoPubSub__Message *msg)
+{
+	nanoPubSub__Reliable_endpoint endpoint;
+	nanoPubSub__Message_view view;
+	struct sockaddr_storage fromAddr;
+	struct pollfd pfd;
+	socklen_t fromAddrLength;
+	char ack[NANOPUBSUB__MAX_MESSAGE_LENGTH];
+	const char *payload;
+	char *string;
+	size_t length, payloadLength;
+	ssize_t size, retval = -1;
+	int timeout;
+
+	if (!nanoPubSub__Message_toView(msg, &view)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	length = options.binary ? nanoPubSub__Message_viewBinaryLength(&view)
+		: nanoPubSub__Message_viewLength(&view);
+
+	if ((string = malloc(length + 1)) == NULL) {
+		return -1;
+	}
+
+	if (options.binary) {
+		nanoPubSub__Message_writeViewBinary(&view, string, length);
+	} else {
+		nanoPubSub__Message_writeViewString(&view, string, length + 1);
+	}
+
+	if (!nanoPubSub__Reliable_init(&endpoint, socketfd, 1)) {
+		free(string);
+		return -1;
+	}
+
+	if (nanoPubSub__Reliable_sendString(&endpoint, destAddr, string, length)
+			!= 1) {
+		goto cleanup;
+	}
+
+	pfd.fd     = socketfd;
+	pfd.events = POLLIN;
+
+	/* Wait for the acknowledgement; the endpoint gives up eventually */
+	for (;;) {
+		timeout = nanoPubSub__Reliable_tick(&endpoint);
+
+		if (nanoPubSub__Reliable_inFlight(&endpoint) == 0) {
+			break;
+		}
+
+		if (poll(&pfd, 1, timeout) <= 0) {
+			continue;
+		}
+
+		fromAddrLength = sizeof(fromAddr);
+		size = recvfrom(socketfd, ack, sizeof(ack), 0,
+			(struct sockaddr*)&fromAddr, &fromAddrLength);
+
+		if (size > 0) {
+			nanoPubSub__Reliable_receive(&endpoint,
+				(const struct sockaddr*)&fromAddr, ack, size, &payload,
+				&payloadLength);
+		}
+	}
+
+	if (endpoint.stats.failed > 0) {
+		errno = ETIMEDOUT;
+	} else {
+		retval = length;
+	}
+
+cleanup:
+	nanoPubSub__Reliable_free(&endpoint);
+	free(string);
+
+	return retval;
+}
+
+
+/**
+ * Prints a received standard message to the standard output (stdout).
+ * Called by the listening workers.
+ */
+static void printMessage(unsigned int worker,
+		const struct sockaddr *fromAddr, const nanoPubSub__Message_view *view,
+		void *arg)
+{
+	if (view->type == NANOPUBSUB__STANDARD_MESSAGE) {
+		/* Keep the lines printed by different workers apart */
+		flockfile(stdout);
+		nanoPubSub__ClientIO_printView(view, true);
+		funlockfile(stdout);
+	}
+}
+
+
+/**
+ * Reads a decimal number from a message's body.
+ *
+ * @param pos Pointer to the position to read at, moved past the number
+ * @param end The end of the body
+ * @param number Pointer to store the number in
+ *
+ * @return 1 if a number was found, 0 otherwise
+ */
+static int readNumber(const char **pos, const char *end,
+		unsigned long long *number)
+{
+	const char *start = *pos;
+
+	*number = 0;
+	while (*pos < end && **pos >= '0' && **pos <= '9') {
+		*number = *number * 10 + (**pos - '0');
+		(*pos)++;
+	}
+
+	return *pos > start;
+}
+
+
+/**
+ * Records the latency of a received probe message. Called by the
+ * listening workers.
+ */
+static void recordProbe(unsigned int worker,
+		const struct sockaddr *fromAddr, const nanoPubSub__Message_view *view,
+		void *arg)
+{
+	nanoPubSub__Client_probes *probes = (nanoPubSub__Client_probes*)arg
+		+ worker;
+	const char *pos = view->body.data, *end = pos + view->body.length;
+	size_t prefixLength = strlen(NANOPUBSUB__CLIENT_PROBE_PREFIX);
+	unsigned long long sequence, sent;
+	uint64_t now = nanoPubSub__Util_currentTimeNs(CLOCK_REALTIME);
+
+	/* Bodies are not Null-terminated, so they are read up to their end */
+	if (view->type != NANOPUBSUB__STANDARD_MESSAGE
+			|| view->body.length < prefixLength
+			|| memcmp(pos, NANOPUBSUB__CLIENT_PROBE_PREFIX, prefixLength)
+				!= 0) {
+		return;
+	}
+
+	pos += prefixLength;
+	if (!readNumber(&pos, end, &sequence) || pos == end || *pos++ != ':'
+			|| !readNumber(&pos, end, &sent)) {
+		return;
+	}
+
+	/* The clocks of different hosts may be slightly apart */
+	nanoPubSub__Histogram_record(&probes->latencies,
+		now > sent ? now - sent : 0);
+
+	if (sequence > probes->highestSequence) {
+		probes->highestSequence = sequence;
+	}
+}
+
+
+/**
+ * Makes the listening workers stop. Installed as the handler of SIGINT,
+ * SIGTERM and SIGALRM.
+ */
+static void stopListening(int signal)
+{
+	nanoPubSub__Worker_stop(&workers);
+}
+
+
 /**
  * Listens for incoming messages and prints them to the standard output
- * (stdout).
+ * (stdout). In probe mode, the latencies of probe messages are recorded
+ * instead and printed once listening stops. Messages not matching any
+ * filter given with --filter are dropped by the workers.
  */
 inline static int receiveMessages(void)
 {
-	int socketfd;
-	struct sockaddr_in myAddr, fromAddr;
-	nanoPubSub__Message msg;
+	nanoPubSub__Client_probes *probes = NULL;
+	nanoPubSub__Histogram *latencies = NULL;
+	unsigned long highestSequence = 0;
+	struct sigaction action;
+	nanoPubSub__Message_slice slice;
+	unsigned int i;
 
-	/* Create a socket */
-	if ((socketfd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-		nanoPubSub__ClientIO_printErrSocket();
-		return 1;
+	if (options.numFilters > 0) {
+		if (!nanoPubSub__Filter_init(&filter,
+				NANOPUBSUB__CLIENT_LISTEN_FILTER_BUCKETS)) {
+			printf("Out of memory!\n");
+			return 1;
+		}
+
+		for (i = 0; i < options.numFilters; i++) {
+			slice.data   = options.filters[i];
+			slice.length = strlen(options.filters[i]);
+
+			if (!nanoPubSub__Filter_add(&filter, &slice, NULL, NULL)) {
+				nanoPubSub__ClientIO_printErrFilter(options.filters[i]);
+				nanoPubSub__Filter_destroy(&filter);
+				return 1;
+			}
+		}
 	}
 
-	/* Bind the socket to a network address */
-	myAddr.sin_family      = AF_INET;
-	myAddr.sin_port        = htons(options.port);
-	myAddr.sin_addr.s_addr = INADDR_ANY;
-	memset(myAddr.sin_zero, '\0', sizeof(myAddr.sin_zero));
-	
-	if (bind(socketfd, (struct sockaddr*)&myAddr, sizeof(myAddr)) == -1) {
-		nanoPubSub__ClientIO_printErrBind();
+	if (options.probe) {
+		probes = malloc(options.threads * sizeof(*probes));
+		latencies = malloc(sizeof(*latencies));
+
+		if (probes == NULL || latencies == NULL) {
+			free(probes);
+			free(latencies);
+			nanoPubSub__Filter_destroy(&filter);
+			printf("Out of memory!\n");
+			return 1;
+		}
+
+		for (i = 0; i < options.threads; i++) {
+			nanoPubSub__Histogram_init(&probes[i].latencies);
+			probes[i].highestSequence = 0;
+		}
+	}
+
+	/* Every worker gets a socket of its own on the same port. Workers are
+	   only pinned to cores if there is more than one. */
+	if (!nanoPubSub__Worker_start(&workers, options.port, options.threads,
+			options.threads > 1, options.probe ? recordProbe : printMessage,
+			probes, options.numFilters > 0 ? &filter : NULL)) {
+		if (errno == ENOMEM) {
+			printf("Out of memory!\n");
+		} else {
+			nanoPubSub__ClientIO_printErrBind();
+		}
+		free(probes);
+		free(latencies);
+		nanoPubSub__Filter_destroy(&filter);
 		return 1;
 	}
-	
-	while (1) {
-		/* Receive a message over the network connected to the socket */
-		if (!nanoPubSub__Network_recvMessage(
-				socketfd, (struct sockaddr*)&fromAddr, &msg)) {
-			return 1;
+
+	/* Probe mode stops on a signal or once the duration is over, so that
+	   the histogram can be printed */
+	if (options.probe || options.duration > 0) {
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = stopListening;
+		sigaction(SIGINT, &action, NULL);
+		sigaction(SIGTERM, &action, NULL);
+		sigaction(SIGALRM, &action, NULL);
+
+		if (options.duration > 0) {
+			alarm(options.duration < 1 ? 1 : (unsigned int)options.duration);
 		}
-		
-		/* Only print standard messages */
-		if (msg.type == NANOPUBSUB__STANDARD_MESSAGE) {
-			nanoPubSub__ClientIO_printMessage(&msg, true);
+	}
+
+	/* Without the handler, the workers only stop if they fail to
+	   receive */
+	nanoPubSub__Worker_wait(&workers);
+	nanoPubSub__Filter_destroy(&filter);
+
+	if (!options.probe) {
+		return options.duration > 0 ? 0 : 1;
+	}
+
+	nanoPubSub__Histogram_init(latencies);
+	for (i = 0; i < options.threads; i++) {
+		nanoPubSub__Histogram_merge(latencies, &probes[i].latencies);
+		if (probes[i].highestSequence > highestSequence) {
+			highestSequence = probes[i].highestSequence;
 		}
 	}
-	
+
+	nanoPubSub__ClientIO_printHistogram(latencies, highestSequence);
+
+	free(probes);
+	free(latencies);
+
 	return 0;
 }
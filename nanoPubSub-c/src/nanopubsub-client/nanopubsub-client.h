@@ -16,17 +16,46 @@
  *   GNU General Public License for more details.
  */
 
+#include <unistd.h>
 #include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 
 #include <message.h>
 #include <network.h>
+#include <reliable.h>
+#include <worker.h>
+#include <filter.h>
+#include <histogram.h>
+#include <util.h>
 
 #include "defs.h"
 #include "client_io.h"
 
+/**
+ * The probe messages received by a listening worker. Every worker has its
+ * own, so that recording never needs a lock.
+ */
+typedef struct
+{
+	/** The latencies of the probe messages (in nanoseconds) */
+	nanoPubSub__Histogram latencies;
+
+	/** The highest sequence number received */
+	unsigned long highestSequence;
+} nanoPubSub__Client_probes;
+
+
 /** Program options */
 static nanoPubSub__ClientIO_options options;
 
+/** The workers listening for incoming messages */
+static nanoPubSub__Worker_group workers;
+
+/** The filters given with --filter, shared by all workers */
+static nanoPubSub__Filter filter;
+
 
 /**
  * Sends a message over the network as specified in the static variable
@@ -36,8 +65,66 @@ static nanoPubSub__ClientIO_options options;
 inline static int sendMessage(void);
 
 
+/**
+ * Sends messages in a loop over the same socket, as many and as fast as
+ * specified in the static variable options. Probe messages carry their
+ * sequence number and send time in the body.
+ *
+ * @param socketfd The socket to send the messages over
+ * @param destAddr The address of the server
+ * @param msg The message to send; its body is replaced
+ *
+ * @return 0 if all messages have been sent, 1 otherwise
+ */
+static int sendMessages(int socketfd, const struct sockaddr *destAddr,
+	nanoPubSub__Message *msg);
+
+
+/**
+ * Sends a message reliably and waits until the server has acknowledged
+ * it, retransmitting it as often as necessary.
+ *
+ * @param socketfd The socket to send the message over
+ * @param destAddr The address of the server
+ * @param msg The message to send
+ *
+ * @return The length of the message (in bytes). Otherwise, -1 is returned
+ *         and errno is set; ETIMEDOUT means the message was never
+ *         acknowledged.
+ */
+static ssize_t sendReliably(int socketfd, const struct sockaddr *destAddr,
+	const nanoPubSub__Message *msg);
+
+
+/**
+ * Prints a received standard message to the standard output (stdout).
+ * Called by the listening workers.
+ */
+static void printMessage(unsigned int worker,
+	const struct sockaddr *fromAddr, const nanoPubSub__Message_view *view,
+	void *arg);
+
+
+/**
+ * Records the latency of a received probe message. Called by the
+ * listening workers.
+ */
+static void recordProbe(unsigned int worker,
+	const struct sockaddr *fromAddr, const nanoPubSub__Message_view *view,
+	void *arg);
+
+
+/**
+ * Makes the listening workers stop. Installed as the handler of SIGINT,
+ * SIGTERM and SIGALRM.
+ */
+static void stopListening(int signal);
+
+
 /**
  * Listens for incoming messages and prints them to the standard output
- * (stdout).
+ * (stdout). In probe mode, the latencies of probe messages are recorded
+ * instead and printed once listening stops. Messages not matching any
+ * filter given with --filter are dropped by the workers.
  */
 inline static int receiveMessages(void);
\ No newline at end of file